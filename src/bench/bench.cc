@@ -0,0 +1,172 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include "bench.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+// {{{ allocation accounting
+namespace {
+std::atomic<uint64_t> allocations{0};
+std::atomic<uint64_t> bytes{0};
+}
+
+void* operator new(std::size_t n) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  bytes.fetch_add(n, std::memory_order_relaxed);
+  if (void* p = std::malloc(n ? n : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t n) {
+  return operator new(n);
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+  std::free(p);
+}
+// }}}
+
+namespace bench {
+
+uint64_t allocationCount() {
+  return allocations.load(std::memory_order_relaxed);
+}
+
+uint64_t allocatedBytes() {
+  return bytes.load(std::memory_order_relaxed);
+}
+
+Runner::Runner() : filter_(), minTime_(0.2), quiet_(false), results_() {}
+
+void Runner::run(const std::string& name,
+                 uint64_t items,
+                 const std::function<void()>& op) {
+  run(name, items, -1, op);
+}
+
+void Runner::run(const std::string& name,
+                 uint64_t items,
+                 double ulps,
+                 const std::function<void()>& op) {
+  using Clock = std::chrono::steady_clock;
+
+  if (!filter_.empty() && name.find(filter_) == std::string::npos)
+    return;
+
+  op();  // warm up
+
+  uint64_t iterations = 1;
+  for (;;) {
+    const uint64_t allocs0 = allocationCount();
+    const uint64_t bytes0 = allocatedBytes();
+    const Clock::time_point start = Clock::now();
+
+    for (uint64_t i = 0; i < iterations; ++i)
+      op();
+
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    if (elapsed >= minTime_ || iterations >= (uint64_t(1) << 40)) {
+      Result r;
+      r.name = name;
+      r.iterations = iterations;
+      r.nsPerOp = elapsed * 1e9 / iterations;
+      r.allocsPerOp = double(allocationCount() - allocs0) / iterations;
+      r.bytesAllocatedPerOp = double(allocatedBytes() - bytes0) / iterations;
+      r.itemsPerSecond = items ? items * iterations / elapsed : 0;
+      r.maxUlps = ulps;
+      results_.push_back(r);
+
+      if (!quiet_) {
+        std::cout << std::left << std::setw(40) << name << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(14) << r.nsPerOp << " ns/op"
+                  << std::setw(10) << r.allocsPerOp << " allocs/op";
+        if (items)
+          std::cout << std::setw(12) << std::setprecision(2) << r.itemsPerSecond / 1e6
+                    << " M items/s";
+        if (ulps >= 0)
+          std::cout << std::setw(8) << std::setprecision(2) << ulps << " ulp";
+        std::cout << '\n';
+      }
+      return;
+    }
+
+    // aim for the minimum time, but never grow by more than 10x at once
+    double factor = elapsed > 0 ? 1.4 * minTime_ / elapsed : 10;
+    if (factor > 10)
+      factor = 10;
+    if (factor < 2)
+      factor = 2;
+    iterations = static_cast<uint64_t>(iterations * factor);
+  }
+}
+
+static void writeJsonString(std::ostream& os, const std::string& s) {
+  os << '"';
+  for (char ch : s) {
+    if (ch == '"' || ch == '\\')
+      os << '\\' << ch;
+    else if (static_cast<unsigned char>(ch) < 0x20)
+      os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(ch)
+         << std::dec << std::setfill(' ');
+    else
+      os << ch;
+  }
+  os << '"';
+}
+
+void Runner::writeJson(std::ostream& os) const {
+  char date[32];
+  std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+  os << "{\n  \"context\": {\n"
+     << "    \"date\": \"" << date << "\",\n"
+     << "    \"compiler\": ";
+  writeJsonString(os, __VERSION__);
+  os << ",\n    \"build_type\": ";
+  writeJsonString(os, CMATH_BUILD_TYPE);
+  os << "\n  },\n  \"benchmarks\": [";
+
+  os << std::setprecision(17);
+  for (size_t i = 0; i < results_.size(); ++i) {
+    const Result& r = results_[i];
+    os << (i ? ",\n" : "\n") << "    {\"name\": ";
+    writeJsonString(os, r.name);
+    os << ", \"iterations\": " << r.iterations
+       << ", \"ns_per_op\": " << r.nsPerOp
+       << ", \"allocs_per_op\": " << r.allocsPerOp
+       << ", \"bytes_allocated_per_op\": " << r.bytesAllocatedPerOp
+       << ", \"items_per_second\": " << r.itemsPerSecond;
+    if (r.maxUlps >= 0)
+      os << ", \"max_ulps\": " << r.maxUlps;
+    os << "}";
+  }
+  os << "\n  ]\n}\n";
+}
+
+}  // namespace bench
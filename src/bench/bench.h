@@ -0,0 +1,75 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+/**
+ * Keeps the compiler from optimizing away the computation of @p value.
+ */
+template <typename T>
+inline void doNotOptimize(const T& value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+struct Result {
+  std::string name;
+  uint64_t iterations;
+  double nsPerOp;
+  double allocsPerOp;
+  double bytesAllocatedPerOp;
+  double itemsPerSecond;  // 0 if not applicable
+  double maxUlps;         // negative if not applicable
+};
+
+/// Number of heap allocations and bytes allocated so far by this process.
+uint64_t allocationCount();
+uint64_t allocatedBytes();
+
+class Runner {
+ public:
+  Runner();
+
+  void setFilter(const std::string& filter) { filter_ = filter; }
+  void setMinTime(double seconds) { minTime_ = seconds; }
+  void setQuiet(bool quiet) { quiet_ = quiet; }
+
+  /**
+   * Runs @p op repeatedly until at least the minimum time has passed.
+   *
+   * @param items number of items (nodes, bytes, lookups...) one call of
+   *              @p op processes, for throughput reporting; 0 for none.
+   */
+  void run(const std::string& name, uint64_t items, const std::function<void()>& op);
+
+  /**
+   * Same, also reporting @p ulps, the largest error of what @p op computes,
+   * in units in the last place.
+   */
+  void run(const std::string& name,
+           uint64_t items,
+           double ulps,
+           const std::function<void()>& op);
+
+  const std::vector<Result>& results() const noexcept { return results_; }
+
+  void writeJson(std::ostream& os) const;
+
+ private:
+  std::string filter_;
+  double minTime_;
+  bool quiet_;
+  std::vector<Result> results_;
+};
+
+}  // namespace bench
@@ -0,0 +1,1025 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include "bench.h"
+#include <cmath/expr.h>
+#include <cmath/expr_archive.h>
+#include <cmath/expr_batch.h>
+#include <cmath/expr_cache.h>
+#include <cmath/expr_generator.h>
+#include <cmath/expr_interval.h>
+#include <cmath/expr_parser.h>
+#include <cmath/expr_rational.h>
+#include <cmath/expr_real.h>
+#include <cmath/integrate.h>
+#include <cmath/plot.h>
+#include <cmath/matrix.h>
+#include <cmath/polynomial.h>
+#include <cmath/rational.h>
+#include <cmath/real.h>
+#include <cmath/roots.h>
+#include <cmath/series.h>
+#include <cmath/simd.h>
+#include <cmath/solve.h>
+#include <cmath/special.h>
+#include <complex>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace cmath;
+using bench::doNotOptimize;
+
+namespace {
+
+// {{{ expression shapes
+// x + y * 2 + x + y * 2 + ...  (n terms, one SumExpr)
+std::string sumChain(size_t n) {
+  std::string s;
+  for (size_t i = 0; i < n; ++i) {
+    if (i)
+      s += " + ";
+    s += (i % 2) ? "y * 2" : "x";
+  }
+  return s;
+}
+
+// ((x + y) * (x - 2)) / (...)  (n leaves, balanced)
+std::string balanced(size_t n, size_t depth = 0) {
+  static const char* ops[] = {" + ", " * ", " - ", " / "};
+  if (n <= 1)
+    return depth % 2 ? "y" : "x";
+
+  return "(" + balanced(n / 2, depth + 1) + ops[depth % 4] +
+         balanced(n - n / 2, depth + 1) + ")";
+}
+
+// sin(cos(sin(...(x)...)))  (n calls deep)
+std::string nestedCalls(size_t n) {
+  std::string s;
+  for (size_t i = 0; i < n; ++i)
+    s += (i % 2) ? "cos(" : "sin(";
+  s += "x";
+  s.append(n, ')');
+  return s;
+}
+
+// 3*x^n + 2*x^(n-1) + ... + 1  (degree n)
+std::string polynomial(size_t n) {
+  std::string s;
+  for (size_t k = n; k > 0; --k) {
+    s += std::to_string(k % 7 + 1) + " * x ^ " + std::to_string(k);
+    s += " + ";
+  }
+  s += "1";
+  return s;
+}
+
+struct Shape {
+  const char* name;
+  std::string (*make)(size_t);
+  std::vector<size_t> sizes;
+};
+
+const std::vector<Shape>& shapes() {
+  static const std::vector<Shape> all = {
+      {"sum", &sumChain, {10, 100, 1000, 10000}},
+      {"balanced", [](size_t n) { return balanced(n); }, {10, 100, 1000, 10000}},
+      {"calls", &nestedCalls, {10, 100, 1000}},
+      {"polynomial", &polynomial, {10, 100, 1000}},
+  };
+  return all;
+}
+// }}}
+
+std::u16string ascii16(const std::string& s) {
+  return std::u16string(s.begin(), s.end());
+}
+
+void benchExpressions(bench::Runner& runner, SymbolTable& st) {
+  for (const Shape& shape : shapes()) {
+    for (size_t n : shape.sizes) {
+      const std::string source = shape.make(n);
+      const std::u16string source16 = ascii16(source);
+      const std::string suffix = std::string("/") + shape.name + "/" + std::to_string(n);
+
+      Result<std::unique_ptr<Expr>> parsed = parseExpression(st, source);
+      if (parsed.isFailure()) {
+        std::cerr << "Cannot parse " << shape.name << "/" << n << ": "
+                  << parsed.failureMessage() << '\n';
+        continue;
+      }
+      const Expr* e = parsed->get();
+      std::unique_ptr<Expr> copy = e->clone();
+
+      runner.run("tokenize" + suffix, source.size(), [&]() {
+        ExprTokenizer t(source16.begin(), source16.end());
+        size_t count = 0;
+        while (t.next())
+          count++;
+        doNotOptimize(count);
+      });
+
+      runner.run("parse" + suffix, source.size(), [&]() {
+        Result<std::unique_ptr<Expr>> r = parseExpression(st, source);
+        doNotOptimize(r);
+      });
+
+      runner.run("calculate" + suffix, n, [&]() {
+        Number y = e->calculate(st);
+        doNotOptimize(y);
+      });
+
+      runner.run("clone" + suffix, n, [&]() {
+        std::unique_ptr<Expr> c = e->clone();
+        doNotOptimize(c);
+      });
+
+      runner.run("compare" + suffix, n, [&]() {
+        bool equal = e->compare(copy.get());
+        doNotOptimize(equal);
+      });
+
+      runner.run("str" + suffix, n, [&]() {
+        std::string s = e->str();
+        doNotOptimize(s);
+      });
+    }
+  }
+}
+
+void benchSymbolTable(bench::Runner& runner, SymbolTable& st) {
+  runner.run("symbols/define+undefine", 1, [&]() {
+    st.defineConstant("tmp", 42);
+    st.undefine("tmp");
+  });
+
+  runner.run("symbols/redefine", 1, [&]() {
+    st.defineConstant("x", 1.5);
+  });
+
+  const Symbol local = "x";
+  const Symbol builtin = "sin";
+  const Symbol unknown = "unknown";
+
+  runner.run("symbols/lookup/local", 1, [&]() {
+    doNotOptimize(st.lookup(local));
+  });
+
+  runner.run("symbols/lookup/builtin", 1, [&]() {
+    doNotOptimize(st.lookup(builtin));
+  });
+
+  runner.run("symbols/lookup/miss", 1, [&]() {
+    doNotOptimize(st.lookup(unknown));
+  });
+
+  std::vector<std::unique_ptr<SymbolTable>> scopes;
+  const SymbolTable* outer = &st;
+  for (int i = 0; i < 8; ++i) {
+    scopes.emplace_back(std::make_unique<SymbolTable>(outer));
+    outer = scopes.back().get();
+  }
+
+  runner.run("symbols/lookup/scope-depth-8", 1, [&]() {
+    doNotOptimize(outer->lookup(local));
+  });
+
+  runner.run("symbols/version/scope-depth-8", 1, [&]() {
+    doNotOptimize(outer->version());
+  });
+
+  runner.run("symbols/context/create", 1, [&]() {
+    SymbolTable scope(&st);
+    doNotOptimize(scope);
+  });
+
+  runner.run("symbols/context/create+define", 1, [&]() {
+    SymbolTable scope(&st);
+    scope.defineConstant("a", 1);
+    doNotOptimize(scope);
+  });
+}
+
+void benchFrontends(bench::Runner& runner, SymbolTable& st) {
+  const std::string source = sumChain(100);
+
+  ExprCache cache(64);
+  runner.run("cache/hit/sum/100", 1, [&]() {
+    Result<std::shared_ptr<const Expr>> e = cache.get(st, source);
+    doNotOptimize(e);
+  });
+
+  Result<std::unique_ptr<Expr>> parsed = parseExpression(st, source);
+  ExprArchiveWriter writer;
+  writer.addFormula(source, parsed->get());
+  const std::string image = writer.finish();
+  Result<std::unique_ptr<ExprArchive>> archive = ExprArchive::view(image.data(),
+                                                                   image.size());
+  if (archive.isSuccess()) {
+    runner.run("archive/calculate/sum/100", 100, [&]() {
+      doNotOptimize((*archive)->calculateFormula(0, st));
+    });
+  }
+}
+
+// random programs, fixed seed, so that runs stay comparable
+void benchCorpus(bench::Runner& runner) {
+  ExprGenerator gen(42, ExprGenerator::Options());
+  const ExprGenerator::Program program = gen.program(4, 200);
+
+  SymbolTable st;
+  for (const std::string& line : program.definitions) {
+    Result<std::unique_ptr<Expr>> e = parseExpression(st, line);
+    if (const auto d = dynamic_cast<DefineExpr*>(e->get()))
+      st.defineConstant(d->symbolName(), d->right()->calculate(st));
+    else if (const auto m = dynamic_cast<DefineMappingExpr*>(e->get()))
+      st.defineMapping(m->symbolName(), m->inputs(), m->body()->clone());
+  }
+
+  std::vector<std::string> sources;
+  std::vector<std::unique_ptr<Expr>> exprs;
+  size_t bytes = 0;
+  size_t nodes = 0;
+  for (const ExprGenerator::Node& node : program.expressions) {
+    sources.emplace_back(ExprGenerator::render(node));
+    exprs.emplace_back(std::move(*parseExpression(st, sources.back())));
+    bytes += sources.back().size();
+    nodes += node.size();
+  }
+
+  runner.run("parse/corpus/200", bytes, [&]() {
+    for (const std::string& source : sources)
+      doNotOptimize(parseExpression(st, source));
+  });
+
+  runner.run("calculate/corpus/200", nodes, [&]() {
+    for (const std::unique_ptr<Expr>& e : exprs)
+      doNotOptimize(e->calculate(st));
+  });
+}
+
+void benchReal(bench::Runner& runner, SymbolTable& st) {
+  // operand sizes across the schoolbook, Karatsuba and Toom-3 ranges
+  for (size_t bits : {256, 4096, 16384, 65536, 262144}) {
+    const std::string suffix = "/" + std::to_string(bits);
+    const Real a = sqrt(Real(2, bits));
+    const Real b = sqrt(Real(3, bits));
+
+    runner.run("real/mul" + suffix, bits, [&]() { doNotOptimize(a * b); });
+    runner.run("real/div" + suffix, bits, [&]() { doNotOptimize(a / b); });
+    runner.run("real/sqrt" + suffix, bits, [&]() { doNotOptimize(sqrt(b)); });
+  }
+
+  const size_t bits = Real::bitsForDigits(100);
+  const std::string digits = Real::pi(bits).toString(100);
+  runner.run("real/parse/100", digits.size(), [&]() {
+    doNotOptimize(Real::parse(digits, bits));
+  });
+
+  const Real pi = Real::pi(bits);
+  runner.run("real/str/100", 100, [&]() { doNotOptimize(pi.toString(100)); });
+
+  Result<std::unique_ptr<Expr>> e = parseExpression(st, "sin(x) ^ 2 + cos(x) ^ 2 + log(y)");
+  runner.run("real/calculate/50", 1, [&]() {
+    doNotOptimize(calculateReal(e->get(), st, Real::bitsForDigits(50)));
+  });
+}
+
+void benchRational(bench::Runner& runner, SymbolTable& st) {
+  // inline int64 fast path, expected to run without heap allocations
+  const Rational third(1, 3);
+  const Rational sixth(1, 6);
+  runner.run("rational/add/small", 1, [&]() { doNotOptimize(third + sixth); });
+  runner.run("rational/mul/small", 1, [&]() { doNotOptimize(third * sixth); });
+
+  // promoted to natural numbers of about 1000 bits
+  const Rational a = pow(Rational(2, 3), 400);
+  const Rational b = pow(Rational(5, 7), 300);
+  runner.run("rational/add/big", 1, [&]() { doNotOptimize(a + b); });
+  runner.run("rational/mul/big", 1, [&]() { doNotOptimize(a * b); });
+
+  Result<std::unique_ptr<Expr>> e = parseExpression(st, "1/3 + 1/6 - 2/7 * (x + 0.5)");
+  runner.run("rational/calculate", 1, [&]() {
+    doNotOptimize(calculateRational(e->get(), st));
+  });
+}
+
+void benchInterval(bench::Runner& runner, SymbolTable& st) {
+  Result<std::unique_ptr<Expr>> e =
+      parseExpression(st, "sin(x) * y ^ 2 - exp(x / (y + 3)) + sqrt(x * x + 1)");
+  Result<IntervalProgram> program = IntervalProgram::compile(e->get(), st, {"x", "y"});
+
+  // a grid of boxes, as one level of branch-and-bound would split them
+  constexpr size_t Count = 1024;
+  std::vector<Interval> boxes;
+  for (size_t i = 0; i < Count; ++i) {
+    const double x = -4.0 + 8.0 * (i % 32) / 32;
+    const double y = -4.0 + 8.0 * (i / 32) / 32;
+    boxes.emplace_back(x, x + 0.25);
+    boxes.emplace_back(y, y + 0.25);
+  }
+  std::vector<Interval> out(Count);
+
+  runner.run("interval/single/1024", Count, [&]() {
+    for (size_t i = 0; i < Count; ++i)
+      out[i] = program->evaluate(&boxes[2 * i]);
+    doNotOptimize(out.data());
+  });
+
+  runner.run("interval/batch/1024", Count, [&]() {
+    program->evaluate(boxes.data(), Count, out.data());
+    doNotOptimize(out.data());
+  });
+}
+
+void benchPolynomial(bench::Runner& runner, SymbolTable& st) {
+  SymbolTable scope(&st);
+  scope.defineConstant("z", Number(0.5, 1.5));
+
+  std::vector<std::pair<std::string, std::string>> cases = {
+      {"cubic", "2 * x ^ 3 - 3 * x ^ 2 + x + 1"},
+      {"bivariate", "x ^ 4 * y - 3 * x ^ 2 * y ^ 2 + y ^ 3 - x + 2"},
+      {"complex", "2 * z ^ 3 - 3 * z ^ 2 + z + 1"},
+  };
+  for (size_t n : {8, 16, 32, 64})
+    cases.emplace_back(std::to_string(n), polynomial(n));
+
+  for (const auto& c : cases) {
+    Result<std::unique_ptr<Expr>> e = parseExpression(scope, c.second);
+    std::unique_ptr<Expr> compiled = compilePolynomials(e->get());
+
+    runner.run("polynomial/tree/" + c.first, 1, [&]() {
+      doNotOptimize((*e)->calculate(scope));
+    });
+    runner.run("polynomial/compiled/" + c.first, 1, [&]() {
+      doNotOptimize(compiled->calculate(scope));
+    });
+  }
+}
+
+void benchRoots(bench::Runner& runner, SymbolTable& st) {
+  std::mt19937 rng(1);
+  std::normal_distribution<double> gauss;
+
+  for (size_t n : {20, 100, 300}) {
+    std::vector<Number> c(n + 1);
+    for (Number& a : c)
+      a = Number(gauss(rng), gauss(rng));
+
+    runner.run("roots/random/" + std::to_string(n), n, [&]() {
+      doNotOptimize(RootFinder::solve(c));
+    });
+  }
+
+  Result<std::unique_ptr<Expr>> e = parseExpression(st, "(x ^ 2 - 1) * (x + 3) ^ 4 - x");
+  runner.run("roots/expr", 1, [&]() {
+    doNotOptimize(RootFinder::solve(e->get(), "x", st));
+  });
+}
+
+// Composite Simpson's rule, doubling the points until two estimates agree,
+// with one calculate() per point, as integrating from outside has to.
+Number simpson(const Expr* e,
+               const Symbol& x,
+               double a,
+               double b,
+               const SymbolTable& st) {
+  SymbolTable scope(&st);
+  auto f = [&](double u) {
+    scope.defineConstant(x, u);
+    return e->calculate(scope);
+  };
+
+  Number ends = f(a) + f(b);
+  Number odd;
+  Number even;
+  Number previous;
+  for (size_t n = 2; n <= (1 << 16); n *= 2) {
+    const double h = (b - a) / n;
+    even += odd;
+    odd = 0;
+    for (size_t k = 1; k < n; k += 2)
+      odd += f(a + k * h);
+    const Number value = h / 3 * (ends + 4.0 * odd + 2.0 * even);
+    if (std::abs(value - previous) <= 1e-10 * std::abs(value))
+      return value;
+    previous = value;
+  }
+  return previous;
+}
+
+void benchIntegrate(bench::Runner& runner, SymbolTable& st) {
+  struct Case {
+    std::string name;
+    std::string source;
+    double a;
+    double b;
+  };
+  const std::vector<Case> cases = {
+      {"smooth", "exp(-u / 3) * sin(5 * u) + u ^ 2 / (1 + u ^ 2)", 0, 10},
+      {"peak", "1 / ((u - 0.3) ^ 2 + 0.0001) + cos(u)", 0, 1},
+      {"oscillatory", "sin(200 * u) * cos(u ^ 2) * exp(-u / 5)", 0, 20},
+      {"endpoint", "log(u) / sqrt(u)", 0, 1},
+  };
+
+  for (const Case& c : cases) {
+    Result<std::unique_ptr<Expr>> e = parseExpression(st, c.source);
+
+    if (c.name != "endpoint") {
+      runner.run("integrate/loop/" + c.name, 1, [&]() {
+        doNotOptimize(simpson(e->get(), "u", c.a, c.b, st));
+      });
+    }
+
+    Integrator::Options tree;
+    tree.batched = false;
+    tree.threads = 1;
+    Integrator::Options batched;
+    batched.threads = 1;
+    Integrator::Options parallel;
+
+    for (const auto& o : {std::make_pair("tree", tree),
+                          std::make_pair("batched", batched),
+                          std::make_pair("parallel", parallel)}) {
+      runner.run(std::string("integrate/") + o.first + "/" + c.name, 1, [&]() {
+        doNotOptimize(Integrator::integrate(e->get(), "u", c.a, c.b, st, o.second));
+      });
+    }
+  }
+}
+
+// z! by multiplication, as FacExpr used to
+Number factorialLoop(Number n) {
+  Number y = 1;
+  for (Number i = 1; i.real() <= n.real(); i += 1)
+    y *= i;
+  return y;
+}
+
+void benchSpecial(bench::Runner& runner) {
+  for (double n : {20, 170}) {
+    const std::string suffix = std::to_string(static_cast<int>(n));
+    runner.run("special/factorial/loop/" + suffix, 1, [&]() {
+      doNotOptimize(factorialLoop(n));
+    });
+    runner.run("special/factorial/table/" + suffix, 1, [&]() {
+      doNotOptimize(factorial(Number(n)));
+    });
+  }
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uniform(-10, 10);
+  std::vector<Number> z(256);
+  for (Number& a : z)
+    a = Number(uniform(rng), uniform(rng));
+
+  const std::vector<std::pair<std::string, Number (*)(Number)>> functions = {
+      {"gamma", &gamma},
+      {"lgamma", &logGamma},
+      {"digamma", &digamma},
+      {"erf", &erf},
+  };
+  for (const auto& f : functions) {
+    runner.run("special/" + f.first, z.size(), [&]() {
+      for (Number a : z)
+        doNotOptimize(f.second(a));
+    });
+  }
+
+  runner.run("special/besselj", z.size(), [&]() {
+    for (Number a : z)
+      doNotOptimize(besselJ(3, a));
+  });
+}
+
+// |a - b| in units in the last place of |b|
+double ulpError(Number a, std::complex<long double> b) {
+  const double m = static_cast<double>(std::abs(b));
+  if (!std::isfinite(m) || m == 0)
+    return 0;
+  const double ulp = std::nextafter(m, HUGE_VAL) - m;
+  const std::complex<long double> d(a.real() - b.real(), a.imag() - b.imag());
+  return static_cast<double>(std::abs(d)) / ulp;
+}
+
+// Elementary functions over 1024 points in [-10, 10]^2, by std::complex
+// one at a time and by cmath/simd.h on the whole array, with their largest
+// error against std::complex<long double>.
+void benchSimd(bench::Runner& runner) {
+  using Long = std::complex<long double>;
+  using ArrayFunction = void (*)(size_t, const double*, const double*, double*, double*);
+
+  struct Function {
+    std::string name;
+    ArrayFunction vector;
+    Number (*scalar)(const Number&);
+    Long (*exact)(const Long&);
+  };
+  const std::vector<Function> functions = {
+      {"exp", &simd::exp, &std::exp<double>, &std::exp<long double>},
+      {"log", &simd::log, &std::log<double>, &std::log<long double>},
+      {"sqrt", &simd::sqrt, &std::sqrt<double>, &std::sqrt<long double>},
+      {"sin", &simd::sin, &std::sin<double>, &std::sin<long double>},
+      {"cos", &simd::cos, &std::cos<double>, &std::cos<long double>},
+      {"tan", &simd::tan, &std::tan<double>, &std::tan<long double>},
+  };
+
+  const size_t n = 1024;
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uniform(-10, 10);
+  std::vector<double> re(n), im(n), outRe(n), outIm(n);
+  for (size_t k = 0; k < n; ++k) {
+    re[k] = uniform(rng);
+    im[k] = uniform(rng);
+  }
+
+  for (const Function& f : functions) {
+    double scalarUlps = 0;
+    double vectorUlps = 0;
+    f.vector(n, re.data(), im.data(), outRe.data(), outIm.data());
+    for (size_t k = 0; k < n; ++k) {
+      const Long exact = f.exact(Long(re[k], im[k]));
+      scalarUlps = std::max(scalarUlps, ulpError(f.scalar(Number(re[k], im[k])), exact));
+      vectorUlps = std::max(vectorUlps, ulpError(Number(outRe[k], outIm[k]), exact));
+    }
+
+    runner.run("simd/" + f.name + "/std", n, scalarUlps, [&]() {
+      for (size_t k = 0; k < n; ++k) {
+        const Number y = f.scalar(Number(re[k], im[k]));
+        outRe[k] = y.real();
+        outIm[k] = y.imag();
+      }
+      doNotOptimize(outRe.data());
+    });
+    runner.run("simd/" + f.name + "/vector", n, vectorUlps, [&]() {
+      f.vector(n, re.data(), im.data(), outRe.data(), outIm.data());
+      doNotOptimize(outRe.data());
+    });
+  }
+}
+
+// a^b as PowExpr computed it before power()
+Number complexPower(Number a, Number b) {
+  return !a.imag() && a.real() == M_E ? std::exp(b) : std::pow(a, b);
+}
+
+// Powers and quotients over 256 points by complex pow() and division, as
+// before, and reduced by power() and reciprocals, with their largest errors.
+void benchStrength(bench::Runner& runner) {
+  using Long = std::complex<long double>;
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uniform(-10, 10);
+  std::vector<Number> complex(256);
+  std::vector<Number> real(256);
+  for (size_t k = 0; k < complex.size(); ++k) {
+    complex[k] = Number(uniform(rng), uniform(rng));
+    real[k] = std::abs(uniform(rng));
+  }
+
+  struct Case {
+    std::string name;
+    Number exponent;
+    const std::vector<Number>* bases;
+  };
+  const std::vector<Case> powers = {
+      {"square", 2, &complex},   {"cube", 3, &complex},   {"inverse", -1, &complex},
+      {"int/10", 10, &complex},  {"sqrt", 0.5, &complex}, {"real/square", 2, &real},
+      {"real/2.5", 2.5, &real},
+  };
+
+  for (const Case& c : powers) {
+    const std::vector<Number>& z = *c.bases;
+    double before = 0;
+    double after = 0;
+    for (Number a : z) {
+      const Long exact = std::pow(Long(a), Long(c.exponent));
+      before = std::max(before, ulpError(complexPower(a, c.exponent), exact));
+      after = std::max(after, ulpError(power(a, c.exponent), exact));
+    }
+    runner.run("strength/pow/" + c.name + "/complex", z.size(), before, [&]() {
+      for (Number a : z)
+        doNotOptimize(complexPower(a, c.exponent));
+    });
+    runner.run("strength/pow/" + c.name + "/reduced", z.size(), after, [&]() {
+      for (Number a : z)
+        doNotOptimize(power(a, c.exponent));
+    });
+  }
+
+  for (Number divisor : {Number(3), Number(3, 2)}) {
+    const std::string name = divisor.imag() ? "complex" : "real";
+    const Number reciprocal = Number(1) / divisor;
+    double before = 0;
+    double after = 0;
+    for (Number a : complex) {
+      const Long exact = Long(a) / Long(divisor);
+      before = std::max(before, ulpError(a / divisor, exact));
+      after = std::max(after, ulpError(a * reciprocal, exact));
+    }
+    runner.run("strength/div/" + name + "/divide", complex.size(), before, [&]() {
+      for (Number a : complex)
+        doNotOptimize(a / divisor);
+    });
+    runner.run("strength/div/" + name + "/reciprocal", complex.size(), after, [&]() {
+      for (Number a : complex)
+        doNotOptimize(a * reciprocal);
+    });
+  }
+}
+
+// Sums and products of n random literals, as the left-deep chain of
+// binary nodes the parser used to build and as one SumExpr (ProductExpr),
+// with the error of the result against a compensated long double one.
+void benchChains(bench::Runner& runner, SymbolTable& st) {
+  using Long = std::complex<long double>;
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uniform(-1, 1);
+
+  for (size_t n : {1000, 10000, 100000}) {
+    std::vector<Number> terms(n);
+    for (Number& z : terms)
+      z = Number(uniform(rng), uniform(rng));
+
+    Long exact = 0;
+    Long compensation = 0;
+    for (Number z : terms) {
+      const Long t = exact + Long(z);
+      compensation += std::abs(exact) >= std::abs(Long(z)) ? (exact - t) + Long(z)
+                                                           : (Long(z) - t) + exact;
+      exact = t;
+    }
+    exact += compensation;
+
+    std::unique_ptr<Expr> chain = std::make_unique<NumberExpr>(terms[0]);
+    std::vector<SumExpr::Term> flat;
+    flat.emplace_back(SumExpr::Term{std::make_unique<NumberExpr>(terms[0]), false});
+    for (size_t i = 1; i < n; ++i) {
+      chain = std::make_unique<PlusExpr>(std::move(chain),
+                                         std::make_unique<NumberExpr>(terms[i]));
+      flat.emplace_back(SumExpr::Term{std::make_unique<NumberExpr>(terms[i]), false});
+    }
+    const SumExpr sum(std::move(flat));
+
+    const std::string suffix = "/" + std::to_string(n);
+    runner.run("chain/sum/binary" + suffix, n, ulpError(chain->calculate(st), exact),
+               [&]() { doNotOptimize(chain->calculate(st)); });
+    runner.run("chain/sum/flat" + suffix, n, ulpError(sum.calculate(st), exact),
+               [&]() { doNotOptimize(sum.calculate(st)); });
+  }
+
+  // factors on the unit circle, so that the product neither over- nor underflows
+  for (size_t n : {100, 1000, 10000}) {
+    std::vector<Number> factors(n);
+    Long exact = 1;
+    for (Number& z : factors) {
+      z = std::polar(1.0, M_PI * uniform(rng));
+      exact *= Long(z);
+    }
+
+    std::unique_ptr<Expr> chain = std::make_unique<NumberExpr>(factors[0]);
+    ProductExpr::FactorList flat;
+    flat.emplace_back(std::make_unique<NumberExpr>(factors[0]));
+    for (size_t i = 1; i < n; ++i) {
+      chain = std::make_unique<MulExpr>(std::move(chain),
+                                        std::make_unique<NumberExpr>(factors[i]));
+      flat.emplace_back(std::make_unique<NumberExpr>(factors[i]));
+    }
+    const ProductExpr product(std::move(flat));
+
+    const std::string suffix = "/" + std::to_string(n);
+    runner.run("chain/product/binary" + suffix, n, ulpError(chain->calculate(st), exact),
+               [&]() { doNotOptimize(chain->calculate(st)); });
+    runner.run("chain/product/flat" + suffix, n, ulpError(product.calculate(st), exact),
+               [&]() { doNotOptimize(product.calculate(st)); });
+  }
+}
+
+// sin(x) * 2 + x * x over n points, as one calculate() per point with x
+// bound to it and as one evaluate() with x bound to the tuple of them.
+void benchTuples(bench::Runner& runner, SymbolTable& st) {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uniform(-10, 10);
+
+  for (size_t n : {1000, 100000}) {
+    Tuple points(n);
+    for (size_t k = 0; k < n; ++k)
+      points.set(k, Number(uniform(rng), uniform(rng)));
+
+    SymbolTable scope(&st);
+    scope.defineConstant("x", Number());
+    std::unique_ptr<Expr> e = std::move(*parseExpression(scope, "sin(x) * 2 + x * x"));
+
+    const std::string suffix = "/" + std::to_string(n);
+    runner.run("tuple/scalar" + suffix, n, [&]() {
+      for (size_t k = 0; k < n; ++k) {
+        scope.defineConstant("x", points[k]);
+        doNotOptimize(e->calculate(scope));
+      }
+    });
+    const Value x(std::make_shared<Tuple>(points));
+    scope.defineConstant("x", x);
+    runner.run("tuple/vector" + suffix, n, [&]() { doNotOptimize(e->evaluate(scope)); });
+  }
+}
+
+// Cases over points of mixed sign, one calculate() per point, which
+// branches on every condition, against a BatchProgram of them.
+void benchCases(bench::Runner& runner, SymbolTable& st) {
+  struct Case {
+    std::string name;
+    std::string source;
+  };
+  const std::vector<Case> cases = {
+      {"abs", "when x > 0 then x when x < 0 then -x else 0"},
+      {"sgn", "when x < 0 then -1 else 1"},
+      {"steps", "when x < -7 then 1 when x < -5 then 2 when x < -3 then 3 "
+                "when x < -1 then 4 when x < 1 then 5 when x < 3 then 6 "
+                "when x < 5 then 7 when x < 7 then 8 else 9"},
+      {"expensive", "when x < 0 then gamma(x) * besselj(2, x) else x * x"},
+  };
+
+  constexpr size_t n = 10000;
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uniform(-10, 10);
+  std::vector<Number> points(n);
+  for (Number& x : points)
+    x = uniform(rng);
+  std::vector<Number> out(n);
+
+  for (const Case& c : cases) {
+    SymbolTable scope(&st);
+    scope.defineConstant("x", Number());
+    std::unique_ptr<Expr> e = std::move(*parseExpression(scope, c.source));
+    runner.run("case/calculate/" + c.name, n, [&]() {
+      for (size_t k = 0; k < n; ++k) {
+        scope.defineConstant("x", points[k]);
+        doNotOptimize(e->calculate(scope));
+      }
+    });
+
+    Result<BatchProgram> program = BatchProgram::compile(e.get(), st, {"x"});
+    runner.run("case/batch/" + c.name, n, [&]() {
+      program->evaluate(points.data(), n, out.data());
+      doNotOptimize(out[0]);
+    });
+  }
+}
+
+// Products, solutions and inverses of random n x n matrices, with floating
+// point operations as items, so that items/s is flops, against a plain
+// triple loop.
+void benchMatrix(bench::Runner& runner) {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uniform(-1, 1);
+  auto random = [&](size_t rows, size_t columns) {
+    Matrix m(rows, columns);
+    for (size_t i = 0; i < rows; ++i)
+      for (size_t j = 0; j < columns; ++j)
+        m.set(i, j, Number(uniform(rng), uniform(rng)));
+    return m;
+  };
+
+  for (size_t n : {64, 256, 1000}) {
+    const Matrix a = random(n, n);
+    const Matrix b = random(n, n);
+    const uint64_t flops = 8 * n * n * n;
+    const std::string suffix = "/" + std::to_string(n);
+
+    if (n <= 256) {
+      runner.run("matrix/multiply/naive" + suffix, flops, [&]() {
+        Matrix c(n, n);
+        for (size_t i = 0; i < n; ++i)
+          for (size_t j = 0; j < n; ++j) {
+            Number z = 0;
+            for (size_t k = 0; k < n; ++k)
+              z += a(i, k) * b(k, j);
+            c.set(i, j, z);
+          }
+        doNotOptimize(c);
+      });
+    }
+    runner.run("matrix/multiply/blocked" + suffix, flops,
+               [&]() { doNotOptimize(Matrix::multiply(a, b, 1)->real()); });
+    runner.run("matrix/multiply/threads" + suffix, flops,
+               [&]() { doNotOptimize(Matrix::multiply(a, b)->real()); });
+    // LU decomposition and two triangular solves per right-hand side
+    runner.run("matrix/solve" + suffix, flops / 3 + 8 * n * n * n,
+               [&]() { doNotOptimize(Matrix::solve(a, b)->real()); });
+    runner.run("matrix/inverse" + suffix, flops / 3 + 8 * n * n * n,
+               [&]() { doNotOptimize(a.inverse()->real()); });
+  }
+}
+
+// Bisection on [a, b] with one calculate() per point, as solving from
+// outside has to.
+double bisect(const Expr* e, const Symbol& x, double a, double b, const SymbolTable& st) {
+  SymbolTable scope(&st);
+  auto f = [&](double u) {
+    scope.defineConstant(x, u);
+    return e->calculate(scope).real();
+  };
+
+  const bool negative = f(a) < 0;
+  while (std::abs(b - a) > 1e-12 * std::max(std::abs(a), 1.0)) {
+    const double m = (a + b) / 2;
+    ((f(m) < 0) == negative ? a : b) = m;
+  }
+  return a;
+}
+
+// sums of the body over k = 1, ..., n, term by term
+Number sumLoop(const Expr* body, size_t n, const SymbolTable& st) {
+  SymbolTable scope(&st);
+  Number s = 0;
+  for (size_t k = 1; k <= n; ++k) {
+    scope.defineConstant("k", Number(k));
+    s += body->calculate(scope);
+  }
+  return s;
+}
+
+void benchSeries(bench::Runner& runner, SymbolTable& st) {
+  struct Case {
+    std::string name;
+    std::string series;
+    std::string body;
+    size_t loop;  // terms to sum term by term instead, 0 for none
+  };
+  const std::vector<Case> cases = {
+      {"arithmetic", "sum over 3 * k + 1 for k = 1 to 100000", "3 * k + 1", 100000},
+      {"geometric", "sum over x * 0.5 ^ k for k = 1 to infinity", "x * 0.5 ^ k", 64},
+      {"taylor", "sum over x ^ k / k! for k = 0 to infinity", "", 0},
+      {"alternating", "sum over (-1) ^ k / k for k = 1 to infinity", "(-1) ^ k / k",
+       100000},
+      {"zeta", "sum over 1 / k ^ 2 for k = 1 to infinity", "1 / k ^ 2", 100000},
+  };
+
+  for (const Case& c : cases) {
+    Result<std::unique_ptr<Expr>> e = parseExpression(st, c.series);
+    runner.run("series/" + c.name, 1, [&]() { doNotOptimize((*e)->calculate(st)); });
+
+    if (c.loop) {
+      Result<std::unique_ptr<Expr>> body = parseExpression(st, c.body);
+      runner.run("series/loop/" + c.name, 1, [&]() {
+        doNotOptimize(sumLoop(body->get(), c.loop, st));
+      });
+    }
+  }
+}
+
+// a fixed grid as dense as the finest adaptive sampling, with one
+// calculate() per point, as sampling from outside has to
+size_t sampleDense(const Expr* e, double a, double b, size_t n, const SymbolTable& st) {
+  SymbolTable scope(&st);
+  size_t defined = 0;
+  for (size_t k = 0; k < n; ++k) {
+    scope.defineConstant("u", Number(a + (b - a) * k / (n - 1)));
+    defined += std::isfinite(e->calculate(scope).real());
+  }
+  return defined;
+}
+
+void benchPlot(bench::Runner& runner, SymbolTable& st) {
+  struct Case {
+    std::string name;
+    std::string source;
+    double a;
+    double b;
+  };
+  const std::vector<Case> cases = {
+      {"line", "3 * u + 2", -10, 10},
+      {"smooth", "sin(u) / u", -20, 20},
+      {"poles", "tan(u)", -5, 5},
+      {"peak", "exp(-1000 * u ^ 2)", -1, 1},
+  };
+
+  // as many points as there are intervals of the resolution across the
+  // drawing, which leaves 80 pixels of the width for the margins
+  const Plot::Options options;
+  const size_t dense = (options.width - 80) / options.resolution;
+  for (const Case& c : cases) {
+    Result<std::unique_ptr<Expr>> e = parseExpression(st, c.source);
+    runner.run("plot/dense/" + c.name, 1, [&]() {
+      doNotOptimize(sampleDense(e->get(), c.a, c.b, dense, st));
+    });
+    runner.run("plot/adaptive/" + c.name, 1, [&]() {
+      doNotOptimize(Plot::sample(e->get(), "u", c.a, c.b, st, options));
+    });
+  }
+}
+
+void benchSolve(bench::Runner& runner, SymbolTable& st) {
+  struct Case {
+    std::string name;
+    std::string source;
+    double a;
+    double b;
+  };
+  const std::vector<Case> cases = {
+      {"sqrt", "u ^ 2 - 2", 0, 2},
+      {"kepler", "u - 0.9 * sin(u) - 1", 0, 3},
+      {"transcendental", "exp(-u) * (u ^ 3 + 2) - cos(u) / 4", 0, 6},
+  };
+
+  for (const Case& c : cases) {
+    Result<std::unique_ptr<Expr>> e = parseExpression(st, c.source);
+    runner.run("solve/bisect/" + c.name, 1, [&]() {
+      doNotOptimize(bisect(e->get(), "u", c.a, c.b, st));
+    });
+    runner.run("solve/brent-newton/" + c.name, 1, [&]() {
+      doNotOptimize(Solver::solve(e->get(), "u", st));
+    });
+  }
+
+  Result<std::unique_ptr<Expr>> complex = parseExpression(st, "u ^ 3 + u + 10 = 0");
+  runner.run("solve/complex", 1, [&]() {
+    doNotOptimize(Solver::solve(complex->get(), "u", st));
+  });
+
+  std::vector<std::unique_ptr<Expr>> system;
+  for (const char* source : {"u ^ 2 + v ^ 2 + w ^ 2 = 14", "u * v = 2 * w - 4",
+                             "exp(u - 1) + v = w"})
+    system.push_back(std::move(*parseExpression(st, source)));
+  const std::vector<const Expr*> equations = {system[0].get(), system[1].get(),
+                                              system[2].get()};
+  runner.run("solve/system/3", 1, [&]() {
+    doNotOptimize(Solver::solve(equations, {"u", "v", "w"}, st, Solver::Options()));
+  });
+}
+
+void printUsage() {
+  std::cout << "Usage: cmath_bench [--filter SUBSTRING] [--min-time SECONDS]"
+            << " [--json FILE]\n";
+}
+
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+  bench::Runner runner;
+  std::string jsonPath;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--filter" && i + 1 < argc) {
+      runner.setFilter(argv[++i]);
+    } else if (arg == "--min-time" && i + 1 < argc) {
+      runner.setMinTime(std::atof(argv[++i]));
+    } else if (arg == "--json" && i + 1 < argc) {
+      jsonPath = argv[++i];
+    } else {
+      printUsage();
+      return arg == "--help" ? 0 : 1;
+    }
+  }
+
+  if (jsonPath == "-")
+    runner.setQuiet(true);
+
+  SymbolTable st;
+  st.defineConstant("x", 1.5);
+  st.defineConstant("y", 0.25);
+
+  benchExpressions(runner, st);
+  benchSymbolTable(runner, st);
+  benchFrontends(runner, st);
+  benchCorpus(runner);
+  benchReal(runner, st);
+  benchRational(runner, st);
+  benchInterval(runner, st);
+  benchPolynomial(runner, st);
+  benchRoots(runner, st);
+  benchIntegrate(runner, st);
+  benchSolve(runner, st);
+  benchSeries(runner, st);
+  benchPlot(runner, st);
+  benchSpecial(runner);
+  benchSimd(runner);
+  benchStrength(runner);
+  benchChains(runner, st);
+  benchTuples(runner, st);
+  benchCases(runner, st);
+  benchMatrix(runner);
+
+  if (jsonPath == "-") {
+    runner.writeJson(std::cout);
+  } else if (!jsonPath.empty()) {
+    std::ofstream out(jsonPath);
+    runner.writeJson(out);
+    if (!out.good()) {
+      std::cerr << "Could not write " << jsonPath << '\n';
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -6,68 +6,445 @@
 // the License at: http://opensource.org/licenses/MIT
 
 #include "console.h"
+#include "server.h"
+#include "stream.h"
+#include <cmath/builtins.h>
 #include <cmath/expr.h>
+#include <cmath/expr_archive.h>
+#include <cmath/expr_cache.h>
 #include <cmath/expr_parser.h>
+#include <cmath/expr_rational.h>
+#include <cmath/expr_real.h>
+#include <cmath/plot.h>
+#include <cmath/polynomial.h>
+#include <cmath/profiler.h>
+#include <cmath/roots.h>
+#include <cmath/solve.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
-#include <sstream>
+#include <map>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace cmath;
 
-std::string simple(Number n) {
-  std::stringstream s;
-  if (!n.imag()) {
-    s << n.real();
-  } else {
-    if (n.real()) {
-      s << n.real() << " + ";
-    }
-    if (n.imag() != 1) {
-      s << n.imag();
+void dumpSymbols(const SymbolTable& symbolTable) {
+  for (const auto& e : symbolTable)
+    std::cout << e.first << " = " << e.second->str() << std::endl;
+}
+
+void dumpBuiltins() {
+  for (size_t i = 0; i < builtinCount(); ++i)
+    std::cout << builtin(i).name << " = " << builtin(i).def->str() << std::endl;
+}
+
+void dumpCacheStats(const ExprCache& cache) {
+  ExprCache::Stats s = cache.stats();
+  std::cout << "size: " << s.size << "/" << cache.capacity()
+            << ", hits: " << s.hits
+            << ", misses: " << s.misses
+            << ", evictions: " << s.evictions << '\n';
+}
+
+void profile(const SymbolTable& symbolTable, const std::string& source, Profiler* profiler) {
+  profiler->reset();
+
+  std::unique_ptr<Expr> e;
+  {
+    Profiler::Phase _p(profiler, "parse");
+    Result<std::unique_ptr<Expr>> parsed = parseExpression(symbolTable, source);
+    if (parsed.isFailure()) {
+      std::error_code ec = parsed.error();
+      std::cerr << ec.category().name() << ": " << ec.message() << '\n';
+      return;
     }
-    s << 'i';
+    e = std::move(*parsed);
+  }
+
+  std::unique_ptr<Expr> probe;
+  {
+    Profiler::Phase _p(profiler, "compile");
+    probe = profiler->instrument(e.get());
   }
-  return s.str();
+
+  // repeat evaluation for a while so that short expressions get meaningful numbers
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+  uint64_t iterations = 0;
+  Value result;
+  {
+    Profiler::Phase _p(profiler, "evaluate");
+    do {
+      result = probe->evaluate(symbolTable);
+      iterations++;
+    } while (iterations < 1000000 && std::chrono::steady_clock::now() < deadline);
+  }
+
+  std::cout << e->str() << " = " << str(result) << " (" << iterations << " runs)\n";
+  profiler->report(std::cout, iterations);
 }
 
-void injectStandardSymbols(SymbolTable* st) {
-  st->defineConstant("i", {0, 1});
-  st->defineConstant("e", M_E);
-  st->defineConstant("pi", std::acos(-1));
-  st->defineConstant(u8"π", std::acos(-1));
-  st->defineConstant("nan", std::nan(""));
-
-  st->defineMapping("Re", [](Number x) { return x.real(); });
-  st->defineMapping("Im", [](Number x) { return x.imag(); });
-  st->defineMapping("arg", [](Number x) { return std::arg(x); });
-  st->defineMapping("sin", [](Number x) { return std::sin(x); });
-  st->defineMapping("cos", [](Number x) { return std::cos(x); });
-  st->defineMapping("tan", [](Number x) { return std::tan(x); });
-  st->defineMapping("exp", [](Number x) { return std::exp(x); });
-  st->defineMapping("sqrt", [](Number x) { return std::sqrt(x); });
-  st->defineMapping("log", [](Number x) { return std::log(x); });
-
-  st->defineMapping("polar", [](Number a, Number b) { return std::polar(a.real(), b.real()); });
+void writeTrace(const Profiler& profiler, const std::string& path) {
+  std::ofstream out(path);
+  profiler.writeTrace(out);
+  if (!out.good())
+    std::cerr << "Could not write " << path << '\n';
 }
 
-void dumpSymbols(const SymbolTable& symbolTable) {
-  for (const auto& e : symbolTable)
-    std::cout << e.first << " = " << e.second->str() << std::endl;
+void printRoots(const SymbolTable& symbolTable, const std::string& source) {
+  Result<std::unique_ptr<Expr>> e = parseExpression(symbolTable, source);
+  if (e.isFailure()) {
+    std::error_code ec = e.error();
+    std::cerr << ec.category().name() << ": " << ec.message() << '\n';
+    return;
+  }
+
+  RootFinder::Stats stats;
+  const auto start = std::chrono::steady_clock::now();
+  Result<std::vector<Number>> roots = RootFinder::solve(e->get(), symbolTable, &stats);
+  const std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  if (roots.isFailure()) {
+    std::error_code ec = roots.error();
+    std::cerr << ec.category().name() << ": " << ec.message() << '\n';
+    return;
+  }
+
+  std::cout << '(';
+  for (size_t i = 0; i < roots->size(); ++i)
+    std::cout << (i ? ", " : "") << str((*roots)[i]);
+  std::cout << ")\n"
+            << "degree " << stats.degree << ", " << stats.iterations << " iterations, "
+            << stats.polishSteps << " polish steps, " << elapsed.count() << " ms\n";
+}
+
+// solves "EQ, ..., VAR, ...", with as many variables as equations
+void printSolution(const SymbolTable& symbolTable, const std::string& source) {
+  Result<std::unique_ptr<Expr>> e = parseExpression(symbolTable, "solve(" + source + ")");
+  if (e.isFailure()) {
+    std::error_code ec = e.error();
+    std::cerr << ec.category().name() << ": " << ec.message() << '\n';
+    return;
+  }
+
+  auto call = dynamic_cast<const CallExpr*>(e->get());
+  if (!call) {
+    std::cerr << "Expected equations and variables\n";
+    return;
+  }
+
+  const size_t n = call->inputs().size() / 2;
+  std::vector<const Expr*> equations;
+  std::vector<Symbol> variables;
+  for (size_t i = 0; i < n; ++i) {
+    auto x = dynamic_cast<const SymbolExpr*>(call->inputs()[n + i].get());
+    if (!x) {
+      std::cerr << "Expected a variable instead of " << call->inputs()[n + i]->str()
+                << '\n';
+      return;
+    }
+    equations.push_back(call->inputs()[i].get());
+    variables.push_back(x->symbolName());
+  }
+  if (call->inputs().size() % 2)
+    equations.push_back(call->inputs().back().get());
+
+  Solver::Stats stats;
+  Result<std::vector<Number>> x =
+      Solver::solve(equations, variables, symbolTable, Solver::Options(), &stats);
+
+  if (x.isFailure()) {
+    std::error_code ec = x.error();
+    std::cerr << ec.category().name() << ": " << ec.message() << '\n';
+    return;
+  }
+
+  for (size_t i = 0; i < n; ++i)
+    std::cout << (i ? ", " : "") << variables[i] << " = " << str((*x)[i]);
+  std::cout << '\n'
+            << stats.iterations << " iterations, " << stats.newtonSteps
+            << " Newton steps, " << stats.evaluations << " evaluations, residual " << stats.residual << ", "
+            << stats.seconds * 1000 << " ms\n";
+}
+
+// plots "F, A, B [to FILE.svg]", where F is an expression in one variable or
+// the name of a mapping, into FILE.svg or plot.svg
+void plot(const SymbolTable& symbolTable, const std::string& source) {
+  std::string args = source;
+  std::string path = "plot.svg";
+  const size_t to = args.rfind(" to ");
+  if (to != std::string::npos && args.size() > 4 &&
+      args.compare(args.size() - 4, 4, ".svg") == 0) {
+    path = args.substr(to + 4);
+    args.resize(to);
+  }
+
+  // the bounds are the last two arguments at the outermost level
+  std::vector<size_t> commas;
+  int depth = 0;
+  for (size_t i = 0; i < args.size(); ++i) {
+    if (args[i] == '(' || args[i] == '[')
+      depth++;
+    else if (args[i] == ')' || args[i] == ']')
+      depth--;
+    else if (args[i] == ',' && depth == 0)
+      commas.push_back(i);
+  }
+  if (commas.size() < 2) {
+    std::cerr << "Expected a function and bounds\n";
+    return;
+  }
+  const size_t comma = commas[commas.size() - 2];
+
+  double bounds[2];
+  const std::string sources[2] = {args.substr(comma + 1, commas.back() - comma - 1),
+                                  args.substr(commas.back() + 1)};
+  for (int k = 0; k < 2; ++k) {
+    Result<std::unique_ptr<Expr>> e = parseExpression(symbolTable, sources[k]);
+    if (e.isFailure()) {
+      std::error_code ec = e.error();
+      std::cerr << ec.category().name() << ": " << ec.message() << '\n';
+      return;
+    }
+    bounds[k] = (*e)->calculate(symbolTable).real();
+  }
+
+  std::string f = args.substr(0, comma);
+  f.erase(0, f.find_first_not_of(' '));
+  f.erase(f.find_last_not_of(' ') + 1);
+
+  // a mapping by name is plotted over its argument
+  const bool name = !f.empty() && std::all_of(f.begin(), f.end(), [](char ch) {
+    return std::isalnum(static_cast<unsigned char>(ch)) || ch == '_';
+  });
+  if (name && dynamic_cast<const MappingDef*>(symbolTable.lookup(f))) {
+    for (const char* x : {"x", "t", "u", "v"}) {
+      if (!symbolTable.lookup(x)) {
+        f = f + '(' + x + ')';
+        break;
+      }
+    }
+  }
+
+  Result<std::unique_ptr<Expr>> e = parseExpression(symbolTable, f);
+  if (e.isFailure()) {
+    std::error_code ec = e.error();
+    std::cerr << ec.category().name() << ": " << ec.message() << '\n';
+    return;
+  }
+
+  Plot::Stats stats;
+  Result<Plot> graph =
+      Plot::sample(e->get(), bounds[0], bounds[1], symbolTable, Plot::Options(), &stats);
+  if (graph.isFailure()) {
+    std::error_code ec = graph.error();
+    std::cerr << ec.category().name() << ": " << ec.message() << '\n';
+    return;
+  }
+
+  std::ofstream out(path);
+  graph->writeSvg(out, (*e)->str());
+  if (!out.good()) {
+    std::cerr << "Could not write " << path << '\n';
+    return;
+  }
+
+  std::cout << "wrote " << path << ": " << stats.samples << " samples in " << stats.rounds
+            << " rounds, " << stats.discontinuities << " discontinuities\n";
 }
 
 void printCommands() {
   std::cout << "Valid input:\n"
             << "?             prints this help\n"
             << "vars          prints all defined variables\n"
+            << "builtins      prints all builtin constants and mappings\n"
+            << "cache         prints expression cache statistics\n"
             << "EXPR          evaluates given expression\n"
             << "SYM := EXPR   defines a new constant by given expression, e.g. a := 3\n"
+            << "SYM : (ARGS) -> EXPR\n"
+            << "              defines a new mapping, e.g. f : (a, b) -> a + b\n"
+            << "profile EXPR  evaluates given expression and prints its hotspots\n"
+            << "roots EXPR    prints all roots of a polynomial in one variable\n"
+            << "solve EQ, ..., VAR, ...\n"
+            << "              solves equations for as many variables, e.g. solve x^2 = 2, x\n"
+            << "plot F, A, B [to FILE.svg]\n"
+            << "              plots F over [A, B] into FILE.svg, or plot.svg\n"
+            << "trace FILE    writes the phases of the last profile as Chrome trace\n"
+            << "digits N      calculates with N significant digits, 0 for double precision\n"
+            << "exact on|off  calculates with exact rational numbers\n"
             << "quit          Exists program\n";
 }
 
+void printUsage() {
+  std::cout << "Usage: cm                                   interactive mode\n"
+            << "       cm --write-archive OUTPUT INPUT      compiles formulas into archive\n"
+            << "       cm --inspect-archive FILE            dumps and evaluates archive\n"
+            << "       cm -f FILE [--jobs N]                evaluates each line of file\n"
+            << "       cm - [--jobs N]                      evaluates each line of stdin\n"
+            << "       cm --serve SOCKET [--workers N]      evaluates for clients of socket\n";
+}
+
+int writeArchive(const std::string& outputPath, const std::string& inputPath) {
+  std::ifstream in(inputPath);
+  if (!in.good()) {
+    std::cerr << "Could not open " << inputPath << '\n';
+    return 1;
+  }
+
+  SymbolTable symbolTable;
+  ExprArchiveWriter writer;
+  std::vector<std::unique_ptr<Expr>> formulas;
+  std::map<Symbol, unsigned> definedAt;
+
+  std::string line;
+  for (unsigned lineNo = 1; std::getline(in, line); ++lineNo) {
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    Result<std::unique_ptr<Expr>> e = parseExpression(symbolTable, line);
+    if (e.error()) {
+      std::error_code ec = e.error();
+      std::cerr << inputPath << ':' << lineNo << ": " << ec.category().name()
+                << ": " << ec.message() << '\n';
+      return 1;
+    }
+
+    if (const auto d = dynamic_cast<DefineExpr*>(e->get())) {
+      symbolTable.defineConstant(d->symbolName(), d->right()->evaluate(symbolTable));
+    } else if (const auto m = dynamic_cast<DefineMappingExpr*>(e->get())) {
+      symbolTable.defineMapping(m->symbolName(), m->inputs(),
+                                compilePolynomials(m->body()));
+      definedAt[m->symbolName()] = lineNo;
+    } else if (Result<size_t> formula = writer.addFormula(line, e->get())) {
+      formulas.emplace_back(std::move(*e));  // keep the bound definitions alive
+    } else {
+      std::error_code ec = formula.error();
+      std::cerr << inputPath << ':' << lineNo << ": " << ec.category().name() << ": "
+                << ec.message() << ", skipped\n";
+    }
+  }
+
+  for (const Symbol& s : writer.addSymbols(symbolTable)) {
+    std::error_code ec = make_error_code(ExprArchive::UnsupportedExpr);
+    std::cerr << inputPath << ':' << definedAt[s] << ": " << ec.category().name() << ": "
+              << ec.message() << ", skipped\n";
+  }
+
+  if (std::error_code ec = writer.save(outputPath)) {
+    std::cerr << outputPath << ": " << ec.message() << '\n';
+    return 1;
+  }
+
+  return 0;
+}
+
+int inspectArchive(const std::string& path) {
+  Result<std::unique_ptr<ExprArchive>> a = ExprArchive::open(path);
+  if (a.isFailure()) {
+    std::error_code ec = a.error();
+    std::cerr << path << ": " << ec.category().name() << ": " << ec.message() << '\n';
+    return 1;
+  }
+
+  const ExprArchive& archive = **a;
+  const archive::Header& h = archive.header();
+  std::cout << "version:  " << h.version << '\n'
+            << "size:     " << archive.size() << " bytes\n"
+            << "checksum: " << std::hex << h.checksum << std::dec << " (ok)\n"
+            << "nodes:    " << h.nodeCount << '\n'
+            << "symbols:  " << h.symbolCount << '\n'
+            << "formulas: " << h.formulaCount << '\n';
+
+  for (size_t i = 0; i < archive.symbolCount(); ++i) {
+    const archive::SymbolRecord& s = archive.symbol(i);
+    std::cout << archive.symbolName(i);
+    if (s.kind == archive::SymbolKind::Constant) {
+      std::cout << " = " << str(Number(s.re, s.im)) << '\n';
+    } else {
+      std::cout << " : (";
+      for (size_t k = 0; k < s.paramCount; ++k)
+        std::cout << (k ? ", " : "") << archive.name(archive.parameter(s, k));
+      std::cout << ") -> #" << s.body << '\n';
+    }
+  }
+
+  SymbolTable symbolTable;
+  for (size_t i = 0; i < archive.formulaCount(); ++i)
+    std::cout << '[' << i << "] " << archive.formulaSource(i) << " = "
+              << str(archive.calculateFormula(i, symbolTable)) << '\n';
+
+  return 0;
+}
+
+// cm -f FILE [--jobs N] | cm - [--jobs N]
+int streamStatements(int argc, const char* argv[]) {
+  const bool stdinput = std::string(argv[1]) == "-";
+  const int first = stdinput ? 2 : 3;
+  if (!stdinput && argc < 3) {
+    printUsage();
+    return 1;
+  }
+
+  StatementStream::Options options;
+  if (argc == first + 2 && std::string(argv[first]) == "--jobs") {
+    options.jobs = std::max(1ul, std::strtoul(argv[first + 1], nullptr, 10));
+  } else if (argc != first) {
+    printUsage();
+    return 1;
+  }
+
+  if (stdinput)
+    return StatementStream("-", STDIN_FILENO, options).run();
+
+  const int fd = open(argv[2], O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << "Could not open " << argv[2] << '\n';
+    return 1;
+  }
+  const int rv = StatementStream(argv[2], fd, options).run();
+  close(fd);
+  return rv;
+}
+
 int main(int argc, const char* argv[]) {
   try {
+    if (argc == 4 && std::string(argv[1]) == "--write-archive")
+      return writeArchive(argv[2], argv[3]);
+
+    if (argc == 3 && std::string(argv[1]) == "--inspect-archive")
+      return inspectArchive(argv[2]);
+
+    if (argc >= 2 && (std::string(argv[1]) == "-f" || std::string(argv[1]) == "-"))
+      return streamStatements(argc, argv);
+
+    if ((argc == 3 || argc == 5) && std::string(argv[1]) == "--serve") {
+      Server::Options options;
+      if (argc == 5) {
+        if (std::string(argv[3]) != "--workers") {
+          printUsage();
+          return 1;
+        }
+        options.workers = std::strtoul(argv[4], nullptr, 10);
+      }
+      return Server(argv[2], options).run();
+    }
+
+    if (argc != 1) {
+      printUsage();
+      return 1;
+    }
+
     SymbolTable symbolTable;
-    injectStandardSymbols(&symbolTable);
+    ExprCache cache(1024);
+    Profiler profiler;
+    size_t digits = 0;
+    bool exact = false;
     Readline input(".cmathirc");
     input.addHistory(u8"e^(i*π) + 1");
 
@@ -89,27 +466,93 @@ int main(int argc, const char* argv[]) {
         continue;
       }
 
+      if (line == "builtins") {
+        dumpBuiltins();
+        continue;
+      }
+
+      if (line == "cache") {
+        dumpCacheStats(cache);
+        continue;
+      }
+
+      if (line.compare(0, 8, "profile ") == 0) {
+        profile(symbolTable, line.substr(8), &profiler);
+        continue;
+      }
+
+      if (line.compare(0, 6, "roots ") == 0) {
+        printRoots(symbolTable, line.substr(6));
+        continue;
+      }
+
+      if (line.compare(0, 6, "solve ") == 0) {
+        printSolution(symbolTable, line.substr(6));
+        continue;
+      }
+
+      if (line.compare(0, 5, "plot ") == 0) {
+        plot(symbolTable, line.substr(5));
+        continue;
+      }
+
+      if (line.compare(0, 6, "trace ") == 0) {
+        writeTrace(profiler, line.substr(6));
+        continue;
+      }
+
+      if (line.compare(0, 7, "digits ") == 0) {
+        digits = std::strtoul(line.c_str() + 7, nullptr, 10);
+        continue;
+      }
+
+      if (line == "exact on" || line == "exact off") {
+        exact = line == "exact on";
+        continue;
+      }
+
       if (line == "?") {
         printCommands();
         continue;
       }
 
-      Result<std::unique_ptr<Expr>> e = parseExpression(symbolTable, line);
+      Result<std::shared_ptr<const Expr>> e = cache.get(symbolTable, line);
       if (e.error()) {
         std::error_code ec = e.error();
         std::cerr << ec.category().name() << ": " << ec.message() << '\n';
-      } else if (const auto d = dynamic_cast<DefineExpr*>(e->get())) {
-        Number value = d->right()->calculate(symbolTable);
+      } else if (const auto d = dynamic_cast<const DefineExpr*>(e->get())) {
+        Value value = d->right()->evaluate(symbolTable);
         // check NAN
-        if (!std::isnan(std::abs(value))) {
+        if (!value.isNumber() || !std::isnan(std::abs(value.number()))) {
           std::cout << "define " << d->str() << '\n';
           symbolTable.defineConstant(d->symbolName(), value);
         } else {
           std::cout << "undefine " << d->str() << '\n';
           symbolTable.undefine(d->symbolName());
         }
+      } else if (const auto m = dynamic_cast<const DefineMappingExpr*>(e->get())) {
+        std::cout << "define " << m->str() << '\n';
+        symbolTable.defineMapping(m->symbolName(), m->inputs(),
+                                compilePolynomials(m->body()));
+      } else if (exact) {
+        Result<Rational> y = calculateRational(e->get(), symbolTable);
+        if (y.isFailure()) {
+          std::error_code ec = y.error();
+          std::cerr << ec.category().name() << ": " << ec.message() << '\n';
+        } else {
+          std::cout << (*e)->str() << " = " << y->str() << '\n';
+        }
+      } else if (digits) {
+        Result<Real> y = calculateReal(e->get(), symbolTable,
+                                       Real::bitsForDigits(digits) + Real::GuardBits);
+        if (y.isFailure()) {
+          std::error_code ec = y.error();
+          std::cerr << ec.category().name() << ": " << ec.message() << '\n';
+        } else {
+          std::cout << (*e)->str() << " = " << y->toString(digits) << '\n';
+        }
       } else {
-        std::cout << (*e)->str() << " = " << simple((*e)->calculate(symbolTable)) << '\n';
+        std::cout << (*e)->str() << " = " << str((*e)->evaluate(symbolTable)) << '\n';
       }
     }
 
@@ -0,0 +1,67 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Framing of the `cm --serve` protocol.
+ *
+ * Requests and responses are frames of a 4-byte little-endian payload
+ * length followed by that many bytes of UTF-8 text. A request holds one
+ * statement per line, as typed into `cm`, and its response one line per
+ * statement, in order: the value, `define ...` or `undefine ...` for
+ * definitions, or `error: CATEGORY: MESSAGE`. Clients may send further
+ * requests before the responses to earlier ones arrived; those of one
+ * connection are answered in the order they were sent.
+ */
+namespace protocol {
+
+constexpr size_t HeaderSize = 4;
+constexpr size_t MaxPayloadSize = 16 << 20;
+
+enum class Frame {
+  Incomplete,
+  Complete,
+  TooLarge,
+};
+
+inline void appendFrame(std::string* out, const char* payload, size_t size) {
+  const uint32_t n = static_cast<uint32_t>(size);
+  const char header[HeaderSize] = {char(n), char(n >> 8), char(n >> 16), char(n >> 24)};
+  out->append(header, HeaderSize);
+  out->append(payload, size);
+}
+
+inline void appendFrame(std::string* out, const std::string& payload) {
+  appendFrame(out, payload.data(), payload.size());
+}
+
+/**
+ * Decodes the frame at @p *offset of @p buffer into @p payload and advances
+ * @p *offset past it, if it has arrived completely.
+ */
+inline Frame takeFrame(const std::string& buffer, size_t* offset, std::string* payload) {
+  if (buffer.size() - *offset < HeaderSize)
+    return Frame::Incomplete;
+
+  const auto* p = reinterpret_cast<const unsigned char*>(buffer.data() + *offset);
+  const size_t n = p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24;
+  if (n > MaxPayloadSize)
+    return Frame::TooLarge;
+
+  if (buffer.size() - *offset - HeaderSize < n)
+    return Frame::Incomplete;
+
+  payload->assign(buffer, *offset + HeaderSize, n);
+  *offset += HeaderSize + n;
+  return Frame::Complete;
+}
+
+}  // namespace protocol
@@ -0,0 +1,516 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include "server.h"
+#include "protocol.h"
+#include <cmath/polynomial.h>
+#include <cmath/tuple.h>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace cmath;
+
+namespace {
+
+constexpr size_t ReadSize = 64 * 1024;
+constexpr size_t MaxInFlight = 1024;         // requests per connection
+constexpr size_t MaxOutput = 4 * 1024 * 1024;  // unsent bytes per connection
+
+void logError(const char* what) {
+  std::cerr << what << ": " << std::strerror(errno) << '\n';
+}
+
+void appendError(std::string* out, std::error_code ec) {
+  *out += "error: ";
+  *out += ec.category().name();
+  *out += ": ";
+  *out += ec.message();
+}
+
+}  // namespace
+
+struct Server::Connection {
+  explicit Connection(int fd) : fd(fd) {}
+
+  const int fd;
+
+  // owned by the loop
+  std::string input;
+  size_t inputOffset = 0;
+  std::string output;
+  size_t outputOffset = 0;
+  size_t inFlight = 0;  // requests read but not answered into output
+  uint32_t events = 0;  // as registered with epoll
+  bool readClosed = false;
+
+  // shared with the workers
+  std::atomic<bool> closed{false};
+  std::mutex lock;
+  std::deque<std::string> requests;
+  std::string responses;  // framed
+  size_t answered = 0;    // frames in responses
+  bool scheduled = false;  // queued or being served by a worker
+};
+
+Server::Server(const std::string& path, const Options& options)
+    : path_(path),
+      options_(options),
+      listener_(-1),
+      epoll_(-1),
+      wakeup_(-1),
+      signals_(-1),
+      cache_(options.cacheCapacity),
+      stopping_(false) {}
+
+Server::~Server() {
+  for (int fd : {listener_, epoll_, wakeup_, signals_})
+    if (fd >= 0)
+      ::close(fd);
+}
+
+int Server::run() {
+  // workers inherit the mask, leaving the signals to the loop's signalfd
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+
+  signals_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  wakeup_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  epoll_ = epoll_create1(EPOLL_CLOEXEC);
+  if (signals_ < 0 || wakeup_ < 0 || epoll_ < 0) {
+    logError("cm");
+    return 1;
+  }
+
+  if (!listen())
+    return 1;
+
+  for (int fd : {listener_, wakeup_, signals_}) {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &ev);
+  }
+
+  unsigned n = options_.workers ? options_.workers : std::thread::hardware_concurrency();
+  for (unsigned i = 0; i < std::max(n, 1u); ++i)
+    workers_.emplace_back(&Server::work, this);
+
+  std::cout << "Serving on " << path_ << " with " << workers_.size() << " workers.\n"
+            << std::flush;
+
+  epoll_event events[64];
+  bool running = true;
+  while (running) {
+    const int count = epoll_wait(epoll_, events, 64, -1);
+    if (count < 0 && errno != EINTR) {
+      logError("epoll_wait");
+      break;
+    }
+
+    for (int i = 0; i < count; ++i) {
+      const int fd = events[i].data.fd;
+      if (fd == listener_) {
+        accept();
+      } else if (fd == wakeup_) {
+        collect();
+      } else if (fd == signals_) {
+        running = false;
+      } else if (auto k = connections_.find(fd); k != connections_.end()) {
+        ConnectionPtr c = k->second;
+        if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+          // the peer is gone for good, so nothing could be answered anyway
+          close(c);
+          continue;
+        }
+        if (events[i].events & EPOLLOUT)
+          send(c);
+        if (!c->closed && (events[i].events & EPOLLIN))
+          receive(c);
+      }
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> _l(queueLock_);
+    stopping_ = true;
+  }
+  queueChanged_.notify_all();
+  for (std::thread& t : workers_)
+    t.join();
+  workers_.clear();
+
+  while (!connections_.empty())
+    close(connections_.begin()->second);
+
+  ::unlink(path_.c_str());
+  std::cout << "Bye." << std::endl;
+  return 0;
+}
+
+// {{{ loop
+bool Server::listen() {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (path_.size() >= sizeof(addr.sun_path)) {
+    std::cerr << path_ << ": socket path too long\n";
+    return false;
+  }
+  std::memcpy(addr.sun_path, path_.c_str(), path_.size() + 1);
+
+  listener_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listener_ < 0) {
+    logError("socket");
+    return false;
+  }
+
+  ::unlink(path_.c_str());  // left behind by a previous server
+  if (bind(listener_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+      ::listen(listener_, SOMAXCONN) < 0) {
+    logError(path_.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+void Server::accept() {
+  for (;;) {
+    const int fd = accept4(listener_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        logError("accept");
+      return;
+    }
+
+    auto c = std::make_shared<Connection>(fd);
+    c->events = EPOLLIN;
+    epoll_event ev{};
+    ev.events = c->events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      logError("epoll_ctl");
+      ::close(fd);
+      continue;
+    }
+    connections_[fd] = std::move(c);
+  }
+}
+
+void Server::receive(const ConnectionPtr& c) {
+  // one read per wakeup keeps a busy client from starving the others;
+  // epoll is level-triggered and reports the rest right away
+  char buf[ReadSize];
+  const ssize_t n = ::read(c->fd, buf, sizeof(buf));
+  if (n > 0) {
+    c->input.append(buf, n);
+  } else if (n == 0) {
+    c->readClosed = true;
+  } else if (n < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      close(c);
+    return;
+  }
+
+  std::deque<std::string> requests;
+  std::string payload;
+  for (;;) {
+    const protocol::Frame f = protocol::takeFrame(c->input, &c->inputOffset, &payload);
+    if (f == protocol::Frame::Incomplete)
+      break;
+    if (f == protocol::Frame::TooLarge) {
+      close(c);
+      return;
+    }
+    requests.emplace_back(std::move(payload));
+  }
+
+  if (c->inputOffset == c->input.size()) {
+    c->input.clear();
+    c->inputOffset = 0;
+  } else if (c->inputOffset >= ReadSize) {
+    c->input.erase(0, c->inputOffset);
+    c->inputOffset = 0;
+  }
+
+  if (!requests.empty()) {
+    c->inFlight += requests.size();
+    bool idle;
+    {
+      std::lock_guard<std::mutex> _l(c->lock);
+      for (std::string& r : requests)
+        c->requests.emplace_back(std::move(r));
+      idle = !c->scheduled;
+      c->scheduled = true;
+    }
+    if (idle)
+      schedule(c);
+  }
+
+  watch(c);
+}
+
+void Server::send(const ConnectionPtr& c) {
+  while (c->outputOffset < c->output.size()) {
+    const ssize_t n = ::send(c->fd, c->output.data() + c->outputOffset,
+                             c->output.size() - c->outputOffset, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        close(c);
+        return;
+      }
+      break;
+    }
+    c->outputOffset += n;
+  }
+
+  if (c->outputOffset == c->output.size()) {
+    c->output.clear();
+    c->outputOffset = 0;
+  }
+
+  watch(c);
+}
+
+// moves the responses of the workers into the output of their connections
+void Server::collect() {
+  uint64_t value;
+  while (::read(wakeup_, &value, sizeof(value)) > 0) {
+  }
+
+  std::vector<ConnectionPtr> done;
+  {
+    std::lock_guard<std::mutex> _l(doneLock_);
+    done.swap(done_);
+  }
+
+  for (const ConnectionPtr& c : done) {
+    if (c->closed)
+      continue;
+
+    size_t answered;
+    {
+      std::lock_guard<std::mutex> _l(c->lock);
+      if (c->output.empty())
+        c->output.swap(c->responses);
+      else
+        c->output += c->responses;
+      c->responses.clear();
+      answered = c->answered;
+      c->answered = 0;
+    }
+    c->inFlight -= answered;
+    send(c);
+  }
+}
+
+// registers interest in what the connection can make progress with
+void Server::watch(const ConnectionPtr& c) {
+  if (c->closed)
+    return;
+
+  const bool draining = !c->output.empty();
+  if (c->readClosed && !c->inFlight && !draining) {
+    close(c);
+    return;
+  }
+
+  uint32_t events = 0;
+  if (!c->readClosed && c->inFlight < MaxInFlight && c->output.size() < MaxOutput)
+    events |= EPOLLIN;
+  if (draining)
+    events |= EPOLLOUT;
+
+  if (events != c->events) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = c->fd;
+    epoll_ctl(epoll_, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = events;
+  }
+}
+
+void Server::close(const ConnectionPtr& c) {
+  if (c->closed.exchange(true))
+    return;
+
+  epoll_ctl(epoll_, EPOLL_CTL_DEL, c->fd, nullptr);
+  ::close(c->fd);
+  connections_.erase(c->fd);
+}
+// }}}
+
+// {{{ workers
+void Server::schedule(const ConnectionPtr& c) {
+  {
+    std::lock_guard<std::mutex> _l(queueLock_);
+    queue_.push_back(c);
+  }
+  queueChanged_.notify_one();
+}
+
+void Server::work() {
+  for (;;) {
+    ConnectionPtr c;
+    {
+      std::unique_lock<std::mutex> l(queueLock_);
+      queueChanged_.wait(l, [this]() { return stopping_ || !queue_.empty(); });
+      if (stopping_)
+        return;
+      c = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    serve(c);
+  }
+}
+
+// answers the requests that have arrived on the connection so far
+void Server::serve(const ConnectionPtr& c) {
+  std::deque<std::string> requests;
+  {
+    std::lock_guard<std::mutex> _l(c->lock);
+    requests.swap(c->requests);
+  }
+
+  std::string responses;
+  if (!c->closed)
+    for (const std::string& request : requests)
+      protocol::appendFrame(&responses, evaluate(request));
+
+  {
+    std::lock_guard<std::mutex> _l(c->lock);
+    c->responses += responses;
+    c->answered += requests.size();
+  }
+  {
+    std::lock_guard<std::mutex> _l(doneLock_);
+    done_.push_back(c);
+  }
+  const uint64_t one = 1;
+  (void) !::write(wakeup_, &one, sizeof(one));
+
+  // requests that arrived meanwhile go to the back of the queue, so that
+  // a busy client cannot hold on to a worker
+  bool more;
+  {
+    std::lock_guard<std::mutex> _l(c->lock);
+    more = !c->requests.empty() && !c->closed;
+    c->scheduled = more;
+  }
+  if (more)
+    schedule(c);
+}
+
+std::string Server::evaluate(const std::string& request) {
+  std::string out;
+  std::shared_lock<std::shared_mutex> lock(symbolLock_);
+
+  size_t begin = 0;
+  while (begin < request.size()) {
+    size_t end = request.find('\n', begin);
+    if (end == std::string::npos)
+      end = request.size();
+
+    size_t n = end - begin;
+    if (n && request[end - 1] == '\r')
+      n--;
+
+    evaluateLine(request.substr(begin, n), &lock, &out);
+    out += '\n';
+    begin = end + 1;
+  }
+
+  return out;
+}
+
+void Server::evaluateLine(const std::string& line,
+                          std::shared_lock<std::shared_mutex>* lock,
+                          std::string* out) {
+  if (line.empty())
+    return;
+
+  bool definition = false;
+  try {
+    Result<std::shared_ptr<const Expr>> e = cache_.get(symbolTable_, line);
+    if (e.isFailure())
+      appendError(out, e.error());
+    else if (dynamic_cast<const DefineExpr*>(e->get()) ||
+             dynamic_cast<const DefineMappingExpr*>(e->get()))
+      definition = true;
+    else
+      *out += str((*e)->evaluate(symbolTable_));
+  } catch (std::error_code ec) {
+    appendError(out, ec);
+  } catch (const char* msg) {
+    *out += "error: ";
+    *out += msg;
+  } catch (const std::string& msg) {
+    *out += "error: " + msg;
+  }
+
+  if (definition) {
+    // waits for all evaluations to finish, and parses once more in case
+    // another definition changed the table in between
+    lock->unlock();
+    {
+      std::unique_lock<std::shared_mutex> _l(symbolLock_);
+      define(line, out);
+    }
+    lock->lock();
+  }
+}
+
+void Server::define(const std::string& line, std::string* out) {
+  try {
+    Result<std::shared_ptr<const Expr>> e = cache_.get(symbolTable_, line);
+    if (e.isFailure()) {
+      appendError(out, e.error());
+    } else if (const auto d = dynamic_cast<const DefineExpr*>(e->get())) {
+      Value value = d->right()->evaluate(symbolTable_);
+      // check NAN
+      if (!value.isNumber() || !std::isnan(std::abs(value.number()))) {
+        const std::string s = d->str();
+        symbolTable_.defineConstant(d->symbolName(), value);
+        *out += "define " + s;
+      } else {
+        *out += "undefine " + d->str();
+        symbolTable_.undefine(d->symbolName());
+      }
+    } else if (const auto m = dynamic_cast<const DefineMappingExpr*>(e->get())) {
+      const std::string s = m->str();
+      symbolTable_.defineMapping(m->symbolName(), m->inputs(),
+                                 compilePolynomials(m->body()));
+      *out += "define " + s;
+    }
+  } catch (std::error_code ec) {
+    appendError(out, ec);
+  } catch (const char* msg) {
+    *out += "error: ";
+    *out += msg;
+  } catch (const std::string& msg) {
+    *out += "error: " + msg;
+  }
+}
+// }}}
@@ -0,0 +1,93 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <cmath/expr_cache.h>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Evaluates statements for clients of a Unix domain socket, speaking the
+ * protocol of protocol.h.
+ *
+ * All clients share one symbol table and one cache of parsed expressions,
+ * both kept for the lifetime of the server, so that a definition made by
+ * one is seen by all and repeated statements are parsed only once.
+ *
+ * One thread multiplexes all connections with epoll, reading requests and
+ * writing responses without blocking, and hands complete requests to a
+ * pool of workers that evaluate them. A connection is served by at most one
+ * worker at a time, which keeps its requests in order, while different
+ * connections are evaluated in parallel. Workers pass their responses back
+ * through an eventfd that wakes the loop. A connection that has too many
+ * requests in flight or too much output unsent is not read from until it
+ * catches up.
+ */
+class Server {
+ public:
+  struct Options {
+    unsigned workers = 0;  // 0 for one per hardware thread
+    size_t cacheCapacity = 4096;
+  };
+
+  Server(const std::string& path, const Options& options);
+  ~Server();
+
+  /// Serves until SIGINT or SIGTERM; returns the process exit code.
+  int run();
+
+ private:
+  struct Connection;
+  using ConnectionPtr = std::shared_ptr<Connection>;
+
+  bool listen();
+  void accept();
+  void receive(const ConnectionPtr& c);
+  void send(const ConnectionPtr& c);
+  void collect();
+  void watch(const ConnectionPtr& c);
+  void close(const ConnectionPtr& c);
+
+  void schedule(const ConnectionPtr& c);
+  void work();
+  void serve(const ConnectionPtr& c);
+  std::string evaluate(const std::string& request);
+  void evaluateLine(const std::string& line, std::shared_lock<std::shared_mutex>* lock,
+                    std::string* out);
+  void define(const std::string& line, std::string* out);
+
+ private:
+  std::string path_;
+  Options options_;
+  int listener_;
+  int epoll_;
+  int wakeup_;
+  int signals_;
+  std::unordered_map<int, ConnectionPtr> connections_;
+
+  cmath::SymbolTable symbolTable_;
+  std::shared_mutex symbolLock_;  // exclusive for definitions
+  cmath::ExprCache cache_;
+
+  std::mutex queueLock_;
+  std::condition_variable queueChanged_;
+  std::deque<ConnectionPtr> queue_;  // connections with requests to evaluate
+  bool stopping_;
+  std::vector<std::thread> workers_;
+
+  std::mutex doneLock_;
+  std::vector<ConnectionPtr> done_;  // connections with responses to send
+};
@@ -0,0 +1,199 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include "stream.h"
+#include <cmath/polynomial.h>
+#include <cmath/tuple.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <system_error>
+#include <thread>
+
+#include <unistd.h>
+
+using namespace cmath;
+
+namespace {
+
+constexpr size_t ReadSize = 1 << 20;
+constexpr size_t WriteSize = 1 << 20;
+constexpr size_t MaxLines = 1 << 14;  // evaluated at a time
+constexpr size_t MinParallelLines = 256;
+constexpr size_t LinesPerGrab = 32;
+
+void appendError(std::string* out, std::error_code ec) {
+  *out += ec.category().name();
+  *out += ": ";
+  *out += ec.message();
+}
+
+// only definitions have a ':' (":=" or "NAME : ARGS -> BODY")
+bool mayDefine(const std::string& source) {
+  return source.find(':') != std::string::npos;
+}
+
+}  // namespace
+
+StatementStream::StatementStream(const std::string& name, int fd, const Options& options)
+    : name_(name), fd_(fd), options_(options), cache_(4096), failures_(0) {}
+
+int StatementStream::run() {
+  std::string buffer;
+  size_t offset = 0;
+  unsigned lineNo = 0;
+
+  for (;;) {
+    const size_t size = buffer.size();
+    buffer.resize(size + ReadSize);
+    const ssize_t n = ::read(fd_, &buffer[size], ReadSize);
+    if (n < 0 && errno == EINTR) {
+      buffer.resize(size);
+      continue;
+    }
+    buffer.resize(size + std::max<ssize_t>(n, 0));
+    if (n < 0) {
+      errors_ += name_ + ": " + std::strerror(errno) + '\n';
+      failures_++;
+    }
+    const bool eof = n <= 0;
+
+    // split off the complete lines, and at the end the last one too
+    for (;;) {
+      size_t end = buffer.find('\n', offset);
+      if (end == std::string::npos) {
+        if (!eof || offset == buffer.size())
+          break;
+        end = buffer.size();
+      }
+
+      lineNo++;
+      size_t length = end - offset;
+      if (length && buffer[end - 1] == '\r')
+        length--;
+      if (length && buffer[offset] != '#')
+        lines_.push_back(Line{lineNo, buffer.substr(offset, length), {}, {}});
+      offset = std::min(end + 1, buffer.size());
+
+      if (lines_.size() == MaxLines)
+        process();
+    }
+    buffer.erase(0, offset);
+    offset = 0;
+
+    if (eof)
+      break;
+  }
+
+  process();
+  flush(STDOUT_FILENO, &output_);
+
+  return failures_ ? 1 : 0;
+}
+
+void StatementStream::process() {
+  for (size_t begin = 0; begin < lines_.size();) {
+    size_t end = begin;
+    while (end < lines_.size() && !mayDefine(lines_[end].source))
+      end++;
+
+    evaluate(begin, end);
+    if (end < lines_.size())
+      evaluate(&lines_[end++]);
+
+    begin = end;
+  }
+
+  for (const Line& line : lines_)
+    emit(line);
+  lines_.clear();
+
+  // errors follow the output of the lines before them
+  if (!errors_.empty() || output_.size() >= WriteSize)
+    flush(STDOUT_FILENO, &output_);
+  flush(STDERR_FILENO, &errors_);
+}
+
+// evaluates lines [begin, end), which define nothing, on up to jobs threads
+void StatementStream::evaluate(size_t begin, size_t end) {
+  const size_t workers =
+      std::clamp<size_t>((end - begin) / MinParallelLines, 1, options_.jobs);
+
+  // lines differ widely in cost, so the threads take small runs of them in
+  // turn rather than a fixed share each
+  std::atomic<size_t> next(begin);
+  auto work = [&]() {
+    for (;;) {
+      const size_t i = next.fetch_add(LinesPerGrab);
+      if (i >= end)
+        return;
+      for (size_t k = i; k < std::min(i + LinesPerGrab, end); ++k)
+        evaluate(&lines_[k]);
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (size_t i = 1; i < workers; ++i)
+    pool.emplace_back(work);
+  work();
+  for (std::thread& t : pool)
+    t.join();
+}
+
+void StatementStream::evaluate(Line* line) {
+  try {
+    Result<std::shared_ptr<const Expr>> e = cache_.get(symbolTable_, line->source);
+    if (e.isFailure()) {
+      appendError(&line->error, e.error());
+    } else if (const auto d = dynamic_cast<const DefineExpr*>(e->get())) {
+      Value value = d->right()->evaluate(symbolTable_);
+      // check NAN
+      if (!value.isNumber() || !std::isnan(std::abs(value.number()))) {
+        line->output = "define " + d->str();
+        symbolTable_.defineConstant(d->symbolName(), value);
+      } else {
+        line->output = "undefine " + d->str();
+        symbolTable_.undefine(d->symbolName());
+      }
+    } else if (const auto m = dynamic_cast<const DefineMappingExpr*>(e->get())) {
+      line->output = "define " + m->str();
+      symbolTable_.defineMapping(m->symbolName(), m->inputs(),
+                                 compilePolynomials(m->body()));
+    } else {
+      line->output = (*e)->str() + " = " + str((*e)->evaluate(symbolTable_));
+    }
+  } catch (std::error_code ec) {
+    appendError(&line->error, ec);
+  } catch (const char* msg) {
+    line->error = msg;
+  } catch (const std::string& msg) {
+    line->error = msg;
+  }
+}
+
+void StatementStream::emit(const Line& line) {
+  if (!line.error.empty()) {
+    errors_ += name_ + ':' + std::to_string(line.number) + ": " + line.error + '\n';
+    failures_++;
+    return;
+  }
+
+  output_ += line.output;
+  output_ += '\n';
+}
+
+void StatementStream::flush(int fd, std::string* buffer) {
+  for (size_t offset = 0; offset < buffer->size();) {
+    const ssize_t n = ::write(fd, buffer->data() + offset, buffer->size() - offset);
+    if (n < 0 && errno != EINTR)
+      break;
+    offset += std::max<ssize_t>(n, 0);
+  }
+  buffer->clear();
+}
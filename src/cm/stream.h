@@ -0,0 +1,63 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <cmath/expr_cache.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Evaluates the statements of a file or pipe, one per line, and prints
+ * their results the way `cm` does interactively, in the order of the input.
+ *
+ * Input is read and output written in large blocks rather than a line at a
+ * time. Errors go to stderr with the line they occurred on, and the stream
+ * goes on with the next line. Empty lines and lines starting with `#` are
+ * skipped.
+ *
+ * With more than one job, runs of lines between two definitions are
+ * evaluated in parallel; definitions, which the lines after them depend
+ * on, are made one at a time in between.
+ */
+class StatementStream {
+ public:
+  struct Options {
+    unsigned jobs = 1;
+  };
+
+  StatementStream(const std::string& name, int fd, const Options& options);
+
+  /// Returns the process exit code, 1 if any line failed.
+  int run();
+
+ private:
+  struct Line {
+    unsigned number;
+    std::string source;
+    std::string output;
+    std::string error;
+  };
+
+  void process();
+  void evaluate(size_t begin, size_t end);
+  void evaluate(Line* line);
+  void emit(const Line& line);
+  void flush(int fd, std::string* buffer);
+
+ private:
+  std::string name_;
+  int fd_;
+  Options options_;
+  cmath::SymbolTable symbolTable_;
+  cmath::ExprCache cache_;
+  std::vector<Line> lines_;  // read but not yet evaluated
+  std::string output_;
+  std::string errors_;
+  size_t failures_;
+};
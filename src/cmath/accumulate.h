@@ -0,0 +1,104 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <cmath>
+#include <cstddef>
+
+// Reductions of many operands, as SumExpr and ProductExpr and the engines
+// compiling them evaluate them. Operand i goes to lane i mod Lanes, so
+// that consecutive additions (multiplications) do not wait for each other,
+// and the lanes are combined at the end.
+
+namespace cmath {
+
+/**
+ * Sum with Neumaier's compensation per lane and component, which keeps the
+ * error near one rounding of the exact sum, however many terms there are.
+ * Non-finite sums are returned uncompensated.
+ */
+class SumAccumulator {
+ public:
+  static constexpr size_t Lanes = 4;
+
+  void add(Number x) {
+    const size_t lane = count_ % Lanes;
+    if (count_++ < Lanes) {
+      // as the first operand, keeping signed zeros as they are
+      re_[lane] = Lane{x.real(), 0};
+      im_[lane] = Lane{x.imag(), 0};
+    } else {
+      re_[lane].add(x.real());
+      im_[lane].add(x.imag());
+    }
+  }
+
+  void subtract(Number x) { add(-x); }
+
+  Number result() const { return Number(combine(re_), combine(im_)); }
+
+ private:
+  struct Lane {
+    double sum;
+    double compensation;
+
+    void add(double x) {
+      const double t = sum + x;
+      compensation += std::fabs(sum) >= std::fabs(x) ? (sum - t) + x : (x - t) + sum;
+      sum = t;
+    }
+  };
+
+  double combine(const Lane* lanes) const {
+    Lane total = lanes[0];
+    for (size_t i = 1; i < Lanes && i < count_; ++i) {
+      total.add(lanes[i].sum);
+      total.compensation += lanes[i].compensation;
+    }
+
+    // a zero compensation must not turn -0 into +0
+    if (!std::isfinite(total.sum) || total.compensation == 0)
+      return total.sum;
+
+    return total.sum + total.compensation;
+  }
+
+  size_t count_ = 0;
+  Lane re_[Lanes] = {};
+  Lane im_[Lanes] = {};
+};
+
+/**
+ * Product, with the lanes multiplied pairwise at the end.
+ */
+class ProductAccumulator {
+ public:
+  static constexpr size_t Lanes = 4;
+
+  void multiply(Number x) {
+    const size_t lane = count_ % Lanes;
+    if (count_++ < Lanes)
+      lanes_[lane] = x;
+    else
+      lanes_[lane] *= x;
+  }
+
+  Number result() const {
+    const Number a = count_ > 1 ? lanes_[0] * lanes_[1] : lanes_[0];
+    if (count_ < 3)
+      return a;
+
+    return a * (count_ > 3 ? lanes_[2] * lanes_[3] : lanes_[2]);
+  }
+
+ private:
+  size_t count_ = 0;
+  Number lanes_[Lanes];
+};
+
+}  // namespace cmath
@@ -0,0 +1,477 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/accumulate.h>
+#include <cmath/builtins.h>
+#include <cmath/integrate.h>
+#include <cmath/roots.h>
+#include <cmath/simd.h>
+#include <cmath/solve.h>
+#include <cmath/special.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace cmath {
+
+// {{{ BuiltinMappingDef
+Number BuiltinMappingDef::call(const SymbolTable& /*t*/, const NumberList& input) const {
+  if (input.size() != 1)
+    return Number(std::nan(""));
+
+  return impl_(input[0]);
+}
+
+Value BuiltinMappingDef::evaluate(const SymbolTable& t, const ValueList& inputs) const {
+  if (inputs.size() != 1 || inputs[0].isNumber())
+    return MappingDef::evaluate(t, inputs);
+
+  if (!arrayImpl_)
+    return mapElements(impl_, inputs[0]);
+
+  if (inputs[0].isMatrix()) {
+    const Matrix& x = inputs[0].matrix();
+    Matrix y(x.rows(), x.columns());
+    arrayImpl_(x.size(), x.real(), x.imag(), y.real(), y.imag());
+    return Value(std::move(y));
+  }
+
+  const Tuple& x = inputs[0].tuple();
+  Tuple y(x.size());
+  arrayImpl_(x.size(), x.real(), x.imag(), y.real(), y.imag());
+  return Value(std::move(y));
+}
+
+std::string BuiltinMappingDef::str() const {
+  return "(x) -> builtin";
+}
+// }}}
+// {{{ BuiltinMapping2Def
+Number BuiltinMapping2Def::call(const SymbolTable& /*t*/, const NumberList& input) const {
+  if (input.size() != 2)
+    return Number(std::nan(""));
+
+  return impl_(input[0], input[1]);
+}
+
+std::string BuiltinMapping2Def::str() const {
+  return "(x1, x2) -> builtin";
+}
+// }}}
+// {{{ BuiltinTupleDef
+Number BuiltinTupleDef::call(const SymbolTable& /*t*/, const NumberList& inputs) const {
+  return impl_(ValueList(inputs.begin(), inputs.end())).number();
+}
+
+Value BuiltinTupleDef::evaluate(const SymbolTable& /*t*/, const ValueList& inputs) const {
+  return impl_(inputs);
+}
+
+std::string BuiltinTupleDef::str() const {
+  return "(x, ...) -> builtin";
+}
+// }}}
+// {{{ BuiltinFormDef
+Value BuiltinFormDef::apply(const SymbolTable& t, const ParamList& inputs) const {
+  return impl_(t, inputs);
+}
+
+Number BuiltinFormDef::call(const SymbolTable& /*t*/,
+                            const NumberList& /*inputs*/) const {
+  return std::nan("");
+}
+
+std::string BuiltinFormDef::str() const {
+  return "(expr, ...) -> builtin";
+}
+// }}}
+// {{{ standard library
+namespace {
+
+constexpr double Pi = 3.14159265358979323846;
+constexpr double E = 2.71828182845904523536;
+
+const ConstantDef iDef{Number(0, 1)};
+const ConstantDef eDef{Number(E)};
+const ConstantDef piDef{Number(Pi)};
+const ConstantDef nanDef{Number(std::numeric_limits<double>::quiet_NaN())};
+const ConstantDef infDef{Number(std::numeric_limits<double>::infinity())};
+
+Number re(Number x) { return x.real(); }
+Number im(Number x) { return x.imag(); }
+Number arg(Number x) { return std::arg(x); }
+Number conjugate(Number x) { return std::conj(x); }
+Number sin(Number x) { return std::sin(x); }
+Number cos(Number x) { return std::cos(x); }
+Number tan(Number x) { return std::tan(x); }
+Number exp(Number x) { return std::exp(x); }
+Number sqrt(Number x) { return std::sqrt(x); }
+Number log(Number x) { return std::log(x); }
+Number polar(Number a, Number b) { return std::polar(a.real(), b.real()); }
+
+void reArray(size_t n, const double* re, const double* /*im*/, double* outRe, double* outIm) {
+  std::copy(re, re + n, outRe);
+  std::fill(outIm, outIm + n, 0.0);
+}
+
+void imArray(size_t n, const double* /*re*/, const double* im, double* outRe, double* outIm) {
+  std::copy(im, im + n, outRe);
+  std::fill(outIm, outIm + n, 0.0);
+}
+
+void conjugateArray(size_t n, const double* re, const double* im, double* outRe,
+                    double* outIm) {
+  for (size_t k = 0; k < n; ++k) {
+    outRe[k] = re[k];
+    outIm[k] = -im[k];
+  }
+}
+
+void argArray(size_t n, const double* re, const double* im, double* outRe, double* outIm) {
+  simd::arg(n, re, im, outRe);
+  std::fill(outIm, outIm + n, 0.0);
+}
+
+// no more elements than fit into 2 GiB
+constexpr double MaxTupleSize = 1 << 27;
+
+// linspace(a, b, n): n equally spaced numbers from a to b
+Value linspace(const ValueList& inputs) {
+  if (inputs.size() != 3 || inputs[0].isTuple() || inputs[1].isTuple() ||
+      inputs[2].isTuple())
+    return Number(std::nan(""));
+
+  const Number a = inputs[0].number();
+  const Number b = inputs[1].number();
+  const Number n = inputs[2].number();
+  if (n.imag() || !(n.real() >= 1 && n.real() <= MaxTupleSize) ||
+      n.real() != std::floor(n.real()))
+    return Number(std::nan(""));
+
+  const size_t count = static_cast<size_t>(n.real());
+  Tuple result(count);
+  const Number step = count > 1 ? (b - a) / static_cast<double>(count - 1) : Number();
+  for (size_t k = 0; k + 1 < count; ++k)
+    result.set(k, a + static_cast<double>(k) * step);
+  result.set(count - 1, count > 1 ? b : a);
+  return Value(std::move(result));
+}
+
+// size(v): the number of elements, 1 for a number
+Value size(const ValueList& inputs) {
+  if (inputs.size() != 1)
+    return Number(std::nan(""));
+
+  if (inputs[0].isTuple())
+    return Number(inputs[0].tuple().size());
+  if (inputs[0].isMatrix())
+    return Number(inputs[0].matrix().size());
+  return Number(1);
+}
+
+// dot(u, v): the sum of the products of the elements, without conjugation
+Value dot(const ValueList& inputs) {
+  size_t n = 0;
+  if (inputs.size() != 2 || !broadcastSize(inputs, &n))
+    return Number(std::nan(""));
+
+  SumAccumulator sum;
+  for (size_t k = 0; k < n; ++k)
+    sum.add(element(inputs[0], k) * element(inputs[1], k));
+  return sum.result();
+}
+
+// norm(v): the Euclidean norm, sqrt(|v1|^2 + |v2|^2 + ...), of a matrix's
+// elements the Frobenius norm
+Value norm(const ValueList& inputs) {
+  if (inputs.size() != 1)
+    return Number(std::nan(""));
+
+  if (inputs[0].isNumber())
+    return Number(std::abs(inputs[0].number()));
+
+  const bool tuple = inputs[0].isTuple();
+  const size_t n = tuple ? inputs[0].tuple().size() : inputs[0].matrix().size();
+  const double* re = tuple ? inputs[0].tuple().real() : inputs[0].matrix().real();
+  const double* im = tuple ? inputs[0].tuple().imag() : inputs[0].matrix().imag();
+  SumAccumulator sum;
+  for (size_t k = 0; k < n; ++k)
+    sum.add(re[k] * re[k] + im[k] * im[k]);
+  return Number(std::sqrt(sum.result().real()));
+}
+
+// identity(n): the n x n identity matrix
+Value identity(const ValueList& inputs) {
+  if (inputs.size() != 1 || !inputs[0].isNumber())
+    return Number(std::nan(""));
+
+  const Number n = inputs[0].number();
+  if (n.imag() || !(n.real() >= 1 && n.real() * n.real() <= MaxTupleSize) ||
+      n.real() != std::floor(n.real()))
+    return Number(std::nan(""));
+
+  return Value(Matrix::identity(static_cast<size_t>(n.real())));
+}
+
+// transpose(m): the transpose of a matrix, a tuple or number as it is
+Value transpose(const ValueList& inputs) {
+  if (inputs.size() != 1)
+    return Number(std::nan(""));
+
+  if (!inputs[0].isMatrix())
+    return inputs[0];
+
+  return Value(inputs[0].matrix().transpose());
+}
+
+// inverse(m): the inverse of a square matrix
+Value inverse(const ValueList& inputs) {
+  if (inputs.size() != 1 || !inputs[0].isMatrix())
+    return Number(std::nan(""));
+
+  Result<Matrix> inverse = inputs[0].matrix().inverse();
+  return inverse ? Value(std::move(*inverse)) : Number(std::nan(""));
+}
+
+// det(m): the determinant of a square matrix
+Value det(const ValueList& inputs) {
+  if (inputs.size() != 1 || !inputs[0].isMatrix())
+    return Number(std::nan(""));
+
+  Result<Number> d = inputs[0].matrix().determinant();
+  return d ? *d : Number(std::nan(""));
+}
+
+// linsolve(a, b): the solution x of a x = b, for a square matrix a and a
+// tuple or matrix b
+Value linsolve(const ValueList& inputs) {
+  if (inputs.size() != 2 || !inputs[0].isMatrix() || inputs[1].isNumber())
+    return Number(std::nan(""));
+
+  if (inputs[1].isMatrix()) {
+    Result<Matrix> x = Matrix::solve(inputs[0].matrix(), inputs[1].matrix());
+    return x ? Value(std::move(*x)) : Number(std::nan(""));
+  }
+
+  const Tuple& b = inputs[1].tuple();
+  Matrix column(b.size(), 1);
+  std::copy(b.real(), b.real() + b.size(), column.real());
+  std::copy(b.imag(), b.imag() + b.size(), column.imag());
+  Result<Matrix> x = Matrix::solve(inputs[0].matrix(), column);
+  if (!x)
+    return Number(std::nan(""));
+
+  Tuple result(b.size());
+  std::copy(x->real(), x->real() + b.size(), result.real());
+  std::copy(x->imag(), x->imag() + b.size(), result.imag());
+  return Value(std::move(result));
+}
+
+// root(p, k): the k-th root of the polynomial p in its one free symbol,
+// counted from 1 by ascending real, then imaginary part
+Value root(const SymbolTable& t, const FormDef::ParamList& inputs) {
+  if (inputs.size() != 2)
+    return Number(std::nan(""));
+
+  const Number k = inputs[1]->calculate(t);
+  Result<std::vector<Number>> roots = RootFinder::solve(inputs[0].get(), t);
+  if (roots.isFailure() || k.imag() || !(k.real() >= 1 && k.real() <= roots->size()) ||
+      k.real() != std::floor(k.real()))
+    return Number(std::nan(""));
+
+  return (*roots)[static_cast<size_t>(k.real()) - 1];
+}
+
+// roots(p): all roots of the polynomial p in its one free symbol, as a
+// tuple, by ascending real, then imaginary part
+Value roots(const SymbolTable& t, const FormDef::ParamList& inputs) {
+  if (inputs.size() != 1)
+    return Number(std::nan(""));
+
+  Result<std::vector<Number>> roots = RootFinder::solve(inputs[0].get(), t);
+  if (roots.isFailure() || roots->empty())
+    return Number(std::nan(""));
+
+  Tuple result(roots->size());
+  for (size_t k = 0; k < roots->size(); ++k)
+    result.set(k, (*roots)[k]);
+  return Value(std::move(result));
+}
+
+// integrate(f, a, b): the integral of f over its one free symbol, along the
+// line from a to b
+Value integrate(const SymbolTable& t, const FormDef::ParamList& inputs) {
+  if (inputs.size() != 3)
+    return Number(std::nan(""));
+
+  Result<Number> y = Integrator::integrate(inputs[0].get(), inputs[1]->calculate(t),
+                                           inputs[2]->calculate(t), t);
+  return y.isSuccess() ? *y : Number(std::nan(""));
+}
+
+// solve(eq1, ..., eqn, x1, ..., xn): the value of x1 in the solution of the
+// equations for the variables x1 to xn
+Value solve(const SymbolTable& t, const FormDef::ParamList& inputs) {
+  const size_t n = inputs.size() / 2;
+  if (n == 0 || inputs.size() % 2)
+    return Number(std::nan(""));
+
+  std::vector<const Expr*> equations;
+  std::vector<Symbol> variables;
+  for (size_t i = 0; i < n; ++i) {
+    auto x = dynamic_cast<const SymbolExpr*>(inputs[n + i].get());
+    if (!x)
+      return Number(std::nan(""));
+    equations.push_back(inputs[i].get());
+    variables.push_back(x->symbolName());
+  }
+
+  Result<std::vector<Number>> y =
+      Solver::solve(equations, variables, t, Solver::Options());
+  return y.isSuccess() ? (*y)[0] : Number(std::nan(""));
+}
+
+const BuiltinMappingDef reDef{&re, &reArray};
+const BuiltinMappingDef imDef{&im, &imArray};
+const BuiltinMappingDef argDef{&arg, &argArray};
+const BuiltinMappingDef conjDef{&conjugate, &conjugateArray};
+const BuiltinMappingDef sinDef{&sin, &simd::sin};
+const BuiltinMappingDef cosDef{&cos, &simd::cos};
+const BuiltinMappingDef tanDef{&tan, &simd::tan};
+const BuiltinMappingDef expDef{&exp, &simd::exp};
+const BuiltinMappingDef sqrtDef{&sqrt, &simd::sqrt};
+const BuiltinMappingDef logDef{&log, &simd::log};
+const BuiltinMapping2Def polarDef{&polar};
+const BuiltinMappingDef gammaDef{&gamma};
+const BuiltinMappingDef lgammaDef{&logGamma};
+const BuiltinMappingDef digammaDef{&digamma};
+const BuiltinMappingDef erfDef{&erf};
+const BuiltinMappingDef erfcDef{&erfc};
+const BuiltinMapping2Def besseljDef{&besselJ};
+const BuiltinMapping2Def besseliDef{&besselI};
+const BuiltinTupleDef linspaceDef{&linspace};
+const BuiltinTupleDef sizeDef{&size};
+const BuiltinTupleDef dotDef{&dot};
+const BuiltinTupleDef normDef{&norm};
+const BuiltinTupleDef identityDef{&identity};
+const BuiltinTupleDef transposeDef{&transpose};
+const BuiltinTupleDef inverseDef{&inverse};
+const BuiltinTupleDef detDef{&det};
+const BuiltinTupleDef linsolveDef{&linsolve};
+const BuiltinFormDef rootDef{&root};
+const BuiltinFormDef rootsDef{&roots};
+const BuiltinFormDef integrateDef{&integrate};
+const BuiltinFormDef solveDef{&solve};
+
+constexpr BuiltinSymbol builtins[] = {
+    {"i", &iDef},
+    {"e", &eDef},
+    {"pi", &piDef},
+    {u8"π", &piDef},
+    {"nan", &nanDef},
+    {"inf", &infDef},
+    {"Re", &reDef},
+    {"Im", &imDef},
+    {"arg", &argDef},
+    {"conj", &conjDef},
+    {"sin", &sinDef},
+    {"cos", &cosDef},
+    {"tan", &tanDef},
+    {"exp", &expDef},
+    {"sqrt", &sqrtDef},
+    {"log", &logDef},
+    {"polar", &polarDef},
+    {"gamma", &gammaDef},
+    {"lgamma", &lgammaDef},
+    {"digamma", &digammaDef},
+    {"erf", &erfDef},
+    {"erfc", &erfcDef},
+    {"besselj", &besseljDef},
+    {"besseli", &besseliDef},
+    {"linspace", &linspaceDef},
+    {"size", &sizeDef},
+    {"dot", &dotDef},
+    {"norm", &normDef},
+    {"identity", &identityDef},
+    {"transpose", &transposeDef},
+    {"inverse", &inverseDef},
+    {"det", &detDef},
+    {"linsolve", &linsolveDef},
+    {"root", &rootDef},
+    {"roots", &rootsDef},
+    {"integrate", &integrateDef},
+    {"solve", &solveDef},
+};
+
+constexpr size_t BuiltinCount = sizeof(builtins) / sizeof(*builtins);
+constexpr size_t SlotCount = 128;  // power of two, >= BuiltinCount
+constexpr uint8_t EmptySlot = 0xFF;
+
+static_assert(BuiltinCount <= SlotCount, "Builtin hash table too small.");
+
+constexpr uint32_t hash(std::string_view s, uint32_t seed) {
+  uint32_t h = 2166136261u ^ seed;
+  for (char ch : s) {
+    h ^= static_cast<unsigned char>(ch);
+    h *= 16777619u;
+  }
+  return h ^ (h >> 15);
+}
+
+constexpr bool isPerfect(uint32_t seed) {
+  bool used[SlotCount] = {};
+  for (const BuiltinSymbol& b : builtins) {
+    uint32_t slot = hash(b.name, seed) & (SlotCount - 1);
+    if (used[slot])
+      return false;
+    used[slot] = true;
+  }
+  return true;
+}
+
+constexpr uint32_t findSeed() {
+  uint32_t seed = 0;
+  while (!isPerfect(seed))
+    ++seed;
+  return seed;
+}
+
+constexpr uint32_t Seed = findSeed();
+
+constexpr std::array<uint8_t, SlotCount> makeSlots() {
+  std::array<uint8_t, SlotCount> slots{};
+  for (size_t i = 0; i < SlotCount; ++i)
+    slots[i] = EmptySlot;
+  for (size_t i = 0; i < BuiltinCount; ++i)
+    slots[hash(builtins[i].name, Seed) & (SlotCount - 1)] = static_cast<uint8_t>(i);
+  return slots;
+}
+
+constexpr std::array<uint8_t, SlotCount> slots = makeSlots();
+
+}  // namespace
+
+const Def* lookupBuiltin(std::string_view name) noexcept {
+  uint8_t i = slots[hash(name, Seed) & (SlotCount - 1)];
+  if (i != EmptySlot && builtins[i].name == name)
+    return builtins[i].def;
+
+  return nullptr;
+}
+
+size_t builtinCount() noexcept {
+  return BuiltinCount;
+}
+
+const BuiltinSymbol& builtin(size_t i) noexcept {
+  return builtins[i];
+}
+// }}}
+
+}  // namespace cmath
@@ -0,0 +1,122 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <cstddef>
+#include <string_view>
+
+namespace cmath {
+
+/**
+ * Single-argument builtin mapping, calling a plain function pointer.
+ */
+class BuiltinMappingDef : public MappingDef {
+ public:
+  using Impl = Number (*)(Number);
+
+  /// The same over arrays of real and imaginary parts, as in cmath/simd.h.
+  using ArrayImpl = void (*)(size_t, const double*, const double*, double*, double*);
+
+  constexpr explicit BuiltinMappingDef(Impl impl, ArrayImpl arrayImpl = nullptr)
+      : impl_(impl), arrayImpl_(arrayImpl) {}
+
+  Impl impl() const noexcept { return impl_; }
+
+  Number call(const SymbolTable& t, const NumberList& inputs) const override;
+
+  /// Maps a tuple in one call of the array function, if there is one.
+  Value evaluate(const SymbolTable& t, const ValueList& inputs) const override;
+
+  std::string str() const override;
+
+ private:
+  Impl impl_;
+  ArrayImpl arrayImpl_;
+};
+
+/**
+ * Two-argument builtin mapping, calling a plain function pointer.
+ */
+class BuiltinMapping2Def : public MappingDef {
+ public:
+  using Impl = Number (*)(Number, Number);
+
+  constexpr explicit BuiltinMapping2Def(Impl impl) : impl_(impl) {}
+
+  Impl impl() const noexcept { return impl_; }
+
+  Number call(const SymbolTable& t, const NumberList& inputs) const override;
+  std::string str() const override;
+
+ private:
+  Impl impl_;
+};
+
+/**
+ * Builtin mapping over whole values, such as the reductions of tuples,
+ * calling a plain function pointer.
+ */
+class BuiltinTupleDef : public MappingDef {
+ public:
+  using Impl = Value (*)(const ValueList&);
+
+  constexpr explicit BuiltinTupleDef(Impl impl) : impl_(impl) {}
+
+  Impl impl() const noexcept { return impl_; }
+
+  /// The number the values of @p inputs map to, or NaN for a tuple.
+  Number call(const SymbolTable& t, const NumberList& inputs) const override;
+
+  Value evaluate(const SymbolTable& t, const ValueList& inputs) const override;
+  std::string str() const override;
+
+ private:
+  Impl impl_;
+};
+
+/**
+ * Builtin form, calling a plain function pointer with the unevaluated
+ * argument expressions.
+ */
+class BuiltinFormDef : public FormDef {
+ public:
+  using Impl = Value (*)(const SymbolTable&, const ParamList&);
+
+  constexpr explicit BuiltinFormDef(Impl impl) : impl_(impl) {}
+
+  Impl impl() const noexcept { return impl_; }
+
+  Value apply(const SymbolTable& t, const ParamList& inputs) const override;
+
+  /// NaN, as a form cannot be applied to values alone.
+  Number call(const SymbolTable& t, const NumberList& inputs) const override;
+
+  std::string str() const override;
+
+ private:
+  Impl impl_;
+};
+
+struct BuiltinSymbol {
+  std::string_view name;
+  const Def* def;
+};
+
+/**
+ * Looks up a symbol of the standard library.
+ *
+ * The builtins live in static storage and are indexed by a perfect hash
+ * computed at compile time, so this is one hash, one probe and one string
+ * comparison. Every SymbolTable falls back to it as its outermost scope.
+ */
+const Def* lookupBuiltin(std::string_view name) noexcept;
+
+size_t builtinCount() noexcept;
+const BuiltinSymbol& builtin(size_t i) noexcept;
+
+}  // namespace cmath
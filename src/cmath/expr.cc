@@ -6,14 +6,114 @@
 // the License at: http://opensource.org/licenses/MIT
 
 #include <assert.h>
+#include <cmath/accumulate.h>
+#include <cmath/builtins.h>
 #include <cmath/expr.h>
+#include <cmath/polynomial.h>
+#include <cmath/series.h>
+#include <cmath/special.h>
+#include <algorithm>
+#include <charconv>
 #include <cmath>
 #include <iostream>
-#include <sstream>
+#include <string_view>
 
 namespace cmath {
 
 // common
+// Shortest digits that read back as @p value. Where to_chars() picks fixed
+// notation for an integral value beyond 2^53, it prints its exact digits,
+// such as 123456789012345683968, so those are taken from scientific notation
+// and padded with zeros instead: 123456789012345680000.
+static void printReal(double value, std::string* out) {
+  char buf[32];
+  auto r = std::to_chars(buf, buf + sizeof(buf), value);
+  const std::string_view plain(buf, r.ptr - buf);
+  if (plain.find_first_of(".e") != std::string_view::npos || std::fabs(value) < 0x1p53) {
+    out->append(plain);
+    return;
+  }
+
+  char sci[32];
+  r = std::to_chars(sci, sci + sizeof(sci), value, std::chars_format::scientific);
+  const std::string_view s(sci, r.ptr - sci);
+  const size_t e = s.find('e');
+  const size_t length = out->size() + plain.size();
+  for (char c : s.substr(0, e))
+    if (c != '.')
+      out->push_back(c);
+  out->resize(length, '0');
+}
+
+// @p n as printNumber() renders it: a number with an infinite part is
+// infinite, whatever its other part is, and one with a NaN part is NaN
+// otherwise
+static Number printable(Number n) {
+  const double re = n.real();
+  const double im = n.imag();
+  if (std::isinf(re) || std::isinf(im))
+    return Number(std::isnan(re) ? 0 : re, std::isnan(im) ? 0 : im);
+
+  if (std::isnan(re) || std::isnan(im))
+    return Number(std::nan(""));
+
+  return n;
+}
+
+void printNumber(Number n, std::string* out) {
+  n = printable(n);
+  if (std::isnan(n.real())) {
+    out->append("nan");
+    return;
+  }
+
+  if (!n.imag()) {
+    printReal(n.real(), out);
+    return;
+  }
+
+  double im = n.imag();
+  if (n.real()) {
+    printReal(n.real(), out);
+    if (std::signbit(im)) {
+      out->append(" - ");
+      im = -im;
+    } else {
+      out->append(" + ");
+    }
+  }
+
+  // infinities have no literal to take the imaginary suffix
+  if (std::isinf(im)) {
+    printReal(im, out);
+    out->append(" * i");
+    return;
+  }
+
+  if (im == -1)
+    out->push_back('-');
+  else if (im != 1)
+    printReal(im, out);
+
+  out->push_back('i');
+}
+
+std::string str(Number n) {
+  std::string s;
+  printNumber(n, &s);
+  return s;
+}
+
+static void printOperand(const Expr* e, bool parens, std::string* out) {
+  if (parens) {
+    out->push_back('(');
+    e->print(out);
+    out->push_back(')');
+  } else {
+    e->print(out);
+  }
+}
+
 std::ostream& operator<<(std::ostream& os, const Expr* expr) {
   return os << expr->str();
 }
@@ -22,40 +122,111 @@ std::ostream& operator<<(std::ostream& os, const Expr& expr) {
   return os << expr.str();
 }
 
+static void collectFreeSymbols(const Expr* e,
+                               const SymbolTable& t,
+                               std::vector<Symbol>* out) {
+  if (auto s = dynamic_cast<const SymbolExpr*>(e)) {
+    if (!dynamic_cast<const ConstantDef*>(t.lookup(s->symbolName())) &&
+        std::find(out->begin(), out->end(), s->symbolName()) == out->end())
+      out->push_back(s->symbolName());
+  } else if (auto p = dynamic_cast<const PolynomialExpr*>(e)) {
+    collectFreeSymbols(p->source(), t, out);
+  } else if (auto u = dynamic_cast<const UnaryExpr*>(e)) {
+    collectFreeSymbols(u->subExpr(), t, out);
+  } else if (auto n = dynamic_cast<const NegExpr*>(e)) {
+    collectFreeSymbols(n->subExpr(), t, out);
+  } else if (auto b = dynamic_cast<const BinaryExpr*>(e)) {
+    collectFreeSymbols(b->left(), t, out);
+    collectFreeSymbols(b->right(), t, out);
+  } else if (auto sum = dynamic_cast<const SumExpr*>(e)) {
+    for (const SumExpr::Term& term : sum->terms())
+      collectFreeSymbols(term.expr.get(), t, out);
+  } else if (auto product = dynamic_cast<const ProductExpr*>(e)) {
+    for (const std::unique_ptr<Expr>& factor : product->factors())
+      collectFreeSymbols(factor.get(), t, out);
+  } else if (auto tuple = dynamic_cast<const TupleExpr*>(e)) {
+    for (const std::unique_ptr<Expr>& element : tuple->elements())
+      collectFreeSymbols(element.get(), t, out);
+  } else if (auto c = dynamic_cast<const CallExpr*>(e)) {
+    for (const std::unique_ptr<Expr>& input : c->inputs())
+      collectFreeSymbols(input.get(), t, out);
+  } else if (auto c = dynamic_cast<const CaseExpr*>(e)) {
+    for (const CaseExpr::CaseMatch& m : c->cases()) {
+      collectFreeSymbols(m.first.get(), t, out);
+      collectFreeSymbols(m.second.get(), t, out);
+    }
+    collectFreeSymbols(c->elseExpr(), t, out);
+  } else if (auto series = dynamic_cast<const SeriesExpr*>(e)) {
+    // the index is bound within the body
+    std::vector<Symbol> body;
+    collectFreeSymbols(series->body(), t, &body);
+    for (const Symbol& symbol : body)
+      if (symbol != series->index() &&
+          std::find(out->begin(), out->end(), symbol) == out->end())
+        out->push_back(symbol);
+    collectFreeSymbols(series->first(), t, out);
+    if (series->last())
+      collectFreeSymbols(series->last(), t, out);
+  }
+}
+
+std::vector<Symbol> freeSymbols(const Expr* e, const SymbolTable& t) {
+  std::vector<Symbol> symbols;
+  collectFreeSymbols(e, t, &symbols);
+  return symbols;
+}
+
 // {{{ Expr
 Expr::Expr(Precedence p) : precedence_(p) {}
+
+std::string Expr::str() const {
+  std::string s;
+  print(&s);
+  return s;
+}
+
+Value Expr::evaluate(const SymbolTable& t) const {
+  return calculate(t);
+}
 // }}}
 // {{{ NumberExpr
-NumberExpr::NumberExpr(Number n) : Expr(Precedence::Primary), literal_(n) {}
+static Precedence precedenceOf(Number n) {
+  n = printable(n);
+  if (n.real() && n.imag())
+    return Precedence::Addition;
 
-std::string NumberExpr::str() const {
-  std::stringstream s;
+  if (std::isinf(n.imag()))
+    return Precedence::Multiplication;
 
-  if (!literal_.imag()) {
-    s << literal_.real();
-  } else {
-    if (literal_.real()) {
-      s << literal_.real() << " + ";
-    }
-    if (literal_.imag() != 1) {
-      s << literal_.imag();
-    }
-    s << 'i';
+  return Precedence::Primary;
+}
+
+NumberExpr::NumberExpr(Number n, const std::string& literal)
+    : Expr(precedenceOf(n)), number_(n), literal_(literal) {}
+
+void NumberExpr::print(std::string* out) const {
+  if (literal_.empty()) {
+    printNumber(number_, out);
+    return;
   }
-  return s.str();
+
+  // as written, which reads back into the same number
+  out->append(literal_);
+  if (number_.imag())
+    out->push_back('i');
 }
 
 Number NumberExpr::calculate(const SymbolTable& /*t*/) const {
-  return literal_;
+  return number_;
 }
 
 std::unique_ptr<Expr> NumberExpr::clone() const {
-  return std::make_unique<NumberExpr>(literal_);
+  return std::make_unique<NumberExpr>(number_, literal_);
 }
 
 bool NumberExpr::compare(const Expr* other) const {
   if (auto e = dynamic_cast<const NumberExpr*>(other))
-    return e->literal_ == literal_;
+    return e->number_ == number_;
 
   return false;
 }
@@ -64,24 +235,19 @@ bool NumberExpr::compare(const Expr* other) const {
 NegExpr::NegExpr(std::unique_ptr<Expr>&& e)
     : Expr(Precedence::Primary), subExpr_(std::move(e)) {}
 
-std::string NegExpr::str() const {
-  std::stringstream s;
-
-  s << '-';
-
-  if (subExpr_->precedence() < precedence()) {
-    s << '(' << subExpr_->str() << ')';
-  } else {
-    s << subExpr_->str();
-  }
-
-  return s.str();
-}  // namespace cmath
+void NegExpr::print(std::string* out) const {
+  out->push_back('-');
+  printOperand(subExpr_.get(), subExpr_->precedence() < precedence(), out);
+}
 
 Number NegExpr::calculate(const SymbolTable& t) const {
   return -subExpr_->calculate(t);
 }
 
+Value NegExpr::evaluate(const SymbolTable& t) const {
+  return -subExpr_->evaluate(t);
+}
+
 std::unique_ptr<Expr> NegExpr::clone() const {
   return std::make_unique<NegExpr>(subExpr_->clone());
 }
@@ -97,26 +263,34 @@ bool NegExpr::compare(const Expr* other) const {
 SymbolExpr::SymbolExpr(const Symbol& s, const ConstantDef* def)
     : Expr(Precedence::Primary), symbol_(s), def_(def) {}
 
-std::string SymbolExpr::str() const {
-  std::stringstream s;
-  s << symbol_;
-  return s.str();
+void SymbolExpr::print(std::string* out) const {
+  out->append(symbol_);
 }
 
 Number SymbolExpr::calculate(const SymbolTable& t) const {
   if (def_)
     return def_->getNumber();
 
-  if (const Def* d = t.lookup(symbol_)) {
-    if (auto i = dynamic_cast<const ConstantDef*>(d)) {
-      const_cast<SymbolExpr*>(this)->def_ = i;
+  // Unbound symbols (such as mapping parameters) are resolved on every
+  // evaluation, as they may refer to a different scope each time.
+  if (const Def* d = t.lookup(symbol_))
+    if (auto i = dynamic_cast<const ConstantDef*>(d))
       return i->getNumber();
-    }
-  }
 
   return std::nan("");
 }
 
+Value SymbolExpr::evaluate(const SymbolTable& t) const {
+  if (def_)
+    return def_->value();
+
+  if (const Def* d = t.lookup(symbol_))
+    if (auto i = dynamic_cast<const ConstantDef*>(d))
+      return i->value();
+
+  return Number(std::nan(""));
+}
+
 std::unique_ptr<Expr> SymbolExpr::clone() const {
   return std::make_unique<SymbolExpr>(symbol_, def_);
 }
@@ -135,22 +309,23 @@ BinaryExpr::BinaryExpr(Precedence p,
                        std::unique_ptr<Expr>&& right)
     : Expr(p), operator_(op), left_(std::move(left)), right_(std::move(right)) {}
 
-std::string BinaryExpr::str() const {
-  std::stringstream s;
+void BinaryExpr::print(std::string* out) const {
+  // all binary operators are left associative, except for ^
+  const bool rightAssoc = precedence() == Precedence::Power;
 
-  if (left_->precedence() < precedence())
-    s << '(' << *left_ << ')';
-  else
-    s << *left_;
-
-  s << ' ' << operator_ << ' ';
+  printOperand(left_.get(),
+               left_->precedence() < precedence() ||
+                   (rightAssoc && left_->precedence() == precedence()),
+               out);
 
-  if (right_->precedence() < precedence())
-    s << '(' << *right_ << ')';
-  else
-    s << *right_;
+  out->push_back(' ');
+  out->append(operator_);
+  out->push_back(' ');
 
-  return s.str();
+  printOperand(right_.get(),
+               right_->precedence() < precedence() ||
+                   (!rightAssoc && right_->precedence() == precedence()),
+               out);
 }
 // }}}
 // {{{ PlusExpr
@@ -161,6 +336,10 @@ Number PlusExpr::calculate(const SymbolTable& t) const {
   return left_->calculate(t) + right_->calculate(t);
 }
 
+Value PlusExpr::evaluate(const SymbolTable& t) const {
+  return left_->evaluate(t) + right_->evaluate(t);
+}
+
 std::unique_ptr<Expr> PlusExpr::clone() const {
   return std::make_unique<PlusExpr>(left_->clone(), right_->clone());
 }
@@ -180,6 +359,10 @@ Number MinusExpr::calculate(const SymbolTable& t) const {
   return left_->calculate(t) - right_->calculate(t);
 }
 
+Value MinusExpr::evaluate(const SymbolTable& t) const {
+  return left_->evaluate(t) - right_->evaluate(t);
+}
+
 std::unique_ptr<Expr> MinusExpr::clone() const {
   return std::make_unique<MinusExpr>(left_->clone(), right_->clone());
 }
@@ -199,6 +382,10 @@ Number MulExpr::calculate(const SymbolTable& t) const {
   return left_->calculate(t) * right_->calculate(t);
 }
 
+Value MulExpr::evaluate(const SymbolTable& t) const {
+  return left_->evaluate(t) * right_->evaluate(t);
+}
+
 std::unique_ptr<Expr> MulExpr::clone() const {
   return std::make_unique<MulExpr>(left_->clone(), right_->clone());
 }
@@ -212,12 +399,29 @@ bool MulExpr::compare(const Expr* other) const {
 // }}}
 // {{{ DivExpr
 DivExpr::DivExpr(std::unique_ptr<Expr>&& left, std::unique_ptr<Expr>&& right)
-    : BinaryExpr(Precedence::Multiplication, "/", std::move(left), std::move(right)) {}
+    : BinaryExpr(Precedence::Multiplication, "/", std::move(left), std::move(right)),
+      constant_(false),
+      reciprocal_() {
+  if (auto n = dynamic_cast<const NumberExpr*>(right_.get())) {
+    constant_ = true;
+    reciprocal_ = Number(1) / n->getNumber();
+  }
+}
 
 Number DivExpr::calculate(const SymbolTable& t) const {
+  if (constant_)
+    return left_->calculate(t) * reciprocal_;
+
   return left_->calculate(t) / right_->calculate(t);
 }
 
+Value DivExpr::evaluate(const SymbolTable& t) const {
+  if (constant_)
+    return left_->evaluate(t) * Value(reciprocal_);
+
+  return left_->evaluate(t) / right_->evaluate(t);
+}
+
 std::unique_ptr<Expr> DivExpr::clone() const {
   return std::make_unique<DivExpr>(left_->clone(), right_->clone());
 }
@@ -229,33 +433,283 @@ bool DivExpr::compare(const Expr* other) const {
   return false;
 }
 // }}}
-// {{{ FacExpr
-FacExpr::FacExpr(std::unique_ptr<Expr>&& subExpr)
-    : UnaryExpr(Precedence::Primary, std::move(subExpr)) {}
+// {{{ SumExpr
+SumExpr::SumExpr(std::vector<Term>&& terms)
+    : Expr(Precedence::Addition), terms_(std::move(terms)) {
+  assert(terms_.size() >= 2 && !terms_.front().subtract);
+}
 
-std::string FacExpr::str() const {
-  std::stringstream s;
-  if (subExpr()->precedence() < precedence())
-    s << '(' << subExpr()->str() << ')';
-  else
-    s << subExpr()->str();
+void SumExpr::print(std::string* out) const {
+  // read back left associative, as the BinaryExpr chain would be
+  printOperand(terms_[0].expr.get(), terms_[0].expr->precedence() < precedence(), out);
+
+  for (size_t i = 1; i < terms_.size(); ++i) {
+    out->append(terms_[i].subtract ? " - " : " + ");
+    printOperand(terms_[i].expr.get(), terms_[i].expr->precedence() <= precedence(), out);
+  }
+}
+
+Number SumExpr::calculate(const SymbolTable& t) const {
+  SumAccumulator sum;
+  for (const Term& term : terms_) {
+    if (term.subtract)
+      sum.subtract(term.expr->calculate(t));
+    else
+      sum.add(term.expr->calculate(t));
+  }
+  return sum.result();
+}
+
+Value SumExpr::evaluate(const SymbolTable& t) const {
+  // numbers are summed as by calculate(), tuples and matrices one after another
+  SumAccumulator numbers;
+  bool anyNumber = false;
+  Value tuples;
+  bool anyTuple = false;
+
+  for (const Term& term : terms_) {
+    Value x = term.expr->evaluate(t);
+    if (x.isNumber()) {
+      if (term.subtract)
+        numbers.subtract(x.number());
+      else
+        numbers.add(x.number());
+      anyNumber = true;
+    } else if (!anyTuple) {
+      tuples = term.subtract ? -std::move(x) : std::move(x);
+      anyTuple = true;
+    } else {
+      tuples = term.subtract ? std::move(tuples) - std::move(x)
+                             : std::move(tuples) + std::move(x);
+    }
+  }
 
-  s << '!';
+  if (!anyTuple)
+    return numbers.result();
 
-  return s.str();
+  return anyNumber ? std::move(tuples) + Value(numbers.result()) : tuples;
 }
 
-Number FacExpr::calculate(const SymbolTable& t) const {
-  Number y = 1;
-  Number i = 1;
-  Number n = subExpr()->calculate(t);
+std::unique_ptr<Expr> SumExpr::clone() const {
+  std::vector<Term> terms;
+  terms.reserve(terms_.size());
+  for (const Term& term : terms_)
+    terms.emplace_back(Term{term.expr->clone(), term.subtract});
+
+  return std::make_unique<SumExpr>(std::move(terms));
+}
+
+bool SumExpr::compare(const Expr* other) const {
+  auto e = dynamic_cast<const SumExpr*>(other);
+  if (!e || e->terms_.size() != terms_.size())
+    return false;
+
+  for (size_t i = 0; i < terms_.size(); ++i)
+    if (e->terms_[i].subtract != terms_[i].subtract ||
+        !e->terms_[i].expr->compare(terms_[i].expr.get()))
+      return false;
+
+  return true;
+}
+// }}}
+// {{{ ProductExpr
+ProductExpr::ProductExpr(FactorList&& factors)
+    : Expr(Precedence::Multiplication), factors_(std::move(factors)) {
+  assert(factors_.size() >= 2);
+}
+
+void ProductExpr::print(std::string* out) const {
+  printOperand(factors_[0].get(), factors_[0]->precedence() < precedence(), out);
+
+  for (size_t i = 1; i < factors_.size(); ++i) {
+    out->append(" * ");
+    printOperand(factors_[i].get(), factors_[i]->precedence() <= precedence(), out);
+  }
+}
+
+Number ProductExpr::calculate(const SymbolTable& t) const {
+  ProductAccumulator product;
+  for (const std::unique_ptr<Expr>& factor : factors_)
+    product.multiply(factor->calculate(t));
+
+  return product.result();
+}
+
+Value ProductExpr::evaluate(const SymbolTable& t) const {
+  // numbers are multiplied as by calculate(), tuples and matrices one after
+  // another, in order, as matrix products do not commute
+  ProductAccumulator numbers;
+  bool anyNumber = false;
+  Value tuples;
+  bool anyTuple = false;
+
+  for (const std::unique_ptr<Expr>& factor : factors_) {
+    Value x = factor->evaluate(t);
+    if (x.isNumber()) {
+      numbers.multiply(x.number());
+      anyNumber = true;
+    } else {
+      tuples = anyTuple ? std::move(tuples) * std::move(x) : std::move(x);
+      anyTuple = true;
+    }
+  }
+
+  if (!anyTuple)
+    return numbers.result();
+
+  return anyNumber ? std::move(tuples) * Value(numbers.result()) : tuples;
+}
+
+std::unique_ptr<Expr> ProductExpr::clone() const {
+  FactorList factors;
+  factors.reserve(factors_.size());
+  for (const std::unique_ptr<Expr>& factor : factors_)
+    factors.emplace_back(factor->clone());
+
+  return std::make_unique<ProductExpr>(std::move(factors));
+}
+
+bool ProductExpr::compare(const Expr* other) const {
+  auto e = dynamic_cast<const ProductExpr*>(other);
+  if (!e || e->factors_.size() != factors_.size())
+    return false;
+
+  for (size_t i = 0; i < factors_.size(); ++i)
+    if (!e->factors_[i]->compare(factors_[i].get()))
+      return false;
+
+  return true;
+}
+// }}}
+// {{{ TupleExpr
+TupleExpr::TupleExpr(ElementList&& elements)
+    : Expr(Precedence::Primary), elements_(std::move(elements)) {}
+
+void TupleExpr::print(std::string* out) const {
+  out->push_back('(');
+  for (size_t i = 0; i < elements_.size(); ++i) {
+    if (i)
+      out->append(", ");
+    elements_[i]->print(out);
+  }
+  out->push_back(')');
+}
 
-  while (i.real() <= n.real()) {
-    y *= i;
-    i += 1;
+Number TupleExpr::calculate(const SymbolTable& /*t*/) const {
+  return std::nan("");
+}
+
+Value TupleExpr::evaluate(const SymbolTable& t) const {
+  ValueList values;
+  values.reserve(elements_.size());
+  for (const std::unique_ptr<Expr>& element : elements_)
+    values.emplace_back(element->evaluate(t));
+
+  if (std::all_of(values.begin(), values.end(), [](const Value& v) { return v.isNumber(); })) {
+    Tuple tuple(values.size());
+    for (size_t i = 0; i < values.size(); ++i)
+      tuple.set(i, values[i].number());
+    return Value(std::move(tuple));
   }
 
-  return y;
+  // a tuple of tuples of one size is a matrix, with them as its rows
+  if (!std::all_of(values.begin(), values.end(), [&](const Value& v) {
+        return v.isTuple() && v.tuple().size() == values[0].tuple().size();
+      }))
+    return Number(std::nan(""));
+
+  Matrix m(values.size(), values[0].tuple().size());
+  for (size_t i = 0; i < m.rows(); ++i)
+    for (size_t j = 0; j < m.columns(); ++j)
+      m.set(i, j, values[i].tuple()[j]);
+  return Value(std::move(m));
+}
+
+std::unique_ptr<Expr> TupleExpr::clone() const {
+  ElementList elements;
+  elements.reserve(elements_.size());
+  for (const std::unique_ptr<Expr>& element : elements_)
+    elements.emplace_back(element->clone());
+
+  return std::make_unique<TupleExpr>(std::move(elements));
+}
+
+bool TupleExpr::compare(const Expr* other) const {
+  auto e = dynamic_cast<const TupleExpr*>(other);
+  if (!e || e->elements_.size() != elements_.size())
+    return false;
+
+  for (size_t i = 0; i < elements_.size(); ++i)
+    if (!e->elements_[i]->compare(elements_[i].get()))
+      return false;
+
+  return true;
+}
+// }}}
+// {{{ SeriesExpr
+SeriesExpr::SeriesExpr(Kind kind,
+                       std::unique_ptr<Expr>&& body,
+                       const Symbol& index,
+                       std::unique_ptr<Expr>&& first,
+                       std::unique_ptr<Expr>&& last)
+    : Expr(Precedence::Relation),
+      kind_(kind),
+      body_(std::move(body)),
+      index_(index),
+      first_(std::move(first)),
+      last_(std::move(last)) {}
+
+void SeriesExpr::print(std::string* out) const {
+  out->append(kind_ == Kind::Sum ? "sum over " : "product over ");
+  body_->print(out);
+  out->append(" for ");
+  out->append(index_);
+  out->append(" = ");
+  printOperand(first_.get(), first_->precedence() < Precedence::Addition, out);
+  out->append(" to ");
+  if (last_)
+    printOperand(last_.get(), last_->precedence() < Precedence::Addition, out);
+  else
+    out->append("infinity");
+}
+
+Number SeriesExpr::calculate(const SymbolTable& t) const {
+  const Number first = first_->calculate(t);
+  const Number last = last_ ? last_->calculate(t) : Number(INFINITY);
+
+  Result<Number> result =
+      kind_ == Kind::Sum ? Series::sum(body_.get(), index_, first, last, t, {})
+                         : Series::product(body_.get(), index_, first, last, t, {});
+  return result ? *result : Number(std::nan(""));
+}
+
+std::unique_ptr<Expr> SeriesExpr::clone() const {
+  return std::make_unique<SeriesExpr>(kind_, body_->clone(), index_, first_->clone(),
+                                      last_ ? last_->clone() : nullptr);
+}
+
+bool SeriesExpr::compare(const Expr* other) const {
+  auto e = dynamic_cast<const SeriesExpr*>(other);
+  return e && e->kind_ == kind_ && e->index_ == index_ && e->body_->compare(body_.get()) &&
+         e->first_->compare(first_.get()) &&
+         (e->last_ ? last_ && e->last_->compare(last_.get()) : !last_);
+}
+// }}}
+// {{{ FacExpr
+FacExpr::FacExpr(std::unique_ptr<Expr>&& subExpr)
+    : UnaryExpr(Precedence::Factorial, std::move(subExpr)) {}
+
+void FacExpr::print(std::string* out) const {
+  printOperand(subExpr(), subExpr()->precedence() < precedence(), out);
+  out->push_back('!');
+}
+
+Number FacExpr::calculate(const SymbolTable& t) const {
+  return factorial(subExpr()->calculate(t));
+}
+
+Value FacExpr::evaluate(const SymbolTable& t) const {
+  return mapElements(&factorial, subExpr()->evaluate(t));
 }
 
 std::unique_ptr<Expr> FacExpr::clone() const {
@@ -269,18 +723,66 @@ bool FacExpr::compare(const Expr* other) const {
   return false;
 }
 // }}}
+// {{{ power
+Number power(Number a, Number b) {
+  if (!a.imag() && a.real() == M_E)
+    return std::exp(b);
+
+  if (!b.imag()) {
+    const double y = b.real();
+    const bool integer = y == std::floor(y);
+
+    if (!a.imag()) {
+      const double x = a.real();
+      if (integer && std::abs(y) <= 4) {
+        const int n = static_cast<int>(y);
+        const double x2 = x * x;
+        const double p = std::abs(n) == 4 ? x2 * x2
+                       : std::abs(n) == 3 ? x2 * x
+                       : std::abs(n) == 2 ? x2
+                       : std::abs(n) == 1 ? x
+                       : 1;
+        return n < 0 ? 1 / p : p;
+      }
+      if (y == 0.5)
+        return x >= 0 ? Number(std::sqrt(x)) : std::sqrt(a);
+      if (integer || x >= 0)
+        return std::pow(x, y);
+    } else {
+      if (integer && std::abs(y) <= 64)
+        return integerPower(a, static_cast<int>(y));
+      if (y == 0.5)
+        return std::sqrt(a);
+    }
+  }
+
+  return std::pow(a, b);
+}
+
+Number integerPower(Number a, int n) {
+  if (n < 0)
+    return Number(1) / integerPower(a, -n);
+  if (n == 0)
+    return 1;
+  if (n == 1)
+    return a;
+  if (n % 2)
+    return integerPower(a, n - 1) * a;
+
+  const Number h = integerPower(a, n / 2);
+  return h * h;
+}
+// }}}
 // {{{ PowExpr
 PowExpr::PowExpr(std::unique_ptr<Expr>&& left, std::unique_ptr<Expr>&& right)
     : BinaryExpr(Precedence::Power, "^", std::move(left), std::move(right)) {}
 
 Number PowExpr::calculate(const SymbolTable& t) const {
-  Number a = left_->calculate(t);
-  Number b = right_->calculate(t);
-  if (!a.imag() && a.real() == M_E) {
-    return std::exp(b);
-  } else {
-    return std::pow(a, b);
-  }
+  return power(left_->calculate(t), right_->calculate(t));
+}
+
+Value PowExpr::evaluate(const SymbolTable& t) const {
+  return power(left_->evaluate(t), right_->evaluate(t));
 }
 
 std::unique_ptr<Expr> PowExpr::clone() const {
@@ -375,16 +877,72 @@ const Symbol& DefineExpr::symbolName() const {
   throw "DefineExpr: no symbol found on left-hand side, but expects one";
 }
 // }}}
+// {{{ DefineMappingExpr
+DefineMappingExpr::DefineMappingExpr(const Symbol& name,
+                                     const SymbolList& inputs,
+                                     std::unique_ptr<Expr>&& body)
+    : Expr(Precedence::Relation), symbol_(name), inputs_(inputs), body_(std::move(body)) {}
+
+void DefineMappingExpr::print(std::string* out) const {
+  out->append(symbol_);
+  out->append(" : (");
+  for (size_t i = 0, e = inputs_.size(); i != e; ++i) {
+    if (i)
+      out->append(", ");
+    out->append(inputs_[i]);
+  }
+  out->append(") -> ");
+  body_->print(out);
+}
+
+Number DefineMappingExpr::calculate(const SymbolTable& /*t*/) const {
+  // a definition has no value
+  return Number(std::nan(""), std::nan(""));
+}
+
+std::unique_ptr<Expr> DefineMappingExpr::clone() const {
+  return std::make_unique<DefineMappingExpr>(symbol_, inputs_, body_->clone());
+}
+
+bool DefineMappingExpr::compare(const Expr* other) const {
+  if (auto e = dynamic_cast<const DefineMappingExpr*>(other))
+    return e->symbol_ == symbol_ && e->inputs_ == inputs_ && e->body_->compare(body_.get());
+
+  return false;
+}
+// }}}
 // {{{ SymbolTable
-SymbolTable::SymbolTable() : symbols_(), outerScope_(nullptr) {}
+SymbolTable::SymbolTable()
+    : symbols_(), retired_(), undefined_(), outerScope_(nullptr), version_(0) {}
 
 SymbolTable::SymbolTable(const SymbolTable* outerScope)
-    : symbols_(), outerScope_(outerScope) {}
+    : symbols_(), retired_(), undefined_(), outerScope_(outerScope), version_(0) {}
+
+void SymbolTable::replace(const Symbol& name, std::unique_ptr<Def>&& def) {
+  // calls parsed before, also from mapping bodies, still point at the old one
+  std::unique_ptr<Def>& slot = symbols_[name];
+  if (slot)
+    retired_.emplace_back(std::move(slot));
+  slot = std::move(def);
+  version_++;
+}
 
 void SymbolTable::defineConstant(const Symbol& name, Number value) {
+  defineConstant(name, Value(value));
+}
+
+void SymbolTable::defineConstant(const Symbol& name, const Value& value) {
   auto def = symbols_.find(name);
   if (def == symbols_.end()) {
-    symbols_[name] = std::make_unique<ConstantDef>(value);
+    auto undefined = undefined_.find(name);
+    if (undefined != undefined_.end()) {
+      undefined->second->redefine(value);
+      symbols_[name] = std::move(undefined->second);
+      undefined_.erase(undefined);
+    } else {
+      symbols_[name] = std::make_unique<ConstantDef>(value);
+    }
+    version_++;
   } else if (auto n = dynamic_cast<ConstantDef*>(def->second.get())) {
     n->redefine(value);
   } else {
@@ -392,25 +950,34 @@ void SymbolTable::defineConstant(const Symbol& name, Number value) {
   }
 }
 
-void SymbolTable::defineFunction(const Symbol& name, NativeMappingDef::Impl impl) {
-  symbols_[name] = std::make_unique<NativeMappingDef>(impl);
+void SymbolTable::defineMapping(const Symbol& name, NativeMappingDef::Impl impl) {
+  replace(name, std::make_unique<NativeMappingDef>(impl));
 }
 
-void SymbolTable::defineFunction(const Symbol& name, NativeMapping2Def::Impl impl) {
-  symbols_[name] = std::make_unique<NativeMapping2Def>(impl);
+void SymbolTable::defineMapping(const Symbol& name, NativeMapping2Def::Impl impl) {
+  replace(name, std::make_unique<NativeMapping2Def>(impl));
 }
 
-void SymbolTable::defineFunction(const Symbol& name,
+void SymbolTable::defineMapping(const Symbol& name,
                                  const CustomMappingDef::SymbolList& inputs,
                                  std::unique_ptr<Expr>&& impl) {
-  symbols_[name] = std::make_unique<CustomMappingDef>(inputs, std::move(impl));
+  replace(name, std::make_unique<CustomMappingDef>(inputs, std::move(impl)));
 }
 
 void SymbolTable::undefine(const Symbol& name) {
   auto def = symbols_.find(name);
-  if (def == symbols_.end()) {
-    symbols_.erase(def);
+  if (def == symbols_.end())
+    return;
+
+  // symbols bound to a constant see NaN until it is defined again
+  if (auto c = dynamic_cast<ConstantDef*>(def->second.get())) {
+    c->redefine(Number(std::nan("")));
+    undefined_[name].reset(static_cast<ConstantDef*>(def->second.release()));
+  } else {
+    retired_.emplace_back(std::move(def->second));
   }
+  symbols_.erase(def);
+  version_++;
 }
 
 const Def* SymbolTable::lookup(const Symbol& name) const {
@@ -420,16 +987,24 @@ const Def* SymbolTable::lookup(const Symbol& name) const {
   } else if (outerScope_) {
     return outerScope_->lookup(name);
   } else {
-    return nullptr;
+    return lookupBuiltin(name);
   }
 }
+
+uint64_t SymbolTable::version() const noexcept {
+  // Each scope's counter only ever grows, so does their sum.
+  return outerScope_ ? version_ + outerScope_->version() : version_;
+}
 // }}}
 // {{{ CallExpr
 CallExpr::CallExpr(const std::string& name, const MappingDef* f, ParamList&& inputs)
     : Expr(Precedence::Primary), symbolName_(name), mapping_(f),
-      inputs_(std::move(inputs)) {}
+      form_(dynamic_cast<const FormDef*>(f)), inputs_(std::move(inputs)) {}
 
 Number CallExpr::calculate(const SymbolTable& t) const {
+  if (form_)
+    return form_->apply(t, inputs_).number();
+
   MappingDef::NumberList args;
   args.resize(inputs_.size());
   for (size_t i = 0, e = inputs_.size(); i != e; ++i)
@@ -438,16 +1013,27 @@ Number CallExpr::calculate(const SymbolTable& t) const {
   return mapping_->call(t, args);
 }
 
-std::string CallExpr::str() const {
-  std::stringstream s;
-  s << symbolName_ << '(';
+Value CallExpr::evaluate(const SymbolTable& t) const {
+  if (form_)
+    return form_->apply(t, inputs_);
+
+  ValueList args;
+  args.reserve(inputs_.size());
+  for (const std::unique_ptr<Expr>& input : inputs_)
+    args.emplace_back(input->evaluate(t));
+
+  return mapping_->evaluate(t, args);
+}
+
+void CallExpr::print(std::string* out) const {
+  out->append(symbolName_);
+  out->push_back('(');
   for (size_t i = 0, e = inputs_.size(); i != e; ++i) {
     if (i)
-      s << ", ";
-    s << inputs_[i]->str();
+      out->append(", ");
+    inputs_[i]->print(out);
   }
-  s << ')';
-  return s.str();
+  out->push_back(')');
 }
 
 std::unique_ptr<Expr> CallExpr::clone() const {
@@ -474,27 +1060,60 @@ bool CallExpr::compare(const Expr* other) const {
 }
 // }}}
 // {{{ ConstantDef
-ConstantDef::ConstantDef(Number value) : number_(value) {}
+ConstantDef::ConstantDef(const Value& value) : number_(), value_() {
+  redefine(value);
+}
+
+void ConstantDef::redefine(const Value& v) {
+  number_ = v.number();
+  if (v.isNumber())
+    value_.reset();
+  else
+    value_ = std::make_unique<Value>(v);
+}
 
 std::string ConstantDef::str() const {
-  std::stringstream s;
-  if (!number_.imag()) {
-    s << number_.real();
+  std::string s;
+  if (value_ || !number_.imag()) {
+    printValue(value(), &s);
   } else {
-    s << "(" << number_.real() << " + ";
-    if (number_.imag() != 1) {
-      s << number_.imag();
-    }
-    s << "i)";
+    s.push_back('(');
+    printNumber(number_, &s);
+    s.push_back(')');
+  }
+  return s;
+}
+// }}}
+// {{{ MappingDef
+Value MappingDef::evaluate(const SymbolTable& t, const ValueList& inputs) const {
+  size_t n = 0;
+  if (!broadcastSize(inputs, &n))
+    return Number(std::nan(""));
+
+  NumberList args(inputs.size());
+  if (std::none_of(inputs.begin(), inputs.end(), [](const Value& v) { return v.isTuple(); })) {
+    for (size_t i = 0; i != inputs.size(); ++i)
+      args[i] = inputs[i].number();
+    return call(t, args);
+  }
+
+  Tuple result(n);
+  for (size_t k = 0; k != n; ++k) {
+    for (size_t i = 0; i != inputs.size(); ++i)
+      args[i] = element(inputs[i], k);
+    result.set(k, call(t, args));
   }
-  return s.str();
+  return Value(std::move(result));
 }
 // }}}
 // {{{ NativeMappingDef
 NativeMappingDef::NativeMappingDef(Impl impl) : impl_(impl) {}
 
 Number NativeMappingDef::call(const SymbolTable& t, const NumberList& input) const {
-    return impl_(input[0]);
+  if (input.size() != 1)
+    return Number(std::nan(""));
+
+  return impl_(input[0]);
 }
 
 std::string NativeMappingDef::str() const {
@@ -505,7 +1124,10 @@ std::string NativeMappingDef::str() const {
 NativeMapping2Def::NativeMapping2Def(Impl impl) : impl_(impl) {}
 
 Number NativeMapping2Def::call(const SymbolTable& t, const NumberList& input) const {
-    return impl_(input[0], input[1]);
+  if (input.size() != 2)
+    return Number(std::nan(""));
+
+  return impl_(input[0], input[1]);
 }
 
 std::string NativeMapping2Def::str() const {
@@ -521,46 +1143,95 @@ Number CustomMappingDef::call(const SymbolTable& t, const NumberList& inputs) co
   SymbolTable st(&t);
 
   for (size_t i = 0, e = inputs_.size(); i != e; ++i)
-    st.defineConstant(inputs_[i], inputs[i]);
+    st.defineConstant(inputs_[i], i < inputs.size() ? inputs[i] : std::nan(""));
+
+  return expr_->calculate(st);
+}
+
+Value CustomMappingDef::evaluate(const SymbolTable& t, const ValueList& inputs) const {
+  SymbolTable st(&t);
+
+  for (size_t i = 0, e = inputs_.size(); i != e; ++i)
+    st.defineConstant(inputs_[i], i < inputs.size() ? inputs[i] : Value(std::nan("")));
 
-  return expr_->calculate(t);
+  return expr_->evaluate(st);
 }
 
 std::string CustomMappingDef::str() const {
-  std::stringstream s;
+  std::string s;
 
-  s << "(";
+  s.push_back('(');
   for (size_t i = 0, e = inputs_.size(); i != e; ++i) {
     if (i)
-      s << ", ";
-    s << inputs_[i];
+      s.append(", ");
+    s.append(inputs_[i]);
   }
-  s << ") = " << expr_->str();
+  s.append(") = ");
+  expr_->print(&s);
 
-  return s.str();
+  return s;
 }
 // }}}
 
 // {{{ CaseExpr
-std::string CaseExpr::str() const {
-  return "CaseExpr()"; // TODO
+CaseExpr::CaseExpr(CaseList&& cases, std::unique_ptr<Expr>&& elseExpr)
+    : Expr(Precedence::Case), cases_(std::move(cases)), elseExpr_(std::move(elseExpr)) {}
+
+CaseExpr::CaseExpr(std::unique_ptr<Expr>&& condExpr,
+                   std::unique_ptr<Expr>&& trueExpr,
+                   std::unique_ptr<Expr>&& elseExpr)
+    : Expr(Precedence::Case), elseExpr_(std::move(elseExpr)) {
+  cases_.emplace_back(std::move(condExpr), std::move(trueExpr));
+}
+
+bool CaseExpr::holds(const Expr* e, Number value) {
+  if (dynamic_cast<const EquExpr*>(e) || dynamic_cast<const LessExpr*>(e))
+    return !std::isnan(value.real());
+
+  return value != Number() && !std::isnan(value.real()) && !std::isnan(value.imag());
+}
+
+void CaseExpr::print(std::string* out) const {
+  // only the else arm may be a case without parentheses
+  for (const CaseMatch& c : cases_) {
+    out->append("when ");
+    printOperand(c.first.get(), c.first->precedence() < Precedence::Relation, out);
+    out->append(" then ");
+    printOperand(c.second.get(), c.second->precedence() < Precedence::Relation, out);
+    out->push_back(' ');
+  }
+  out->append("else ");
+  elseExpr_->print(out);
 }
 
 Number CaseExpr::calculate(const SymbolTable& t) const {
-  for (const auto& c: cases_) {
-    if (c.first->calculate(t) != Number()) {
+  for (const CaseMatch& c : cases_)
+    if (holds(c.first.get(), c.first->calculate(t)))
       return c.second->calculate(t);
-    }
-  }
+
   return elseExpr_->calculate(t);
 }
 
 std::unique_ptr<Expr> CaseExpr::clone() const {
-  return nullptr; // TODO
+  CaseList cases;
+  cases.reserve(cases_.size());
+  for (const CaseMatch& c : cases_)
+    cases.emplace_back(c.first->clone(), c.second->clone());
+
+  return std::make_unique<CaseExpr>(std::move(cases), elseExpr_->clone());
 }
 
 bool CaseExpr::compare(const Expr* other) const {
-  return false; // TODO
+  auto e = dynamic_cast<const CaseExpr*>(other);
+  if (!e || e->cases_.size() != cases_.size() || !e->elseExpr_->compare(elseExpr_.get()))
+    return false;
+
+  for (size_t i = 0; i < cases_.size(); ++i)
+    if (!e->cases_[i].first->compare(cases_[i].first.get()) ||
+        !e->cases_[i].second->compare(cases_[i].second.get()))
+      return false;
+
+  return true;
 }
 // }}}
 }  // namespace cmath
@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <cmath/tuple.h>
 #include <complex>
+#include <cstdint>
 #include <iosfwd>
 #include <map>
 #include <memory>
@@ -60,12 +62,14 @@ class ASTNode {
 };
 
 using Number = std::complex<double>;
-using Name = std::string;
+using Symbol = std::string;
 
 enum class Precedence {
+  Case,            // when then else
   Relation,        // < > <= >= != =
   Addition,        // + -
-  Multiplication,  // * / !
+  Multiplication,  // * /
+  Factorial,       // !
   Power,           // ^
   Primary,         // 42 x a b
 };
@@ -77,28 +81,47 @@ class Expr : public ASTNode {
 
   Precedence precedence() const noexcept { return precedence_; }
 
-  virtual std::string str() const = 0;
+  /// Renders this expression with the fewest parentheses that still read
+  /// back into the same tree.
+  std::string str() const;
+
+  /// Appends the rendering of this expression to @p out.
+  virtual void print(std::string* out) const = 0;
+
   virtual Number calculate(const SymbolTable& t) const = 0;
   virtual std::unique_ptr<Expr> clone() const = 0;
   virtual bool compare(const Expr* other) const = 0;
 
+  /**
+   * Like calculate(), but also for tuple and matrix values, which arithmetic
+   * and mappings take element by element, broadcasting numbers, except for
+   * matrix products and powers. Nodes without a tuple form, such as
+   * relations, are calculated as numbers, which are NaN for such operands.
+   */
+  virtual Value evaluate(const SymbolTable& t) const;
+
  protected:
   Precedence precedence_;
 };
 
 class NumberExpr : public Expr {
  public:
-  explicit NumberExpr(Number n);
+  explicit NumberExpr(Number n, const std::string& literal = std::string());
 
-  Number getNumber() const { return literal_; }
+  Number getNumber() const { return number_; }
 
-  std::string str() const override;
+  /// The decimal as written, such as 1.50 or 2e3, without the suffix i, if
+  /// parsed from one; exact where the number may be rounded.
+  const std::string& literal() const noexcept { return literal_; }
+
+  void print(std::string* out) const override;
   Number calculate(const SymbolTable& t) const override;
   std::unique_ptr<Expr> clone() const override;
   bool compare(const Expr* other) const override;
 
  private:
-  Number literal_;
+  Number number_;
+  std::string literal_;
 };
 
 class UnaryExpr : public Expr {
@@ -116,8 +139,9 @@ class FacExpr : public UnaryExpr {
  public:
   explicit FacExpr(std::unique_ptr<Expr>&& subExpr);
 
-  std::string str() const override;
+  void print(std::string* out) const override;
   Number calculate(const SymbolTable& t) const override;
+  Value evaluate(const SymbolTable& t) const override;
   std::unique_ptr<Expr> clone() const override;
   bool compare(const Expr* other) const override;
 };
@@ -126,8 +150,11 @@ class NegExpr : public Expr {
  public:
   explicit NegExpr(std::unique_ptr<Expr>&& e);
 
-  std::string str() const override;
+  const Expr* subExpr() const { return subExpr_.get(); }
+
+  void print(std::string* out) const override;
   Number calculate(const SymbolTable& t) const override;
+  Value evaluate(const SymbolTable& t) const override;
   std::unique_ptr<Expr> clone() const override;
   bool compare(const Expr* other) const override;
 
@@ -142,8 +169,9 @@ class SymbolExpr : public Expr {
 
   const Symbol& symbolName() const noexcept { return symbol_; }
 
-  std::string str() const override;
+  void print(std::string* out) const override;
   Number calculate(const SymbolTable& t) const override;
+  Value evaluate(const SymbolTable& t) const override;
   std::unique_ptr<Expr> clone() const override;
   bool compare(const Expr* other) const override;
 
@@ -159,7 +187,7 @@ class BinaryExpr : public Expr {
              std::unique_ptr<Expr>&& left,
              std::unique_ptr<Expr>&& right);
 
-  std::string str() const override;
+  void print(std::string* out) const override;
 
   Expr* left() const { return left_.get(); }
   Expr* right() const { return right_.get(); }
@@ -175,6 +203,7 @@ class PlusExpr : public BinaryExpr {
   PlusExpr(std::unique_ptr<Expr>&& left, std::unique_ptr<Expr>&& right);
 
   Number calculate(const SymbolTable& t) const override;
+  Value evaluate(const SymbolTable& t) const override;
   std::unique_ptr<Expr> clone() const override;
   bool compare(const Expr* other) const override;
 };
@@ -184,6 +213,7 @@ class MinusExpr : public BinaryExpr {
   MinusExpr(std::unique_ptr<Expr>&& left, std::unique_ptr<Expr>&& right);
 
   Number calculate(const SymbolTable& t) const override;
+  Value evaluate(const SymbolTable& t) const override;
   std::unique_ptr<Expr> clone() const override;
   bool compare(const Expr* other) const override;
 };
@@ -193,17 +223,77 @@ class MulExpr : public BinaryExpr {
   MulExpr(std::unique_ptr<Expr>&& left, std::unique_ptr<Expr>&& right);
 
   Number calculate(const SymbolTable& t) const override;
+  Value evaluate(const SymbolTable& t) const override;
   std::unique_ptr<Expr> clone() const override;
   bool compare(const Expr* other) const override;
 };
 
+/**
+ * Division; by a numeric literal, multiplication by its reciprocal, which
+ * is computed once and costs at most another ulp.
+ */
 class DivExpr : public BinaryExpr {
  public:
   DivExpr(std::unique_ptr<Expr>&& left, std::unique_ptr<Expr>&& right);
 
   Number calculate(const SymbolTable& t) const override;
+  Value evaluate(const SymbolTable& t) const override;
   std::unique_ptr<Expr> clone() const override;
   bool compare(const Expr* other) const override;
+
+ private:
+  bool constant_;
+  Number reciprocal_;
+};
+
+/**
+ * Flattened chain of additions and subtractions, such as a + b - c + d,
+ * which the parser produces for three terms or more instead of a left-deep
+ * tree of PlusExpr and MinusExpr. It evaluates without recursing per term,
+ * compensated in interleaved lanes (SumAccumulator in cmath/accumulate.h).
+ */
+class SumExpr : public Expr {
+ public:
+  struct Term {
+    std::unique_ptr<Expr> expr;
+    bool subtract;  // never the first term
+  };
+
+  explicit SumExpr(std::vector<Term>&& terms);
+
+  const std::vector<Term>& terms() const noexcept { return terms_; }
+
+  void print(std::string* out) const override;
+  Number calculate(const SymbolTable& t) const override;
+  Value evaluate(const SymbolTable& t) const override;
+  std::unique_ptr<Expr> clone() const override;
+  bool compare(const Expr* other) const override;
+
+ private:
+  std::vector<Term> terms_;
+};
+
+/**
+ * Flattened chain of three or more multiplications, a * b * c, multiplied
+ * in interleaved lanes (ProductAccumulator in cmath/accumulate.h). A
+ * division ends the chain, as in (a * b * c) / d.
+ */
+class ProductExpr : public Expr {
+ public:
+  using FactorList = std::vector<std::unique_ptr<Expr>>;
+
+  explicit ProductExpr(FactorList&& factors);
+
+  const FactorList& factors() const noexcept { return factors_; }
+
+  void print(std::string* out) const override;
+  Number calculate(const SymbolTable& t) const override;
+  Value evaluate(const SymbolTable& t) const override;
+  std::unique_ptr<Expr> clone() const override;
+  bool compare(const Expr* other) const override;
+
+ private:
+  FactorList factors_;
 };
 
 class PowExpr : public BinaryExpr {
@@ -211,6 +301,7 @@ class PowExpr : public BinaryExpr {
   PowExpr(std::unique_ptr<Expr>&& left, std::unique_ptr<Expr>&& right);
 
   Number calculate(const SymbolTable& t) const override;
+  Value evaluate(const SymbolTable& t) const override;
   std::unique_ptr<Expr> clone() const override;
   bool compare(const Expr* other) const override;
 };
@@ -245,22 +336,110 @@ class DefineExpr : public BinaryExpr {
   bool compare(const Expr* other) const override;
 };
 
+class DefineMappingExpr : public Expr {
+ public:
+  using SymbolList = std::vector<Symbol>;
+
+  // name : (inputs) -> body
+  DefineMappingExpr(const Symbol& name,
+                    const SymbolList& inputs,
+                    std::unique_ptr<Expr>&& body);
+
+  const Symbol& symbolName() const noexcept { return symbol_; }
+  const SymbolList& inputs() const noexcept { return inputs_; }
+  const Expr* body() const noexcept { return body_.get(); }
+
+  void print(std::string* out) const override;
+  Number calculate(const SymbolTable& t) const override;
+  std::unique_ptr<Expr> clone() const override;
+  bool compare(const Expr* other) const override;
+
+ private:
+  Symbol symbol_;
+  SymbolList inputs_;
+  std::unique_ptr<Expr> body_;
+};
+
+/**
+ * Tuple (x1, x2, ...) of numbers, which evaluates to one Tuple value, or of
+ * tuples of one size, which evaluates to the Matrix with them as rows; its
+ * calculate() is NaN.
+ */
+class TupleExpr : public Expr {
+ public:
+  using ElementList = std::vector<std::unique_ptr<Expr>>;
+
+  explicit TupleExpr(ElementList&& elements);
+
+  const ElementList& elements() const noexcept { return elements_; }
+
+  void print(std::string* out) const override;
+  Number calculate(const SymbolTable& t) const override;
+  Value evaluate(const SymbolTable& t) const override;
+  std::unique_ptr<Expr> clone() const override;
+  bool compare(const Expr* other) const override;
+
+ private:
+  ElementList elements_;
+};
+
+/**
+ * Sum or product of a body over an index k = first, first + 1, ..., last,
+ * as in sum over 1/k^2 for k = 1 to infinity; last is null for infinity.
+ * Its calculate() goes by Series (cmath/series.h), NaN where that fails.
+ */
+class SeriesExpr : public Expr {
+ public:
+  enum class Kind { Sum, Product };
+
+  SeriesExpr(Kind kind,
+             std::unique_ptr<Expr>&& body,
+             const Symbol& index,
+             std::unique_ptr<Expr>&& first,
+             std::unique_ptr<Expr>&& last);
+
+  Kind kind() const noexcept { return kind_; }
+  const Expr* body() const noexcept { return body_.get(); }
+  const Symbol& index() const noexcept { return index_; }
+  const Expr* first() const noexcept { return first_.get(); }
+  const Expr* last() const noexcept { return last_.get(); }
+
+  void print(std::string* out) const override;
+  Number calculate(const SymbolTable& t) const override;
+  std::unique_ptr<Expr> clone() const override;
+  bool compare(const Expr* other) const override;
+
+ private:
+  Kind kind_;
+  std::unique_ptr<Expr> body_;
+  Symbol index_;
+  std::unique_ptr<Expr> first_;
+  std::unique_ptr<Expr> last_;
+};
+
 class MappingDef;
+class FormDef;
 
 class CallExpr : public Expr {
  public:
   using ParamList = std::vector<std::unique_ptr<Expr>>;
 
-  CallExpr(const std::string& symbolName, const MappingDef* f, ParamList inputs);
+  CallExpr(const std::string& symbolName, const MappingDef* f, ParamList&& inputs);
+
+  const std::string& symbolName() const noexcept { return symbolName_; }
+  const MappingDef* mapping() const noexcept { return mapping_; }
+  const ParamList& inputs() const noexcept { return inputs_; }
 
   Number calculate(const SymbolTable& t) const override;
-  std::string str() const override;
+  Value evaluate(const SymbolTable& t) const override;
+  void print(std::string* out) const override;
   std::unique_ptr<Expr> clone() const override;
   bool compare(const Expr* other) const override;
 
  private:
   std::string symbolName_;
   const MappingDef* mapping_;
+  const FormDef* form_;  // mapping_, if it takes its arguments unevaluated
   ParamList inputs_;
 };
 
@@ -271,18 +450,28 @@ class Def {
   virtual std::string str() const = 0;
 };
 
+/**
+ * Constant number, or tuple or matrix. Numbers are held without a Value, so
+ * that the builtin constants are constant-initialized like the rest of the
+ * builtin table.
+ */
 class ConstantDef : public Def {
  public:
-  explicit ConstantDef(Number value);
+  constexpr explicit ConstantDef(Number n) : number_(n), value_() {}
+  explicit ConstantDef(const Value& value);
 
-  Number getNumber() const { return number_; }
+  /// The number, or NaN for a tuple or matrix.
+  Number getNumber() const noexcept { return number_; }
 
-  void redefine(Number n) { number_ = n; }
+  Value value() const { return value_ ? *value_ : Value(number_); }
+
+  void redefine(const Value& v);
 
   std::string str() const override;
 
  private:
   Number number_;
+  std::unique_ptr<Value> value_;  // for tuples and matrices only
 };
 
 class MappingDef : public Def {
@@ -290,6 +479,24 @@ class MappingDef : public Def {
   using NumberList = std::vector<Number>;
 
   virtual Number call(const SymbolTable& t, const NumberList& inputs) const = 0;
+
+  /**
+   * Maps tuples element by element, broadcasting numbers, by default with
+   * one call() per element; NaN for tuples of different sizes.
+   */
+  virtual Value evaluate(const SymbolTable& t, const ValueList& inputs) const;
+};
+
+/**
+ * Mapping that receives its argument expressions unevaluated, such as a
+ * solver, which has to know the symbol to solve for.
+ */
+class FormDef : public MappingDef {
+ public:
+  using ParamList = CallExpr::ParamList;
+
+  /// The value of the form, which may be a tuple, such as all roots.
+  virtual Value apply(const SymbolTable& t, const ParamList& inputs) const = 0;
 };
 
 class NativeMappingDefEx : public MappingDef {
@@ -338,7 +545,14 @@ class CustomMappingDef : public MappingDef {
 
   CustomMappingDef(const SymbolList& inputs, std::unique_ptr<Expr>&& expression);
 
+  const SymbolList& inputs() const noexcept { return inputs_; }
+  const Expr* expr() const noexcept { return expr_.get(); }
+
   Number call(const SymbolTable& t, const NumberList& inputs) const override;
+
+  /// Evaluates the body once, with the parameters bound to whole tuples.
+  Value evaluate(const SymbolTable& t, const ValueList& inputs) const override;
+
   std::string str() const override;
 
  private:
@@ -355,12 +569,21 @@ class ConstDef {
   std::unique_ptr<Expr> expr_;
 };
 
+/**
+ * Definitions by name, nested in an outer scope.
+ *
+ * Expressions bind to the definitions they were parsed against, so those
+ * that are replaced stay alive, unchanged, as long as the table does.
+ * Undefined constants are kept as NaN, and come back with their next
+ * definition, so that expressions bound to them follow it.
+ */
 class SymbolTable {
  public:
   SymbolTable();
   explicit SymbolTable(const SymbolTable* outerScope);
 
   void defineConstant(const Symbol& name, Number value);
+  void defineConstant(const Symbol& name, const Value& value);
   void defineMapping(const Symbol& name, NativeMappingDef::Impl impl);
   void defineMapping(const Symbol& name, NativeMapping2Def::Impl impl);
   void defineMapping(const Symbol& name,
@@ -371,6 +594,11 @@ class SymbolTable {
 
   const Def* lookup(const Symbol& name) const;
 
+  // Changes whenever a symbol is added to, replaced in or removed from this
+  // table or any of its outer scopes, i.e. whenever previously parsed
+  // expressions may have bound to a different definition.
+  uint64_t version() const noexcept;
+
   using Map = std::map<Symbol, std::unique_ptr<Def>>;
   using iterator = Map::iterator;
   using const_iterator = Map::const_iterator;
@@ -384,9 +612,15 @@ class SymbolTable {
   const_iterator cbegin() const { return symbols_.cbegin(); }
   const_iterator cend() const { return symbols_.cend(); }
 
+ private:
+  void replace(const Symbol& name, std::unique_ptr<Def>&& def);
+
  private:
   Map symbols_;
+  std::vector<std::unique_ptr<Def>> retired_;  // replaced, still bound to
+  std::map<Symbol, std::unique_ptr<ConstantDef>> undefined_;
   const SymbolTable* outerScope_;
+  uint64_t version_;
 };
 
 class Program {
@@ -398,6 +632,11 @@ class Program {
   std::vector<std::unique_ptr<MappingDef>> mappings_;
 };
 
+/**
+ * when c1 then e1 when c2 then e2 ... else e, the first arm whose condition
+ * holds, or the else arm. A relation holds unless it evaluates to NaN, any
+ * other condition if it is a nonzero number.
+ */
 class CaseExpr : public Expr {
  public:
   using CaseMatch = std::pair<std::unique_ptr<Expr>, std::unique_ptr<Expr>>;
@@ -411,7 +650,10 @@ class CaseExpr : public Expr {
   const CaseList& cases() const { return cases_; }
   const Expr* elseExpr() const { return elseExpr_.get(); }
 
-  std::string str() const override;
+  /// Whether the condition @p e, evaluated to @p value, holds.
+  static bool holds(const Expr* e, Number value);
+
+  void print(std::string* out) const override;
   Number calculate(const SymbolTable& t) const override;
   std::unique_ptr<Expr> clone() const override;
   bool compare(const Expr* other) const override;
@@ -433,7 +675,50 @@ class CompoundExpr : public Expr {
   ExprList expressions_;
 };
 
+/**
+ * Appends @p n to @p out, using the shortest decimal representation of
+ * each component that reads back to the identical double, the imaginary
+ * one with the suffix i, as in 1 - 2.5i.
+ *
+ * Numbers with an infinite part print as inf, -inf, inf * i and the like,
+ * and otherwise numbers with a NaN part as nan, both of which read back as
+ * the builtin constants.
+ */
+void printNumber(Number n, std::string* out);
+std::string str(Number n);
+
 std::ostream& operator<<(std::ostream& os, const Expr* expr);
 std::ostream& operator<<(std::ostream& os, const Expr& expr);
 
+/**
+ * @p a to the power of @p b, as PowExpr computes it, by the cheapest
+ * operation for the kinds of its operands that is no less accurate than
+ * complex pow():
+ *
+ * - e^b by exp(),
+ * - integer exponents of a complex base up to 64 in magnitude by
+ *   integerPower(), which rounds once per multiplication instead of
+ *   amplifying the rounding of log(a) by b,
+ * - integer exponents of a real base up to 4 in magnitude by
+ *   multiplication in double, larger ones by real pow(),
+ * - square roots by sqrt(),
+ * - real exponents of a nonnegative real base by real pow(),
+ *
+ * and by complex pow() otherwise.
+ */
+Number power(Number a, Number b);
+
+/**
+ * @p a to the power of @p n by the binary method, the addition chain
+ * a^n = (a^(n/2))^2 for even and a^(n-1) a for odd @p n; a reciprocal for
+ * negative @p n.
+ */
+Number integerPower(Number a, int n);
+
+/**
+ * Symbols of @p e which @p t does not define as constants, such as the
+ * variable of a formula handed to a solver, in order of appearance.
+ */
+std::vector<Symbol> freeSymbols(const Expr* e, const SymbolTable& t);
+
 }  // namespace cmath
@@ -0,0 +1,819 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/accumulate.h>
+#include <cmath/expr_archive.h>
+#include <cmath/polynomial.h>
+#include <cmath/series.h>
+#include <cmath/special.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cmath {
+
+using archive::Node;
+using archive::NodeKind;
+using archive::None;
+
+uint64_t archive::checksum(const void* data, size_t size) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < size; ++i) {
+    h ^= p[i];
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+// {{{ ExprArchiveWriter
+ExprArchiveWriter::ExprArchiveWriter()
+    : nodes_(), indices_(), names_(), nameIds_(), symbols_(), formulas_(), strings_() {}
+
+uint32_t ExprArchiveWriter::string(const std::string& s) {
+  uint32_t offset = static_cast<uint32_t>(strings_.size());
+  strings_ += s;
+  return offset;
+}
+
+uint32_t ExprArchiveWriter::name(const std::string& s) {
+  auto i = nameIds_.find(s);
+  if (i != nameIds_.end())
+    return i->second;
+
+  uint32_t id = static_cast<uint32_t>(names_.size());
+  names_.push_back(archive::NameRef{string(s), static_cast<uint32_t>(s.size()), None, 0});
+  nameIds_[s] = id;
+  return id;
+}
+
+uint32_t ExprArchiveWriter::push(const Node& n) {
+  nodes_.push_back(n);
+  return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+// Adds the nodes of @p e, or none at all, if any is not supported.
+Result<uint32_t> ExprArchiveWriter::tree(const Expr* e) {
+  const size_t nodes = nodes_.size();
+  const size_t indices = indices_.size();
+  try {
+    return node(e);
+  } catch (const std::error_code& ec) {
+    nodes_.resize(nodes);
+    indices_.resize(indices);
+    return ec;
+  }
+}
+
+uint32_t ExprArchiveWriter::node(const Expr* e) {
+  auto binary = [this](NodeKind kind, const BinaryExpr* b) {
+    uint32_t left = node(b->left());
+    uint32_t right = node(b->right());
+    return push(Node{kind, 0, 0, left, right, 0, 0});
+  };
+
+  if (auto p = dynamic_cast<const PolynomialExpr*>(e))
+    return node(p->source());
+
+  if (auto n = dynamic_cast<const NumberExpr*>(e))
+    return push(Node{NodeKind::Number, 0, 0, 0, 0,
+                     n->getNumber().real(), n->getNumber().imag()});
+
+  if (auto s = dynamic_cast<const SymbolExpr*>(e))
+    return push(Node{NodeKind::Symbol, 0, 0, name(s->symbolName()), 0, 0, 0});
+
+  if (auto n = dynamic_cast<const NegExpr*>(e)) {
+    uint32_t sub = node(n->subExpr());
+    return push(Node{NodeKind::Neg, 0, 0, sub, 0, 0, 0});
+  }
+
+  if (auto f = dynamic_cast<const FacExpr*>(e)) {
+    uint32_t sub = node(f->subExpr());
+    return push(Node{NodeKind::Fac, 0, 0, sub, 0, 0, 0});
+  }
+
+  if (auto b = dynamic_cast<const PlusExpr*>(e))
+    return binary(NodeKind::Plus, b);
+  if (auto b = dynamic_cast<const MinusExpr*>(e))
+    return binary(NodeKind::Minus, b);
+  if (auto b = dynamic_cast<const MulExpr*>(e))
+    return binary(NodeKind::Mul, b);
+  if (auto b = dynamic_cast<const DivExpr*>(e))
+    return binary(NodeKind::Div, b);
+  if (auto b = dynamic_cast<const PowExpr*>(e))
+    return binary(NodeKind::Pow, b);
+  if (auto b = dynamic_cast<const EquExpr*>(e))
+    return binary(NodeKind::Equ, b);
+  if (auto b = dynamic_cast<const LessExpr*>(e))
+    return binary(NodeKind::Less, b);
+  if (auto b = dynamic_cast<const DefineExpr*>(e))
+    return binary(NodeKind::Define, b);
+
+  if (auto c = dynamic_cast<const CallExpr*>(e)) {
+    std::vector<uint32_t> args;
+    for (const std::unique_ptr<Expr>& input : c->inputs())
+      args.push_back(node(input.get()));
+
+    uint32_t first = static_cast<uint32_t>(indices_.size());
+    indices_.insert(indices_.end(), args.begin(), args.end());
+    return push(Node{NodeKind::Call, 0, static_cast<uint32_t>(args.size()),
+                     name(c->symbolName()), first, 0, 0});
+  }
+
+  if (auto s = dynamic_cast<const SumExpr*>(e)) {
+    std::vector<uint32_t> terms;
+    for (const SumExpr::Term& term : s->terms()) {
+      uint32_t k = node(term.expr.get());
+      terms.push_back(term.subtract ? push(Node{NodeKind::Neg, 0, 0, k, 0, 0, 0}) : k);
+    }
+
+    uint32_t first = static_cast<uint32_t>(indices_.size());
+    indices_.insert(indices_.end(), terms.begin(), terms.end());
+    return push(Node{NodeKind::Sum, 0, static_cast<uint32_t>(terms.size()), 0, first, 0,
+                     0});
+  }
+
+  if (auto p = dynamic_cast<const ProductExpr*>(e)) {
+    std::vector<uint32_t> factors;
+    for (const std::unique_ptr<Expr>& factor : p->factors())
+      factors.push_back(node(factor.get()));
+
+    uint32_t first = static_cast<uint32_t>(indices_.size());
+    indices_.insert(indices_.end(), factors.begin(), factors.end());
+    return push(Node{NodeKind::Product, 0, static_cast<uint32_t>(factors.size()), 0, first,
+                     0, 0});
+  }
+
+  if (auto c = dynamic_cast<const CaseExpr*>(e)) {
+    std::vector<uint32_t> arms;
+    for (const CaseExpr::CaseMatch& m : c->cases()) {
+      arms.push_back(node(m.first.get()));
+      arms.push_back(node(m.second.get()));
+    }
+    arms.push_back(node(c->elseExpr()));
+
+    uint32_t first = static_cast<uint32_t>(indices_.size());
+    indices_.insert(indices_.end(), arms.begin(), arms.end());
+    return push(Node{NodeKind::Case, 0, static_cast<uint32_t>(c->cases().size()),
+                     0, first, 0, 0});
+  }
+
+  if (auto s = dynamic_cast<const SeriesExpr*>(e)) {
+    std::vector<uint32_t> parts{node(s->body()), node(s->first())};
+    if (s->last())
+      parts.push_back(node(s->last()));
+
+    const NodeKind kind = s->kind() == SeriesExpr::Kind::Sum ? NodeKind::SeriesSum
+                                                             : NodeKind::SeriesProduct;
+    uint32_t first = static_cast<uint32_t>(indices_.size());
+    indices_.insert(indices_.end(), parts.begin(), parts.end());
+    return push(Node{kind, 0, static_cast<uint32_t>(parts.size()), name(s->index()), first,
+                     0, 0});
+  }
+
+  throw make_error_code(ExprArchive::UnsupportedExpr);
+}
+
+std::vector<Symbol> ExprArchiveWriter::addSymbols(const SymbolTable& symbolTable) {
+  std::vector<Symbol> skipped;
+  for (const auto& s : symbolTable) {
+    archive::SymbolRecord r{name(s.first), archive::SymbolKind::Constant,
+                            0, 0, None, 0, 0, 0};
+
+    if (auto c = dynamic_cast<const ConstantDef*>(s.second.get())) {
+      r.re = c->getNumber().real();
+      r.im = c->getNumber().imag();
+    } else if (auto m = dynamic_cast<const CustomMappingDef*>(s.second.get())) {
+      Result<uint32_t> body = tree(m->expr());
+      if (!body) {
+        skipped.push_back(s.first);
+        continue;
+      }
+
+      std::vector<uint32_t> params;
+      for (const Symbol& param : m->inputs())
+        params.push_back(name(param));
+
+      r.kind = archive::SymbolKind::Mapping;
+      r.body = *body;
+      r.params = static_cast<uint32_t>(indices_.size());
+      r.paramCount = static_cast<uint32_t>(params.size());
+      indices_.insert(indices_.end(), params.begin(), params.end());
+    } else {
+      // native mappings are resolved by name at evaluation time
+      continue;
+    }
+
+    symbols_.push_back(r);
+  }
+  return skipped;
+}
+
+Result<size_t> ExprArchiveWriter::addFormula(const std::string& source, const Expr* expr) {
+  Result<uint32_t> root = tree(expr);
+  if (!root)
+    return root.error();
+
+  formulas_.push_back(archive::FormulaRecord{
+      string(source), static_cast<uint32_t>(source.size()), *root, 0});
+  return formulas_.size() - 1;
+}
+
+std::string ExprArchiveWriter::finish() const {
+  // symbols are kept sorted by name for ExprArchive::lookup()
+  std::vector<archive::SymbolRecord> symbols = symbols_;
+  auto nameOf = [this](const archive::SymbolRecord& r) {
+    const archive::NameRef& n = names_[r.name];
+    return std::string_view(strings_.data() + n.offset, n.length);
+  };
+  std::stable_sort(symbols.begin(), symbols.end(),
+                   [&](const archive::SymbolRecord& a, const archive::SymbolRecord& b) {
+                     return nameOf(a) < nameOf(b);
+                   });
+
+  std::vector<archive::NameRef> names = names_;
+  for (size_t i = 0; i < symbols.size(); ++i)
+    names[symbols[i].name].symbol = static_cast<uint32_t>(i);  // last one wins
+
+  auto align = [](size_t n) { return (n + 7) & ~size_t(7); };
+
+  archive::Header h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, archive::Magic, sizeof(h.magic));
+  h.version = archive::FormatVersion;
+  h.byteOrder = archive::ByteOrderMark;
+
+  size_t offset = align(sizeof(archive::Header));
+  h.nodeOffset = offset;
+  h.nodeCount = nodes_.size();
+  offset = align(offset + nodes_.size() * sizeof(Node));
+  h.indexOffset = offset;
+  h.indexCount = indices_.size();
+  offset = align(offset + indices_.size() * sizeof(uint32_t));
+  h.nameOffset = offset;
+  h.nameCount = names.size();
+  offset = align(offset + names.size() * sizeof(archive::NameRef));
+  h.symbolOffset = offset;
+  h.symbolCount = symbols.size();
+  offset = align(offset + symbols.size() * sizeof(archive::SymbolRecord));
+  h.formulaOffset = offset;
+  h.formulaCount = formulas_.size();
+  offset = align(offset + formulas_.size() * sizeof(archive::FormulaRecord));
+  h.stringOffset = offset;
+  h.stringSize = strings_.size();
+  offset = align(offset + strings_.size());
+  h.fileSize = offset;
+
+  std::string image(offset, '\0');
+  auto put = [&](size_t at, const void* data, size_t n) {
+    if (n)
+      std::memcpy(&image[at], data, n);
+  };
+  put(h.nodeOffset, nodes_.data(), nodes_.size() * sizeof(Node));
+  put(h.indexOffset, indices_.data(), indices_.size() * sizeof(uint32_t));
+  put(h.nameOffset, names.data(), names.size() * sizeof(archive::NameRef));
+  put(h.symbolOffset, symbols.data(), symbols.size() * sizeof(archive::SymbolRecord));
+  put(h.formulaOffset, formulas_.data(),
+      formulas_.size() * sizeof(archive::FormulaRecord));
+  put(h.stringOffset, strings_.data(), strings_.size());
+
+  h.checksum = archive::checksum(image.data() + sizeof(h), image.size() - sizeof(h));
+  put(0, &h, sizeof(h));
+
+  return image;
+}
+
+std::error_code ExprArchiveWriter::save(const std::string& path) const {
+  std::string image = finish();
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out.good())
+    return std::error_code(errno, std::system_category());
+
+  out.write(image.data(), image.size());
+  if (!out.good())
+    return std::error_code(errno, std::system_category());
+
+  return std::error_code();
+}
+// }}}
+// {{{ ExprArchive
+// Arguments of a mapping call, or the index of a series within the
+// enclosing frame.
+struct ExprArchive::Frame {
+  const archive::SymbolRecord* mapping;
+  const Number* args;
+  const Frame* outer;
+  uint32_t index;  // name of the series index
+};
+
+ExprArchive::ExprArchive(const void* base, size_t size, bool mapped)
+    : base_(static_cast<const char*>(base)),
+      size_(size),
+      mapped_(mapped),
+      header_(reinterpret_cast<const archive::Header*>(base)),
+      nodes_(nullptr),
+      indices_(nullptr),
+      names_(nullptr),
+      symbols_(nullptr),
+      formulas_(nullptr),
+      strings_(nullptr) {}
+
+ExprArchive::~ExprArchive() {
+  if (mapped_)
+    munmap(const_cast<char*>(base_), size_);
+}
+
+Result<std::unique_ptr<ExprArchive>> ExprArchive::open(const std::string& path,
+                                                       bool verify) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return std::error_code(errno, std::system_category());
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    std::error_code ec(errno, std::system_category());
+    ::close(fd);
+    return ec;
+  }
+
+  if (static_cast<size_t>(st.st_size) < sizeof(archive::Header)) {
+    ::close(fd);
+    return make_error_code(Truncated);
+  }
+
+  void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (base == MAP_FAILED)
+    return std::error_code(errno, std::system_category());
+
+  std::unique_ptr<ExprArchive> a(new ExprArchive(base, st.st_size, true));
+  if (std::error_code ec = a->validate(verify))
+    return ec;
+
+  return a;
+}
+
+Result<std::unique_ptr<ExprArchive>> ExprArchive::view(const void* data,
+                                                       size_t size,
+                                                       bool verify) {
+  if (size < sizeof(archive::Header))
+    return make_error_code(Truncated);
+
+  std::unique_ptr<ExprArchive> a(new ExprArchive(data, size, false));
+  if (std::error_code ec = a->validate(verify))
+    return ec;
+
+  return a;
+}
+
+std::error_code ExprArchive::validate(bool verify) {
+  const archive::Header& h = *header_;
+
+  if (std::memcmp(h.magic, archive::Magic, sizeof(h.magic)) != 0)
+    return make_error_code(InvalidMagic);
+
+  if (h.byteOrder != archive::ByteOrderMark)
+    return make_error_code(ForeignByteOrder);
+
+  if (h.version != archive::FormatVersion)
+    return make_error_code(UnsupportedVersion);
+
+  if (h.fileSize > size_)
+    return make_error_code(Truncated);
+
+  auto fits = [&](uint32_t offset, size_t count, size_t elementSize) {
+    return offset % 8 == 0 && offset >= sizeof(archive::Header) &&
+           offset <= h.fileSize && count <= (h.fileSize - offset) / elementSize;
+  };
+
+  if (!fits(h.nodeOffset, h.nodeCount, sizeof(Node)) ||
+      !fits(h.indexOffset, h.indexCount, sizeof(uint32_t)) ||
+      !fits(h.nameOffset, h.nameCount, sizeof(archive::NameRef)) ||
+      !fits(h.symbolOffset, h.symbolCount, sizeof(archive::SymbolRecord)) ||
+      !fits(h.formulaOffset, h.formulaCount, sizeof(archive::FormulaRecord)) ||
+      !fits(h.stringOffset, h.stringSize, 1))
+    return make_error_code(Truncated);
+
+  nodes_ = reinterpret_cast<const Node*>(base_ + h.nodeOffset);
+  indices_ = reinterpret_cast<const uint32_t*>(base_ + h.indexOffset);
+  names_ = reinterpret_cast<const archive::NameRef*>(base_ + h.nameOffset);
+  symbols_ = reinterpret_cast<const archive::SymbolRecord*>(base_ + h.symbolOffset);
+  formulas_ = reinterpret_cast<const archive::FormulaRecord*>(base_ + h.formulaOffset);
+  strings_ = base_ + h.stringOffset;
+
+  if (!verify)
+    return std::error_code();
+
+  if (archive::checksum(base_ + sizeof(h), h.fileSize - sizeof(h)) != h.checksum)
+    return make_error_code(ChecksumMismatch);
+
+  // structural checks, so that evaluation can trust every reference.
+  // Children always precede their parents, which also rules out cycles.
+  auto validRange = [&](uint32_t first, uint32_t count) {
+    return first <= h.indexCount && count <= h.indexCount - first;
+  };
+  auto validString = [&](uint32_t offset, uint32_t length) {
+    return offset <= h.stringSize && length <= h.stringSize - offset;
+  };
+
+  for (uint32_t i = 0; i < h.nodeCount; ++i) {
+    const Node& n = nodes_[i];
+    switch (n.kind) {
+      case NodeKind::Number:
+        break;
+      case NodeKind::Symbol:
+        if (n.a >= h.nameCount)
+          return make_error_code(Corrupted);
+        break;
+      case NodeKind::Neg:
+      case NodeKind::Fac:
+        if (n.a >= i)
+          return make_error_code(Corrupted);
+        break;
+      case NodeKind::Plus:
+      case NodeKind::Minus:
+      case NodeKind::Mul:
+      case NodeKind::Div:
+      case NodeKind::Pow:
+      case NodeKind::Equ:
+      case NodeKind::Less:
+      case NodeKind::Define:
+        if (n.a >= i || n.b >= i)
+          return make_error_code(Corrupted);
+        break;
+      case NodeKind::Sum:
+      case NodeKind::Product:
+        if (n.count < 2 || !validRange(n.b, n.count))
+          return make_error_code(Corrupted);
+        for (uint32_t k = 0; k < n.count; ++k)
+          if (indices_[n.b + k] >= i)
+            return make_error_code(Corrupted);
+        break;
+      case NodeKind::Call:
+        if (n.a >= h.nameCount || !validRange(n.b, n.count))
+          return make_error_code(Corrupted);
+        for (uint32_t k = 0; k < n.count; ++k)
+          if (indices_[n.b + k] >= i)
+            return make_error_code(Corrupted);
+        break;
+      case NodeKind::Case:
+        if (n.count > h.indexCount / 2 || !validRange(n.b, 2 * n.count + 1))
+          return make_error_code(Corrupted);
+        for (uint32_t k = 0; k < 2 * n.count + 1; ++k)
+          if (indices_[n.b + k] >= i)
+            return make_error_code(Corrupted);
+        break;
+      case NodeKind::SeriesSum:
+      case NodeKind::SeriesProduct:
+        if (n.a >= h.nameCount || n.count < 2 || n.count > 3 || !validRange(n.b, n.count))
+          return make_error_code(Corrupted);
+        for (uint32_t k = 0; k < n.count; ++k)
+          if (indices_[n.b + k] >= i)
+            return make_error_code(Corrupted);
+        break;
+      default:
+        return make_error_code(Corrupted);
+    }
+  }
+
+  for (uint32_t i = 0; i < h.nameCount; ++i) {
+    const archive::NameRef& n = names_[i];
+    if (!validString(n.offset, n.length))
+      return make_error_code(Corrupted);
+    if (n.symbol != None && n.symbol >= h.symbolCount)
+      return make_error_code(Corrupted);
+  }
+
+  for (uint32_t i = 0; i < h.symbolCount; ++i) {
+    const archive::SymbolRecord& s = symbols_[i];
+    if (s.name >= h.nameCount)
+      return make_error_code(Corrupted);
+
+    if (s.kind == archive::SymbolKind::Mapping) {
+      if (s.body >= h.nodeCount || !validRange(s.params, s.paramCount))
+        return make_error_code(Corrupted);
+      for (uint32_t k = 0; k < s.paramCount; ++k)
+        if (indices_[s.params + k] >= h.nameCount)
+          return make_error_code(Corrupted);
+    } else if (s.kind != archive::SymbolKind::Constant) {
+      return make_error_code(Corrupted);
+    }
+  }
+
+  for (uint32_t i = 0; i < h.formulaCount; ++i) {
+    const archive::FormulaRecord& f = formulas_[i];
+    if (!validString(f.sourceOffset, f.sourceLength) || f.root >= h.nodeCount)
+      return make_error_code(Corrupted);
+  }
+
+  return validateCalls();
+}
+
+// Calls resolve by name, so a mapping may reach itself through its body;
+// a depth-first search over the calls finds any such cycle.
+std::error_code ExprArchive::validateCalls() const {
+  enum : uint8_t { Unvisited, OnPath, Done };
+
+  struct Visit {
+    uint32_t symbol;
+    std::vector<uint32_t> callees;
+    size_t next;
+  };
+
+  const uint32_t count = header_->symbolCount;
+  std::vector<uint8_t> state(count, Unvisited);
+  std::vector<uint32_t> seen(header_->nodeCount, None);
+
+  for (uint32_t root = 0; root < count; ++root) {
+    if (symbols_[root].kind != archive::SymbolKind::Mapping || state[root] != Unvisited)
+      continue;
+
+    state[root] = OnPath;
+    std::vector<Visit> path{Visit{root, callees(root, &seen), 0}};
+    while (!path.empty()) {
+      Visit& v = path.back();
+      if (v.next == v.callees.size()) {
+        state[v.symbol] = Done;
+        path.pop_back();
+        continue;
+      }
+
+      const uint32_t s = v.callees[v.next++];
+      if (state[s] == OnPath)
+        return make_error_code(RecursiveMapping);
+      if (state[s] == Unvisited) {
+        state[s] = OnPath;
+        path.push_back(Visit{s, callees(s, &seen), 0});
+      }
+    }
+  }
+
+  return std::error_code();
+}
+
+// The archive mappings called from the body of @p symbol, whose nodes are
+// marked in @p seen, so that shared ones are walked once.
+std::vector<uint32_t> ExprArchive::callees(uint32_t symbol,
+                                           std::vector<uint32_t>* seen) const {
+  std::vector<uint32_t> out;
+  std::vector<uint32_t> pending{symbols_[symbol].body};
+  auto children = [&](uint32_t first, uint32_t count) {
+    pending.insert(pending.end(), indices_ + first, indices_ + first + count);
+  };
+
+  while (!pending.empty()) {
+    const uint32_t i = pending.back();
+    pending.pop_back();
+    if ((*seen)[i] == symbol)
+      continue;
+    (*seen)[i] = symbol;
+
+    const Node& n = nodes_[i];
+    switch (n.kind) {
+      case NodeKind::Number:
+      case NodeKind::Symbol:
+        break;
+      case NodeKind::Neg:
+      case NodeKind::Fac:
+        pending.push_back(n.a);
+        break;
+      case NodeKind::Case:
+        children(n.b, 2 * n.count + 1);
+        break;
+      case NodeKind::Call: {
+        const uint32_t s = names_[n.a].symbol;
+        if (s != None && symbols_[s].kind == archive::SymbolKind::Mapping)
+          out.push_back(s);
+        children(n.b, n.count);
+        break;
+      }
+      case NodeKind::Sum:
+      case NodeKind::Product:
+      case NodeKind::SeriesSum:
+      case NodeKind::SeriesProduct:
+        children(n.b, n.count);
+        break;
+      default:
+        pending.push_back(n.a);
+        pending.push_back(n.b);
+        break;
+    }
+  }
+
+  return out;
+}
+
+std::string_view ExprArchive::name(uint32_t id) const {
+  return std::string_view(strings_ + names_[id].offset, names_[id].length);
+}
+
+std::string_view ExprArchive::symbolName(size_t i) const {
+  return name(symbols_[i].name);
+}
+
+uint32_t ExprArchive::parameter(const archive::SymbolRecord& s, size_t i) const {
+  return indices_[s.params + i];
+}
+
+std::string_view ExprArchive::formulaSource(size_t i) const {
+  return std::string_view(strings_ + formulas_[i].sourceOffset,
+                          formulas_[i].sourceLength);
+}
+
+const archive::SymbolRecord* ExprArchive::lookup(std::string_view s) const {
+  const archive::SymbolRecord* begin = symbols_;
+  const archive::SymbolRecord* end = symbols_ + header_->symbolCount;
+  auto i = std::lower_bound(begin, end, s,
+                            [this](const archive::SymbolRecord& r, std::string_view v) {
+                              return name(r.name) < v;
+                            });
+  if (i != end && name(i->name) == s)
+    return i;
+
+  return nullptr;
+}
+
+Number ExprArchive::calculateFormula(size_t i, const SymbolTable& t) const {
+  return calculate(formulas_[i].root, nullptr, t);
+}
+
+Number ExprArchive::call(const archive::SymbolRecord& mapping,
+                         const Number* args,
+                         const SymbolTable& t) const {
+  Frame frame{&mapping, args, nullptr, None};
+  return calculate(mapping.body, &frame, t);
+}
+
+Number ExprArchive::calculate(uint32_t i, const Frame* frame, const SymbolTable& t) const {
+  const Node& n = nodes_[i];
+  switch (n.kind) {
+    case NodeKind::Number:
+      return Number(n.re, n.im);
+    case NodeKind::Symbol: {
+      for (const Frame* f = frame; f; f = f->outer) {
+        if (!f->mapping && f->index == n.a)
+          return *f->args;
+        if (f->mapping)
+          for (uint32_t k = 0; k < f->mapping->paramCount; ++k)
+            if (parameter(*f->mapping, k) == n.a)
+              return f->args[k];
+      }
+
+      uint32_t s = names_[n.a].symbol;
+      if (s != None && symbols_[s].kind == archive::SymbolKind::Constant)
+        return Number(symbols_[s].re, symbols_[s].im);
+
+      if (auto c = dynamic_cast<const ConstantDef*>(t.lookup(Symbol(name(n.a)))))
+        return c->getNumber();
+
+      return std::nan("");
+    }
+    case NodeKind::Neg:
+      return -calculate(n.a, frame, t);
+    case NodeKind::Fac:
+      return factorial(calculate(n.a, frame, t));
+    case NodeKind::Plus:
+      return calculate(n.a, frame, t) + calculate(n.b, frame, t);
+    case NodeKind::Minus:
+      return calculate(n.a, frame, t) - calculate(n.b, frame, t);
+    case NodeKind::Mul:
+      return calculate(n.a, frame, t) * calculate(n.b, frame, t);
+    case NodeKind::Div: {
+      // by the reciprocal of a literal, as DivExpr does
+      const Node& d = nodes_[n.b];
+      if (d.kind == NodeKind::Number)
+        return calculate(n.a, frame, t) * (Number(1) / Number(d.re, d.im));
+      return calculate(n.a, frame, t) / calculate(n.b, frame, t);
+    }
+    case NodeKind::Pow:
+      return power(calculate(n.a, frame, t), calculate(n.b, frame, t));
+    case NodeKind::Equ: {
+      Number a = calculate(n.a, frame, t);
+      Number b = calculate(n.b, frame, t);
+      if (a == b)
+        return a;
+      else
+        return Number(std::nan(""), std::nan(""));
+    }
+    case NodeKind::Less: {
+      Number a = calculate(n.a, frame, t);
+      Number b = calculate(n.b, frame, t);
+      if (!a.imag() && !b.imag() && a.real() < b.real())
+        return a;
+      else
+        return Number(std::nan(""), std::nan(""));
+    }
+    case NodeKind::Define:
+      return calculate(n.a, frame, t) == calculate(n.b, frame, t) ? 1 : 0;
+    case NodeKind::Call: {
+      MappingDef::NumberList args(n.count);
+      for (uint32_t k = 0; k < n.count; ++k)
+        args[k] = calculate(indices_[n.b + k], frame, t);
+
+      uint32_t s = names_[n.a].symbol;
+      if (s != None && symbols_[s].kind == archive::SymbolKind::Mapping) {
+        if (args.size() < symbols_[s].paramCount)
+          args.resize(symbols_[s].paramCount, Number(std::nan(""), std::nan("")));
+        return call(symbols_[s], args.data(), t);
+      }
+
+      if (auto m = dynamic_cast<const MappingDef*>(t.lookup(Symbol(name(n.a)))))
+        return m->call(t, args);
+
+      return std::nan("");
+    }
+    case NodeKind::Case: {
+      // relations hold where they are not NaN, as CaseExpr::holds() has it
+      auto holds = [&](uint32_t c) {
+        const Number x = calculate(c, frame, t);
+        if (nodes_[c].kind == NodeKind::Equ || nodes_[c].kind == NodeKind::Less)
+          return !std::isnan(x.real());
+        return x != Number() && !std::isnan(x.real()) && !std::isnan(x.imag());
+      };
+      for (uint32_t k = 0; k < n.count; ++k)
+        if (holds(indices_[n.b + 2 * k]))
+          return calculate(indices_[n.b + 2 * k + 1], frame, t);
+
+      return calculate(indices_[n.b + 2 * n.count], frame, t);
+    }
+    case NodeKind::Sum: {
+      SumAccumulator sum;
+      for (uint32_t k = 0; k < n.count; ++k)
+        sum.add(calculate(indices_[n.b + k], frame, t));
+      return sum.result();
+    }
+    case NodeKind::Product: {
+      ProductAccumulator product;
+      for (uint32_t k = 0; k < n.count; ++k)
+        product.multiply(calculate(indices_[n.b + k], frame, t));
+      return product.result();
+    }
+    case NodeKind::SeriesSum:
+    case NodeKind::SeriesProduct: {
+      const Number first = calculate(indices_[n.b + 1], frame, t);
+      const Number last = n.count == 3 ? calculate(indices_[n.b + 2], frame, t)
+                                       : Number(INFINITY);
+      if (first.imag() != 0 || last.imag() != 0)
+        return std::nan("");
+
+      Number k;
+      Frame inner{nullptr, &k, frame, n.a};
+      auto term = [&](double x) {
+        k = x;
+        return calculate(indices_[n.b], &inner, t);
+      };
+      Result<Number> y =
+          n.kind == NodeKind::SeriesSum
+              ? Series::sum(term, first.real(), last.real(), Series::Options())
+              : Series::product(term, first.real(), last.real(), Series::Options());
+      return y ? *y : Number(std::nan(""));
+    }
+  }
+  return std::nan("");
+}
+// }}}
+// {{{ ExprArchive::ErrorCategory
+const ExprArchive::ErrorCategory& ExprArchive::ErrorCategory::get() {
+  static ErrorCategory c;
+  return c;
+}
+
+const char* ExprArchive::ErrorCategory::name() const noexcept {
+  return "ExprArchiveError";
+}
+
+std::string ExprArchive::ErrorCategory::message(int ec) const {
+  switch (static_cast<ErrorCode>(ec)) {
+    case InvalidMagic:
+      return "Not an expression archive";
+    case UnsupportedVersion:
+      return "Unsupported archive version";
+    case ForeignByteOrder:
+      return "Archive was written with a different byte order";
+    case Truncated:
+      return "Archive is truncated";
+    case ChecksumMismatch:
+      return "Archive checksum mismatch";
+    case Corrupted:
+      return "Archive is corrupted";
+    case UnsupportedExpr:
+      return "Expression cannot be archived";
+    case RecursiveMapping:
+      return "Archive mapping calls itself";
+  }
+  return "Unknown error";
+}
+// }}}
+
+}  // namespace cmath
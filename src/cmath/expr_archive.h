@@ -0,0 +1,276 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <cmath/result.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+namespace cmath {
+
+/*
+  Binary, position independent expression archive.
+
+  All sections are addressed by byte offsets relative to the start of the
+  file and all cross references by indices, so the file can be mmap()ed at
+  any address and evaluated in place, sharing its pages between processes.
+
+    Header
+    Node[nodeCount]           expression nodes, children before parents
+    uint32_t[indexCount]      argument, case and parameter lists
+    NameRef[nameCount]        interned symbol names
+    SymbolRecord[symbolCount] constants and custom mappings
+    FormulaRecord[formulaCount]
+    char[stringSize]          UTF-8 string pool (names and formula sources)
+
+  The header's checksum is the 64-bit FNV-1a hash of everything behind it.
+  All integers are stored in host byte order; byteOrder tells a foreign
+  reader to reject the file.
+ */
+namespace archive {
+
+constexpr char Magic[8] = {'C', 'M', 'A', 'T', 'H', 'A', 'R', 0};
+constexpr uint32_t FormatVersion = 2;
+constexpr uint32_t ByteOrderMark = 0x01020304;
+constexpr uint32_t None = 0xFFFFFFFF;
+
+enum class NodeKind : uint16_t {
+  Number,  // re, im
+  Symbol,  // a = name
+  Neg,     // a = subexpr
+  Fac,     // a = subexpr
+  Plus,    // a = left, b = right
+  Minus,
+  Mul,
+  Div,
+  Pow,
+  Equ,
+  Less,
+  Define,
+  Call,    // a = name, b = first index of arguments, count = arguments
+  Case,    // b = first index of (cond, expr)* else, count = cases
+  Sum,     // b = first index of terms, subtracted ones negated, count = terms
+  Product, // b = first index of factors, count = factors
+  SeriesSum,      // a = index name, b = first index of body, first, last,
+  SeriesProduct,  // count = 3, or 2 without last for infinity
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint64_t fileSize;
+  uint64_t checksum;
+  uint32_t nodeOffset;
+  uint32_t nodeCount;
+  uint32_t indexOffset;
+  uint32_t indexCount;
+  uint32_t nameOffset;
+  uint32_t nameCount;
+  uint32_t symbolOffset;
+  uint32_t symbolCount;
+  uint32_t formulaOffset;
+  uint32_t formulaCount;
+  uint32_t stringOffset;
+  uint32_t stringSize;
+};
+
+struct Node {
+  NodeKind kind;
+  uint16_t reserved;
+  uint32_t count;
+  uint32_t a;
+  uint32_t b;
+  double re;
+  double im;
+};
+
+struct NameRef {
+  uint32_t offset;  // into string pool
+  uint32_t length;
+  uint32_t symbol;  // SymbolRecord defining this name, or None
+  uint32_t reserved;
+};
+
+enum class SymbolKind : uint32_t {
+  Constant,  // re, im
+  Mapping,   // params, paramCount, body
+};
+
+struct SymbolRecord {
+  uint32_t name;
+  SymbolKind kind;
+  uint32_t params;  // first index of parameter names
+  uint32_t paramCount;
+  uint32_t body;
+  uint32_t reserved;
+  double re;
+  double im;
+};
+
+struct FormulaRecord {
+  uint32_t sourceOffset;  // into string pool
+  uint32_t sourceLength;
+  uint32_t root;
+  uint32_t reserved;
+};
+
+uint64_t checksum(const void* data, size_t size);
+
+}  // namespace archive
+
+/**
+ * Serializes parsed expressions and symbol definitions into the binary
+ * archive format understood by ExprArchive.
+ */
+class ExprArchiveWriter {
+ public:
+  ExprArchiveWriter();
+
+  /**
+   * Adds all constants and custom mappings of @p symbolTable's own scope,
+   * except for the mappings whose bodies archives cannot hold, such as
+   * tuples and matrices. Returns the names of those.
+   */
+  std::vector<Symbol> addSymbols(const SymbolTable& symbolTable);
+
+  /**
+   * Adds @p expr, parsed from @p source, and returns its formula index,
+   * or ExprArchive::UnsupportedExpr, leaving the archive as it was, if
+   * archives cannot hold it.
+   */
+  Result<size_t> addFormula(const std::string& source, const Expr* expr);
+
+  /// Returns the complete archive image.
+  std::string finish() const;
+
+  std::error_code save(const std::string& path) const;
+
+ private:
+  uint32_t name(const std::string& s);
+  uint32_t string(const std::string& s);
+  Result<uint32_t> tree(const Expr* e);
+  uint32_t node(const Expr* e);
+  uint32_t push(const archive::Node& n);
+
+ private:
+  std::vector<archive::Node> nodes_;
+  std::vector<uint32_t> indices_;
+  std::vector<archive::NameRef> names_;
+  std::unordered_map<std::string, uint32_t> nameIds_;
+  std::vector<archive::SymbolRecord> symbols_;
+  std::vector<archive::FormulaRecord> formulas_;
+  std::string strings_;
+};
+
+/**
+ * Read-only view of a memory mapped expression archive.
+ *
+ * Formulas are evaluated directly off the mapped nodes; no expression tree
+ * is materialized. Symbols not defined by the archive itself are resolved
+ * through the SymbolTable passed for evaluation.
+ */
+class ExprArchive {
+ public:
+  enum ErrorCode {
+    InvalidMagic = 1,
+    UnsupportedVersion,
+    ForeignByteOrder,
+    Truncated,
+    ChecksumMismatch,
+    Corrupted,
+    UnsupportedExpr,
+    RecursiveMapping,
+  };
+  class ErrorCategory;
+
+  /**
+   * Maps the archive at @p path.
+   *
+   * @param verify whether or not to validate the checksum and all internal
+   *               references, which touches every page of the file once,
+   *               and that no mapping calls itself, also through others.
+   */
+  static Result<std::unique_ptr<ExprArchive>> open(const std::string& path,
+                                                   bool verify = true);
+
+  /// Uses @p size bytes at @p data without taking ownership.
+  static Result<std::unique_ptr<ExprArchive>> view(const void* data,
+                                                   size_t size,
+                                                   bool verify = true);
+
+  ~ExprArchive();
+
+  ExprArchive(const ExprArchive&) = delete;
+  ExprArchive& operator=(const ExprArchive&) = delete;
+
+  const archive::Header& header() const noexcept { return *header_; }
+  size_t size() const noexcept { return size_; }
+
+  size_t formulaCount() const noexcept { return header_->formulaCount; }
+  std::string_view formulaSource(size_t i) const;
+  Number calculateFormula(size_t i, const SymbolTable& t) const;
+
+  size_t symbolCount() const noexcept { return header_->symbolCount; }
+  const archive::SymbolRecord& symbol(size_t i) const { return symbols_[i]; }
+  std::string_view symbolName(size_t i) const;
+  std::string_view name(uint32_t id) const;
+  uint32_t parameter(const archive::SymbolRecord& s, size_t i) const;
+
+  /// Looks up a constant or mapping defined by the archive.
+  const archive::SymbolRecord* lookup(std::string_view name) const;
+
+ private:
+  ExprArchive(const void* base, size_t size, bool mapped);
+
+  std::error_code validate(bool verify);
+  std::error_code validateCalls() const;
+  std::vector<uint32_t> callees(uint32_t symbol, std::vector<uint32_t>* seen) const;
+
+  struct Frame;
+  Number calculate(uint32_t node, const Frame* frame, const SymbolTable& t) const;
+  Number call(const archive::SymbolRecord& mapping,
+              const Number* args,
+              const SymbolTable& t) const;
+
+ private:
+  const char* base_;
+  size_t size_;
+  bool mapped_;
+  const archive::Header* header_;
+  const archive::Node* nodes_;
+  const uint32_t* indices_;
+  const archive::NameRef* names_;
+  const archive::SymbolRecord* symbols_;
+  const archive::FormulaRecord* formulas_;
+  const char* strings_;
+};
+
+class ExprArchive::ErrorCategory : public std::error_category {
+ public:
+  static const ErrorCategory& get();
+
+  const char* name() const noexcept override;
+  std::string message(int ec) const override;
+};
+
+inline std::error_code make_error_code(ExprArchive::ErrorCode ec) {
+  return std::error_code(static_cast<int>(ec), ExprArchive::ErrorCategory::get());
+}
+
+}  // namespace cmath
+
+namespace std {
+template <>
+struct is_error_code_enum<cmath::ExprArchive::ErrorCode> : public true_type {};
+}  // namespace std
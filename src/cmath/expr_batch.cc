@@ -0,0 +1,773 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/accumulate.h>
+#include <cmath/expr_batch.h>
+#include <cmath/lowering.h>
+#include <cmath/simd.h>
+#include <cmath/special.h>
+#include <algorithm>
+#include <cmath>
+
+namespace cmath {
+
+namespace {
+
+// points evaluated per operation at a time; their registers stay in cache
+constexpr size_t BatchSize = 64;
+
+// arms of a case that cost more than this many additions per point are run
+// as branches, for their points only
+constexpr size_t BranchCost = 32;
+
+// chains of this many comparisons with thresholds or more are searched
+constexpr size_t MinThresholds = 4;
+
+const Number NaN(std::nan(""), std::nan(""));
+
+}  // namespace
+
+// {{{ BatchProgram::Compiler
+class BatchProgram::Compiler : public Lowering {
+ public:
+  Compiler(const SymbolTable& t, BatchProgram* program)
+      : Lowering(t, make_error_code(UnsupportedExpr)), program_(program) {}
+
+  uint32_t emit(OpKind kind, uint32_t a = 0, uint32_t b = 0);
+
+ private:
+  uint32_t operandList(OpKind kind, const std::vector<uint32_t>& operands);
+  uint32_t constant(Number value) override;
+  uint32_t builtin(const Symbol& name, const std::vector<uint32_t>& args) override;
+  uint32_t operation(const Expr* e) override;
+  uint32_t power(uint32_t x, uint32_t y);
+  uint32_t integerPower(uint32_t x, int n);
+  uint32_t caseExpr(const CaseExpr* e);
+  bool thresholds(const CaseExpr* e, Case* c, std::vector<size_t>* taken);
+  Arm arm(const Expr* e);
+
+  // sizes of the program so far, to roll back to
+  struct Mark {
+    size_t ops;
+    size_t operands;
+    size_t cases;
+    size_t branches;
+  };
+  Mark mark() const;
+  void rollback(const Mark& m);
+  size_t cost(const Mark& m) const;
+
+ private:
+  BatchProgram* program_;
+};
+
+uint32_t BatchProgram::Compiler::emit(OpKind kind, uint32_t a, uint32_t b) {
+  program_->ops_.push_back(Op{kind, a, b, Number()});
+  return static_cast<uint32_t>(program_->ops_.size() - 1);
+}
+
+uint32_t BatchProgram::Compiler::operandList(OpKind kind,
+                                             const std::vector<uint32_t>& operands) {
+  std::vector<uint32_t>& list = program_->operands_;
+  const uint32_t first = static_cast<uint32_t>(list.size());
+  list.insert(list.end(), operands.begin(), operands.end());
+  return emit(kind, first, static_cast<uint32_t>(operands.size()));
+}
+
+uint32_t BatchProgram::Compiler::constant(Number value) {
+  const uint32_t reg = emit(OpKind::Constant);
+  program_->ops_[reg].value = value;
+  return reg;
+}
+
+// x^y, reduced as power() reduces it for a constant exponent, so that the
+// results are the same: small integer exponents to multiplications, 1/2 to
+// a square root, and e^y to exp(y)
+uint32_t BatchProgram::Compiler::power(uint32_t x, uint32_t y) {
+  const Op& base = program_->ops_[x];
+  if (base.kind == OpKind::Constant && base.value == Number(M_E))
+    return emit(OpKind::Exp, y);
+
+  const Op& exponent = program_->ops_[y];
+  if (exponent.kind == OpKind::Constant && !exponent.value.imag()) {
+    const double n = exponent.value.real();
+    if (n == std::floor(n) && std::abs(n) <= 4)
+      return integerPower(x, static_cast<int>(n));
+    if (n == 0.5)
+      return emit(OpKind::Sqrt, x);
+  }
+
+  return emit(OpKind::Pow, x, y);
+}
+
+// x^n for |n| <= 4, with real bases multiplied as reals and complex ones by
+// the addition chain of cmath::integerPower(), as power() does
+uint32_t BatchProgram::Compiler::integerPower(uint32_t x, int n) {
+  if (n == 0)
+    return constant(1);
+
+  const uint32_t reg = emit(OpKind::PowInt, x);
+  program_->ops_[reg].value = n;
+  return reg;
+}
+
+uint32_t BatchProgram::Compiler::builtin(const Symbol& name,
+                                         const std::vector<uint32_t>& args) {
+  const uint32_t x = args.empty() ? constant(std::nan("")) : args[0];
+
+  if (name == "Re")
+    return emit(OpKind::Re, x);
+  if (name == "Im")
+    return emit(OpKind::Im, x);
+  if (name == "arg")
+    return emit(OpKind::Arg, x);
+  if (name == "sin")
+    return emit(OpKind::Sin, x);
+  if (name == "cos")
+    return emit(OpKind::Cos, x);
+  if (name == "tan")
+    return emit(OpKind::Tan, x);
+  if (name == "exp")
+    return emit(OpKind::Exp, x);
+  if (name == "sqrt")
+    return emit(OpKind::Sqrt, x);
+  if (name == "log")
+    return emit(OpKind::Log, x);
+  if (name == "gamma")
+    return emit(OpKind::Gamma, x);
+  if (name == "lgamma")
+    return emit(OpKind::LogGamma, x);
+  if (name == "digamma")
+    return emit(OpKind::Digamma, x);
+  if (name == "erf")
+    return emit(OpKind::Erf, x);
+  if (name == "erfc")
+    return emit(OpKind::Erfc, x);
+
+  const uint32_t y = args.size() < 2 ? constant(std::nan("")) : args[1];
+  if (name == "polar")
+    return emit(OpKind::Polar, x, y);
+  if (name == "besselj")
+    return emit(OpKind::BesselJ, x, y);
+  if (name == "besseli")
+    return emit(OpKind::BesselI, x, y);
+
+  unsupported();
+}
+
+BatchProgram::Compiler::Mark BatchProgram::Compiler::mark() const {
+  return Mark{program_->ops_.size(), program_->operands_.size(), program_->cases_.size(),
+              program_->branches_.size()};
+}
+
+void BatchProgram::Compiler::rollback(const Mark& m) {
+  program_->ops_.resize(m.ops);
+  program_->operands_.resize(m.operands);
+  program_->cases_.resize(m.cases);
+  program_->branches_.resize(m.branches);
+}
+
+// Additions per point that the operations since @p m take, roughly.
+size_t BatchProgram::Compiler::cost(const Mark& m) const {
+  size_t total = 0;
+  for (size_t i = m.ops; i < program_->ops_.size(); ++i) {
+    const Op& op = program_->ops_[i];
+    switch (op.kind) {
+      case OpKind::Mul:
+      case OpKind::Div:
+      case OpKind::PowInt:
+        total += 4;
+        break;
+      case OpKind::Sum:
+      case OpKind::Product:
+        total += op.b;
+        break;
+      case OpKind::Arg:
+      case OpKind::Sqrt:
+      case OpKind::Exp:
+      case OpKind::Log:
+      case OpKind::Sin:
+      case OpKind::Cos:
+      case OpKind::Tan:
+      case OpKind::Polar:
+        total += 16;
+        break;
+      case OpKind::Fac:
+      case OpKind::Pow:
+      case OpKind::Gamma:
+      case OpKind::LogGamma:
+      case OpKind::Digamma:
+      case OpKind::Erf:
+      case OpKind::Erfc:
+      case OpKind::BesselJ:
+      case OpKind::BesselI:
+      case OpKind::Case:
+        total += 64;
+        break;
+      default:
+        total += 1;
+        break;
+    }
+  }
+  return total;
+}
+
+// Recognizes the conditions of @p e as comparisons of one register with
+// constants, all x < t or all t < x, keeping those cases in @p taken that
+// an earlier one does not shadow.
+bool BatchProgram::Compiler::thresholds(const CaseExpr* e,
+                                        Case* c,
+                                        std::vector<size_t>* taken) {
+  if (e->cases().size() < MinThresholds)
+    return false;
+
+  // the comparisons themselves are only compiled to look at their operands
+  const Mark start = mark();
+  uint32_t x = 0;
+  double direction = 0;
+  for (size_t i = 0; i < e->cases().size(); ++i) {
+    auto less = dynamic_cast<const LessExpr*>(e->cases()[i].first.get());
+    if (!less)
+      break;
+
+    const uint32_t l = compile(less->left());
+    const uint32_t r = compile(less->right());
+    const Op& left = program_->ops_[l];
+    const Op& right = program_->ops_[r];
+
+    // x < t, or t < x, which is -x < -t
+    uint32_t subject;
+    double sign;
+    Number t;
+    if (right.kind == OpKind::Constant && left.kind != OpKind::Constant) {
+      subject = l;
+      sign = 1;
+      t = right.value;
+    } else if (left.kind == OpKind::Constant && right.kind != OpKind::Constant) {
+      subject = r;
+      sign = -1;
+      t = left.value;
+    } else {
+      break;
+    }
+
+    if (t.imag() || std::isnan(t.real()) || (i && (subject != x || sign != direction)))
+      break;
+
+    x = subject;
+    direction = sign;
+
+    // reachable only past all smaller thresholds so far
+    if (c->thresholds.empty() || sign * t.real() > c->thresholds.back()) {
+      c->thresholds.push_back(sign * t.real());
+      taken->push_back(i);
+    }
+
+    if (i + 1 == e->cases().size() && c->thresholds.size() >= MinThresholds) {
+      rollback(start);
+      c->x = direction > 0 ? x : emit(OpKind::Neg, x);
+      return true;
+    }
+  }
+
+  rollback(start);
+  c->thresholds.clear();
+  taken->clear();
+  return false;
+}
+
+// @p e inline, or as a branch of its own if it is expensive.
+BatchProgram::Arm BatchProgram::Compiler::arm(const Expr* e) {
+  const Mark start = mark();
+  const uint32_t y = compile(e);
+  if (cost(start) <= BranchCost)
+    return Arm{false, y, {}};
+
+  rollback(start);
+
+  // the innermost binding of each name in scope becomes a variable of the branch
+  BatchProgram branch;
+  Compiler compiler(symbols_, &branch);
+  compiler.depth_ = depth_;
+  Arm a{true, static_cast<uint32_t>(program_->branches_.size()), {}};
+  for (size_t i = frame_.size(); i-- > 0;) {
+    const Symbol& name = frame_[i].first;
+    if (compiler.argument(name))
+      continue;
+    compiler.bind(name,
+                  compiler.emit(OpKind::Variable, static_cast<uint32_t>(a.inputs.size())));
+    branch.variables_.push_back(name);
+    a.inputs.push_back(frame_[i].second);
+  }
+  branch.result_ = compiler.compile(e);
+
+  program_->branches_.push_back(std::move(branch));
+  return a;
+}
+
+uint32_t BatchProgram::Compiler::caseExpr(const CaseExpr* e) {
+  Case c;
+  std::vector<const Expr*> arms;
+  std::vector<size_t> taken;
+  if (thresholds(e, &c, &taken)) {
+    for (size_t i : taken)
+      arms.push_back(e->cases()[i].second.get());
+  } else {
+    for (const CaseExpr::CaseMatch& m : e->cases()) {
+      c.conditions.push_back(compile(m.first.get()));
+      c.relations.push_back(dynamic_cast<const EquExpr*>(m.first.get()) ||
+                            dynamic_cast<const LessExpr*>(m.first.get()));
+      arms.push_back(m.second.get());
+    }
+  }
+  arms.push_back(e->elseExpr());
+
+  bool branches = false;
+  for (const Expr* a : arms) {
+    c.arms.push_back(arm(a));
+    branches |= c.arms.back().branch;
+  }
+
+  if (!c.thresholds.empty() || branches) {
+    program_->cases_.push_back(std::move(c));
+    return emit(OpKind::Case, static_cast<uint32_t>(program_->cases_.size() - 1));
+  }
+
+  // all arms cheap: selects by mask, from the else arm up
+  uint32_t y = c.arms.back().index;
+  for (size_t i = c.conditions.size(); i-- > 0;) {
+    std::vector<uint32_t>& list = program_->operands_;
+    const uint32_t first = static_cast<uint32_t>(list.size());
+    list.insert(list.end(), {c.conditions[i], c.arms[i].index, y});
+    y = emit(OpKind::Select, first, c.relations[i]);
+  }
+  return y;
+}
+
+uint32_t BatchProgram::Compiler::operation(const Expr* e) {
+  if (auto n = dynamic_cast<const NumberExpr*>(e))
+    return constant(n->getNumber());
+
+  if (auto n = dynamic_cast<const NegExpr*>(e)) {
+    // of a constant: the negated constant
+    const uint32_t x = compile(n->subExpr());
+    if (program_->ops_[x].kind == OpKind::Constant)
+      return constant(-program_->ops_[x].value);
+    return emit(OpKind::Neg, x);
+  }
+
+  if (auto f = dynamic_cast<const FacExpr*>(e))
+    return emit(OpKind::Fac, compile(f->subExpr()));
+
+  if (auto s = dynamic_cast<const SumExpr*>(e)) {
+    std::vector<uint32_t> terms;
+    for (const SumExpr::Term& term : s->terms()) {
+      const uint32_t x = compile(term.expr.get());
+      terms.push_back(term.subtract ? emit(OpKind::Neg, x) : x);
+    }
+    return operandList(OpKind::Sum, terms);
+  }
+
+  if (auto p = dynamic_cast<const ProductExpr*>(e)) {
+    std::vector<uint32_t> factors;
+    for (const std::unique_ptr<Expr>& factor : p->factors())
+      factors.push_back(compile(factor.get()));
+    return operandList(OpKind::Product, factors);
+  }
+
+  if (auto b = dynamic_cast<const BinaryExpr*>(e)) {
+    const uint32_t x = compile(b->left());
+    const uint32_t y = compile(b->right());
+
+    if (dynamic_cast<const PlusExpr*>(e))
+      return emit(OpKind::Plus, x, y);
+    if (dynamic_cast<const MinusExpr*>(e))
+      return emit(OpKind::Minus, x, y);
+    if (dynamic_cast<const MulExpr*>(e))
+      return emit(OpKind::Mul, x, y);
+    if (dynamic_cast<const DivExpr*>(e)) {
+      // by a literal: multiplication by its reciprocal, as DivExpr does, so
+      // that the results agree; not by other constants, which it divides by
+      if (auto n = dynamic_cast<const NumberExpr*>(b->right()))
+        return emit(OpKind::Mul, x, constant(Number(1) / n->getNumber()));
+      return emit(OpKind::Div, x, y);
+    }
+    if (dynamic_cast<const PowExpr*>(e))
+      return power(x, y);
+    if (dynamic_cast<const EquExpr*>(e))
+      return emit(OpKind::Equ, x, y);
+    if (dynamic_cast<const LessExpr*>(e))
+      return emit(OpKind::Less, x, y);
+    if (dynamic_cast<const DefineExpr*>(e))
+      return emit(OpKind::Define, x, y);
+  }
+
+  if (auto c = dynamic_cast<const CaseExpr*>(e))
+    return caseExpr(c);
+
+  unsupported();
+}
+// }}}
+
+// {{{ BatchProgram
+Result<BatchProgram> BatchProgram::compile(const Expr* e,
+                                           const SymbolTable& t,
+                                           const std::vector<Symbol>& variables) {
+  BatchProgram program;
+  program.variables_ = variables;
+
+  try {
+    Compiler compiler(t, &program);
+    for (size_t i = 0; i < variables.size(); ++i)
+      compiler.bind(variables[i], compiler.emit(OpKind::Variable, i));
+
+    program.result_ = compiler.compile(e);
+  } catch (const std::error_code& ec) {
+    return ec;
+  }
+
+  return program;
+}
+
+Number BatchProgram::evaluate(const Number* point) const {
+  Number result;
+  evaluate(point, 1, &result);
+  return result;
+}
+
+void BatchProgram::evaluate(const Number* points, size_t count, Number* out) const {
+  const size_t n = ops_.size() * std::min(count, BatchSize);
+  std::vector<double> regs(2 * n);
+
+  for (size_t i = 0; i < count; i += BatchSize)
+    run(points + i * variables_.size(), std::min(BatchSize, count - i),
+        regs.data(), regs.data() + n, out + i);
+}
+
+// Runs all operations over @p count points, one operation at a time, with
+// the real and imaginary parts of an operation's registers in separate
+// arrays.
+void BatchProgram::run(const Number* points,
+                       size_t count,
+                       double* re,
+                       double* im,
+                       Number* out) const {
+  const size_t arity = variables_.size();
+
+  for (size_t i = 0; i < ops_.size(); ++i) {
+    const Op& op = ops_[i];
+    double* rr = re + i * count;
+    double* ri = im + i * count;
+    const double* xr = re + op.a * count;
+    const double* xi = im + op.a * count;
+    const double* yr = re + op.b * count;
+    const double* yi = im + op.b * count;
+
+    auto store = [&](size_t k, Number z) {
+      rr[k] = z.real();
+      ri[k] = z.imag();
+    };
+    auto unary = [&](auto f) {
+      for (size_t k = 0; k < count; ++k)
+        store(k, f(Number(xr[k], xi[k])));
+    };
+    auto binary = [&](auto f) {
+      for (size_t k = 0; k < count; ++k)
+        store(k, f(Number(xr[k], xi[k]), Number(yr[k], yi[k])));
+    };
+
+    switch (op.kind) {
+      case OpKind::Constant:
+        std::fill(rr, rr + count, op.value.real());
+        std::fill(ri, ri + count, op.value.imag());
+        break;
+      case OpKind::Variable:
+        for (size_t k = 0; k < count; ++k)
+          store(k, points[k * arity + op.a]);
+        break;
+      case OpKind::Neg:
+        for (size_t k = 0; k < count; ++k) {
+          rr[k] = -xr[k];
+          ri[k] = -xi[k];
+        }
+        break;
+      case OpKind::Fac:
+        unary([](Number a) { return factorial(a); });
+        break;
+      case OpKind::Re:
+        std::copy(xr, xr + count, rr);
+        std::fill(ri, ri + count, 0);
+        break;
+      case OpKind::Im:
+        std::copy(xi, xi + count, rr);
+        std::fill(ri, ri + count, 0);
+        break;
+      case OpKind::Arg:
+        simd::arg(count, xr, xi, rr);
+        std::fill(ri, ri + count, 0);
+        break;
+      case OpKind::Sqrt:
+        simd::sqrt(count, xr, xi, rr, ri);
+        break;
+      case OpKind::Exp:
+        simd::exp(count, xr, xi, rr, ri);
+        break;
+      case OpKind::Log:
+        simd::log(count, xr, xi, rr, ri);
+        break;
+      case OpKind::Sin:
+        simd::sin(count, xr, xi, rr, ri);
+        break;
+      case OpKind::Cos:
+        simd::cos(count, xr, xi, rr, ri);
+        break;
+      case OpKind::Tan:
+        simd::tan(count, xr, xi, rr, ri);
+        break;
+      case OpKind::Gamma:
+        unary([](Number a) { return gamma(a); });
+        break;
+      case OpKind::LogGamma:
+        unary([](Number a) { return logGamma(a); });
+        break;
+      case OpKind::Digamma:
+        unary([](Number a) { return digamma(a); });
+        break;
+      case OpKind::Erf:
+        unary([](Number a) { return erf(a); });
+        break;
+      case OpKind::Erfc:
+        unary([](Number a) { return erfc(a); });
+        break;
+      case OpKind::Plus:
+        for (size_t k = 0; k < count; ++k) {
+          rr[k] = xr[k] + yr[k];
+          ri[k] = xi[k] + yi[k];
+        }
+        break;
+      case OpKind::Minus:
+        for (size_t k = 0; k < count; ++k) {
+          rr[k] = xr[k] - yr[k];
+          ri[k] = xi[k] - yi[k];
+        }
+        break;
+      case OpKind::Mul:
+        for (size_t k = 0; k < count; ++k) {
+          rr[k] = xr[k] * yr[k] - xi[k] * yi[k];
+          ri[k] = xr[k] * yi[k] + xi[k] * yr[k];
+        }
+        // redo the products that came out NaN with the C rules for
+        // infinities, as std::complex does
+        for (size_t k = 0; k < count; ++k)
+          if (std::isnan(rr[k]) && std::isnan(ri[k]))
+            store(k, Number(xr[k], xi[k]) * Number(yr[k], yi[k]));
+        break;
+      case OpKind::Div:
+        binary([](Number a, Number b) { return a / b; });
+        break;
+      case OpKind::Pow:
+        binary([](Number a, Number b) { return cmath::power(a, b); });
+        break;
+      case OpKind::PowInt: {
+        // both ways, selected per point by whether the base is real
+        const int n = static_cast<int>(op.value.real());
+        const int m = std::abs(n);
+        for (size_t k = 0; k < count; ++k) {
+          const double x = xr[k];
+          const double y = xi[k];
+          const double x2 = x * x;
+          const double p = m == 4 ? x2 * x2 : m == 3 ? x2 * x : m == 2 ? x2 : x;
+          const double sr = x * x - y * y;  // (x + yi)^2
+          const double si = x * y + y * x;
+          const double cr = m == 4 ? sr * sr - si * si
+                          : m == 3 ? sr * x - si * y
+                          : m == 2 ? sr
+                          : x;
+          const double ci = m == 4 ? sr * si + si * sr
+                          : m == 3 ? sr * y + si * x
+                          : m == 2 ? si
+                          : y;
+          rr[k] = y == 0 ? p : cr;
+          ri[k] = y == 0 ? 0 : ci;
+        }
+        // reciprocals, and products that came out NaN, as power() has them
+        for (size_t k = 0; k < count; ++k)
+          if (n < 0 || (std::isnan(rr[k]) && std::isnan(ri[k])))
+            store(k, cmath::power(Number(xr[k], xi[k]), Number(n)));
+        break;
+      }
+      case OpKind::Polar:
+        simd::polar(count, xr, yr, rr, ri);
+        break;
+      case OpKind::BesselJ:
+        binary([](Number a, Number b) { return besselJ(a, b); });
+        break;
+      case OpKind::BesselI:
+        binary([](Number a, Number b) { return besselI(a, b); });
+        break;
+      case OpKind::Equ:
+        binary([](Number a, Number b) { return a == b ? a : NaN; });
+        break;
+      case OpKind::Less:
+        binary([](Number a, Number b) {
+          return !a.imag() && !b.imag() && a.real() < b.real() ? a : NaN;
+        });
+        break;
+      case OpKind::Define:
+        binary([](Number a, Number b) { return a == b ? Number(1) : Number(0); });
+        break;
+      case OpKind::Sum:
+        for (size_t k = 0; k < count; ++k) {
+          SumAccumulator sum;
+          for (uint32_t j = 0; j < op.b; ++j) {
+            const size_t x = operands_[op.a + j] * count + k;
+            sum.add(Number(re[x], im[x]));
+          }
+          store(k, sum.result());
+        }
+        break;
+      case OpKind::Product:
+        for (size_t k = 0; k < count; ++k) {
+          ProductAccumulator product;
+          for (uint32_t j = 0; j < op.b; ++j) {
+            const size_t x = operands_[op.a + j] * count + k;
+            product.multiply(Number(re[x], im[x]));
+          }
+          store(k, product.result());
+        }
+        break;
+      case OpKind::Select: {
+        const uint32_t* s = &operands_[op.a];
+        const double* cr = re + s[0] * count;
+        const double* ci = im + s[0] * count;
+        const double* tr = re + s[1] * count;
+        const double* ti = im + s[1] * count;
+        const double* er = re + s[2] * count;
+        const double* ei = im + s[2] * count;
+        auto select = [&](auto holds) {
+          for (size_t k = 0; k < count; ++k) {
+            const bool h = holds(cr[k], ci[k]);
+            rr[k] = h ? tr[k] : er[k];
+            ri[k] = h ? ti[k] : ei[k];
+          }
+        };
+        if (op.b)
+          select([](double r, double) { return r == r; });
+        else
+          select([](double r, double i) { return (r != 0 || i != 0) && r == r && i == i; });
+        break;
+      }
+      case OpKind::Case:
+        runCase(cases_[op.a], count, re, im, rr, ri);
+        break;
+    }
+  }
+
+  for (size_t k = 0; k < count; ++k)
+    out[k] = Number(re[result_ * count + k], im[result_ * count + k]);
+}
+
+// Finds the arm of @p c each point takes, by its conditions or by binary
+// search among its thresholds, then takes the point's value from the arm's
+// register, or runs the arm's branch over all points that take it at once.
+void BatchProgram::runCase(const Case& c,
+                           size_t count,
+                           const double* re,
+                           const double* im,
+                           double* rr,
+                           double* ri) const {
+  const uint32_t otherwise = static_cast<uint32_t>(c.arms.size() - 1);
+  uint32_t arm[BatchSize];
+
+  if (c.conditions.empty()) {
+    const double* xr = re + c.x * count;
+    const double* xi = im + c.x * count;
+    const double* t = c.thresholds.data();
+    const uint32_t n = otherwise;
+    uint32_t top = 1;
+    while (top * 2 <= n)
+      top *= 2;
+
+    // the number of thresholds up to x
+    for (size_t k = 0; k < count; ++k) {
+      uint32_t i = 0;
+      for (uint32_t step = top; step; step >>= 1)
+        i = i + step <= n && t[i + step - 1] <= xr[k] ? i + step : i;
+      arm[k] = xi[k] == 0 && xr[k] == xr[k] ? i : otherwise;
+    }
+  } else {
+    std::fill(arm, arm + count, otherwise);
+    for (uint32_t j = otherwise; j-- > 0;) {
+      const double* cr = re + c.conditions[j] * count;
+      const double* ci = im + c.conditions[j] * count;
+      if (c.relations[j]) {
+        for (size_t k = 0; k < count; ++k)
+          arm[k] = cr[k] == cr[k] ? j : arm[k];
+      } else {
+        for (size_t k = 0; k < count; ++k)
+          arm[k] = (cr[k] != 0 || ci[k] != 0) && cr[k] == cr[k] && ci[k] == ci[k] ? j
+                                                                                 : arm[k];
+      }
+    }
+  }
+
+  for (size_t k = 0; k < count; ++k) {
+    const Arm& a = c.arms[arm[k]];
+    if (!a.branch) {
+      rr[k] = re[a.index * count + k];
+      ri[k] = im[a.index * count + k];
+    }
+  }
+
+  for (uint32_t j = 0; j <= otherwise; ++j) {
+    const Arm& a = c.arms[j];
+    if (!a.branch)
+      continue;
+
+    std::vector<size_t> points;
+    for (size_t k = 0; k < count; ++k)
+      if (arm[k] == j)
+        points.push_back(k);
+    if (points.empty())
+      continue;
+
+    const size_t arity = a.inputs.size();
+    std::vector<Number> inputs(points.size() * arity);
+    for (size_t p = 0; p < points.size(); ++p)
+      for (size_t v = 0; v < arity; ++v)
+        inputs[p * arity + v] = Number(re[a.inputs[v] * count + points[p]],
+                                       im[a.inputs[v] * count + points[p]]);
+
+    std::vector<Number> out(points.size());
+    branches_[a.index].evaluate(inputs.data(), points.size(), out.data());
+    for (size_t p = 0; p < points.size(); ++p) {
+      rr[points[p]] = out[p].real();
+      ri[points[p]] = out[p].imag();
+    }
+  }
+}
+// }}}
+// {{{ BatchProgram::ErrorCategory
+const BatchProgram::ErrorCategory& BatchProgram::ErrorCategory::get() {
+  static ErrorCategory c;
+  return c;
+}
+
+const char* BatchProgram::ErrorCategory::name() const noexcept {
+  return "BatchProgramError";
+}
+
+std::string BatchProgram::ErrorCategory::message(int ec) const {
+  switch (static_cast<ErrorCode>(ec)) {
+    case UnsupportedExpr:
+      return "Expression cannot be evaluated in batches";
+  }
+  return "Unknown error";
+}
+// }}}
+
+}  // namespace cmath
@@ -0,0 +1,163 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <cmath/result.h>
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace cmath {
+
+/**
+ * An expression compiled for evaluation at many points at once, i.e. one
+ * value per variable and point.
+ *
+ * Like IntervalProgram, compiling resolves constants and inlines custom
+ * mappings into a flat list of operations. Each operation then runs over a
+ * whole batch of points, on separate arrays of real and imaginary parts,
+ * so that the arithmetic vectorizes, as do the elementary functions, which
+ * come from cmath/simd.h. Results are those of Expr::calculate() with the
+ * variables defined as constants, up to the few ulps these differ from
+ * std::complex.
+ *
+ * Cases run without branching per point where their arms are cheap: all
+ * arms are evaluated and the results selected by mask. A chain of four or
+ * more comparisons of one variable with constants, such as
+ * when x < 1 then a when x < 2 then b ..., becomes a binary search for the
+ * arm among the thresholds. Expensive arms are compiled into programs of
+ * their own, which run for just the points that take them.
+ *
+ * Mappings that are neither builtin nor custom, and forms such as root(),
+ * fail to compile with UnsupportedExpr; callers fall back to calculate().
+ */
+class BatchProgram {
+ public:
+  enum ErrorCode {
+    UnsupportedExpr = 1,
+  };
+  class ErrorCategory;
+
+  static Result<BatchProgram> compile(const Expr* e,
+                                      const SymbolTable& t,
+                                      const std::vector<Symbol>& variables);
+
+  const std::vector<Symbol>& variables() const noexcept { return variables_; }
+
+  /// Number of operations.
+  size_t size() const noexcept { return ops_.size(); }
+
+  /// Evaluates at @p point, one value per variable.
+  Number evaluate(const Number* point) const;
+
+  /**
+   * Evaluates @p count points, stored one after another, into @p out.
+   * Safe to call from several threads at once.
+   */
+  void evaluate(const Number* points, size_t count, Number* out) const;
+
+ private:
+  enum class OpKind : uint8_t {
+    Constant,  // value
+    Variable,  // a = index into the point
+    Neg,       // a = operand
+    Fac,
+    Re,
+    Im,
+    Arg,
+    Sqrt,
+    Exp,
+    Log,
+    Sin,
+    Cos,
+    Tan,
+    Gamma,
+    LogGamma,
+    Digamma,
+    Erf,
+    Erfc,
+    Plus,      // a = left, b = right
+    Minus,
+    Mul,
+    Div,
+    Pow,
+    PowInt,    // a = base, value = exponent, 0 < |n| <= 4
+    Polar,
+    BesselJ,
+    BesselI,
+    Equ,
+    Less,
+    Define,
+    Sum,       // a = first index into operands_, b = count, subtracted ones negated
+    Product,   // a = first index into operands_, b = count
+    Select,    // a = first index into operands_ of condition, then, else;
+               // b = 1 if the condition is a relation
+    Case,      // a = index into cases_
+  };
+
+  struct Op {
+    OpKind kind;
+    uint32_t a;
+    uint32_t b;
+    Number value;
+  };
+
+  // an arm of a Case: a register, or a program of its own over the registers
+  // of its variables, run for the points that take the arm
+  struct Arm {
+    bool branch;
+    uint32_t index;                // register, or into branches_
+    std::vector<uint32_t> inputs;  // registers of the branch's variables
+  };
+
+  struct Case {
+    std::vector<uint32_t> conditions;  // registers; none for thresholds
+    std::vector<bool> relations;       // whether each condition is a relation
+    uint32_t x;                        // register compared to the thresholds
+    std::vector<double> thresholds;    // ascending, x < thresholds[i] takes arm i
+    std::vector<Arm> arms;             // the last one for else
+  };
+
+  class Compiler;
+
+  void run(const Number* points, size_t count, double* re, double* im, Number* out) const;
+  void runCase(const Case& c,
+               size_t count,
+               const double* re,
+               const double* im,
+               double* rr,
+               double* ri) const;
+
+ private:
+  std::vector<Symbol> variables_;
+  std::vector<Op> ops_;
+  std::vector<uint32_t> operands_;
+  std::vector<Case> cases_;
+  std::vector<BatchProgram> branches_;
+  uint32_t result_ = 0;
+};
+
+class BatchProgram::ErrorCategory : public std::error_category {
+ public:
+  static const ErrorCategory& get();
+
+  const char* name() const noexcept override;
+  std::string message(int ec) const override;
+};
+
+inline std::error_code make_error_code(BatchProgram::ErrorCode ec) {
+  return std::error_code(static_cast<int>(ec), BatchProgram::ErrorCategory::get());
+}
+
+}  // namespace cmath
+
+namespace std {
+template <>
+struct is_error_code_enum<cmath::BatchProgram::ErrorCode> : public true_type {};
+}  // namespace std
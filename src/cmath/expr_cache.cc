@@ -0,0 +1,128 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/expr_cache.h>
+#include <cmath/expr_parser.h>
+#include <functional>
+
+namespace cmath {
+
+ExprCache::ExprCache(size_t capacity, size_t shardCount)
+    : capacity_(capacity),
+      shardCapacity_(0),
+      shards_() {
+  if (shardCount == 0)
+    shardCount = 1;
+
+  if (shardCount > capacity && capacity != 0)
+    shardCount = capacity;
+
+  shardCapacity_ = (capacity + shardCount - 1) / shardCount;
+
+  shards_.reserve(shardCount);
+  for (size_t i = 0; i < shardCount; ++i)
+    shards_.emplace_back(std::make_unique<Shard>());
+}
+
+size_t ExprCache::hash(const SymbolTable* scope,
+                       uint64_t version,
+                       const std::string& source) {
+  size_t h = std::hash<std::string>()(source);
+  h ^= std::hash<const void*>()(scope) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+  h ^= std::hash<uint64_t>()(version) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+  return h;
+}
+
+ExprCache::LruList::iterator ExprCache::find(Shard& shard,
+                                             size_t hash,
+                                             const SymbolTable* scope,
+                                             uint64_t version,
+                                             const std::string& source) {
+  auto range = shard.index.equal_range(hash);
+  for (auto i = range.first; i != range.second; ++i) {
+    const Entry& e = *i->second;
+    if (e.scope == scope && e.version == version && e.source == source)
+      return i->second;
+  }
+  return shard.lru.end();
+}
+
+Result<std::shared_ptr<const Expr>> ExprCache::get(const SymbolTable& symbolTable,
+                                                   const std::string& source) {
+  const uint64_t version = symbolTable.version();
+  const size_t h = hash(&symbolTable, version, source);
+  Shard& shard = *shards_[h % shards_.size()];
+
+  {
+    std::lock_guard<std::mutex> _l(shard.lock);
+    auto i = find(shard, h, &symbolTable, version, source);
+    if (i != shard.lru.end()) {
+      shard.hits++;
+      shard.lru.splice(shard.lru.begin(), shard.lru, i);
+      return i->expr;
+    }
+    shard.misses++;
+  }
+
+  // parse without holding the shard lock, so that other keys of this shard
+  // are not stalled behind us.
+  Result<std::unique_ptr<Expr>> parsed = parseExpression(symbolTable, source);
+  if (parsed.isFailure())
+    return parsed.error();
+
+  std::shared_ptr<const Expr> expr = std::move(*parsed);
+
+  if (shardCapacity_ == 0)
+    return expr;
+
+  std::lock_guard<std::mutex> _l(shard.lock);
+
+  // somebody else might have been faster parsing the very same source
+  auto i = find(shard, h, &symbolTable, version, source);
+  if (i != shard.lru.end())
+    return i->expr;
+
+  while (shard.lru.size() >= shardCapacity_) {
+    Entry& victim = shard.lru.back();
+    auto range = shard.index.equal_range(victim.hash);
+    for (auto k = range.first; k != range.second; ++k) {
+      if (&*k->second == &victim) {
+        shard.index.erase(k);
+        break;
+      }
+    }
+    shard.lru.pop_back();
+    shard.evictions++;
+  }
+
+  shard.lru.push_front(Entry{h, &symbolTable, version, source, expr});
+  shard.index.emplace(h, shard.lru.begin());
+
+  return expr;
+}
+
+ExprCache::Stats ExprCache::stats() const {
+  Stats s{0, 0, 0, 0};
+  for (const std::unique_ptr<Shard>& shard : shards_) {
+    std::lock_guard<std::mutex> _l(shard->lock);
+    s.hits += shard->hits;
+    s.misses += shard->misses;
+    s.evictions += shard->evictions;
+    s.size += shard->lru.size();
+  }
+  return s;
+}
+
+void ExprCache::clear() {
+  for (std::unique_ptr<Shard>& shard : shards_) {
+    std::lock_guard<std::mutex> _l(shard->lock);
+    shard->index.clear();
+    shard->lru.clear();
+  }
+}
+
+}  // namespace cmath
@@ -0,0 +1,88 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <cmath/result.h>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cmath {
+
+/**
+ * Bounded, thread-safe cache of parsed expressions.
+ *
+ * Entries are keyed by the source text, the SymbolTable it was parsed
+ * against and that table's version(), so redefining a symbol automatically
+ * misses on the next lookup. Keys are spread over independently locked
+ * shards, each of which evicts its least recently used entry when full.
+ *
+ * Cached expressions hold raw pointers into the symbol table they were parsed
+ * with, so the table must outlive the cache (or the cache be cleared).
+ */
+class ExprCache {
+ public:
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t size;
+  };
+
+  explicit ExprCache(size_t capacity, size_t shardCount = 16);
+
+  /**
+   * Returns the parsed form of @p source, parsing (and caching) it on a miss.
+   *
+   * Parse errors are returned as such and are not cached.
+   */
+  Result<std::shared_ptr<const Expr>> get(const SymbolTable& symbolTable,
+                                          const std::string& source);
+
+  size_t capacity() const noexcept { return capacity_; }
+  Stats stats() const;
+  void clear();
+
+ private:
+  struct Entry {
+    size_t hash;
+    const SymbolTable* scope;
+    uint64_t version;
+    std::string source;
+    std::shared_ptr<const Expr> expr;
+  };
+
+  using LruList = std::list<Entry>;
+
+  struct Shard {
+    std::mutex lock;
+    LruList lru;  // most recently used first
+    std::unordered_multimap<size_t, LruList::iterator> index;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+  };
+
+  static size_t hash(const SymbolTable* scope, uint64_t version, const std::string& s);
+  static LruList::iterator find(Shard& shard,
+                                size_t hash,
+                                const SymbolTable* scope,
+                                uint64_t version,
+                                const std::string& source);
+
+ private:
+  size_t capacity_;
+  size_t shardCapacity_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+}  // namespace cmath
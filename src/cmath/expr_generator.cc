@@ -0,0 +1,281 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/expr_generator.h>
+#include <charconv>
+
+namespace cmath {
+
+size_t ExprGenerator::Node::size() const {
+  size_t n = 1;
+  for (const Node& child : children)
+    n += child.size();
+  return n;
+}
+
+static Symbol symbolName(unsigned i) {
+  static const char* first[] = {"x", "y", "z", "u", "v", "w"};
+  if (i < 6)
+    return first[i];
+
+  Symbol s = "x";
+  for (i -= 6; ; i = i / 26 - 1) {
+    s.insert(s.begin() + 1, static_cast<char>('a' + i % 26));
+    if (i < 26)
+      break;
+  }
+  return s;
+}
+
+ExprGenerator::ExprGenerator(uint64_t seed, const Options& options)
+    : state_(seed), options_(options), symbols_() {
+  for (unsigned i = 0; i < options_.symbolCount; ++i)
+    symbols_.emplace_back(symbolName(i));
+}
+
+uint64_t ExprGenerator::next() {
+  // splitmix64, for identical sequences on every platform
+  uint64_t z = (state_ += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+unsigned ExprGenerator::uniform(unsigned n) {
+  return n ? static_cast<unsigned>(next() % n) : 0;
+}
+
+ExprGenerator::Node ExprGenerator::generate() {
+  return generate(0, symbols_);
+}
+
+ExprGenerator::Node ExprGenerator::leaf(const std::vector<Symbol>& symbols) {
+  const unsigned symbolWeight = symbols.empty() ? 0 : options_.symbol;
+  if (uniform(options_.literal + symbolWeight) >= options_.literal)
+    return Node{Node::Symbol, symbols[uniform(symbols.size())], {}};
+
+  std::string literal = std::to_string(uniform(options_.maxLiteral + 1));
+  if (options_.decimals && uniform(4) == 0)
+    literal += "." + std::to_string(uniform(100) + 1);
+
+  return Node{Node::Literal, literal, {}};
+}
+
+ExprGenerator::Node ExprGenerator::generate(unsigned depth,
+                                            const std::vector<Symbol>& symbols) {
+  if (depth >= options_.maxDepth || uniform(options_.maxDepth + 1) < depth)
+    return leaf(symbols);
+
+  const Options& o = options_;
+  const unsigned callWeight = o.callables.empty() ? 0 : o.call;
+  const unsigned weights[] = {o.plus, o.minus, o.mul,  o.div,   o.pow,    o.neg,
+                              o.fac,  callWeight, o.cases, o.series, o.tuple};
+
+  unsigned total = 0;
+  for (unsigned w : weights)
+    total += w;
+
+  if (total == 0)
+    return leaf(symbols);
+
+  unsigned pick = uniform(total);
+  unsigned op = 0;
+  while (pick >= weights[op])
+    pick -= weights[op++];
+
+  auto binary = [&](Node::Kind kind) {
+    Node lhs = generate(depth + 1, symbols);
+    Node rhs = generate(depth + 1, symbols);
+    return Node{kind, "", {lhs, rhs}};
+  };
+
+  switch (op) {
+    case 0:
+      return binary(Node::Plus);
+    case 1:
+      return binary(Node::Minus);
+    case 2:
+      return binary(Node::Mul);
+    case 3:
+      return binary(Node::Div);
+    case 4: {
+      // keep exponents small, mostly integral, to stay within double range
+      Node base = generate(depth + 1, symbols);
+      Node exponent = uniform(3) ? Node{Node::Literal, std::to_string(uniform(5)), {}}
+                                 : generate(depth + 1, symbols);
+      return Node{Node::Pow, "", {base, exponent}};
+    }
+    case 5:
+      return Node{Node::Neg, "", {generate(depth + 1, symbols)}};
+    case 6:
+      return Node{Node::Fac, "", {Node{Node::Literal, std::to_string(uniform(9)), {}}}};
+    case 7: {
+      const Callable& f = o.callables[uniform(o.callables.size())];
+      Node call{Node::Call, f.name, {}};
+      for (unsigned i = 0; i < f.arity; ++i)
+        call.children.emplace_back(generate(depth + 1, symbols));
+      return call;
+    }
+    case 8: {
+      Node c{Node::Case, "", {}};
+      for (unsigned i = 0, n = 1 + uniform(2); i < n; ++i) {
+        c.children.emplace_back(binary(uniform(2) ? Node::Less : Node::Equ));
+        c.children.emplace_back(generate(depth + 1, symbols));
+      }
+      c.children.emplace_back(generate(depth + 1, symbols));
+      return c;
+    }
+    case 9: {
+      // short constant ranges, so that every engine sums them up term by term
+      std::vector<Symbol> scope = symbols;
+      scope.emplace_back("k");
+      const unsigned first = uniform(3);
+      return Node{Node::Series, uniform(2) ? "sum" : "product",
+                  {generate(depth + 1, scope), Node{Node::Literal, std::to_string(first), {}},
+                   Node{Node::Literal, std::to_string(first + uniform(5)), {}}}};
+    }
+    default: {
+      Node t{Node::Tuple, "", {}};
+      for (unsigned i = 0, n = 2 + uniform(2); i < n; ++i)
+        t.children.emplace_back(generate(depth + 1, symbols));
+      return t;
+    }
+  }
+}
+
+std::vector<std::string> ExprGenerator::Program::lines() const {
+  std::vector<std::string> result = definitions;
+  for (const Node& e : expressions)
+    result.emplace_back(render(e));
+  return result;
+}
+
+ExprGenerator::Program ExprGenerator::program(size_t mappings, size_t expressions) {
+  Program p;
+
+  // constants, each only depending on the ones before
+  std::vector<Symbol> defined;
+  for (const Symbol& s : symbols_) {
+    // the right hand side of := is no case expression unless parenthesized
+    const Node value = generate(options_.maxDepth / 2, defined);
+    const std::string text = render(value);
+    p.definitions.emplace_back(s + " := " + (value.kind == Node::Case ? "(" + text + ")" : text));
+    defined.push_back(s);
+  }
+
+  const std::vector<Callable> builtins = options_.callables;
+  for (size_t i = 0; i < mappings; ++i) {
+    const Symbol name = "f" + symbolName(6 + i).substr(1);  // fa, fb, ...
+    std::vector<Symbol> params = {"p"};
+    if (uniform(2))
+      params.push_back("q");
+
+    std::vector<Symbol> scope = defined;
+    scope.insert(scope.end(), params.begin(), params.end());
+
+    std::string line = name + " : (" + params[0];
+    if (params.size() > 1)
+      line += ", " + params[1];
+    line += ") -> " + render(generate(1, scope));
+    p.definitions.emplace_back(line);
+
+    // later mappings and expressions may call this one
+    options_.callables.push_back(Callable{name, static_cast<unsigned>(params.size())});
+  }
+
+  for (size_t i = 0; i < expressions; ++i)
+    p.expressions.emplace_back(generate());
+
+  options_.callables = builtins;
+  return p;
+}
+
+static std::unique_ptr<Expr> toExpr(const ExprGenerator::Node& n) {
+  using Node = ExprGenerator::Node;
+
+  switch (n.kind) {
+    case Node::Literal: {
+      double value = 0;
+      std::from_chars(n.text.data(), n.text.data() + n.text.size(), value);
+      return std::make_unique<NumberExpr>(value);
+    }
+    case Node::Symbol:
+      return std::make_unique<SymbolExpr>(n.text, nullptr);
+    case Node::Neg:
+      return std::make_unique<NegExpr>(toExpr(n.children[0]));
+    case Node::Fac:
+      return std::make_unique<FacExpr>(toExpr(n.children[0]));
+    case Node::Plus:
+      return std::make_unique<PlusExpr>(toExpr(n.children[0]), toExpr(n.children[1]));
+    case Node::Minus:
+      return std::make_unique<MinusExpr>(toExpr(n.children[0]), toExpr(n.children[1]));
+    case Node::Mul:
+      return std::make_unique<MulExpr>(toExpr(n.children[0]), toExpr(n.children[1]));
+    case Node::Div:
+      return std::make_unique<DivExpr>(toExpr(n.children[0]), toExpr(n.children[1]));
+    case Node::Pow:
+      return std::make_unique<PowExpr>(toExpr(n.children[0]), toExpr(n.children[1]));
+    case Node::Call: {
+      CallExpr::ParamList args;
+      for (const Node& child : n.children)
+        args.emplace_back(toExpr(child));
+      return std::make_unique<CallExpr>(n.text, nullptr, std::move(args));
+    }
+    case Node::Less:
+      return std::make_unique<LessExpr>(toExpr(n.children[0]), toExpr(n.children[1]));
+    case Node::Equ:
+      return std::make_unique<EquExpr>(toExpr(n.children[0]), toExpr(n.children[1]));
+    case Node::Case: {
+      CaseExpr::CaseList cases;
+      for (size_t i = 0; i + 1 < n.children.size(); i += 2)
+        cases.emplace_back(toExpr(n.children[i]), toExpr(n.children[i + 1]));
+      return std::make_unique<CaseExpr>(std::move(cases), toExpr(n.children.back()));
+    }
+    case Node::Series:
+      return std::make_unique<SeriesExpr>(
+          n.text == "sum" ? SeriesExpr::Kind::Sum : SeriesExpr::Kind::Product,
+          toExpr(n.children[0]), "k", toExpr(n.children[1]), toExpr(n.children[2]));
+    case Node::Tuple: {
+      TupleExpr::ElementList elements;
+      for (const Node& child : n.children)
+        elements.emplace_back(toExpr(child));
+      return std::make_unique<TupleExpr>(std::move(elements));
+    }
+  }
+  return nullptr;
+}
+
+std::string ExprGenerator::render(const Node& node) {
+  // the printer knows best how to parenthesize
+  return toExpr(node)->str();
+}
+
+std::vector<ExprGenerator::Node> ExprGenerator::shrink(const Node& node) {
+  std::vector<Node> result;
+
+  // replace the whole tree by one of its children ...
+  if (node.kind != Node::Fac)
+    for (const Node& child : node.children)
+      result.push_back(child);
+
+  // ... by a trivial leaf ...
+  if (node.kind != Node::Literal || (node.text != "0" && node.text != "1"))
+    result.push_back(Node{Node::Literal, "1", {}});
+
+  // ... or shrink one child at a time
+  for (size_t i = 0; i < node.children.size(); ++i) {
+    for (Node& smaller : shrink(node.children[i])) {
+      Node copy = node;
+      copy.children[i] = std::move(smaller);
+      result.emplace_back(std::move(copy));
+    }
+  }
+
+  return result;
+}
+
+}  // namespace cmath
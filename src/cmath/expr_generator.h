@@ -0,0 +1,137 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cmath {
+
+/**
+ * Seeded generator of random, well-formed expressions and .cm programs.
+ *
+ * Used for differential testing of evaluation engines and as benchmark
+ * corpus. Generation is fully determined by the seed and the options, on
+ * every platform.
+ */
+class ExprGenerator {
+ public:
+  struct Callable {
+    Symbol name;
+    unsigned arity;
+  };
+
+  struct Options {
+    unsigned maxDepth = 6;
+    unsigned symbolCount = 3;
+
+    // relative weights of inner nodes
+    unsigned plus = 4;
+    unsigned minus = 3;
+    unsigned mul = 4;
+    unsigned div = 2;
+    unsigned pow = 1;
+    unsigned neg = 1;
+    unsigned fac = 0;
+    unsigned call = 2;
+    unsigned cases = 1;   // when ... then ... else ...
+    unsigned series = 1;  // sum or product over k, of up to five terms
+    unsigned tuple = 1;   // of two or three elements
+
+    // relative weights of leaves
+    unsigned literal = 1;
+    unsigned symbol = 1;
+
+    unsigned maxLiteral = 10;
+    bool decimals = true;  // e.g. 2.5 in addition to integers
+
+    std::vector<Callable> callables = {
+        {"sin", 1}, {"cos", 1}, {"exp", 1}, {"sqrt", 1},
+        {"log", 1}, {"arg", 1}, {"Re", 1},  {"polar", 2},
+    };
+  };
+
+  /**
+   * Simple syntax tree, decoupled from Expr so that it can be generated and
+   * shrunk without a SymbolTable.
+   */
+  struct Node {
+    enum Kind {
+      Literal,
+      Symbol,
+      Neg,
+      Fac,
+      Plus,
+      Minus,
+      Mul,
+      Div,
+      Pow,
+      Call,
+      Less,
+      Equ,
+      Case,    // (condition, arm)*, else arm
+      Series,  // body, first, last; over k
+      Tuple,
+    };
+
+    Kind kind;
+    std::string text;  // literal, symbol or callee name, "sum" or "product"
+    std::vector<Node> children;
+
+    size_t size() const;
+  };
+
+  /// A .cm program, see program().
+  struct Program {
+    std::vector<std::string> definitions;
+    std::vector<Node> expressions;
+
+    /// Source lines: definitions first, then the rendered expressions.
+    std::vector<std::string> lines() const;
+  };
+
+  ExprGenerator(uint64_t seed, const Options& options);
+
+  const Options& options() const noexcept { return options_; }
+
+  /// Names of the free symbols generated expressions may refer to.
+  const std::vector<Symbol>& symbols() const noexcept { return symbols_; }
+
+  Node generate();
+  std::string expression() { return render(generate()); }
+
+  /**
+   * Generates a .cm program: constant definitions for all symbols(), then
+   * @p mappings mapping definitions and @p expressions expressions using
+   * them.
+   */
+  Program program(size_t mappings, size_t expressions);
+
+  /// Renders @p node as parseable source text.
+  static std::string render(const Node& node);
+
+  /**
+   * All trees that are one simplification step away from @p node, roughly
+   * smallest first, for shrinking failing cases.
+   */
+  static std::vector<Node> shrink(const Node& node);
+
+ private:
+  uint64_t next();
+  unsigned uniform(unsigned n);
+  Node generate(unsigned depth, const std::vector<Symbol>& symbols);
+  Node leaf(const std::vector<Symbol>& symbols);
+
+ private:
+  uint64_t state_;
+  Options options_;
+  std::vector<Symbol> symbols_;
+};
+
+}  // namespace cmath
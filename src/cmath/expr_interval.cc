@@ -0,0 +1,548 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/expr_interval.h>
+#include <cmath/lowering.h>
+#include <algorithm>
+#include <cmath>
+
+namespace cmath {
+
+namespace {
+
+// boxes evaluated per operation at a time; their registers stay in cache
+constexpr size_t BatchSize = 64;
+
+// series are unrolled over at most this many terms
+constexpr double MaxUnrolledTerms = 1024;
+
+[[noreturn]] void fail(Interval::ErrorCode ec) {
+  throw make_error_code(ec);
+}
+
+// whether Number may not yield a finite real number inside @p a
+bool unbounded(Interval a) {
+  return a.isEmpty() || !std::isfinite(a.lower()) || !std::isfinite(a.upper());
+}
+
+}  // namespace
+
+// {{{ IntervalProgram::Compiler
+class IntervalProgram::Compiler : public Lowering {
+ public:
+  Compiler(const SymbolTable& t, IntervalProgram* program)
+      : Lowering(t, make_error_code(Interval::UnsupportedExpr)), program_(program) {}
+
+  uint32_t emit(OpKind kind, uint32_t a = 0, uint32_t b = 0);
+
+ private:
+  uint32_t constant(Number value) override;
+  uint32_t constant(Interval value);
+  uint32_t symbol(const Symbol& name) override;
+  uint32_t builtin(const Symbol& name, const std::vector<uint32_t>& args) override;
+  uint32_t operation(const Expr* e) override;
+  uint32_t series(const SeriesExpr* e);
+  uint32_t condition(const Expr* e);
+  uint32_t cases(const CaseExpr* e);
+  bool isConstant(uint32_t reg, Interval value) const;
+  bool isPoint(uint32_t reg, double* value) const;
+
+ private:
+  IntervalProgram* program_;
+};
+
+uint32_t IntervalProgram::Compiler::emit(OpKind kind, uint32_t a, uint32_t b) {
+  program_->ops_.push_back(Op{kind, a, b, 0, Interval()});
+  return static_cast<uint32_t>(program_->ops_.size() - 1);
+}
+
+uint32_t IntervalProgram::Compiler::constant(Number value) {
+  // as exact points; NaN is nowhere defined
+  if (std::isnan(value.real()))
+    return constant(Interval::empty());
+  if (value.imag() != 0)
+    fail(Interval::NotReal);
+  return constant(Interval(value.real()));
+}
+
+uint32_t IntervalProgram::Compiler::constant(Interval value) {
+  const uint32_t reg = emit(OpKind::Constant);
+  program_->ops_[reg].value = value;
+  return reg;
+}
+
+bool IntervalProgram::Compiler::isConstant(uint32_t reg, Interval value) const {
+  const Op& op = program_->ops_[reg];
+  return op.kind == OpKind::Constant && op.value == value;
+}
+
+bool IntervalProgram::Compiler::isPoint(uint32_t reg, double* value) const {
+  const Op& op = program_->ops_[reg];
+  if (op.kind != OpKind::Constant || !op.value.isPoint())
+    return false;
+
+  *value = op.value.lower();
+  return true;
+}
+
+uint32_t IntervalProgram::Compiler::symbol(const Symbol& name) {
+  // pi and e as tight enclosures rather than their nearest doubles
+  if (!argument(name) && isBuiltin(name, symbols_.lookup(name))) {
+    if (name == "pi" || name == "π")
+      return constant(Interval::pi());
+    if (name == "e")
+      return constant(Interval::e());
+  }
+
+  return Lowering::symbol(name);
+}
+
+uint32_t IntervalProgram::Compiler::series(const SeriesExpr* e) {
+  // unrolled term by term, so the range must be constant and finite
+  if (!e->last())
+    unsupported();
+
+  const uint32_t a = compile(e->first());
+  const uint32_t b = compile(e->last());
+  if (isConstant(a, Interval::empty()) || isConstant(b, Interval::empty()))
+    return constant(Interval::empty());  // an invalid range, as with Number
+
+  double first, last;
+  if (!isPoint(a, &first) || !isPoint(b, &last) || !std::isfinite(last))
+    unsupported();
+
+  const double count = std::max(0.0, std::floor(last - first) + 1);
+  if (count > MaxUnrolledTerms)
+    unsupported();
+
+  const bool product = e->kind() == SeriesExpr::Kind::Product;
+  uint32_t y = constant(Interval(product ? 1 : 0));
+  frame_.emplace_back(e->index(), 0);
+  for (double j = 0; j < count; ++j) {
+    frame_.back().second = constant(Interval(first + j));
+    y = emit(product ? OpKind::Mul : OpKind::Plus, y, compile(e->body()));
+  }
+  frame_.pop_back();
+  return y;
+}
+
+uint32_t IntervalProgram::Compiler::condition(const Expr* e) {
+  // relations hold where they are not NaN, as CaseExpr::holds() has it;
+  // empty operands may hold, as they also stand for complex values
+  if (auto q = dynamic_cast<const EquExpr*>(e))
+    return emit(OpKind::IsEqual, compile(q->left()), compile(q->right()));
+  if (auto l = dynamic_cast<const LessExpr*>(e))
+    return emit(OpKind::IsLess, compile(l->left()), compile(l->right()));
+
+  return emit(OpKind::IsNonzero, compile(e));
+}
+
+uint32_t IntervalProgram::Compiler::cases(const CaseExpr* e) {
+  // from the else arm outwards, each case selecting its arm, the rest, or
+  // the hull of both where its condition may or may not hold
+  uint32_t y = compile(e->elseExpr());
+  for (size_t i = e->cases().size(); i-- > 0;) {
+    const CaseExpr::CaseMatch& c = e->cases()[i];
+    const uint32_t reg = emit(OpKind::Select, condition(c.first.get()), compile(c.second.get()));
+    program_->ops_[reg].n = y;
+    y = reg;
+  }
+  return y;
+}
+
+uint32_t IntervalProgram::Compiler::builtin(const Symbol& name,
+                                            const std::vector<uint32_t>& args) {
+  const uint32_t x = args.empty() ? constant(Interval::empty()) : args[0];
+
+  if (name == "sin")
+    return emit(OpKind::Sin, x);
+  if (name == "cos")
+    return emit(OpKind::Cos, x);
+  if (name == "tan")
+    return emit(OpKind::Tan, x);
+  if (name == "exp")
+    return emit(OpKind::Exp, x);
+  if (name == "sqrt")
+    return emit(OpKind::Sqrt, x);
+  if (name == "log")
+    return emit(OpKind::Log, x);
+  if (name == "arg")
+    return emit(OpKind::Arg, x);
+  if (name == "Re")
+    return x;
+  if (name == "Im")
+    return constant(Interval(0));
+
+  if (name == "polar") {
+    // r e^(i phi) is only real for a zero angle
+    if (args.size() < 2 || !isConstant(args[1], 0))
+      fail(Interval::NotReal);
+    return x;
+  }
+
+  unsupported();
+}
+
+uint32_t IntervalProgram::Compiler::operation(const Expr* e) {
+  if (auto n = dynamic_cast<const NumberExpr*>(e))
+    return constant(n->getNumber());
+
+  if (auto n = dynamic_cast<const NegExpr*>(e))
+    return emit(OpKind::Neg, compile(n->subExpr()));
+
+  if (auto f = dynamic_cast<const FacExpr*>(e))
+    return emit(OpKind::Fac, compile(f->subExpr()));
+
+  if (auto s = dynamic_cast<const SeriesExpr*>(e))
+    return series(s);
+
+  if (auto c = dynamic_cast<const CaseExpr*>(e))
+    return cases(c);
+
+  // left to right, as the binary chain would be
+  if (auto s = dynamic_cast<const SumExpr*>(e)) {
+    uint32_t x = compile(s->terms()[0].expr.get());
+    for (size_t i = 1; i < s->terms().size(); ++i) {
+      const SumExpr::Term& term = s->terms()[i];
+      x = emit(term.subtract ? OpKind::Minus : OpKind::Plus, x, compile(term.expr.get()));
+    }
+    return x;
+  }
+
+  if (auto p = dynamic_cast<const ProductExpr*>(e)) {
+    uint32_t x = compile(p->factors()[0].get());
+    for (size_t i = 1; i < p->factors().size(); ++i)
+      x = emit(OpKind::Mul, x, compile(p->factors()[i].get()));
+    return x;
+  }
+
+  if (auto b = dynamic_cast<const BinaryExpr*>(e)) {
+    // e^x goes straight to exp(), as with Number
+    if (dynamic_cast<const PowExpr*>(e)) {
+      auto base = dynamic_cast<const SymbolExpr*>(b->left());
+      if (base && base->symbolName() == "e" && !argument("e") &&
+          isBuiltin("e", symbols_.lookup("e")))
+        return emit(OpKind::Exp, compile(b->right()));
+    }
+
+    const uint32_t x = compile(b->left());
+    const uint32_t y = compile(b->right());
+
+    if (dynamic_cast<const PlusExpr*>(e))
+      return emit(OpKind::Plus, x, y);
+    if (dynamic_cast<const MinusExpr*>(e))
+      return emit(OpKind::Minus, x, y);
+    if (dynamic_cast<const MulExpr*>(e))
+      return emit(OpKind::Mul, x, y);
+    if (dynamic_cast<const DivExpr*>(e))
+      return emit(OpKind::Div, x, y);
+    if (dynamic_cast<const PowExpr*>(e)) {
+      // integral exponents get the tight enclosure, also for negative bases
+      const Op& exponent = program_->ops_[y];
+      const double n = exponent.value.lower();
+      if (exponent.kind == OpKind::Constant && exponent.value.isPoint() &&
+          n == std::trunc(n) && std::abs(n) < 0x1p63) {
+        // x^0 is 1 for any x, NaN included, as with Number
+        if (n == 0)
+          return constant(Interval(1));
+        const uint32_t reg = emit(OpKind::PowInt, x);
+        program_->ops_[reg].n = static_cast<int64_t>(n);
+        return reg;
+      }
+      return emit(OpKind::Pow, x, y);
+    }
+    if (dynamic_cast<const EquExpr*>(e))
+      return emit(OpKind::Equ, x, y);
+    if (dynamic_cast<const LessExpr*>(e))
+      return emit(OpKind::Less, x, y);
+    if (dynamic_cast<const DefineExpr*>(e))
+      return emit(OpKind::Define, x, y);
+  }
+
+  unsupported();
+}
+// }}}
+
+// {{{ IntervalProgram
+Result<IntervalProgram> IntervalProgram::compile(const Expr* e,
+                                                 const SymbolTable& t,
+                                                 const std::vector<Symbol>& variables) {
+  IntervalProgram program;
+  program.variables_ = variables;
+
+  try {
+    Compiler compiler(t, &program);
+    for (size_t i = 0; i < variables.size(); ++i)
+      compiler.bind(variables[i], compiler.emit(OpKind::Variable, i));
+
+    program.result_ = compiler.compile(e);
+  } catch (const std::error_code& ec) {
+    return ec;
+  }
+
+  return program;
+}
+
+Interval IntervalProgram::evaluate(const Interval* box) const {
+  Interval result;
+  evaluate(box, 1, &result);
+  return result;
+}
+
+void IntervalProgram::evaluate(const Interval* boxes, size_t count, Interval* out) const {
+  std::vector<Interval> regs(ops_.size() * std::min(count, BatchSize));
+  std::vector<uint8_t> partial(regs.size());
+
+  for (size_t i = 0; i < count; i += BatchSize) {
+    const size_t n = std::min(BatchSize, count - i);
+    run(boxes + i * variables_.size(), n, regs.data(), partial.data(), out + i);
+  }
+}
+
+bool IntervalProgram::mayBePartial(OpKind kind, Interval a, Interval b) {
+  switch (kind) {
+    case OpKind::Fac:
+    case OpKind::Sqrt:
+    case OpKind::Log:
+      return a.lower() < 0;
+    case OpKind::Div:
+      return b.contains(0);
+    case OpKind::Pow:
+      return a.lower() <= 0;
+    case OpKind::Equ:
+      return !a.isPoint() || a != b;
+    case OpKind::Less:
+      return !(a.upper() < b.lower());
+    default:
+      return false;
+  }
+}
+
+// Runs all operations over @p count boxes, one operation at a time, with
+// the registers of an operation next to each other.
+//
+// Alongside each register, @p partial tells whether Number may yield NaN
+// or a complex value somewhere in the box, which the enclosure of the
+// defined values does not show, so that conditions over it may also not
+// hold. Infinite bounds count as such, as with Number inf * 1 has a NaN
+// imaginary part.
+void IntervalProgram::run(const Interval* boxes,
+                          size_t count,
+                          Interval* regs,
+                          uint8_t* partial,
+                          Interval* out) const {
+  const size_t arity = variables_.size();
+
+  for (size_t i = 0; i < ops_.size(); ++i) {
+    const Op& op = ops_[i];
+    Interval* r = regs + i * count;
+    const Interval* x = regs + op.a * count;
+    const Interval* y = regs + op.b * count;
+    uint8_t* u = partial + i * count;
+    const uint8_t* ux = partial + op.a * count;
+    const uint8_t* uy = partial + op.b * count;
+
+    auto unary = [&](auto f) {
+      for (size_t k = 0; k < count; ++k)
+        r[k] = f(x[k]);
+    };
+    auto binary = [&](auto f) {
+      for (size_t k = 0; k < count; ++k)
+        r[k] = f(x[k], y[k]);
+    };
+
+    switch (op.kind) {
+      case OpKind::Constant:
+        std::fill(r, r + count, op.value);
+        break;
+      case OpKind::Variable:
+        for (size_t k = 0; k < count; ++k)
+          r[k] = boxes[k * arity + op.a];
+        break;
+      case OpKind::Neg:
+        unary([](Interval a) { return -a; });
+        break;
+      case OpKind::Fac:
+        unary([](Interval a) { return factorial(a); });
+        break;
+      case OpKind::Sqrt:
+        unary([](Interval a) { return sqrt(a); });
+        break;
+      case OpKind::Exp:
+        unary([](Interval a) { return exp(a); });
+        break;
+      case OpKind::Log:
+        unary([](Interval a) { return log(a); });
+        break;
+      case OpKind::Sin:
+        unary([](Interval a) { return sin(a); });
+        break;
+      case OpKind::Cos:
+        unary([](Interval a) { return cos(a); });
+        break;
+      case OpKind::Tan:
+        unary([](Interval a) { return tan(a); });
+        break;
+      case OpKind::Arg:
+        // 0 for positive, pi or -pi for negative numbers, as the sign of
+        // their zero imaginary part, which is not tracked here, picks either;
+        // any of these for zero, depending on the signs of both parts
+        unary([](Interval a) {
+          if (a.isEmpty() || a.lower() > 0)
+            return a.isEmpty() ? a : Interval(0);
+          return hull(-Interval::pi(), Interval::pi());
+        });
+        break;
+      case OpKind::PowInt:
+        unary([n = op.n](Interval a) { return pow(a, n); });
+        break;
+      case OpKind::Plus:
+        binary([](Interval a, Interval b) { return a + b; });
+        break;
+      case OpKind::Minus:
+        binary([](Interval a, Interval b) { return a - b; });
+        break;
+      case OpKind::Mul:
+        binary([](Interval a, Interval b) { return a * b; });
+        break;
+      case OpKind::Div:
+        binary([](Interval a, Interval b) { return a / b; });
+        break;
+      case OpKind::Pow:
+        binary([](Interval a, Interval b) { return pow(a, b); });
+        break;
+      case OpKind::Equ:
+        // a where a = b, NaN otherwise
+        binary([](Interval a, Interval b) { return intersect(a, b); });
+        break;
+      case OpKind::Less:
+        // a where a < b, NaN otherwise
+        binary([](Interval a, Interval b) {
+          return b.isEmpty() ? b : intersect(a, Interval(-INFINITY, b.upper()));
+        });
+        break;
+      case OpKind::Define:
+        // 1 where a = b, 0 otherwise
+        binary([](Interval a, Interval b) {
+          if (a.isPoint() && a == b)
+            return Interval(1);
+          if (intersect(a, b).isEmpty())
+            return Interval(0);
+          return Interval(0, 1);
+        });
+        break;
+      case OpKind::IsEqual:
+        binary([](Interval a, Interval b) {
+          if (a.isEmpty() || b.isEmpty())
+            return Interval(0, 1);
+          if (intersect(a, b).isEmpty())
+            return Interval(0);
+          return a.isPoint() && a == b ? Interval(1) : Interval(0, 1);
+        });
+        break;
+      case OpKind::IsLess:
+        binary([](Interval a, Interval b) {
+          if (a.isEmpty() || b.isEmpty())
+            return Interval(0, 1);
+          if (a.lower() >= b.upper())
+            return Interval(0);
+          return a.upper() < b.lower() ? Interval(1) : Interval(0, 1);
+        });
+        break;
+      case OpKind::IsNonzero:
+        unary([](Interval a) {
+          if (a.isEmpty())
+            return Interval(0, 1);
+          if (a == Interval(0))
+            return Interval(0);
+          return a.lower() <= 0 && a.upper() >= 0 ? Interval(0, 1) : Interval(1);
+        });
+        break;
+      case OpKind::Select: {
+        const Interval* z = regs + op.n * count;
+        const uint8_t* uz = partial + op.n * count;
+        for (size_t k = 0; k < count; ++k) {
+          if (x[k] == Interval(1)) {
+            r[k] = y[k];
+            u[k] = uy[k];
+          } else if (x[k] == Interval(0)) {
+            r[k] = z[k];
+            u[k] = uz[k];
+          } else {
+            r[k] = hull(y[k], z[k]);
+            u[k] = uy[k] | uz[k];
+          }
+        }
+        break;
+      }
+    }
+
+    switch (op.kind) {
+      case OpKind::Select:
+        break;
+      case OpKind::Constant:
+      case OpKind::Variable:
+        for (size_t k = 0; k < count; ++k)
+          u[k] = unbounded(r[k]);
+        break;
+      case OpKind::IsEqual:
+      case OpKind::IsLess:
+        for (size_t k = 0; k < count; ++k) {
+          if (ux[k] | uy[k])
+            r[k] = hull(r[k], Interval(0));
+          u[k] = 0;
+        }
+        break;
+      case OpKind::IsNonzero:
+        for (size_t k = 0; k < count; ++k) {
+          if (ux[k])
+            r[k] = hull(r[k], Interval(0));
+          u[k] = 0;
+        }
+        break;
+      case OpKind::Neg:
+      case OpKind::Fac:
+      case OpKind::Sqrt:
+      case OpKind::Exp:
+      case OpKind::Log:
+      case OpKind::Sin:
+      case OpKind::Cos:
+      case OpKind::Tan:
+      case OpKind::Arg:
+      case OpKind::PowInt:
+        for (size_t k = 0; k < count; ++k)
+          u[k] = ux[k] || unbounded(r[k]) || mayBePartial(op.kind, x[k], Interval());
+        break;
+      default:
+        for (size_t k = 0; k < count; ++k)
+          u[k] = ux[k] || uy[k] || unbounded(r[k]) || mayBePartial(op.kind, x[k], y[k]);
+        break;
+    }
+  }
+
+  std::copy(regs + result_ * count, regs + (result_ + 1) * count, out);
+}
+// }}}
+
+Result<Interval> calculateInterval(const Expr* e,
+                                   const SymbolTable& t,
+                                   const std::vector<std::pair<Symbol, Interval>>& variables) {
+  std::vector<Symbol> names;
+  std::vector<Interval> box;
+  for (const std::pair<Symbol, Interval>& v : variables) {
+    names.push_back(v.first);
+    box.push_back(v.second);
+  }
+
+  Result<IntervalProgram> program = IntervalProgram::compile(e, t, names);
+  if (program.isFailure())
+    return program.error();
+
+  return program->evaluate(box.data());
+}
+
+}  // namespace cmath
@@ -0,0 +1,113 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <cmath/interval.h>
+#include <cmath/result.h>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace cmath {
+
+/**
+ * An expression compiled for interval evaluation over boxes, i.e. one
+ * interval per variable.
+ *
+ * Compiling resolves constants and inlines custom mappings into a flat list
+ * of operations, by Lowering (cmath/lowering.h), so that evaluating many
+ * boxes at once, as branch-and-bound does, runs each operation over a whole
+ * batch of boxes.
+ *
+ * Constants are taken as exact points and pi and e as tight enclosures.
+ * Results that would be complex fail to compile with Interval::NotReal;
+ * where Number yields NaN, the enclosure is empty. Series are unrolled
+ * term by term, so only over constant, finite ranges. Case expressions
+ * enclose the hull of all arms that may be taken within a box; conditions
+ * over operands that may be NaN or complex somewhere in it may not hold.
+ */
+class IntervalProgram {
+ public:
+  static Result<IntervalProgram> compile(const Expr* e,
+                                         const SymbolTable& t,
+                                         const std::vector<Symbol>& variables);
+
+  const std::vector<Symbol>& variables() const noexcept { return variables_; }
+
+  /// Number of operations.
+  size_t size() const noexcept { return ops_.size(); }
+
+  /// Encloses the expression over @p box, one interval per variable.
+  Interval evaluate(const Interval* box) const;
+
+  /// Evaluates @p count boxes, stored one after another, into @p out.
+  void evaluate(const Interval* boxes, size_t count, Interval* out) const;
+
+ private:
+  enum class OpKind : uint8_t {
+    Constant,  // value
+    Variable,  // a = index into the box
+    Neg,       // a = operand
+    Fac,
+    Sqrt,
+    Exp,
+    Log,
+    Sin,
+    Cos,
+    Tan,
+    Arg,
+    PowInt,    // a = base, n = exponent
+    Plus,      // a = left, b = right
+    Minus,
+    Mul,
+    Div,
+    Pow,
+    Equ,
+    Less,
+    Define,
+    IsEqual,   // whether a = b holds: [0, 0], [1, 1], or [0, 1] if it may
+    IsLess,    // whether a < b holds
+    IsNonzero, // whether a holds as a condition, being nonzero
+    Select,    // a = condition as above, b = then, n = else
+  };
+
+  struct Op {
+    OpKind kind;
+    uint32_t a;
+    uint32_t b;
+    int64_t n;
+    Interval value;
+  };
+
+  class Compiler;
+
+  void run(const Interval* boxes,
+           size_t count,
+           Interval* regs,
+           uint8_t* partial,
+           Interval* out) const;
+
+  /// Whether Number may yield NaN or a complex value for operands in @p a
+  /// and @p b, where their enclosure leaves those points out.
+  static bool mayBePartial(OpKind kind, Interval a, Interval b);
+
+ private:
+  std::vector<Symbol> variables_;
+  std::vector<Op> ops_;
+  uint32_t result_ = 0;
+};
+
+/**
+ * Encloses @p e over the given intervals of @p variables; all other
+ * symbols are resolved by @p t.
+ */
+Result<Interval> calculateInterval(const Expr* e,
+                                   const SymbolTable& t,
+                                   const std::vector<std::pair<Symbol, Interval>>& variables = {});
+
+}  // namespace cmath
@@ -7,6 +7,8 @@
 
 #include <cmath/expr.h>
 #include <cmath/expr_parser.h>
+#include <algorithm>
+#include <charconv>
 #include <codecvt>
 #include <iostream>
 #include <locale>
@@ -50,8 +52,9 @@ void ExprToken::setSymbol(const Symbol& s) {
   setToken(Token::Symbol);
 }
 
-void ExprToken::setNumber(Number n) {
+void ExprToken::setNumber(Number n, const std::string& literal) {
   number_ = n;
+  literal_ = literal;
   setToken(Token::Number);
 }
 
@@ -215,6 +218,7 @@ bool ExprTokenizer::next() {
       return true;
     case '>':
       // > >=
+      currentChar_++;
       if (hasBytesPending() && *currentChar_ == '=') {
         currentChar_++;
         currentToken_.setToken(Token::GreaterEqu);
@@ -234,16 +238,48 @@ bool ExprTokenizer::next() {
       break;
   }
 
-  // decimal numbers
+  // decimal numbers, imaginary with the suffix i
+  // DIGITS ['.' DIGITS] [('e' | 'E') ['+' | '-'] DIGITS] ['i']
   if (std::isdigit(*currentChar_)) {
-    Number n = *currentChar_ - '0';
-    currentChar_++;
-    while (hasBytesPending() && std::isdigit(*currentChar_)) {
-      n *= 10;
-      n += *currentChar_ - '0';
+    auto isDigitAt = [this](std::u16string::const_iterator i) {
+      return i != endChar() && std::isdigit(*i);
+    };
+
+    std::string literal;
+    while (hasBytesPending() && std::isdigit(*currentChar_))
+      literal += static_cast<char>(*currentChar_++);
+
+    if (hasBytesPending() && *currentChar_ == '.' && isDigitAt(currentChar_ + 1)) {
+      literal += static_cast<char>(*currentChar_++);
+      while (hasBytesPending() && std::isdigit(*currentChar_))
+        literal += static_cast<char>(*currentChar_++);
+    }
+
+    // only an exponent if digits follow, so that "2e" still reads as 2 * e
+    if (hasBytesPending() && (*currentChar_ == 'e' || *currentChar_ == 'E')) {
+      auto i = currentChar_ + 1;
+      if (i != endChar() && (*i == '+' || *i == '-'))
+        ++i;
+      if (isDigitAt(i)) {
+        while (currentChar_ != i)
+          literal += static_cast<char>(*currentChar_++);
+        while (hasBytesPending() && std::isdigit(*currentChar_))
+          literal += static_cast<char>(*currentChar_++);
+      }
+    }
+
+    double value = 0;
+    std::from_chars(literal.data(), literal.data() + literal.size(), value);
+
+    // only a suffix if the symbol ends there, so that "2in" is no literal
+    if (hasBytesPending() && *currentChar_ == 'i' &&
+        (currentChar_ + 1 == endChar() || !std::isalnum(currentChar_[1]))) {
       currentChar_++;
+      currentToken_.setNumber(Number(0, value), literal);
+      return true;
     }
-    currentToken_.setNumber(n);
+
+    currentToken_.setNumber(value, literal);
     return true;
   }
 
@@ -277,6 +313,9 @@ ExprParser::ExprParser(const SymbolTable& symbolTable, const std::u16string& e)
   nextToken();
 }
 
+ExprTokenizer::ExprTokenizer(const ExprTokenizer& t)
+    : currentChar_(t.currentChar_), endChar_(t.endChar_), currentToken_(t.currentToken_) {}
+
 ExprTokenizer& ExprTokenizer::operator=(const ExprTokenizer& t) {
   currentChar_ = t.currentChar_;
   endChar_ = t.endChar_;
@@ -302,7 +341,10 @@ Result<std::unique_ptr<Expr>> parseExpression(const SymbolTable& symbolTable,
 
 Result<std::unique_ptr<Expr>> ExprParser::parse() {
   try {
-    if (auto e = relExpr(); currentToken_.eof()) {
+    const bool isMappingDef =
+        currentToken() == Token::Symbol && peekToken() == Token::Colon;
+
+    if (auto e = isMappingDef ? mappingDef() : expr(); currentToken_.eof()) {
       return e;
     } else {
       return make_error_code(UnexpectedToken);
@@ -312,15 +354,67 @@ Result<std::unique_ptr<Expr>> ExprParser::parse() {
   }
 }
 
+std::unique_ptr<Expr> ExprParser::mappingDef() {
+  // SYMBOL ':' (SYMBOL | '(' SYMBOL (',' SYMBOL)* ')') '->' expr
+  Symbol name = consumeSymbol();
+  consumeToken(Token::Colon);
+
+  DefineMappingExpr::SymbolList inputs;
+  if (tryConsumeToken(Token::RndOpen)) {
+    do
+      inputs.emplace_back(consumeSymbol());
+    while (tryConsumeToken(Token::Comma));
+    consumeToken(Token::RndClose);
+  } else {
+    inputs.emplace_back(consumeSymbol());
+  }
+
+  consumeToken(Token::RightArrow);
+
+  parameters_ = inputs;
+  std::unique_ptr<Expr> body = expr();
+  parameters_.clear();
+
+  return std::make_unique<DefineMappingExpr>(name, inputs, std::move(body));
+}
+
 std::unique_ptr<Expr> ExprParser::expr() {
+  if (currentToken() == Token::Symbol &&
+      (currentToken_->symbol() == "when" || currentToken_->symbol() == "if") &&
+      isKeyword(currentToken_->symbol()))
+    return caseExpr();
+
   return relExpr();
 }
 
+std::unique_ptr<Expr> ExprParser::caseExpr() {
+  // 'if' relExpr 'then' relExpr 'else' expr
+  // | ('when' relExpr 'then' relExpr)+ 'else' expr
+  if (tryConsumeKeyword("if")) {
+    std::unique_ptr<Expr> condition = relExpr();
+    consumeKeyword("then");
+    std::unique_ptr<Expr> then = relExpr();
+    consumeKeyword("else");
+    return std::make_unique<CaseExpr>(std::move(condition), std::move(then), expr());
+  }
+
+  CaseExpr::CaseList cases;
+  while (tryConsumeKeyword("when")) {
+    std::unique_ptr<Expr> condition = relExpr();
+    consumeKeyword("then");
+    cases.emplace_back(std::move(condition), relExpr());
+  }
+  consumeKeyword("else");
+  return std::make_unique<CaseExpr>(std::move(cases), expr());
+}
+
 std::unique_ptr<Expr> ExprParser::relExpr() {
   auto lhs = addExpr();
   while (!currentToken_.eof()) {
     switch (currentToken()) {
       case Token::Define:
+        if (!dynamic_cast<const SymbolExpr*>(lhs.get()))
+          throw make_error_code(NotASymbol);
         nextToken();
         lhs = std::make_unique<DefineExpr>(std::move(lhs), addExpr());
         break;
@@ -332,6 +426,11 @@ std::unique_ptr<Expr> ExprParser::relExpr() {
         nextToken();
         lhs = std::make_unique<LessExpr>(std::move(lhs), addExpr());
         break;
+      case Token::Greater:
+        // a > b is b < a
+        nextToken();
+        lhs = std::make_unique<LessExpr>(addExpr(), std::move(lhs));
+        break;
       default:
         return lhs;
     }
@@ -340,48 +439,68 @@ std::unique_ptr<Expr> ExprParser::relExpr() {
 }
 
 std::unique_ptr<Expr> ExprParser::addExpr() {
-  auto lhs = mulExpr();
-  while (!currentToken_.eof()) {
-    switch (currentToken()) {
-      case Token::Plus:
-        nextToken();
-        lhs = std::make_unique<PlusExpr>(std::move(lhs), mulExpr());
-        break;
-      case Token::Minus:
-        nextToken();
-        lhs = std::make_unique<MinusExpr>(std::move(lhs), mulExpr());
-        break;
-      default:
-        return lhs;
+  // three terms or more go into one SumExpr rather than a left-deep tree
+  // of PlusExpr and MinusExpr; two stay a binary node
+  std::vector<SumExpr::Term> terms;
+  terms.emplace_back(SumExpr::Term{mulExpr(), false});
+  for (;;) {
+    if (currentToken() == Token::Plus) {
+      nextToken();
+      terms.emplace_back(SumExpr::Term{mulExpr(), false});
+    } else if (currentToken() == Token::Minus) {
+      nextToken();
+      terms.emplace_back(SumExpr::Term{mulExpr(), true});
+    } else {
+      break;
     }
   }
-  return lhs;
+
+  if (terms.size() == 1)
+    return std::move(terms[0].expr);
+
+  if (terms.size() == 2) {
+    std::unique_ptr<Expr>& left = terms[0].expr;
+    std::unique_ptr<Expr>& right = terms[1].expr;
+    if (terms[1].subtract)
+      return std::make_unique<MinusExpr>(std::move(left), std::move(right));
+    return std::make_unique<PlusExpr>(std::move(left), std::move(right));
+  }
+
+  return std::make_unique<SumExpr>(std::move(terms));
+}
+
+// Joins a run of factors, as multiplied left to right.
+static std::unique_ptr<Expr> makeProduct(ProductExpr::FactorList&& factors) {
+  if (factors.size() == 1)
+    return std::move(factors[0]);
+
+  if (factors.size() == 2)
+    return std::make_unique<MulExpr>(std::move(factors[0]), std::move(factors[1]));
+
+  return std::make_unique<ProductExpr>(std::move(factors));
 }
 
 std::unique_ptr<Expr> ExprParser::mulExpr() {
-  auto lhs = facExpr();
+  ProductExpr::FactorList factors;
+  factors.emplace_back(facExpr());
   for (;;) {
     switch (currentToken()) {
-      case Token::Eof:
-      case Token::RndClose:
-        return lhs;
       case Token::Mul:
         nextToken();
-        lhs = std::make_unique<MulExpr>(std::move(lhs), facExpr());
+        factors.emplace_back(facExpr());
         break;
-      case Token::Div:
+      case Token::Div: {
+        // the product so far is the dividend, and the quotient starts the next one
         nextToken();
-        lhs = std::make_unique<DivExpr>(std::move(lhs), facExpr());
+        auto lhs = makeProduct(std::move(factors));
+        factors.clear();
+        factors.emplace_back(std::make_unique<DivExpr>(std::move(lhs), facExpr()));
         break;
+      }
       default:
-        return lhs;
-        // // a*b = ab
-        // std::cout << "x: " << currentToken() << '\n';
-        // lhs = std::make_unique<MulExpr>(std::move(lhs), powExpr());
-        // break;
+        return makeProduct(std::move(factors));
     }
   }
-  return lhs;
 }
 
 std::unique_ptr<Expr> ExprParser::facExpr() {
@@ -418,8 +537,16 @@ std::unique_ptr<Expr> ExprParser::powExpr() {
 std::unique_ptr<Expr> ExprParser::primaryExpr() {
   switch (currentToken()) {
     case Token::RndOpen: {
+      // (expr) or the tuple (expr, expr, ...)
       nextToken();
       auto e = expr();
+      if (currentToken() == Token::Comma) {
+        TupleExpr::ElementList elements;
+        elements.emplace_back(std::move(e));
+        while (tryConsumeToken(Token::Comma))
+          elements.emplace_back(expr());
+        e = std::make_unique<TupleExpr>(std::move(elements));
+      }
       consumeToken(Token::RndClose);
       return e;
     }
@@ -428,12 +555,24 @@ std::unique_ptr<Expr> ExprParser::primaryExpr() {
       return std::make_unique<NegExpr>(primaryExpr());
     }
     case Token::Number: {
-      return std::make_unique<NumberExpr>(consumeNumber());
+      const std::string literal = currentToken_->literal();
+      return std::make_unique<NumberExpr>(consumeNumber(), literal);
     }
     case Token::Symbol: {
       Symbol name = currentToken_->symbol();
       nextToken();
 
+      // sum and product start a series, unless being defined
+      if (name == "sum" && isKeyword(name) && currentToken() != Token::Define)
+        return seriesExpr(SeriesExpr::Kind::Sum);
+
+      if (name == "product" && isKeyword(name) && currentToken() != Token::Define)
+        return seriesExpr(SeriesExpr::Kind::Product);
+
+      // parameters are bound by the mapping's scope at call time
+      if (std::find(parameters_.begin(), parameters_.end(), name) != parameters_.end())
+        return std::make_unique<SymbolExpr>(name, nullptr);
+
       const Def* def = symbolTable_.lookup(name);
       if (def == nullptr)
         return std::make_unique<SymbolExpr>(name, nullptr);
@@ -473,6 +612,76 @@ std::unique_ptr<Expr> ExprParser::primaryExpr() {
   }
 }
 
+std::unique_ptr<Expr> ExprParser::seriesExpr(SeriesExpr::Kind kind) {
+  // ['over'] expr 'for' SYMBOL '=' addExpr 'to' ('infinity' | addExpr),
+  // after 'sum' or 'product'
+  tryConsumeKeyword("over");
+
+  // the index is bound within the body, which comes before it
+  const Symbol index = seriesIndex();
+  parameters_.push_back(index);
+  std::unique_ptr<Expr> body = expr();
+  parameters_.pop_back();
+
+  consumeKeyword("for");
+  consumeSymbol();
+  consumeToken(Token::Equ);
+  std::unique_ptr<Expr> first = addExpr();
+  consumeKeyword("to");
+  std::unique_ptr<Expr> last = tryConsumeKeyword("infinity") ? nullptr : addExpr();
+
+  return std::make_unique<SeriesExpr>(kind, std::move(body), index, std::move(first),
+                                      std::move(last));
+}
+
+// Scans ahead to the 'for' that ends the series body starting here, past
+// those of nested series, for the index named after it.
+Symbol ExprParser::seriesIndex() {
+  ExprTokenizer t = currentToken_;
+  int depth = 0;
+  size_t nested = 0;
+  for (; !t.eof(); t.next()) {
+    if (t->token() == Token::RndOpen) {
+      ++depth;
+    } else if (t->token() == Token::RndClose) {
+      if (--depth < 0)
+        break;
+    } else if (t->token() == Token::Symbol && depth == 0) {
+      if (t->symbol() == "for" && nested == 0) {
+        t.next();
+        if (t->token() != Token::Symbol)
+          break;
+        return t->symbol();
+      }
+      if (t->symbol() == "for")
+        --nested;
+      else if (isKeyword(t->symbol()) && (t->symbol() == "sum" || t->symbol() == "product"))
+        ++nested;
+    }
+  }
+  throw make_error_code(t.eof() ? UnexpectedEof : UnexpectedToken);
+}
+
+// Keywords are the symbols that are neither defined nor parameters.
+bool ExprParser::isKeyword(const Symbol& name) const {
+  return std::find(parameters_.begin(), parameters_.end(), name) == parameters_.end() &&
+         symbolTable_.lookup(name) == nullptr;
+}
+
+bool ExprParser::tryConsumeKeyword(const char* keyword) {
+  if (currentToken() != Token::Symbol || currentToken_->symbol() != keyword ||
+      !isKeyword(currentToken_->symbol()))
+    return false;
+
+  nextToken();
+  return true;
+}
+
+void ExprParser::consumeKeyword(const char* keyword) {
+  if (!tryConsumeKeyword(keyword))
+    throw make_error_code(UnexpectedToken);
+}
+
 void ExprParser::consumeToken(Token t) {
   if (currentToken() != t)
     throw make_error_code(UnexpectedToken);
@@ -497,6 +706,21 @@ Number ExprParser::consumeNumber() {
   return n;
 }
 
+Symbol ExprParser::consumeSymbol() {
+  if (currentToken() != Token::Symbol)
+    throw make_error_code(UnexpectedToken);
+
+  Symbol s = currentToken_->symbol();
+  nextToken();
+  return s;
+}
+
+Token ExprParser::peekToken() {
+  ExprTokenizer t = currentToken_;
+  t.next();
+  return t->token();
+}
+
 Token ExprParser::currentToken() {
   return currentToken_->token();
 }
@@ -528,6 +752,8 @@ std::string ExprParser::ErrorCategory::message(int ec) const {
       return "Unexpected end of expression";
     case UnknownSymbol:
       return "Unknown symbol";
+    case NotASymbol:
+      return "Only symbols can be defined";
   }
 }
 
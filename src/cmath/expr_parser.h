@@ -12,6 +12,7 @@
 #include <memory>
 #include <system_error>
 #include <utility>
+#include <vector>
 
 namespace cmath {
 
@@ -19,7 +20,7 @@ class SymbolTable;
 
 enum class Token {  // {{{
   Eof,              // <artificial delimiter>
-  Number,           // 1234, -5
+  Number,           // 1234, -5, 2i
   Symbol,           // a, b, pi, phi, ...
   Equ,              // =
   NotEqu,           // <>
@@ -46,19 +47,21 @@ std::ostream& operator<<(std::ostream& os, Token t);
 
 class ExprToken {
  public:
-  ExprToken() : token_(Token::Eof), number_(), symbol_() {}
+  ExprToken() : token_(Token::Eof), number_(), literal_(), symbol_() {}
 
   Token token() const noexcept { return token_; }
   Number number() const { return number_; }
+  const std::string& literal() const { return literal_; }  // of the number
   const Symbol& symbol() const { return symbol_; }
 
   void setToken(Token t);
   void setSymbol(const Symbol& s);
-  void setNumber(Number n);
+  void setNumber(Number n, const std::string& literal);
 
  private:
   Token token_;
   Number number_;
+  std::string literal_;
   Symbol symbol_;
 };
 
@@ -66,6 +69,7 @@ class ExprTokenizer {
  public:
   ExprTokenizer(std::u16string::const_iterator begin, std::u16string::const_iterator end);
   ExprTokenizer();
+  ExprTokenizer(const ExprTokenizer& t);
 
   ExprTokenizer& operator=(const ExprTokenizer& t);
 
@@ -114,7 +118,13 @@ class ExprParser {
 
   Result<std::unique_ptr<Expr>> parse();
 
-  enum ErrorCode { UnexpectedCharacter, UnexpectedToken, UnexpectedEof, UnknownSymbol };
+  enum ErrorCode {
+    UnexpectedCharacter,
+    UnexpectedToken,
+    UnexpectedEof,
+    UnknownSymbol,
+    NotASymbol,  // defining anything but a symbol with :=
+  };
   class ErrorCategory;
 
   ExprTokenizer begin() { return ExprTokenizer(expression_.begin(), expression_.end()); }
@@ -125,11 +135,16 @@ class ExprParser {
   Token currentToken();
   void consumeToken(Token t);
   bool tryConsumeToken(Token t);
+  Token peekToken();
   Number consumeNumber();
+  Symbol consumeSymbol();
+  bool isKeyword(const Symbol& name) const;
+  bool tryConsumeKeyword(const char* keyword);
+  void consumeKeyword(const char* keyword);
 
   std::unique_ptr<Program> program();
   std::unique_ptr<ConstDef> constDef();      // A := 1.234
-  std::unique_ptr<MappingDef> mappingDef();  // f : (a, b) -> a + b
+  std::unique_ptr<Expr> mappingDef();        // f : (a, b) -> a + b
   std::unique_ptr<Expr> expr();
   std::unique_ptr<Expr> caseExpr();
   std::unique_ptr<Expr> relExpr();           // < > = != <= >=
@@ -138,11 +153,14 @@ class ExprParser {
   std::unique_ptr<Expr> facExpr();           // !
   std::unique_ptr<Expr> powExpr();           // ^
   std::unique_ptr<Expr> primaryExpr();       // number symbol ( ! -
+  std::unique_ptr<Expr> seriesExpr(SeriesExpr::Kind kind);  // sum product
+  Symbol seriesIndex();
 
  private:
   const SymbolTable& symbolTable_;
   std::u16string expression_;
   ExprTokenizer currentToken_;
+  std::vector<Symbol> parameters_;  // of the mapping currently being parsed
 };
 
 class ExprParser::ErrorCategory : public std::error_category {
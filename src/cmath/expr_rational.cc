@@ -0,0 +1,315 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/builtins.h>
+#include <cmath/expr_rational.h>
+#include <cmath/polynomial.h>
+#include <cmath/series.h>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace cmath {
+
+namespace {
+
+// powers beyond would take unbounded time and memory; about 315000 digits
+constexpr size_t MaxPowerBits = 1 << 20;
+
+class RationalCalculator {
+ public:
+  explicit RationalCalculator(const SymbolTable& t) : symbols_(t), frame_() {}
+
+  Rational calculate(const Expr* e);
+
+ private:
+  Rational number(Number n) const;
+  Rational literal(const NumberExpr* e) const;
+  const Rational* argument(const Symbol& name) const;
+  bool isBuiltin(const Symbol& name, const Def* def) const;
+  Rational symbol(const Symbol& name);
+  Rational call(const CallExpr* e);
+  Rational series(const SeriesExpr* e);
+  bool holds(const Expr* condition);
+  Rational cases(const CaseExpr* e);
+  Rational builtin(const Symbol& name, const std::vector<Rational>& args);
+
+ private:
+  const SymbolTable& symbols_;
+  std::vector<std::pair<Symbol, Rational>> frame_;  // mapping arguments, innermost last
+};
+
+[[noreturn]] void fail(Rational::ErrorCode ec) {
+  throw make_error_code(ec);
+}
+
+Rational RationalCalculator::number(Number n) const {
+  if (n.imag() != 0)
+    fail(Rational::NotRational);
+
+  const double x = n.real();
+  if (!std::isfinite(x))
+    fail(Rational::Undefined);
+
+  // integers directly, everything else by the shortest decimal that reads
+  // back into this double, usually the literal as written
+  if (x == std::trunc(x) && std::abs(x) < 0x1p63)
+    return Rational(static_cast<long long>(x));
+
+  char buf[32];
+  std::to_chars_result r = std::to_chars(buf, buf + sizeof(buf), x);
+  return *Rational::parse(std::string_view(buf, r.ptr - buf));
+}
+
+Rational RationalCalculator::literal(const NumberExpr* e) const {
+  // by the decimal as written, where it is exact and the double may not be
+  if (!e->literal().empty() && !e->getNumber().imag())
+    if (Result<Rational> r = Rational::parse(e->literal()))
+      return *r;
+
+  return number(e->getNumber());
+}
+
+const Rational* RationalCalculator::argument(const Symbol& name) const {
+  for (size_t i = frame_.size(); i-- > 0;)
+    if (frame_[i].first == name)
+      return &frame_[i].second;
+
+  return nullptr;
+}
+
+bool RationalCalculator::isBuiltin(const Symbol& name, const Def* def) const {
+  return def && def == lookupBuiltin(name);
+}
+
+Rational RationalCalculator::symbol(const Symbol& name) {
+  if (const Rational* value = argument(name))
+    return *value;
+
+  const Def* def = symbols_.lookup(name);
+  if (isBuiltin(name, def) && name != "nan")
+    fail(Rational::NotRational);  // i, e, pi and inf
+
+  if (auto c = dynamic_cast<const ConstantDef*>(def))
+    return number(c->getNumber());
+
+  fail(Rational::Undefined);
+}
+
+Rational RationalCalculator::call(const CallExpr* e) {
+  std::vector<Rational> args;
+  args.reserve(e->inputs().size());
+  for (const std::unique_ptr<Expr>& input : e->inputs())
+    args.emplace_back(calculate(input.get()));
+
+  const Def* def = e->mapping();
+  if (!def)
+    def = symbols_.lookup(e->symbolName());
+
+  if (isBuiltin(e->symbolName(), def))
+    return builtin(e->symbolName(), args);
+
+  if (auto m = dynamic_cast<const CustomMappingDef*>(def)) {
+    // missing arguments would be NaN
+    if (args.size() < m->inputs().size())
+      fail(Rational::Undefined);
+
+    const size_t base = frame_.size();
+    for (size_t i = 0; i < m->inputs().size(); ++i)
+      frame_.emplace_back(m->inputs()[i], args[i]);
+
+    Rational y = calculate(m->expr());
+    frame_.resize(base);
+    return y;
+  }
+
+  if (!def)
+    fail(Rational::Undefined);
+
+  fail(Rational::UnsupportedExpr);
+}
+
+Rational RationalCalculator::series(const SeriesExpr* e) {
+  // term by term, so only over finite ranges of at most Series' term limit;
+  // the limits of infinite series are rarely rational
+  if (!e->last())
+    fail(Rational::UnsupportedExpr);
+
+  const Rational first = calculate(e->first());
+  const Rational last = calculate(e->last());
+  const auto maxTerms = static_cast<long long>(Series::Options().maxTerms);
+  if (last - first > Rational(maxTerms))
+    fail(Rational::UnsupportedExpr);
+
+  const bool product = e->kind() == SeriesExpr::Kind::Product;
+  Rational y(product ? 1 : 0);
+  const size_t base = frame_.size();
+  frame_.emplace_back(e->index(), first);
+  for (Rational k = first; k <= last; k = k + Rational(1)) {
+    frame_.back().second = k;
+    const Rational x = calculate(e->body());
+    y = product ? y * x : y + x;
+  }
+  frame_.resize(base);
+  return y;
+}
+
+bool RationalCalculator::holds(const Expr* condition) {
+  // relations hold where they do not fail, as CaseExpr::holds() has it
+  if (auto q = dynamic_cast<const EquExpr*>(condition))
+    return calculate(q->left()) == calculate(q->right());
+  if (auto l = dynamic_cast<const LessExpr*>(condition))
+    return calculate(l->left()) < calculate(l->right());
+
+  return !calculate(condition).isZero();
+}
+
+Rational RationalCalculator::cases(const CaseExpr* e) {
+  for (const CaseExpr::CaseMatch& c : e->cases())
+    if (holds(c.first.get()))
+      return calculate(c.second.get());
+
+  return calculate(e->elseExpr());
+}
+
+Rational RationalCalculator::builtin(const Symbol& name, const std::vector<Rational>& args) {
+  if (args.empty())
+    fail(Rational::Undefined);
+
+  const Rational& x = args[0];
+
+  if (name == "Re")
+    return x;
+  if (name == "Im")
+    return Rational();
+  if (name == "arg" && !x.isNegative())
+    return Rational();
+
+  Rational root;
+  if (name == "sqrt" && sqrt(x, &root))
+    return root;
+
+  if (name == "polar" && args.size() >= 2 && args[1].isZero())
+    return x;  // r e^(i 0)
+
+  fail(Rational::NotRational);
+}
+
+Rational RationalCalculator::calculate(const Expr* e) {
+  if (auto p = dynamic_cast<const PolynomialExpr*>(e))
+    return calculate(p->source());
+
+  if (auto n = dynamic_cast<const NumberExpr*>(e))
+    return literal(n);
+
+  if (auto s = dynamic_cast<const SymbolExpr*>(e))
+    return symbol(s->symbolName());
+
+  if (auto n = dynamic_cast<const NegExpr*>(e))
+    return -calculate(n->subExpr());
+
+  if (auto f = dynamic_cast<const FacExpr*>(e)) {
+    // z! = gamma(z + 1) is irrational at non-integers, and has its poles at
+    // the negative integers
+    const Rational n = calculate(f->subExpr());
+    if (!n.isInteger())
+      fail(Rational::NotRational);
+    if (n.isNegative())
+      fail(Rational::Undefined);
+
+    Rational y(1);
+    for (Rational i(1); i <= n; i = i + Rational(1))
+      y = y * i;
+    return y;
+  }
+
+  if (auto c = dynamic_cast<const CallExpr*>(e))
+    return call(c);
+
+  if (auto s = dynamic_cast<const SeriesExpr*>(e))
+    return series(s);
+
+  if (auto c = dynamic_cast<const CaseExpr*>(e))
+    return cases(c);
+
+  // exact in any order
+  if (auto s = dynamic_cast<const SumExpr*>(e)) {
+    Rational x = calculate(s->terms()[0].expr.get());
+    for (size_t i = 1; i < s->terms().size(); ++i) {
+      const SumExpr::Term& term = s->terms()[i];
+      x = term.subtract ? x - calculate(term.expr.get()) : x + calculate(term.expr.get());
+    }
+    return x;
+  }
+
+  if (auto p = dynamic_cast<const ProductExpr*>(e)) {
+    Rational x = calculate(p->factors()[0].get());
+    for (size_t i = 1; i < p->factors().size(); ++i)
+      x = x * calculate(p->factors()[i].get());
+    return x;
+  }
+
+  if (auto b = dynamic_cast<const BinaryExpr*>(e)) {
+    const Rational x = calculate(b->left());
+    const Rational y = calculate(b->right());
+
+    if (dynamic_cast<const PlusExpr*>(e))
+      return x + y;
+    if (dynamic_cast<const MinusExpr*>(e))
+      return x - y;
+    if (dynamic_cast<const MulExpr*>(e))
+      return x * y;
+    if (dynamic_cast<const DivExpr*>(e))
+      return x / y;
+    if (dynamic_cast<const PowExpr*>(e)) {
+      int64_t n = 0;
+      if (y.toInteger(&n)) {
+        const size_t bits = std::max(natural::bitLength(x.numerator()),
+                                     natural::bitLength(x.denominator()));
+        const uint64_t m = n < 0 ? uint64_t(-(n + 1)) + 1 : uint64_t(n);
+        if (bits > 1 && m > MaxPowerBits / (bits - 1))
+          fail(Rational::UnsupportedExpr);
+        return pow(x, n);
+      }
+      if ((x.isZero() && !y.isNegative()) || x == Rational(1))
+        return x;
+      fail(Rational::NotRational);
+    }
+    if (dynamic_cast<const EquExpr*>(e)) {
+      if (x != y)
+        fail(Rational::Undefined);  // NaN with Number
+      return x;
+    }
+    if (dynamic_cast<const LessExpr*>(e)) {
+      if (!(x < y))
+        fail(Rational::Undefined);
+      return x;
+    }
+    if (dynamic_cast<const DefineExpr*>(e))
+      return Rational(x == y ? 1 : 0);
+  }
+
+  if (dynamic_cast<const DefineMappingExpr*>(e))
+    fail(Rational::Undefined);
+
+  fail(Rational::UnsupportedExpr);
+}
+
+}  // namespace
+
+Result<Rational> calculateRational(const Expr* e, const SymbolTable& t) {
+  try {
+    RationalCalculator calculator(t);
+    return calculator.calculate(e);
+  } catch (const std::error_code& ec) {
+    return ec;
+  }
+}
+
+}  // namespace cmath
@@ -0,0 +1,28 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <cmath/rational.h>
+#include <cmath/result.h>
+
+namespace cmath {
+
+/**
+ * Calculates @p e exactly, with rational numbers instead of Number.
+ *
+ * Literals are taken as written, so 0.1 means exactly one tenth, and
+ * integers beyond 2^53 are not rounded; constants are taken by their
+ * shortest decimal form. Powers need integral exponents, square roots
+ * perfect squares; anything irrational fails with Rational::NotRational,
+ * division by zero with Rational::DivisionByZero. Powers of more than about
+ * a million bits fail with Rational::UnsupportedExpr.
+ * Series are summed up term by term, so only over finite ranges.
+ */
+Result<Rational> calculateRational(const Expr* e, const SymbolTable& t);
+
+}  // namespace cmath
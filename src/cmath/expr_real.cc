@@ -0,0 +1,320 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/builtins.h>
+#include <cmath/expr_real.h>
+#include <cmath/polynomial.h>
+#include <cmath/series.h>
+#include <charconv>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace cmath {
+
+namespace {
+
+class RealCalculator {
+ public:
+  RealCalculator(const SymbolTable& t, size_t precision)
+      : symbols_(t), precision_(precision), frame_() {}
+
+  Real calculate(const Expr* e);
+
+ private:
+  Real number(Number n) const;
+  Real literal(const NumberExpr* e) const;
+  const Real* argument(const Symbol& name) const;
+  bool isBuiltin(const Symbol& name, const Def* def) const;
+  Real symbol(const Symbol& name);
+  Real call(const CallExpr* e);
+  Real series(const SeriesExpr* e);
+  bool holds(const Expr* condition);
+  Real cases(const CaseExpr* e);
+  Real builtin(const Symbol& name, const std::vector<Real>& args);
+
+ private:
+  const SymbolTable& symbols_;
+  size_t precision_;
+  std::vector<std::pair<Symbol, Real>> frame_;  // mapping arguments, innermost last
+};
+
+[[noreturn]] void fail(Real::ErrorCode ec) {
+  throw make_error_code(ec);
+}
+
+Real RealCalculator::number(Number n) const {
+  if (n.imag() != 0)
+    fail(Real::NotReal);
+
+  if (!std::isfinite(n.real()))
+    return Real(n.real(), precision_);
+
+  // the shortest decimal that reads back into this double, usually the
+  // literal as written
+  char buf[32];
+  std::to_chars_result r = std::to_chars(buf, buf + sizeof(buf), n.real());
+  return *Real::parse(std::string_view(buf, r.ptr - buf), precision_);
+}
+
+Real RealCalculator::literal(const NumberExpr* e) const {
+  // by the decimal as written, which may have more digits than the double
+  if (!e->literal().empty() && !e->getNumber().imag())
+    if (Result<Real> r = Real::parse(e->literal(), precision_))
+      return *r;
+
+  return number(e->getNumber());
+}
+
+const Real* RealCalculator::argument(const Symbol& name) const {
+  for (size_t i = frame_.size(); i-- > 0;)
+    if (frame_[i].first == name)
+      return &frame_[i].second;
+
+  return nullptr;
+}
+
+bool RealCalculator::isBuiltin(const Symbol& name, const Def* def) const {
+  return def && def == lookupBuiltin(name);
+}
+
+Real RealCalculator::symbol(const Symbol& name) {
+  if (const Real* value = argument(name))
+    return *value;
+
+  const Def* def = symbols_.lookup(name);
+  if (isBuiltin(name, def)) {
+    if (name == "pi" || name == "π")
+      return Real::pi(precision_);
+    if (name == "e")
+      return Real::e(precision_);
+    if (name == "i")
+      fail(Real::NotReal);
+  }
+
+  if (auto c = dynamic_cast<const ConstantDef*>(def))
+    return number(c->getNumber());
+
+  return Real::nan(precision_);
+}
+
+Real RealCalculator::call(const CallExpr* e) {
+  std::vector<Real> args;
+  args.reserve(e->inputs().size());
+  for (const std::unique_ptr<Expr>& input : e->inputs())
+    args.emplace_back(calculate(input.get()));
+
+  const Def* def = e->mapping();
+  if (!def)
+    def = symbols_.lookup(e->symbolName());
+
+  if (isBuiltin(e->symbolName(), def))
+    return builtin(e->symbolName(), args);
+
+  if (auto m = dynamic_cast<const CustomMappingDef*>(def)) {
+    const size_t base = frame_.size();
+    for (size_t i = 0; i < m->inputs().size(); ++i)
+      frame_.emplace_back(m->inputs()[i], i < args.size() ? args[i] : Real::nan(precision_));
+
+    Real y = calculate(m->expr());
+    frame_.resize(base);
+    return y;
+  }
+
+  if (!def)
+    return Real::nan(precision_);
+
+  fail(Real::UnsupportedExpr);
+}
+
+Real RealCalculator::series(const SeriesExpr* e) {
+  // term by term, so only over finite ranges of at most Series' term limit
+  if (!e->last())
+    fail(Real::UnsupportedExpr);
+
+  const Real first = calculate(e->first());
+  const Real last = calculate(e->last());
+  if (first.isNaN() || last.isNaN())
+    return Real::nan(precision_);  // an invalid range, as with Number
+
+  const auto maxTerms = static_cast<long long>(Series::Options().maxTerms);
+  if (!first.isFinite() || !last.isFinite() || Real(maxTerms, precision_) < last - first)
+    fail(Real::UnsupportedExpr);
+
+  const bool product = e->kind() == SeriesExpr::Kind::Product;
+  Real y(product ? 1 : 0, precision_);
+  const Real one(1, precision_);
+  const size_t base = frame_.size();
+  frame_.emplace_back(e->index(), first);
+  for (Real k = first; k <= last; k = k + one) {
+    frame_.back().second = k;
+    const Real x = calculate(e->body());
+    y = product ? y * x : y + x;
+  }
+  frame_.resize(base);
+  return y;
+}
+
+bool RealCalculator::holds(const Expr* condition) {
+  // relations hold where they are not NaN, as CaseExpr::holds() has it
+  if (auto q = dynamic_cast<const EquExpr*>(condition))
+    return calculate(q->left()) == calculate(q->right());
+  if (auto l = dynamic_cast<const LessExpr*>(condition))
+    return calculate(l->left()) < calculate(l->right());
+
+  const Real x = calculate(condition);
+  return !x.isNaN() && !x.isZero();
+}
+
+Real RealCalculator::cases(const CaseExpr* e) {
+  for (const CaseExpr::CaseMatch& c : e->cases())
+    if (holds(c.first.get()))
+      return calculate(c.second.get());
+
+  return calculate(e->elseExpr());
+}
+
+Real RealCalculator::builtin(const Symbol& name, const std::vector<Real>& args) {
+  const Real x = args.empty() ? Real::nan(precision_) : args[0];
+  const bool negative = x.isNegative() && !x.isZero();
+
+  if (name == "sin")
+    return sin(x);
+  if (name == "cos")
+    return cos(x);
+  if (name == "tan")
+    return tan(x);
+  if (name == "exp")
+    return exp(x);
+  if (name == "Re")
+    return x;
+  if (name == "Im")
+    return Real::zero(precision_);
+  if (name == "arg")
+    return x.isNaN() ? x : negative ? Real::pi(precision_) : Real::zero(precision_);
+
+  if (name == "sqrt" || name == "log") {
+    if (negative)
+      fail(Real::NotReal);
+    return name == "sqrt" ? sqrt(x) : log(x);
+  }
+
+  if (name == "polar") {
+    // r e^(i phi) is only real for a zero angle
+    if (args.size() < 2 || !args[1].isZero())
+      fail(Real::NotReal);
+    return x;
+  }
+
+  fail(Real::UnsupportedExpr);
+}
+
+Real RealCalculator::calculate(const Expr* e) {
+  if (auto p = dynamic_cast<const PolynomialExpr*>(e))
+    return calculate(p->source());
+
+  if (auto n = dynamic_cast<const NumberExpr*>(e))
+    return literal(n);
+
+  if (auto s = dynamic_cast<const SymbolExpr*>(e))
+    return symbol(s->symbolName());
+
+  if (auto n = dynamic_cast<const NegExpr*>(e))
+    return -calculate(n->subExpr());
+
+  if (auto f = dynamic_cast<const FacExpr*>(e)) {
+    // the gamma function is only computed in double precision
+    const Real n = calculate(f->subExpr());
+    if (!n.isInteger() || n.isNegative())
+      fail(Real::UnsupportedExpr);
+
+    Real y(1, precision_);
+    for (Real i(1, precision_); i <= n; i = i + Real(1, precision_))
+      y = y * i;
+    return y;
+  }
+
+  if (auto c = dynamic_cast<const CallExpr*>(e))
+    return call(c);
+
+  if (auto s = dynamic_cast<const SeriesExpr*>(e))
+    return series(s);
+
+  if (auto c = dynamic_cast<const CaseExpr*>(e))
+    return cases(c);
+
+  // left to right, as the binary chain would be
+  if (auto s = dynamic_cast<const SumExpr*>(e)) {
+    Real x = calculate(s->terms()[0].expr.get());
+    for (size_t i = 1; i < s->terms().size(); ++i) {
+      const SumExpr::Term& term = s->terms()[i];
+      x = term.subtract ? x - calculate(term.expr.get()) : x + calculate(term.expr.get());
+    }
+    return x;
+  }
+
+  if (auto p = dynamic_cast<const ProductExpr*>(e)) {
+    Real x = calculate(p->factors()[0].get());
+    for (size_t i = 1; i < p->factors().size(); ++i)
+      x = x * calculate(p->factors()[i].get());
+    return x;
+  }
+
+  if (auto b = dynamic_cast<const BinaryExpr*>(e)) {
+    // e^x goes straight to exp(), as with Number
+    if (dynamic_cast<const PowExpr*>(e)) {
+      auto base = dynamic_cast<const SymbolExpr*>(b->left());
+      if (base && base->symbolName() == "e" && !argument("e") &&
+          isBuiltin("e", symbols_.lookup("e")))
+        return exp(calculate(b->right()));
+    }
+
+    const Real x = calculate(b->left());
+    const Real y = calculate(b->right());
+
+    if (dynamic_cast<const PlusExpr*>(e))
+      return x + y;
+    if (dynamic_cast<const MinusExpr*>(e))
+      return x - y;
+    if (dynamic_cast<const MulExpr*>(e))
+      return x * y;
+    if (dynamic_cast<const DivExpr*>(e))
+      return x / y;
+    if (dynamic_cast<const PowExpr*>(e)) {
+      if (x.isNegative() && !x.isZero() && y.isFinite() && !y.isInteger())
+        fail(Real::NotReal);
+      return pow(x, y);
+    }
+    if (dynamic_cast<const EquExpr*>(e))
+      return x == y ? x : Real::nan(precision_);
+    if (dynamic_cast<const LessExpr*>(e))
+      return x < y ? x : Real::nan(precision_);
+    if (dynamic_cast<const DefineExpr*>(e))
+      return Real(x == y ? 1 : 0, precision_);
+  }
+
+  if (dynamic_cast<const DefineMappingExpr*>(e))
+    return Real::nan(precision_);
+
+  fail(Real::UnsupportedExpr);
+}
+
+}  // namespace
+
+Result<Real> calculateReal(const Expr* e, const SymbolTable& t, size_t precision) {
+  // a few guard bits absorb the rounding errors of the individual steps
+  constexpr size_t GuardBits = 16;
+
+  try {
+    RealCalculator calculator(t, precision + GuardBits);
+    return calculator.calculate(e).rounded(precision);
+  } catch (const std::error_code& ec) {
+    return ec;
+  }
+}
+
+}  // namespace cmath
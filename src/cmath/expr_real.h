@@ -0,0 +1,28 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <cmath/real.h>
+#include <cmath/result.h>
+
+namespace cmath {
+
+/**
+ * Calculates @p e with @p precision bits instead of Number's double
+ * precision.
+ *
+ * Literals are taken as written, to all of their digits, constants by
+ * their shortest decimal form, so 0.1 means exactly one tenth; pi and e
+ * are computed to the full precision.
+ * Results that would be complex fail with Real::NotReal, constructs that
+ * have no arbitrary-precision counterpart with Real::UnsupportedExpr.
+ * Series are summed up term by term, so only over finite ranges.
+ */
+Result<Real> calculateReal(const Expr* e, const SymbolTable& t, size_t precision);
+
+}  // namespace cmath
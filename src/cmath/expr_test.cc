@@ -0,0 +1,108 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/expr.h>
+#include <cmath/expr_parser.h>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+using namespace cmath;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool ok, const std::string& what) {
+  if (!ok) {
+    std::cerr << "FAILED: " << what << '\n';
+    failures++;
+  }
+}
+
+std::unique_ptr<Expr> parse(SymbolTable& st, const std::string& s) {
+  Result<std::unique_ptr<Expr>> e = parseExpression(st, s);
+  if (e.isFailure()) {
+    std::cerr << "Cannot parse " << s << ": " << e.failureMessage() << '\n';
+    std::exit(1);
+  }
+  return std::move(*e);
+}
+
+// Defines the mapping @p s in @p st, as cm does.
+void define(SymbolTable& st, const std::string& s) {
+  std::unique_ptr<Expr> e = parse(st, s);
+  auto m = dynamic_cast<DefineMappingExpr*>(e.get());
+  st.defineMapping(m->symbolName(), m->inputs(), m->body()->clone());
+}
+
+void testRedefinedMapping() {
+  // g keeps calling the f it was defined with
+  SymbolTable st;
+  define(st, "f : x -> x * 2");
+  define(st, "g : x -> f(x) + 1");
+  define(st, "f : x -> x * 3");
+  expect(parse(st, "g(1)")->calculate(st) == 3.0, "g(1) after redefining f");
+  expect(parse(st, "f(1)")->calculate(st) == 3.0, "f(1) after redefining f");
+}
+
+void testRecursiveRedefinition() {
+  // the f in the new body is the old one
+  SymbolTable st;
+  define(st, "f : x -> x * 2");
+  define(st, "f : x -> f(x) + 1");
+  expect(parse(st, "f(1)")->calculate(st) == 3.0, "f(1) calling the f before it");
+}
+
+void testUndefinedConstant() {
+  SymbolTable st;
+  st.defineConstant("a", 3);
+  define(st, "g : x -> a + x");
+  std::unique_ptr<Expr> sum = parse(st, "a + 1");
+
+  st.undefine("a");
+  expect(std::isnan(parse(st, "g(1)")->calculate(st).real()), "g(1) after undefining a");
+  expect(std::isnan(sum->calculate(st).real()), "older a + 1 after undefining a");
+
+  st.defineConstant("a", 5);
+  expect(parse(st, "g(1)")->calculate(st) == 6.0, "g(1) after defining a again");
+  expect(sum->calculate(st) == 6.0, "older a + 1 after defining a again");
+}
+
+void testBuiltinArity() {
+  SymbolTable st;
+  for (const char* s : {"polar(1)", "sin(1, 2)", "polar(1, 2, 3)"}) {
+    std::unique_ptr<Expr> e = parse(st, s);
+    expect(std::isnan(e->calculate(st).real()), std::string(s) + " calculates NaN");
+    expect(std::isnan(e->evaluate(st).number().real()),
+           std::string(s) + " evaluates NaN");
+  }
+}
+
+void testShortestDigits() {
+  expect(str(Number(123456789012345680000.0)) == "123456789012345680000",
+         "123456789012345680000 printed as is");
+  expect(str(Number(-std::ldexp(1, 69))) == "-590295810358705700000", "-2^69");
+
+  for (double x : {std::ldexp(1, 70), 1e20, 9007199254740994.0, 0.1, 1e-7, 1e300}) {
+    const std::string s = str(Number(x));
+    expect(std::strtod(s.c_str(), nullptr) == x, s + " reads back");
+  }
+}
+
+}  // namespace
+
+int main() {
+  testRedefinedMapping();
+  testRecursiveRedefinition();
+  testUndefinedConstant();
+  testBuiltinArity();
+  testShortestDigits();
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,460 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/expr_batch.h>
+#include <cmath/integrate.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace cmath {
+
+namespace {
+
+constexpr double Epsilon = std::numeric_limits<double>::epsilon();
+
+// the error estimate never goes below this many rounding errors of the
+// integral of |f|
+constexpr double RoundoffFactor = 100;
+
+// {{{ Gauss–Kronrod 7-15
+// Kronrod nodes in (0, 1], descending; the odd ones are the Gauss nodes,
+// the center 0 is one, too
+constexpr double KronrodNodes[7] = {
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245,
+};
+
+constexpr double KronrodWeights[8] = {
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714,
+};
+
+constexpr double GaussWeights[4] = {
+    0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975, 0.417959183673469387755102040816327,
+};
+
+constexpr size_t PanelNodes = 15;
+
+// panels the interval is split into before the first estimate
+constexpr size_t InitialPanels = 4;
+
+// A part [lo, hi] of the parameter range [0, 1] of the line a + (b - a) s.
+struct Panel {
+  double lo;
+  double hi;
+  Number value;
+  double error;
+  double abs;  // integral of |f|
+};
+
+// Stores the nodes of @p p on the line from @p a in direction @p d to @p x.
+void kronrodNodes(const Panel& p, Number a, Number d, Number* x) {
+  const double c = (p.lo + p.hi) / 2;
+  const double h = (p.hi - p.lo) / 2;
+
+  x[0] = a + d * c;
+  for (size_t j = 0; j != 7; ++j) {
+    x[1 + 2 * j] = a + d * (c - h * KronrodNodes[j]);
+    x[2 + 2 * j] = a + d * (c + h * KronrodNodes[j]);
+  }
+}
+
+// Integrates @p p from the integrand's values @p y at its nodes.
+void kronrodRule(const Number* y, Number d, Panel* p) {
+  const double h = (p->hi - p->lo) / 2;
+
+  Number k = KronrodWeights[7] * y[0];
+  Number g = GaussWeights[3] * y[0];
+  double abs = KronrodWeights[7] * std::abs(y[0]);
+  for (size_t j = 0; j != 7; ++j) {
+    const Number s = y[1 + 2 * j] + y[2 + 2 * j];
+    k += KronrodWeights[j] * s;
+    if (j % 2)
+      g += GaussWeights[j / 2] * s;
+    abs += KronrodWeights[j] * (std::abs(y[1 + 2 * j]) + std::abs(y[2 + 2 * j]));
+  }
+
+  // deviation from the mean, which scales the raw error estimate (QUADPACK)
+  const Number mean = k / 2.0;
+  double asc = KronrodWeights[7] * std::abs(y[0] - mean);
+  for (size_t j = 0; j != 7; ++j)
+    asc += KronrodWeights[j] *
+           (std::abs(y[1 + 2 * j] - mean) + std::abs(y[2 + 2 * j] - mean));
+
+  const double scale = std::abs(d) * h;
+  double error = std::abs(k - g) * scale;
+  asc *= scale;
+  abs *= scale;
+  if (asc != 0 && error != 0)
+    error = asc * std::min(1.0, std::pow(200 * error / asc, 1.5));
+
+  p->value = d * h * k;
+  p->error = std::max(error, 50 * Epsilon * abs);
+  p->abs = abs;
+
+  if (!std::isfinite(p->value.real()) || !std::isfinite(p->value.imag()) ||
+      !std::isfinite(p->error)) {
+    p->value = 0;
+    p->error = INFINITY;
+    p->abs = 0;
+  }
+}
+// }}}
+// {{{ tanh-sinh
+// step of the coarsest level
+constexpr double TanhSinhStep = 0.5;
+
+// beyond this, all nodes coincide with the endpoints in double precision
+constexpr double TanhSinhRange = 6.5;
+
+constexpr unsigned MaxLevels = 10;
+// }}}
+// {{{ Evaluator
+// a round is spread over another thread for every this many nanoseconds
+// it is estimated to take
+constexpr double ThreadCost = 200000;
+
+// Evaluates the integrand for whole rounds, on as many threads as pays off.
+class Evaluator {
+ public:
+  Evaluator(const Integrator::Integrand& f, unsigned threads, Integrator::Stats* stats)
+      : f_(f), threads_(threads), stats_(stats), nsPerPoint_(0) {}
+
+  void operator()(const std::vector<Number>& x, std::vector<Number>* y);
+
+ private:
+  const Integrator::Integrand& f_;
+  unsigned threads_;
+  Integrator::Stats* stats_;
+  double nsPerPoint_;  // measured by the previous round, 0 before
+};
+
+void Evaluator::operator()(const std::vector<Number>& x, std::vector<Number>* y) {
+  const size_t n = x.size();
+  y->resize(n);
+  stats_->evaluations += n;
+  stats_->rounds++;
+
+  const size_t workers = std::clamp<size_t>(n * nsPerPoint_ / ThreadCost, 1, threads_);
+  const size_t chunk = (n + workers - 1) / workers;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> pool;
+  for (size_t begin = chunk; begin < n; begin += chunk) {
+    const size_t count = std::min(chunk, n - begin);
+    pool.emplace_back(
+        [&, begin, count]() { f_(x.data() + begin, count, y->data() + begin); });
+  }
+  f_(x.data(), std::min(chunk, n), y->data());
+  for (std::thread& t : pool)
+    t.join();
+
+  const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  if (n)
+    nsPerPoint_ = elapsed.count() * (pool.size() + 1) / n;
+  stats_->threads = std::max(stats_->threads, static_cast<unsigned>(pool.size() + 1));
+}
+// }}}
+
+double target(const Integrator::Options& options, Number value, double abs) {
+  return std::max(options.tolerance * std::abs(value), RoundoffFactor * Epsilon * abs);
+}
+
+bool gaussKronrod(Evaluator& f,
+                  Number a,
+                  Number b,
+                  const Integrator::Options& options,
+                  Number* result,
+                  double* error) {
+  const Number d = b - a;
+
+  std::vector<Panel> panels;
+  std::vector<size_t> fresh;
+  for (size_t i = 0; i != InitialPanels; ++i) {
+    panels.push_back(Panel{double(i) / InitialPanels, double(i + 1) / InitialPanels,
+                           Number(), 0, 0});
+    fresh.push_back(i);
+  }
+  panels.back().hi = 1;
+
+  std::vector<Number> x, y;
+  std::vector<size_t> split;
+  for (;;) {
+    x.resize(fresh.size() * PanelNodes);
+    for (size_t i = 0; i != fresh.size(); ++i)
+      kronrodNodes(panels[fresh[i]], a, d, &x[i * PanelNodes]);
+
+    f(x, &y);
+
+    for (size_t i = 0; i != fresh.size(); ++i)
+      kronrodRule(&y[i * PanelNodes], d, &panels[fresh[i]]);
+
+    Number value;
+    double abs = 0;
+    *error = 0;
+    for (const Panel& p : panels) {
+      value += p.value;
+      *error += p.error;
+      abs += p.abs;
+    }
+    *result = value;
+
+    const double tolerance = target(options, value, abs);
+    if (*error <= tolerance)
+      return true;
+
+    if (panels.size() >= options.maxPanels)
+      return false;
+
+    // bisect the panels whose error exceeds their share of the tolerance,
+    // as long as they can still be bisected
+    split.clear();
+    for (size_t i = 0; i != panels.size(); ++i) {
+      const Panel& p = panels[i];
+      const double mid = (p.lo + p.hi) / 2;
+      if (p.error > tolerance * (p.hi - p.lo) && p.lo < mid && mid < p.hi)
+        split.push_back(i);
+    }
+
+    if (split.empty())
+      return false;
+
+    const size_t room = options.maxPanels - panels.size();
+    if (split.size() > room) {
+      auto worse = [&](size_t i, size_t j) { return panels[i].error > panels[j].error; };
+      std::nth_element(split.begin(), split.begin() + room, split.end(), worse);
+      split.resize(room);
+    }
+
+    fresh.clear();
+    for (size_t i : split) {
+      const double mid = (panels[i].lo + panels[i].hi) / 2;
+      panels.push_back(Panel{mid, panels[i].hi, Number(), 0, 0});
+      panels[i].hi = mid;
+      fresh.push_back(i);
+      fresh.push_back(panels.size() - 1);
+    }
+  }
+}
+
+// The outermost node towards one endpoint with a finite value, whose
+// contribution estimates that of the nodes beyond it.
+struct Edge {
+  double t = 0;
+  double contribution = 0;  // w |f|
+
+  void update(double t, double contribution) {
+    if (t >= this->t) {
+      this->t = t;
+      this->contribution = contribution;
+    }
+  }
+
+  // Integral over t beyond, with w |f| falling like sqrt(w), at half the
+  // rate pi cosh(t) of the weights, as for singularities up to 1/sqrt(x).
+  double tail() const { return 2 * contribution / (M_PI * std::cosh(t)); }
+};
+
+std::error_code tanhSinh(Evaluator& f,
+                         Number a,
+                         Number b,
+                         const Integrator::Options& options,
+                         Number* result,
+                         double* error) {
+  const Number d = b - a;
+
+  Number sum;
+  double abs = 0;
+  Number previous;
+  Edge edges[2];  // towards b and towards a
+
+  std::vector<Number> x, y;
+  std::vector<double> w;
+  std::vector<double> t;  // the node's t, negative for those towards a
+  for (unsigned level = 0; level <= MaxLevels; ++level) {
+    const double h = std::ldexp(TanhSinhStep, -static_cast<int>(level));
+
+    // level 0 has all multiples of the step, the later ones the odd
+    // multiples of their halved step; every node t has its mirror -t
+    x.clear();
+    w.clear();
+    t.clear();
+    for (size_t k = level ? 1 : 0; k * h <= TanhSinhRange; k += level ? 2 : 1) {
+      const double tk = k * h;
+      // distance 1/(1 + e^u) of the node from the nearer endpoint in [0, 1],
+      // computed directly, as 1 - s would cancel
+      const double u = M_PI * std::sinh(tk);
+      const double q = 1 / (1 + std::exp(u));
+      const double weight = M_PI * std::cosh(tk) * q * (1 - q);
+      if (q == 0 || weight == 0)
+        break;
+
+      x.push_back(b - d * q);
+      w.push_back(weight);
+      t.push_back(tk);
+      if (k) {
+        x.push_back(a + d * q);
+        w.push_back(weight);
+        t.push_back(-tk);
+      }
+    }
+
+    f(x, &y);
+
+    // nodes where the integrand overflows count as zero if they coincide
+    // with an endpoint, right at its singularity; inside, the rule would
+    // step over a singularity it cannot integrate, as that of 1/x at 0
+    for (size_t i = 0; i != x.size(); ++i) {
+      if (std::isfinite(y[i].real()) && std::isfinite(y[i].imag())) {
+        sum += w[i] * y[i];
+        abs += w[i] * std::abs(y[i]);
+        edges[t[i] < 0].update(std::fabs(t[i]), w[i] * std::abs(y[i]));
+      } else if (x[i] != a && x[i] != b) {
+        return Integrator::InteriorSingularity;
+      }
+    }
+
+    // the nodes beyond the outermost ones with a finite value, nearer the
+    // endpoints than doubles resolve, do not change from level to level,
+    // so their share is estimated separately
+    const Number value = d * h * sum;
+    if (level) {
+      *result = value;
+      *error = std::max(std::abs(value - previous),
+                        std::abs(d) * (edges[0].tail() + edges[1].tail()));
+      if (*error <= target(options, value, std::abs(d) * h * abs))
+        return {};
+    }
+    previous = value;
+  }
+
+  return Integrator::NoConvergence;
+}
+
+}  // namespace
+
+// {{{ Integrator
+Result<Number> Integrator::integrate(const Integrand& f,
+                                     Number a,
+                                     Number b,
+                                     const Options& options,
+                                     Stats* stats) {
+  if (!std::isfinite(a.real()) || !std::isfinite(a.imag()) ||
+      !std::isfinite(b.real()) || !std::isfinite(b.imag()))
+    return NonFiniteBounds;
+
+  Stats s;
+  Number result;
+
+  if (a != b) {
+    const unsigned threads = options.threads
+                                 ? options.threads
+                                 : std::max(1u, std::thread::hardware_concurrency());
+    Evaluator evaluator(f, threads, &s);
+
+    std::vector<Number> y;
+    evaluator({a, b}, &y);
+    const bool singular = std::any_of(y.begin(), y.end(), [](Number z) {
+      return !std::isfinite(z.real()) || !std::isfinite(z.imag());
+    });
+
+    if (singular || !gaussKronrod(evaluator, a, b, options, &result, &s.error)) {
+      s.method = Method::TanhSinh;
+      if (std::error_code ec = tanhSinh(evaluator, a, b, options, &result, &s.error))
+        return ec;
+    }
+  }
+
+  if (stats)
+    *stats = s;
+
+  return result;
+}
+
+Result<Number> Integrator::integrate(const Expr* e,
+                                     const Symbol& x,
+                                     Number a,
+                                     Number b,
+                                     const SymbolTable& t,
+                                     const Options& options,
+                                     Stats* stats) {
+  if (options.batched) {
+    Result<BatchProgram> program = BatchProgram::compile(e, t, {x});
+    if (program.isSuccess()) {
+      const BatchProgram& p = *program;
+      auto f = [&](const Number* xs, size_t n, Number* ys) { p.evaluate(xs, n, ys); };
+      return integrate(f, a, b, options, stats);
+    }
+  }
+
+  // one point at a time, with the variable defined in a scope per thread
+  auto f = [&](const Number* xs, size_t n, Number* ys) {
+    SymbolTable scope(&t);
+    for (size_t k = 0; k != n; ++k) {
+      scope.defineConstant(x, xs[k]);
+      ys[k] = e->calculate(scope);
+    }
+  };
+  return integrate(f, a, b, options, stats);
+}
+
+Result<Number> Integrator::integrate(const Expr* e,
+                                     Number a,
+                                     Number b,
+                                     const SymbolTable& t,
+                                     Stats* stats) {
+  const std::vector<Symbol> symbols = freeSymbols(e, t);
+
+  if (symbols.size() > 1)
+    return TooManyVariables;
+
+  if (symbols.empty()) {
+    if (stats)
+      *stats = Stats();
+    return e->calculate(t) * (b - a);
+  }
+
+  return integrate(e, symbols[0], a, b, t, Options(), stats);
+}
+// }}}
+// {{{ Integrator::ErrorCategory
+const Integrator::ErrorCategory& Integrator::ErrorCategory::get() {
+  static ErrorCategory c;
+  return c;
+}
+
+const char* Integrator::ErrorCategory::name() const noexcept {
+  return "IntegratorError";
+}
+
+std::string Integrator::ErrorCategory::message(int ec) const {
+  switch (static_cast<ErrorCode>(ec)) {
+    case TooManyVariables:
+      return "Expression has more than one variable to integrate over";
+    case NonFiniteBounds:
+      return "Bounds of integration must be finite";
+    case NoConvergence:
+      return "Integral did not converge to the requested tolerance";
+    case InteriorSingularity:
+      return "Integrand is not finite inside the interval of integration";
+  }
+  return "Unknown error";
+}
+// }}}
+
+}  // namespace cmath
@@ -0,0 +1,113 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <cmath/result.h>
+#include <functional>
+#include <string>
+#include <system_error>
+
+namespace cmath {
+
+/**
+ * Integrates along the straight line from a to b by adaptive quadrature.
+ *
+ * Panels are integrated with the 15 point Gauss–Kronrod rule, whose
+ * embedded 7 point Gauss rule yields the error estimate. Each round
+ * bisects every panel whose error exceeds its share of the tolerance, and
+ * evaluates the integrand at the nodes of all new panels in one batch,
+ * spread over several threads once a round is expensive enough.
+ *
+ * If the integrand is not finite at an endpoint, or Gauss–Kronrod does not
+ * converge, the tanh-sinh rule takes over, whose nodes cluster doubly
+ * exponentially at the endpoints and so integrate endpoint singularities
+ * such as 1/sqrt(x) or log(x). It refines by halving its step, again one
+ * batch per level, and fails on a node inside the interval where the
+ * integrand is not finite. Its error estimate includes the share of the
+ * nodes nearer the endpoints than doubles resolve, which no level sees,
+ * so that integrands such as 1/sqrt(1 - x^2), whose values there cancel,
+ * fail to converge rather than come out short.
+ */
+class Integrator {
+ public:
+  enum ErrorCode {
+    TooManyVariables = 1,
+    NonFiniteBounds,
+    NoConvergence,
+    InteriorSingularity,
+  };
+  class ErrorCategory;
+
+  enum class Method {
+    GaussKronrod,
+    TanhSinh,
+  };
+
+  struct Options {
+    double tolerance = 1e-10;  // relative to the integral
+    size_t maxPanels = 4096;
+    unsigned threads = 0;      // 0 for one per hardware thread
+    bool batched = true;       // compile expressions to a BatchProgram
+  };
+
+  struct Stats {
+    Method method = Method::GaussKronrod;
+    size_t evaluations = 0;
+    unsigned rounds = 0;       // batches the integrand was evaluated in
+    unsigned threads = 1;      // most threads used by a round
+    double error = 0;          // estimated absolute error
+  };
+
+  /// Evaluates the integrand at @p count points; called from several
+  /// threads at once.
+  using Integrand = std::function<void(const Number* x, size_t count, Number* y)>;
+
+  static Result<Number> integrate(const Integrand& f,
+                                  Number a,
+                                  Number b,
+                                  const Options& options,
+                                  Stats* stats = nullptr);
+
+  /**
+   * Integrates @p e over @p x. Other symbols are constants, with their
+   * values in @p t.
+   */
+  static Result<Number> integrate(const Expr* e,
+                                  const Symbol& x,
+                                  Number a,
+                                  Number b,
+                                  const SymbolTable& t,
+                                  const Options& options,
+                                  Stats* stats = nullptr);
+
+  /// Integrates @p e over the one symbol of it that @p t does not define.
+  static Result<Number> integrate(const Expr* e,
+                                  Number a,
+                                  Number b,
+                                  const SymbolTable& t,
+                                  Stats* stats = nullptr);
+};
+
+class Integrator::ErrorCategory : public std::error_category {
+ public:
+  static const ErrorCategory& get();
+
+  const char* name() const noexcept override;
+  std::string message(int ec) const override;
+};
+
+inline std::error_code make_error_code(Integrator::ErrorCode ec) {
+  return std::error_code(static_cast<int>(ec), Integrator::ErrorCategory::get());
+}
+
+}  // namespace cmath
+
+namespace std {
+template <>
+struct is_error_code_enum<cmath::Integrator::ErrorCode> : public true_type {};
+}  // namespace std
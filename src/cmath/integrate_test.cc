@@ -0,0 +1,66 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/expr_parser.h>
+#include <cmath/integrate.h>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace cmath;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool ok, const std::string& what) {
+  if (!ok) {
+    std::cerr << "FAILED: " << what << '\n';
+    failures++;
+  }
+}
+
+Result<Number> integrate(const std::string& s, double a, double b) {
+  SymbolTable st;
+  Result<std::unique_ptr<Expr>> e = parseExpression(st, s);
+  if (!e) {
+    std::cerr << "Cannot parse " << s << ": " << e.failureMessage() << '\n';
+    std::exit(EXIT_FAILURE);
+  }
+  return Integrator::integrate(e->get(), a, b, st);
+}
+
+// Within the default tolerance, or reported as not converging.
+bool honest(const Result<Number>& y, double expected) {
+  return !y ? y.error() == Integrator::NoConvergence
+            : std::abs(y->real() - expected) <= 1e-10 * std::abs(expected);
+}
+
+void testEndpointSingularities() {
+  Result<Number> y = integrate("log(x)", 0, 1);
+  expect(y && std::abs(y->real() + 1) <= 1e-10, "integrate(log(x), 0, 1)");
+
+  // its values near either endpoint cancel in 1 - x^2
+  expect(honest(integrate("1 / sqrt(1 - x^2)", -1, 1), M_PI),
+         "integrate(1 / sqrt(1 - x^2), -1, 1)");
+  expect(honest(integrate("1 / sqrt(1 - x)", 0, 1), 2),
+         "integrate(1 / sqrt(1 - x), 0, 1)");
+}
+
+void testInteriorSingularity() {
+  Result<Number> y = integrate("1 / x", -1, 1);
+  expect(!y && y.error() == Integrator::InteriorSingularity, "integrate(1 / x, -1, 1)");
+}
+
+}  // namespace
+
+int main() {
+  testEndpointSingularities();
+  testInteriorSingularity();
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
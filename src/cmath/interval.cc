@@ -0,0 +1,469 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/interval.h>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <ostream>
+
+namespace cmath {
+
+namespace {
+
+constexpr double Inf = std::numeric_limits<double>::infinity();
+constexpr double Max = std::numeric_limits<double>::max();
+
+// below this magnitude the error terms computed by fma() may underflow
+constexpr double Tiny = 0x1p-960;
+
+constexpr double Pi = 3.141592653589793;  // below pi
+constexpr double HalfPi = Pi / 2;
+constexpr double TwoPi = 2 * Pi;
+
+// std::nextafter(x, +-Inf), without the libm call
+double up(double x) {
+  if (std::isnan(x) || x == Inf)
+    return x;
+  if (x == 0)
+    return std::numeric_limits<double>::denorm_min();
+
+  uint64_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  bits = x > 0 ? bits + 1 : bits - 1;
+  std::memcpy(&x, &bits, sizeof(bits));
+  return x;
+}
+
+double down(double x) {
+  return -up(-x);
+}
+
+// {{{ directed rounding
+// Lower and upper bound of an exact result.
+struct Bounds {
+  double lo;
+  double hi;
+};
+
+// the exact value is s + err, where s is rounded to nearest
+Bounds enclose(double s, double err) {
+  if (err < 0)
+    return Bounds{down(s), s};
+  if (err > 0)
+    return Bounds{s, up(s)};
+  return Bounds{s, s};
+}
+
+// s is off by at most one unit in the last place, or overflowed
+Bounds widen(double s) {
+  return Bounds{down(s), up(s)};
+}
+
+Bounds add(double a, double b) {
+  const double s = a + b;
+  if (std::isnan(s))
+    return Bounds{-Inf, Inf};  // inf - inf
+  if (std::isinf(s))
+    return std::isinf(a) || std::isinf(b) ? Bounds{s, s} : widen(s);
+
+  // Knuth's TwoSum
+  const double bb = s - a;
+  return enclose(s, (a - (s - bb)) + (b - bb));
+}
+
+Bounds mul(double a, double b) {
+  if (a == 0 || b == 0)
+    return Bounds{0, 0};  // also for infinite factors
+
+  const double p = a * b;
+  if (std::isinf(p))
+    return std::isinf(a) || std::isinf(b) ? Bounds{p, p} : widen(p);
+  if (std::abs(p) < Tiny)
+    return widen(p);
+
+  return enclose(p, std::fma(a, b, -p));
+}
+
+Bounds div(double a, double b) {
+  if (a == 0)
+    return Bounds{0, 0};
+
+  const double q = a / b;
+  if (std::isinf(a) || std::isinf(b))
+    return std::isnan(q) ? Bounds{-Inf, Inf} : Bounds{q, q};
+  if (std::isinf(q) || std::abs(q) < Tiny || std::abs(a) < Tiny)
+    return widen(q);
+
+  // a - q b is exact, and has the sign of the error times b's
+  const double r = std::fma(-q, b, a);
+  return enclose(q, b > 0 ? r : -r);
+}
+
+Bounds root(double x) {
+  const double s = std::sqrt(x);
+  if (x == 0 || std::isinf(x))
+    return Bounds{s, s};
+  if (x < Tiny)
+    return Bounds{std::max(0.0, down(s)), up(s)};
+
+  return enclose(s, std::fma(-s, s, x));
+}
+
+// x^n for x >= 0, by binary powering of the rounded-down or rounded-up
+// bound, which keeps being one as all factors are nonnegative
+double power(double x, uint64_t n, bool upward) {
+  double r = 1;
+  for (; n; n >>= 1) {
+    if (n & 1)
+      r = upward ? mul(r, x).hi : mul(r, x).lo;
+    if (n > 1)
+      x = upward ? mul(x, x).hi : mul(x, x).lo;
+  }
+  return r;
+}
+// }}}
+
+// {{{ elementary functions
+double expDown(double x) {
+  if (x == 0 || std::isinf(x))
+    return std::exp(x);
+  return std::max(0.0, down(std::exp(x)));
+}
+
+double expUp(double x) {
+  if (x == 0 || std::isinf(x))
+    return std::exp(x);
+  return up(std::exp(x));
+}
+
+double logDown(double x) {
+  if (x == 1 || x == 0 || std::isinf(x))
+    return std::log(x);
+  return down(std::log(x));
+}
+
+double logUp(double x) {
+  if (x == 1 || x == 0 || std::isinf(x))
+    return std::log(x);
+  return up(std::log(x));
+}
+
+/**
+ * Whether [lo, hi] contains phase + k period for some integer k.
+ *
+ * Decided with a slack well above the rounding errors involved, so it errs
+ * towards yes.
+ */
+bool hitsPhase(double lo, double hi, double phase, double period) {
+  const double slack = 0x1p-40 * (1 + std::max(std::abs(lo), std::abs(hi)));
+  const double k = std::ceil((lo - phase) / period - slack);
+  return k <= (hi - phase) / period + slack;
+}
+
+/**
+ * Bounds of sin() or cos() over @p x, whose maxima are at maxAt + 2k pi,
+ * and minima half a period later.
+ */
+Interval periodic(Interval x, double (*f)(double), double maxAt) {
+  if (x.isEmpty())
+    return x;
+
+  const double lo = x.lower();
+  const double hi = x.upper();
+  if (!(hi - lo < TwoPi) || std::max(std::abs(lo), std::abs(hi)) > 0x1p40)
+    return Interval(-1, 1);
+
+  const double a = f(lo);
+  const double b = f(hi);
+  const double l = hitsPhase(lo, hi, maxAt + Pi, TwoPi) ? -1 : down(std::min(a, b));
+  const double u = hitsPhase(lo, hi, maxAt, TwoPi) ? 1 : up(std::max(a, b));
+  return Interval(std::max(-1.0, l), std::min(1.0, u));
+}
+
+Interval nonnegative(Interval a) {
+  return intersect(a, Interval(0, Inf));
+}
+
+std::string str(double v) {
+  char buf[32];
+  std::to_chars_result r = std::to_chars(buf, buf + sizeof(buf), v);
+  return std::string(buf, r.ptr);
+}
+// }}}
+
+}  // namespace
+
+// {{{ Interval
+Interval Interval::pi() noexcept {
+  return Interval(Pi, up(Pi));
+}
+
+Interval Interval::e() noexcept {
+  constexpr double E = 2.718281828459045;  // below e
+  return Interval(E, up(E));
+}
+
+double Interval::width() const noexcept {
+  if (isEmpty())
+    return std::numeric_limits<double>::quiet_NaN();
+
+  return add(hi_, -lo_).hi;
+}
+
+double Interval::mid() const noexcept {
+  if (isEmpty())
+    return std::numeric_limits<double>::quiet_NaN();
+  if (lo_ == hi_)
+    return lo_;
+  if (std::isinf(lo_) && std::isinf(hi_))
+    return 0;
+  if (std::isinf(lo_))
+    return -Max;
+  if (std::isinf(hi_))
+    return Max;
+
+  return std::clamp(lo_ / 2 + hi_ / 2, lo_, hi_);
+}
+
+std::string Interval::str() const {
+  if (isEmpty())
+    return "[]";
+
+  return "[" + cmath::str(lo_) + ", " + cmath::str(hi_) + "]";
+}
+
+Interval operator+(Interval a, Interval b) noexcept {
+  if (a.isEmpty() || b.isEmpty())
+    return Interval::empty();
+
+  return Interval(add(a.lo_, b.lo_).lo, add(a.hi_, b.hi_).hi);
+}
+
+Interval operator-(Interval a, Interval b) noexcept {
+  return a + -b;
+}
+
+Interval operator*(Interval a, Interval b) noexcept {
+  if (a.isEmpty() || b.isEmpty())
+    return Interval::empty();
+
+  const Bounds p[] = {mul(a.lo_, b.lo_), mul(a.lo_, b.hi_), mul(a.hi_, b.lo_),
+                      mul(a.hi_, b.hi_)};
+
+  double lo = p[0].lo;
+  double hi = p[0].hi;
+  for (const Bounds& q : p) {
+    lo = std::min(lo, q.lo);
+    hi = std::max(hi, q.hi);
+  }
+  return Interval(lo, hi);
+}
+
+Interval operator/(Interval a, Interval b) noexcept {
+  if (a.isEmpty() || b.isEmpty() || (b.lo_ == 0 && b.hi_ == 0))
+    return Interval::empty();
+
+  if (a.lo_ == 0 && a.hi_ == 0)
+    return a;
+
+  if (b.lo_ > 0 || b.hi_ < 0) {
+    const Bounds q[] = {div(a.lo_, b.lo_), div(a.lo_, b.hi_), div(a.hi_, b.lo_),
+                        div(a.hi_, b.hi_)};
+    double lo = q[0].lo;
+    double hi = q[0].hi;
+    for (const Bounds& r : q) {
+      lo = std::min(lo, r.lo);
+      hi = std::max(hi, r.hi);
+    }
+    return Interval(lo, hi);
+  }
+
+  // b touches zero at one end: a's sign decides which half line is hit
+  if (b.lo_ == 0) {
+    if (a.lo_ >= 0)
+      return Interval(div(a.lo_, b.hi_).lo, Inf);
+    if (a.hi_ <= 0)
+      return Interval(-Inf, div(a.hi_, b.hi_).hi);
+  } else if (b.hi_ == 0) {
+    if (a.lo_ >= 0)
+      return Interval(-Inf, div(a.lo_, b.lo_).hi);
+    if (a.hi_ <= 0)
+      return Interval(div(a.hi_, b.lo_).lo, Inf);
+  }
+
+  // b contains zero inside: two half lines, whose hull is everything
+  return Interval::entire();
+}
+
+Interval hull(Interval a, Interval b) noexcept {
+  if (a.isEmpty())
+    return b;
+  if (b.isEmpty())
+    return a;
+
+  return Interval(std::min(a.lower(), b.lower()), std::max(a.upper(), b.upper()));
+}
+
+Interval intersect(Interval a, Interval b) noexcept {
+  const Interval r(std::max(a.lower(), b.lower()), std::min(a.upper(), b.upper()));
+  return a.isEmpty() || b.isEmpty() || r.isEmpty() ? Interval::empty() : r;
+}
+
+Interval abs(Interval a) noexcept {
+  if (a.lower() >= 0 || a.isEmpty())
+    return a;
+  if (a.upper() <= 0)
+    return -a;
+
+  return Interval(0, std::max(-a.lower(), a.upper()));
+}
+
+Interval sqrt(Interval a) noexcept {
+  a = nonnegative(a);
+  if (a.isEmpty())
+    return a;
+
+  return Interval(root(a.lower()).lo, root(a.upper()).hi);
+}
+
+Interval exp(Interval a) noexcept {
+  if (a.isEmpty())
+    return a;
+
+  return Interval(expDown(a.lower()), expUp(a.upper()));
+}
+
+Interval log(Interval a) noexcept {
+  a = nonnegative(a);
+  if (a.isEmpty())
+    return a;
+
+  return Interval(logDown(a.lower()), logUp(a.upper()));
+}
+
+Interval sin(Interval a) noexcept {
+  return periodic(a, [](double x) { return std::sin(x); }, HalfPi);
+}
+
+Interval cos(Interval a) noexcept {
+  return periodic(a, [](double x) { return std::cos(x); }, 0);
+}
+
+Interval tan(Interval a) noexcept {
+  if (a.isEmpty())
+    return a;
+
+  const double lo = a.lower();
+  const double hi = a.upper();
+  if (!(hi - lo < Pi) || std::max(std::abs(lo), std::abs(hi)) > 0x1p40 ||
+      hitsPhase(lo, hi, HalfPi, Pi))
+    return Interval::entire();
+
+  return Interval(down(std::tan(lo)), up(std::tan(hi)));
+}
+
+Interval pow(Interval a, int64_t n) noexcept {
+  if (a.isEmpty())
+    return a;
+  if (n == 0)
+    return Interval(1);
+
+  // magnitude of n, also for INT64_MIN
+  const uint64_t m = n < 0 ? 0 - static_cast<uint64_t>(n) : static_cast<uint64_t>(n);
+  const double lo = a.lower();
+  const double hi = a.upper();
+
+  Interval r;
+  if (lo >= 0)
+    r = Interval(power(lo, m, false), power(hi, m, true));
+  else if (hi <= 0 && (m & 1))
+    r = Interval(-power(-lo, m, true), -power(-hi, m, false));
+  else if (hi <= 0)
+    r = Interval(power(-hi, m, false), power(-lo, m, true));
+  else if (m & 1)
+    r = Interval(-power(-lo, m, true), power(hi, m, true));
+  else
+    r = Interval(0, power(std::max(-lo, hi), m, true));
+
+  return n < 0 ? Interval(1) / r : r;
+}
+
+Interval pow(Interval a, Interval b) noexcept {
+  if (a.isEmpty() || b.isEmpty())
+    return Interval::empty();
+
+  const double n = b.lower();
+  if (b.isPoint() && n == std::trunc(n) && std::abs(n) < 0x1p63)
+    return pow(a, static_cast<int64_t>(n));
+
+  return exp(b * log(a));
+}
+
+Interval factorial(Interval a) noexcept {
+  if (a.isEmpty())
+    return a;
+
+  // the poles at the negative integers
+  if (a.lower() <= -1)
+    return Interval::entire();
+
+  // gamma(x + 1): exact products at the integers, else libm's tgamma(),
+  // widened for its error and the rounding of x + 1
+  auto bound = [](double x, bool upward) {
+    if (x == std::floor(x)) {
+      const double n = std::min(x, 171.0);
+      double y = 1;
+      for (double i = 2; i <= n; ++i)
+        y = upward ? mul(y, i).hi : mul(y, i).lo;
+      return y;
+    }
+    const double y = std::tgamma(x + 1);
+    return upward ? up(y * (1 + 0x1p-40)) : down(y * (1 - 0x1p-40));
+  };
+
+  // gamma(x + 1) decreases up to its minimum, and increases beyond
+  constexpr double MinimumPoint = 0.46163214496836234126;
+  constexpr double Minimum = 0.88560319441088870028;
+
+  if (a.upper() <= MinimumPoint)
+    return Interval(bound(a.upper(), false), bound(a.lower(), true));
+  if (a.lower() >= MinimumPoint)
+    return Interval(bound(a.lower(), false), bound(a.upper(), true));
+
+  return Interval(down(Minimum * (1 - 0x1p-40)),
+                  std::max(bound(a.lower(), true), bound(a.upper(), true)));
+}
+
+std::ostream& operator<<(std::ostream& os, Interval a) {
+  return os << a.str();
+}
+// }}}
+
+// {{{ Interval::ErrorCategory
+const Interval::ErrorCategory& Interval::ErrorCategory::get() {
+  static ErrorCategory c;
+  return c;
+}
+
+const char* Interval::ErrorCategory::name() const noexcept {
+  return "IntervalError";
+}
+
+std::string Interval::ErrorCategory::message(int ec) const {
+  switch (static_cast<ErrorCode>(ec)) {
+    case NotReal:
+      return "Result is not a real number";
+    case UnsupportedExpr:
+      return "Expression cannot be calculated with intervals";
+  }
+  return "Unknown error";
+}
+// }}}
+
+}  // namespace cmath
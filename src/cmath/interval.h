@@ -0,0 +1,132 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/result.h>
+#include <cstdint>
+#include <iosfwd>
+#include <limits>
+#include <string>
+#include <system_error>
+
+namespace cmath {
+
+/**
+ * Closed interval [lower, upper] of real numbers, with possibly infinite
+ * bounds, or the empty set.
+ *
+ * Every operation returns an enclosure of all results for all points of
+ * its operands. Arithmetic and sqrt() round their bounds outwards exactly
+ * (by error-free transformations, without switching the FPU rounding
+ * mode); the transcendental functions widen libm's result by one unit in
+ * the last place, assuming libm is faithful.
+ *
+ * Functions are restricted to their real domain, e.g. sqrt([-1, 4]) is
+ * [0, 2] and log of a negative interval is empty.
+ */
+class Interval {
+ public:
+  enum ErrorCode {
+    NotReal = 1,
+    UnsupportedExpr,
+  };
+  class ErrorCategory;
+
+  constexpr Interval() noexcept : lo_(0), hi_(0) {}
+  constexpr Interval(double v) noexcept : lo_(v), hi_(v) {}
+  constexpr Interval(double lo, double hi) noexcept : lo_(lo), hi_(hi) {}
+
+  static constexpr Interval empty() noexcept {
+    return Interval(std::numeric_limits<double>::quiet_NaN(),
+                    std::numeric_limits<double>::quiet_NaN());
+  }
+
+  static constexpr Interval entire() noexcept {
+    return Interval(-std::numeric_limits<double>::infinity(),
+                    std::numeric_limits<double>::infinity());
+  }
+
+  static Interval pi() noexcept;
+  static Interval e() noexcept;
+
+  double lower() const noexcept { return lo_; }
+  double upper() const noexcept { return hi_; }
+
+  bool isEmpty() const noexcept { return !(lo_ <= hi_); }
+  bool isPoint() const noexcept { return lo_ == hi_; }
+  bool contains(double x) const noexcept { return lo_ <= x && x <= hi_; }
+
+  /// Upper bound of the width, or NaN if empty.
+  double width() const noexcept;
+
+  /// A point inside, NaN if empty.
+  double mid() const noexcept;
+
+  /// Renders as "[lower, upper]" or "[]".
+  std::string str() const;
+
+  Interval operator-() const noexcept { return Interval(-hi_, -lo_); }
+
+  friend Interval operator+(Interval a, Interval b) noexcept;
+  friend Interval operator-(Interval a, Interval b) noexcept;
+  friend Interval operator*(Interval a, Interval b) noexcept;
+
+  /// Division by intervals containing zero yields the hull of the result.
+  friend Interval operator/(Interval a, Interval b) noexcept;
+
+ private:
+  double lo_;
+  double hi_;
+};
+
+inline bool operator==(Interval a, Interval b) noexcept {
+  return (a.isEmpty() && b.isEmpty()) || (a.lower() == b.lower() && a.upper() == b.upper());
+}
+
+inline bool operator!=(Interval a, Interval b) noexcept { return !(a == b); }
+
+Interval hull(Interval a, Interval b) noexcept;
+Interval intersect(Interval a, Interval b) noexcept;
+
+Interval abs(Interval a) noexcept;
+Interval sqrt(Interval a) noexcept;
+Interval exp(Interval a) noexcept;
+Interval log(Interval a) noexcept;
+Interval sin(Interval a) noexcept;
+Interval cos(Interval a) noexcept;
+Interval tan(Interval a) noexcept;
+
+/// @p a to the power of @p n, tight also for even @p n across zero.
+Interval pow(Interval a, int64_t n) noexcept;
+
+/// exp(b log(a)), or pow(a, n) if @p b is the integer point n.
+Interval pow(Interval a, Interval b) noexcept;
+
+/// gamma(x + 1), as FacExpr does; the entire line from -1 on downwards,
+/// where the poles are.
+Interval factorial(Interval a) noexcept;
+
+std::ostream& operator<<(std::ostream& os, Interval a);
+
+class Interval::ErrorCategory : public std::error_category {
+ public:
+  static const ErrorCategory& get();
+
+  const char* name() const noexcept override;
+  std::string message(int ec) const override;
+};
+
+inline std::error_code make_error_code(Interval::ErrorCode ec) {
+  return std::error_code(static_cast<int>(ec), Interval::ErrorCategory::get());
+}
+
+}  // namespace cmath
+
+namespace std {
+template <>
+struct is_error_code_enum<cmath::Interval::ErrorCode> : public true_type {};
+}  // namespace std
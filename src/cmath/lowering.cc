@@ -0,0 +1,105 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/builtins.h>
+#include <cmath/lowering.h>
+#include <cmath/polynomial.h>
+#include <cmath>
+
+namespace cmath {
+
+Lowering::Lowering(const SymbolTable& t, std::error_code unsupported)
+    : symbols_(t), frame_(), depth_(0), unsupported_(unsupported) {}
+
+Lowering::~Lowering() = default;
+
+void Lowering::bind(const Symbol& name, uint32_t reg) {
+  frame_.emplace_back(name, reg);
+}
+
+void Lowering::unsupported() const {
+  throw unsupported_;
+}
+
+const uint32_t* Lowering::argument(const Symbol& name) const {
+  for (size_t i = frame_.size(); i-- > 0;)
+    if (frame_[i].first == name)
+      return &frame_[i].second;
+
+  return nullptr;
+}
+
+bool Lowering::isBuiltin(const Symbol& name, const Def* def) const {
+  return def && def == lookupBuiltin(name);
+}
+
+uint32_t Lowering::symbol(const Symbol& name) {
+  if (const uint32_t* reg = argument(name))
+    return *reg;
+
+  if (auto c = dynamic_cast<const ConstantDef*>(symbols_.lookup(name)))
+    return constant(c->getNumber());
+
+  return constant(std::nan(""));
+}
+
+uint32_t Lowering::call(const CallExpr* e) {
+  const Def* def = e->mapping();
+  if (!def)
+    def = symbols_.lookup(e->symbolName());
+
+  if (!def)
+    return constant(std::nan(""));
+
+  // forms, such as root(), need their argument expressions
+  if (dynamic_cast<const FormDef*>(def))
+    unsupported();
+
+  std::vector<uint32_t> args;
+  args.reserve(e->inputs().size());
+  for (const std::unique_ptr<Expr>& input : e->inputs())
+    args.push_back(compile(input.get()));
+
+  if (isBuiltin(e->symbolName(), def))
+    return builtin(e->symbolName(), args);
+
+  if (auto m = dynamic_cast<const CustomMappingDef*>(def)) {
+    if (depth_ == MaxInlineDepth)
+      unsupported();
+
+    const size_t base = frame_.size();
+    for (size_t i = 0; i < m->inputs().size(); ++i)
+      bind(m->inputs()[i], i < args.size() ? args[i] : constant(std::nan("")));
+
+    depth_++;
+    const uint32_t y = compile(m->expr());
+    depth_--;
+    frame_.resize(base);
+    return y;
+  }
+
+  unsupported();
+}
+
+uint32_t Lowering::compile(const Expr* e) {
+  if (auto p = dynamic_cast<const PolynomialExpr*>(e))
+    return compile(p->source());
+
+  if (auto s = dynamic_cast<const SymbolExpr*>(e))
+    return symbol(s->symbolName());
+
+  if (auto c = dynamic_cast<const CallExpr*>(e))
+    return call(c);
+
+  // a definition has no value
+  if (dynamic_cast<const DefineMappingExpr*>(e))
+    return constant(Number(std::nan(""), std::nan("")));
+
+  return operation(e);
+}
+
+}  // namespace cmath
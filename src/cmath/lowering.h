@@ -0,0 +1,73 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace cmath {
+
+/**
+ * Lowering of expression trees into flat lists of operations in numbered
+ * registers, as shared by IntervalProgram, BatchProgram and the solver.
+ *
+ * This resolves symbols to bound variables and constants, and inlines
+ * custom mappings, binding their parameters to the registers of the
+ * arguments, so that each argument is computed once. Inlining stops at
+ * MaxInlineDepth, which rules out recursion.
+ *
+ * Backends derive from it, emit constants and builtin calls, and compile
+ * all other node kinds in operation().
+ */
+class Lowering {
+ public:
+  static constexpr size_t MaxInlineDepth = 32;
+
+  /// Fails with @p unsupported where an expression cannot be lowered.
+  Lowering(const SymbolTable& t, std::error_code unsupported);
+  virtual ~Lowering();
+
+  /// Compiles @p e, returning the register of its result.
+  uint32_t compile(const Expr* e);
+
+  /// Binds @p name to @p reg, shadowing earlier bindings of it.
+  void bind(const Symbol& name, uint32_t reg);
+
+ protected:
+  virtual uint32_t constant(Number value) = 0;
+  virtual uint32_t builtin(const Symbol& name, const std::vector<uint32_t>& args) = 0;
+
+  /// Compiles the node kinds that are not resolved by the lowering itself.
+  virtual uint32_t operation(const Expr* e) = 0;
+
+  /// A bound variable or argument, else a constant, NaN if undefined.
+  virtual uint32_t symbol(const Symbol& name);
+
+  /// The register bound to @p name, or null.
+  const uint32_t* argument(const Symbol& name) const;
+
+  bool isBuiltin(const Symbol& name, const Def* def) const;
+
+  [[noreturn]] void unsupported() const;
+
+ private:
+  uint32_t call(const CallExpr* e);
+
+ protected:
+  const SymbolTable& symbols_;
+  std::vector<std::pair<Symbol, uint32_t>> frame_;  // variables and arguments, innermost last
+  size_t depth_;
+
+ private:
+  std::error_code unsupported_;
+};
+
+}  // namespace cmath
@@ -0,0 +1,452 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/matrix.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+// the micro-kernel once more for AVX2 and FMA, dispatched to at load time
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define CMATH_KERNEL_CLONES __attribute__((target_clones("arch=x86-64-v3", "default")))
+#else
+#define CMATH_KERNEL_CLONES
+#endif
+
+namespace cmath {
+
+namespace {
+
+// {{{ blocking
+// An MR x NR block of the product is kept in registers, 2 * MR * NR / 4 = 12
+// of the 16 AVX2 registers, accumulated from KC x NR panels of the right
+// operand, which stay in L1, and an MC x KC block of the left one, which
+// stays in L2, while a KC x NC block of the right one stays in L3.
+constexpr size_t MR = 6;
+constexpr size_t NR = 4;
+constexpr size_t KC = 256;
+constexpr size_t MC = 96;
+constexpr size_t NC = 2048;
+
+// LU decomposition and substitution work on blocks of this many rows
+// (columns), the rest goes to multiply
+constexpr size_t NB = 64;
+
+// a product is spread over another thread for every this many floating
+// point operations
+constexpr double ThreadFlops = 2e7;
+
+// Submatrix, starting at re[0] and im[0], with rows stride apart.
+template <typename T>
+struct View {
+  T* re;
+  T* im;
+  size_t stride;
+
+  View<T> at(size_t i, size_t j) const {
+    return View<T>{re + i * stride + j, im + i * stride + j, stride};
+  }
+};
+
+using MutableView = View<double>;
+using ConstView = View<const double>;
+
+MutableView view(Matrix& a) {
+  return MutableView{a.real(), a.imag(), a.columns()};
+}
+
+ConstView view(const Matrix& a) {
+  return ConstView{a.real(), a.imag(), a.columns()};
+}
+
+ConstView constant(const MutableView& a) {
+  return ConstView{a.re, a.im, a.stride};
+}
+// }}}
+// {{{ packing
+// Packs rows [0, mc) and columns [0, kc) of @p a into panels of MR rows,
+// each column of a panel as MR real parts followed by MR imaginary parts,
+// with rows beyond mc as zeros.
+void packLeft(size_t mc, size_t kc, ConstView a, double* out) {
+  for (size_t i0 = 0; i0 < mc; i0 += MR) {
+    const size_t mr = std::min(MR, mc - i0);
+    for (size_t p = 0; p < kc; ++p) {
+      for (size_t i = 0; i < MR; ++i) {
+        out[i] = i < mr ? a.re[(i0 + i) * a.stride + p] : 0;
+        out[MR + i] = i < mr ? a.im[(i0 + i) * a.stride + p] : 0;
+      }
+      out += 2 * MR;
+    }
+  }
+}
+
+// Packs rows [0, kc) and columns [0, nc) of @p b into panels of NR
+// columns, each row of a panel as NR real parts followed by NR imaginary
+// parts, with columns beyond nc as zeros.
+void packRight(size_t kc, size_t nc, ConstView b, double* out) {
+  for (size_t j0 = 0; j0 < nc; j0 += NR) {
+    const size_t nr = std::min(NR, nc - j0);
+    for (size_t p = 0; p < kc; ++p) {
+      const double* re = b.re + p * b.stride + j0;
+      const double* im = b.im + p * b.stride + j0;
+      for (size_t j = 0; j < NR; ++j) {
+        out[j] = j < nr ? re[j] : 0;
+        out[NR + j] = j < nr ? im[j] : 0;
+      }
+      out += 2 * NR;
+    }
+  }
+}
+// }}}
+// {{{ kernels
+// A row of an MR x NR block of the product, in one AVX2 register, or two SSE2
+// ones.
+typedef double Row __attribute__((vector_size(NR * sizeof(double))));
+
+// c += sign * a b for packed blocks a (mc x kc) and b (kc x nc), one MR x NR
+// block of c at a time, kept in registers as the real and imaginary parts of
+// its rows.
+CMATH_KERNEL_CLONES
+void multiplyPacked(size_t mc,
+                    size_t nc,
+                    size_t kc,
+                    const double* a,
+                    const double* b,
+                    double sign,
+                    MutableView c) {
+  for (size_t j0 = 0; j0 < nc; j0 += NR) {
+    const double* bp = b + j0 * kc * 2;
+    const size_t nr = std::min(NR, nc - j0);
+    for (size_t i0 = 0; i0 < mc; i0 += MR) {
+      const double* ap = a + i0 * kc * 2;
+      const size_t mr = std::min(MR, mc - i0);
+
+      Row zr[MR] = {};
+      Row zi[MR] = {};
+      for (size_t p = 0; p < kc; ++p) {
+        const double* ar = ap + p * 2 * MR;
+        const double* ai = ar + MR;
+        Row br;
+        Row bi;
+        std::memcpy(&br, bp + p * 2 * NR, sizeof(Row));
+        std::memcpy(&bi, bp + p * 2 * NR + NR, sizeof(Row));
+        for (size_t i = 0; i < MR; ++i) {
+          zr[i] += ar[i] * br;
+          zr[i] -= ai[i] * bi;
+          zi[i] += ar[i] * bi;
+          zi[i] += ai[i] * br;
+        }
+      }
+
+      for (size_t i = 0; i < mr; ++i) {
+        double* cr = c.re + (i0 + i) * c.stride + j0;
+        double* ci = c.im + (i0 + i) * c.stride + j0;
+        for (size_t j = 0; j < nr; ++j) {
+          cr[j] += sign * zr[i][j];
+          ci[j] += sign * zi[i][j];
+        }
+      }
+    }
+  }
+}
+
+// c += sign * a b for a (m x k) and b (k x n), on this thread.
+void multiplyBlocked(size_t m,
+                     size_t n,
+                     size_t k,
+                     ConstView a,
+                     ConstView b,
+                     double sign,
+                     MutableView c) {
+  if (!m || !n || !k)
+    return;
+
+  const size_t ncMax = std::min(NC, (n + NR - 1) / NR * NR);
+  const size_t mcMax = std::min(MC, (m + MR - 1) / MR * MR);
+  std::vector<double> packedB(2 * std::min(KC, k) * ncMax);
+  std::vector<double> packedA(2 * std::min(KC, k) * mcMax);
+
+  for (size_t jc = 0; jc < n; jc += NC) {
+    const size_t nc = std::min(NC, n - jc);
+    for (size_t pc = 0; pc < k; pc += KC) {
+      const size_t kc = std::min(KC, k - pc);
+      packRight(kc, nc, b.at(pc, jc), packedB.data());
+      for (size_t ic = 0; ic < m; ic += MC) {
+        const size_t mc = std::min(MC, m - ic);
+        packLeft(mc, kc, a.at(ic, pc), packedA.data());
+        multiplyPacked(mc, nc, kc, packedA.data(), packedB.data(), sign, c.at(ic, jc));
+      }
+    }
+  }
+}
+
+// c += sign * a b, with the columns of b and c split over up to @p threads
+// threads, as many as pay off.
+void multiply(size_t m,
+              size_t n,
+              size_t k,
+              ConstView a,
+              ConstView b,
+              double sign,
+              MutableView c,
+              unsigned threads) {
+  const double flops = 8.0 * m * n * k;
+  const size_t panels = (n + NR - 1) / NR;
+  const size_t workers =
+      std::clamp<size_t>(std::min<double>(flops / ThreadFlops, panels), 1, threads);
+  const size_t chunk = (panels + workers - 1) / workers * NR;
+
+  std::vector<std::thread> pool;
+  for (size_t begin = chunk; begin < n; begin += chunk) {
+    const size_t count = std::min(chunk, n - begin);
+    pool.emplace_back([=]() {
+      multiplyBlocked(m, count, k, a, b.at(0, begin), sign, c.at(0, begin));
+    });
+  }
+  multiplyBlocked(m, std::min(chunk, n), k, a, b, sign, c);
+  for (std::thread& t : pool)
+    t.join();
+}
+
+unsigned hardwareThreads() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// y -= s x over n elements
+void subtractScaled(size_t n,
+                    double sr,
+                    double si,
+                    const double* xr,
+                    const double* xi,
+                    double* yr,
+                    double* yi) {
+  for (size_t j = 0; j < n; ++j) {
+    const double tr = sr * xr[j] - si * xi[j];
+    const double ti = sr * xi[j] + si * xr[j];
+    yr[j] -= tr;
+    yi[j] -= ti;
+  }
+}
+
+// x *= s over n elements
+void scale(size_t n, double sr, double si, double* xr, double* xi) {
+  for (size_t j = 0; j < n; ++j) {
+    const double tr = sr * xr[j] - si * xi[j];
+    const double ti = sr * xi[j] + si * xr[j];
+    xr[j] = tr;
+    xi[j] = ti;
+  }
+}
+
+void swapRows(Matrix* a, size_t i, size_t k) {
+  const size_t n = a->columns();
+  std::swap_ranges(a->real() + i * n, a->real() + (i + 1) * n, a->real() + k * n);
+  std::swap_ranges(a->imag() + i * n, a->imag() + (i + 1) * n, a->imag() + k * n);
+}
+// }}}
+// {{{ LU decomposition
+// Decomposes the square @p lu in place into P lu = L U, with the unit lower
+// triangle L below the diagonal and U on and above it, row k swapped with
+// row pivots[k] on the way. False if lu is singular.
+//
+// Right-looking by blocks of NB columns: the panel of a block is decomposed
+// column by column, its rows of U solved for, and the trailing submatrix
+// updated by one multiply.
+bool decompose(Matrix* lu, std::vector<size_t>* pivots) {
+  const size_t n = lu->rows();
+  const MutableView a = view(*lu);
+  pivots->resize(n);
+
+  for (size_t k0 = 0; k0 < n; k0 += NB) {
+    const size_t k1 = std::min(n, k0 + NB);
+
+    for (size_t k = k0; k < k1; ++k) {
+      size_t p = k;
+      double largest = 0;
+      for (size_t i = k; i < n; ++i) {
+        const double x = std::norm((*lu)(i, k));
+        if (x > largest) {
+          largest = x;
+          p = i;
+        }
+      }
+      if (!(largest > 0))
+        return false;
+
+      (*pivots)[k] = p;
+      if (p != k)
+        swapRows(lu, p, k);
+
+      const Number inverse = 1.0 / (*lu)(k, k);
+      for (size_t i = k + 1; i < n; ++i) {
+        const Number l = (*lu)(i, k) * inverse;
+        lu->set(i, k, l);
+        subtractScaled(k1 - k - 1, l.real(), l.imag(), a.re + k * n + k + 1,
+                       a.im + k * n + k + 1, a.re + i * n + k + 1, a.im + i * n + k + 1);
+      }
+    }
+
+    if (k1 == n)
+      break;
+
+    // U12 = L11^-1 A12
+    for (size_t k = k0; k < k1; ++k) {
+      for (size_t i = k + 1; i < k1; ++i) {
+        const Number l = (*lu)(i, k);
+        subtractScaled(n - k1, l.real(), l.imag(), a.re + k * n + k1, a.im + k * n + k1,
+                       a.re + i * n + k1, a.im + i * n + k1);
+      }
+    }
+
+    // A22 -= L21 U12
+    multiply(n - k1, n - k1, k1 - k0, constant(a.at(k1, k0)), constant(a.at(k0, k1)), -1,
+             a.at(k1, k1), hardwareThreads());
+  }
+
+  return true;
+}
+
+// Solves L U x = P b for the decomposition @p lu, with @p x holding b.
+void substitute(const Matrix& lu, const std::vector<size_t>& pivots, Matrix* x) {
+  const size_t n = lu.rows();
+  const size_t r = x->columns();
+  const ConstView a = view(lu);
+  const MutableView b = view(*x);
+
+  for (size_t k = 0; k < n; ++k)
+    if (pivots[k] != k)
+      swapRows(x, k, pivots[k]);
+
+  // L y = P b, by blocks of NB rows
+  for (size_t i0 = 0; i0 < n; i0 += NB) {
+    const size_t i1 = std::min(n, i0 + NB);
+    multiply(i1 - i0, r, i0, a.at(i0, 0), constant(b), -1, b.at(i0, 0),
+             hardwareThreads());
+    for (size_t i = i0; i < i1; ++i)
+      for (size_t k = i0; k < i; ++k)
+        subtractScaled(r, a.re[i * n + k], a.im[i * n + k], b.re + k * r, b.im + k * r,
+                       b.re + i * r, b.im + i * r);
+  }
+
+  // U x = y, by blocks of NB rows from the bottom
+  for (size_t i1 = n; i1 > 0;) {
+    const size_t i0 = i1 > NB ? i1 - NB : 0;
+    multiply(i1 - i0, r, n - i1, a.at(i0, i1), constant(b.at(i1, 0)), -1, b.at(i0, 0),
+             hardwareThreads());
+    for (size_t i = i1; i-- > i0;) {
+      for (size_t k = i + 1; k < i1; ++k)
+        subtractScaled(r, a.re[i * n + k], a.im[i * n + k], b.re + k * r, b.im + k * r,
+                       b.re + i * r, b.im + i * r);
+      const Number inverse = 1.0 / lu(i, i);
+      scale(r, inverse.real(), inverse.imag(), b.re + i * r, b.im + i * r);
+    }
+    i1 = i0;
+  }
+}
+// }}}
+
+}  // namespace
+
+// {{{ Matrix
+Matrix Matrix::identity(size_t n) {
+  Matrix m(n, n);
+  for (size_t i = 0; i < n; ++i)
+    m.set(i, i, 1);
+  return m;
+}
+
+Matrix Matrix::transpose() const {
+  Matrix t(columns_, rows_);
+  for (size_t i = 0; i < rows_; ++i) {
+    for (size_t j = 0; j < columns_; ++j) {
+      t.re_[j * rows_ + i] = re_[i * columns_ + j];
+      t.im_[j * rows_ + i] = im_[i * columns_ + j];
+    }
+  }
+  return t;
+}
+
+Matrix Matrix::adjoint() const {
+  Matrix t = transpose();
+  for (double& x : t.im_)
+    x = -x;
+  return t;
+}
+
+Result<Matrix> Matrix::multiply(const Matrix& a, const Matrix& b, unsigned threads) {
+  if (a.columns() != b.rows())
+    return ShapeMismatch;
+
+  Matrix c(a.rows(), b.columns());
+  cmath::multiply(a.rows(), b.columns(), a.columns(), view(a), view(b), 1, view(c),
+                  threads ? threads : hardwareThreads());
+  return c;
+}
+
+Result<Matrix> Matrix::solve(const Matrix& a, const Matrix& b) {
+  if (a.rows() != a.columns())
+    return NotSquare;
+  if (b.rows() != a.rows())
+    return ShapeMismatch;
+
+  Matrix lu = a;
+  std::vector<size_t> pivots;
+  if (!decompose(&lu, &pivots))
+    return Singular;
+
+  Matrix x = b;
+  substitute(lu, pivots, &x);
+  return x;
+}
+
+Result<Matrix> Matrix::inverse() const {
+  if (rows_ != columns_)
+    return NotSquare;
+
+  return solve(*this, identity(rows_));
+}
+
+Result<Number> Matrix::determinant() const {
+  if (rows_ != columns_)
+    return NotSquare;
+
+  Matrix lu = *this;
+  std::vector<size_t> pivots;
+  if (!decompose(&lu, &pivots))
+    return Number(0);
+
+  Number det = 1;
+  for (size_t k = 0; k < rows_; ++k)
+    det *= pivots[k] != k ? -lu(k, k) : lu(k, k);
+  return det;
+}
+// }}}
+// {{{ Matrix::ErrorCategory
+const Matrix::ErrorCategory& Matrix::ErrorCategory::get() {
+  static ErrorCategory c;
+  return c;
+}
+
+const char* Matrix::ErrorCategory::name() const noexcept {
+  return "MatrixError";
+}
+
+std::string Matrix::ErrorCategory::message(int ec) const {
+  switch (static_cast<ErrorCode>(ec)) {
+    case ShapeMismatch:
+      return "Matrix shapes do not match";
+    case NotSquare:
+      return "Matrix is not square";
+    case Singular:
+      return "Matrix is singular";
+  }
+  return "Unknown error";
+}
+// }}}
+
+}  // namespace cmath
@@ -0,0 +1,112 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/result.h>
+#include <complex>
+#include <cstddef>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace cmath {
+
+using Number = std::complex<double>;
+
+/**
+ * Dense complex matrix, row-major, with the real and imaginary parts in
+ * separate arrays like Tuple.
+ *
+ * multiply() is blocked for the caches the way BLIS does it: blocks of the
+ * right operand are packed into contiguous panels NR columns wide that stay
+ * in L3 and L2, blocks of the left one into panels MR rows tall that stay in
+ * L2 and L1, and a micro-kernel keeps an MR x NR block of the product in
+ * registers while it runs down a pair of panels. On x86-64 the kernel is
+ * also compiled for AVX2 and FMA, picked at load time where the processor
+ * has them. Large products split their columns over several threads.
+ *
+ * solve(), inverse() and determinant() go by LU decomposition with partial
+ * pivoting, blocked so that most of its work is a multiply() of the trailing
+ * submatrix.
+ */
+class Matrix {
+ public:
+  enum ErrorCode {
+    ShapeMismatch = 1,
+    NotSquare,
+    Singular,
+  };
+  class ErrorCategory;
+
+  Matrix() : rows_(0), columns_(0) {}
+
+  /// @p rows x @p columns zeros.
+  Matrix(size_t rows, size_t columns)
+      : rows_(rows), columns_(columns), re_(rows * columns), im_(rows * columns) {}
+
+  static Matrix identity(size_t n);
+
+  size_t rows() const noexcept { return rows_; }
+  size_t columns() const noexcept { return columns_; }
+  size_t size() const noexcept { return re_.size(); }
+
+  Number operator()(size_t i, size_t j) const {
+    return Number(re_[i * columns_ + j], im_[i * columns_ + j]);
+  }
+
+  void set(size_t i, size_t j, Number z) {
+    re_[i * columns_ + j] = z.real();
+    im_[i * columns_ + j] = z.imag();
+  }
+
+  double* real() noexcept { return re_.data(); }
+  double* imag() noexcept { return im_.data(); }
+  const double* real() const noexcept { return re_.data(); }
+  const double* imag() const noexcept { return im_.data(); }
+
+  Matrix transpose() const;
+
+  /// The conjugate transpose.
+  Matrix adjoint() const;
+
+  /**
+   * The product @p a @p b, on up to @p threads threads, 0 for one per
+   * hardware thread; products too small to pay off run on one.
+   */
+  static Result<Matrix> multiply(const Matrix& a, const Matrix& b, unsigned threads = 0);
+
+  /// The solution x of @p a x = @p b, for square @p a.
+  static Result<Matrix> solve(const Matrix& a, const Matrix& b);
+
+  Result<Matrix> inverse() const;
+  Result<Number> determinant() const;
+
+ private:
+  size_t rows_;
+  size_t columns_;
+  std::vector<double> re_;
+  std::vector<double> im_;
+};
+
+class Matrix::ErrorCategory : public std::error_category {
+ public:
+  static const ErrorCategory& get();
+
+  const char* name() const noexcept override;
+  std::string message(int ec) const override;
+};
+
+inline std::error_code make_error_code(Matrix::ErrorCode ec) {
+  return std::error_code(static_cast<int>(ec), Matrix::ErrorCategory::get());
+}
+
+}  // namespace cmath
+
+namespace std {
+template <>
+struct is_error_code_enum<cmath::Matrix::ErrorCode> : public true_type {};
+}  // namespace std
@@ -0,0 +1,520 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/natural.h>
+#include <algorithm>
+#include <cmath>
+
+namespace cmath::natural {
+
+using Wide = unsigned __int128;
+
+// {{{ natural numbers
+// Unsigned integers as little-endian limb vectors without leading zero
+// limbs; zero is the empty vector. The multiplication and division kernels
+// work on raw limb ranges, which may have leading zeros.
+
+void trim(Limbs& a) {
+  while (!a.empty() && a.back() == 0)
+    a.pop_back();
+}
+
+size_t bitLength(const Limbs& a) {
+  return a.empty() ? 0 : a.size() * 64 - __builtin_clzll(a.back());
+}
+
+bool testBit(const Limbs& a, size_t i) {
+  return i / 64 < a.size() && ((a[i / 64] >> (i % 64)) & 1);
+}
+
+bool anyBitBelow(const Limbs& a, size_t n) {
+  const size_t full = std::min(n / 64, a.size());
+  for (size_t i = 0; i < full; ++i)
+    if (a[i])
+      return true;
+
+  if (n % 64 && full < a.size())
+    return a[full] & ((Limb(1) << (n % 64)) - 1);
+
+  return false;
+}
+
+size_t trailingZeros(const Limbs& a) {
+  size_t i = 0;
+  while (a[i] == 0)
+    i++;
+  return i * 64 + __builtin_ctzll(a[i]);
+}
+
+int compare(const Limbs& a, const Limbs& b) {
+  if (a.size() != b.size())
+    return a.size() < b.size() ? -1 : 1;
+
+  for (size_t i = a.size(); i-- > 0;)
+    if (a[i] != b[i])
+      return a[i] < b[i] ? -1 : 1;
+
+  return 0;
+}
+
+Limbs shiftLeft(const Limbs& a, size_t n) {
+  if (a.empty())
+    return Limbs();
+
+  const size_t limbs = n / 64;
+  const unsigned bits = n % 64;
+  Limbs r(a.size() + limbs + 1, 0);
+  for (size_t i = 0; i < a.size(); ++i) {
+    r[i + limbs] |= a[i] << bits;
+    if (bits)
+      r[i + limbs + 1] = a[i] >> (64 - bits);
+  }
+  trim(r);
+  return r;
+}
+
+Limbs shiftRight(const Limbs& a, size_t n) {
+  const size_t limbs = n / 64;
+  const unsigned bits = n % 64;
+  if (limbs >= a.size())
+    return Limbs();
+
+  Limbs r(a.size() - limbs);
+  for (size_t i = 0; i < r.size(); ++i) {
+    r[i] = a[i + limbs] >> bits;
+    if (bits && i + limbs + 1 < a.size())
+      r[i] |= a[i + limbs + 1] << (64 - bits);
+  }
+  trim(r);
+  return r;
+}
+
+namespace {
+
+// r[0, rn) += b[0, bn), bn <= rn; returns the carry out
+Limb addTo(Limb* r, size_t rn, const Limb* b, size_t bn) {
+  Limb carry = 0;
+  size_t i = 0;
+  for (; i < bn; ++i) {
+    Wide t = Wide(r[i]) + b[i] + carry;
+    r[i] = Limb(t);
+    carry = Limb(t >> 64);
+  }
+  for (; carry && i < rn; ++i)
+    carry = ++r[i] == 0;
+  return carry;
+}
+
+// r[0, rn) -= b[0, bn), bn <= rn and r >= b
+void subFrom(Limb* r, size_t rn, const Limb* b, size_t bn) {
+  Limb borrow = 0;
+  size_t i = 0;
+  for (; i < bn; ++i) {
+    const Limb x = r[i];
+    const Limb d = x - b[i];
+    r[i] = d - borrow;
+    borrow = (x < b[i]) || (d < borrow);
+  }
+  for (; borrow && i < rn; ++i)
+    borrow = r[i]-- == 0;
+}
+
+}  // namespace
+
+Limbs add(const Limbs& a, const Limbs& b) {
+  const Limbs& big = a.size() >= b.size() ? a : b;
+  const Limbs& small = a.size() >= b.size() ? b : a;
+  Limbs r(big.size() + 1, 0);
+  std::copy(big.begin(), big.end(), r.begin());
+  addTo(r.data(), r.size(), small.data(), small.size());
+  trim(r);
+  return r;
+}
+
+// a - b, requires a >= b
+Limbs sub(const Limbs& a, const Limbs& b) {
+  Limbs r = a;
+  subFrom(r.data(), r.size(), b.data(), b.size());
+  trim(r);
+  return r;
+}
+
+// a = a * m + c
+void mulAddSmall(Limbs& a, Limb m, Limb c) {
+  for (Limb& limb : a) {
+    Wide t = Wide(limb) * m + c;
+    limb = Limb(t);
+    c = Limb(t >> 64);
+  }
+  if (c)
+    a.push_back(c);
+}
+
+// a /= d, returns the remainder
+Limb divSmall(Limbs& a, Limb d) {
+  Wide rem = 0;
+  for (size_t i = a.size(); i-- > 0;) {
+    Wide cur = (rem << 64) | a[i];
+    a[i] = Limb(cur / d);
+    rem = cur % d;
+  }
+  trim(a);
+  return Limb(rem);
+}
+// }}}
+
+// {{{ multiplication
+namespace {
+
+void mul(const Limb* a, size_t an, const Limb* b, size_t bn, Limb* r);
+
+void mulSchoolbook(const Limb* a, size_t an, const Limb* b, size_t bn, Limb* r) {
+  std::fill(r, r + an + bn, 0);
+  for (size_t i = 0; i < an; ++i) {
+    Limb carry = 0;
+    for (size_t j = 0; j < bn; ++j) {
+      Wide t = Wide(a[i]) * b[j] + r[i + j] + carry;
+      r[i + j] = Limb(t);
+      carry = Limb(t >> 64);
+    }
+    r[i + bn] = carry;
+  }
+}
+
+// (a1 B^m + a0)(b1 B^m + b0), with z1 = (a0 + a1)(b0 + b1) - z0 - z2
+void mulKaratsuba(const Limb* a, size_t an, const Limb* b, size_t bn, Limb* r) {
+  const size_t m = (an + 1) / 2;
+  const size_t a1n = an - m;
+  const size_t b1n = bn - m;
+
+  mul(a, m, b, m, r);
+  mul(a + m, a1n, b + m, b1n, r + 2 * m);
+
+  Limbs sa(m + 1, 0);
+  Limbs sb(m + 1, 0);
+  std::copy(a, a + m, sa.begin());
+  std::copy(b, b + m, sb.begin());
+  addTo(sa.data(), sa.size(), a + m, a1n);
+  addTo(sb.data(), sb.size(), b + m, b1n);
+
+  Limbs z1(2 * m + 2);
+  mul(sa.data(), sa.size(), sb.data(), sb.size(), z1.data());
+  subFrom(z1.data(), z1.size(), r, 2 * m);
+  subFrom(z1.data(), z1.size(), r + 2 * m, a1n + b1n);
+
+  trim(z1);
+  addTo(r + m, an + bn - m, z1.data(), z1.size());
+}
+
+struct Signed {
+  bool negative;
+  Limbs mag;
+};
+
+Signed add(const Signed& a, const Signed& b) {
+  if (a.negative == b.negative)
+    return Signed{a.negative, natural::add(a.mag, b.mag)};
+
+  const int c = compare(a.mag, b.mag);
+  if (c >= 0)
+    return Signed{a.negative && c != 0, natural::sub(a.mag, b.mag)};
+  else
+    return Signed{b.negative, natural::sub(b.mag, a.mag)};
+}
+
+Signed sub(const Signed& a, const Signed& b) {
+  return add(a, Signed{!b.negative && !b.mag.empty(), b.mag});
+}
+
+Signed twice(const Signed& a) {
+  return Signed{a.negative, shiftLeft(a.mag, 1)};
+}
+
+Signed divExact(Signed a, Limb d) {
+  divSmall(a.mag, d);
+  a.negative = a.negative && !a.mag.empty();
+  return a;
+}
+
+Signed mul(const Signed& a, const Signed& b);
+
+// Toom-3 with evaluation points 0, 1, -1, -2 and infinity, and Bodrato's
+// interpolation sequence.
+void mulToom3(const Limb* a, size_t an, const Limb* b, size_t bn, Limb* r) {
+  const size_t k = (an + 2) / 3;
+
+  auto part = [k](const Limb* p, size_t n, size_t i) {
+    const size_t from = std::min(i * k, n);
+    const size_t to = std::min(from + k, n);
+    Limbs s(p + from, p + to);
+    trim(s);
+    return Signed{false, s};
+  };
+
+  const Signed a0 = part(a, an, 0), a1 = part(a, an, 1), a2 = part(a, an, 2);
+  const Signed b0 = part(b, bn, 0), b1 = part(b, bn, 1), b2 = part(b, bn, 2);
+
+  const Signed pa = add(a0, a2);
+  const Signed pa1 = add(pa, a1);
+  const Signed pam1 = sub(pa, a1);
+  const Signed pam2 = sub(twice(add(pam1, a2)), a0);
+
+  const Signed pb = add(b0, b2);
+  const Signed pb1 = add(pb, b1);
+  const Signed pbm1 = sub(pb, b1);
+  const Signed pbm2 = sub(twice(add(pbm1, b2)), b0);
+
+  const Signed r0 = mul(a0, b0);
+  const Signed r1 = mul(pa1, pb1);
+  const Signed rm1 = mul(pam1, pbm1);
+  const Signed rm2 = mul(pam2, pbm2);
+  const Signed rinf = mul(a2, b2);
+
+  Signed c3 = divExact(sub(rm2, r1), 3);
+  Signed c1 = divExact(sub(r1, rm1), 2);
+  Signed c2 = sub(rm1, r0);
+  c3 = add(divExact(sub(c2, c3), 2), twice(rinf));
+  c2 = sub(add(c2, c1), rinf);
+  c1 = sub(c1, c3);
+
+  std::fill(r, r + an + bn, 0);
+  const Signed* coefficients[] = {&r0, &c1, &c2, &c3, &rinf};
+  for (size_t i = 0; i < 5; ++i) {
+    const Limbs& c = coefficients[i]->mag;
+    addTo(r + i * k, an + bn - i * k, c.data(), c.size());
+  }
+}
+
+// r[0, an + bn) = a * b
+void mul(const Limb* a, size_t an, const Limb* b, size_t bn, Limb* r) {
+  if (an < bn) {
+    std::swap(a, b);
+    std::swap(an, bn);
+  }
+
+  if (bn < KaratsubaThreshold) {
+    mulSchoolbook(a, an, b, bn, r);
+  } else if (bn <= (an + 1) / 2) {
+    // unbalanced: multiply bn-sized slices of a
+    std::fill(r, r + an + bn, 0);
+    Limbs t(2 * bn);
+    for (size_t i = 0; i < an; i += bn) {
+      const size_t n = std::min(bn, an - i);
+      mul(a + i, n, b, bn, t.data());
+      addTo(r + i, an + bn - i, t.data(), n + bn);
+    }
+  } else if (bn < ToomThreshold || bn <= 2 * ((an + 2) / 3)) {
+    mulKaratsuba(a, an, b, bn, r);
+  } else {
+    mulToom3(a, an, b, bn, r);
+  }
+}
+
+}  // namespace
+
+Limbs mul(const Limbs& a, const Limbs& b) {
+  if (a.empty() || b.empty())
+    return Limbs();
+
+  Limbs r(a.size() + b.size());
+  mul(a.data(), a.size(), b.data(), b.size(), r.data());
+  trim(r);
+  return r;
+}
+
+namespace {
+Signed mul(const Signed& a, const Signed& b) {
+  Limbs m = natural::mul(a.mag, b.mag);
+  return Signed{a.negative != b.negative && !m.empty(), std::move(m)};
+}
+}  // namespace
+// }}}
+
+// {{{ division
+// Knuth, TAOCP vol. 2, 4.3.1, algorithm D.
+void divmod(const Limbs& a, const Limbs& b, Limbs* q, Limbs* r) {
+  if (compare(a, b) < 0) {
+    *q = Limbs();
+    *r = a;
+    return;
+  }
+
+  if (b.size() == 1) {
+    *q = a;
+    const Limb rem = divSmall(*q, b[0]);
+    *r = rem ? Limbs{rem} : Limbs();
+    return;
+  }
+
+  // normalize, so that the divisor's top bit is set
+  const unsigned s = __builtin_clzll(b.back());
+  const Limbs v = shiftLeft(b, s);
+  Limbs u = shiftLeft(a, s);
+  u.resize(a.size() + 1, 0);
+
+  const size_t n = v.size();
+  const size_t m = a.size() - n;
+  Limbs quot(m + 1);
+
+  for (size_t j = m + 1; j-- > 0;) {
+    const Wide num = (Wide(u[j + n]) << 64) | u[j + n - 1];
+    Wide qhat = num / v[n - 1];
+    Wide rhat = num % v[n - 1];
+    while ((qhat >> 64) || qhat * v[n - 2] > ((rhat << 64) | u[j + n - 2])) {
+      qhat--;
+      rhat += v[n - 1];
+      if (rhat >> 64)
+        break;
+    }
+
+    // u[j, j + n] -= qhat * v
+    __int128 k = 0;
+    __int128 t;
+    for (size_t i = 0; i < n; ++i) {
+      const Wide p = qhat * v[i];
+      t = __int128(u[i + j]) - k - __int128(Limb(p));
+      u[i + j] = Limb(t);
+      k = __int128(p >> 64) - (t >> 64);
+    }
+    t = __int128(u[j + n]) - k;
+    u[j + n] = Limb(t);
+
+    if (t < 0) {
+      // qhat was one too large, add back
+      qhat--;
+      u[j + n] += addTo(u.data() + j, n, v.data(), n);
+    }
+    quot[j] = Limb(qhat);
+  }
+
+  trim(quot);
+  *q = std::move(quot);
+  u.resize(n);
+  trim(u);
+  *r = shiftRight(u, s);
+}
+
+// floor(sqrt(n)), by Newton iteration from above
+Limbs isqrt(const Limbs& n) {
+  if (n.empty())
+    return Limbs();
+
+  // start from the square root of the leading (up to) 64 bits, rounded up
+  const size_t length = bitLength(n);
+  const size_t shift = length > 64 ? (length - 63) & ~size_t(1) : 0;
+  const double top = static_cast<double>(shiftRight(n, shift)[0]);
+  const Limb root = static_cast<Limb>(std::sqrt(top + 1)) + 2;
+  Limbs x = shiftLeft(Limbs{root}, shift / 2);
+
+  for (;;) {
+    Limbs q, r;
+    divmod(n, x, &q, &r);
+    Limbs y = shiftRight(add(x, q), 1);
+    if (compare(y, x) >= 0)
+      return x;
+    x = std::move(y);
+  }
+}
+
+Limbs pow10(size_t n) {
+  Limbs result{1};
+  Limbs base{5};
+  for (size_t i = n; i; i >>= 1) {
+    if (i & 1)
+      result = mul(result, base);
+    if (i > 1)
+      base = mul(base, base);
+  }
+  return shiftLeft(result, n);
+}
+
+std::string toDecimal(Limbs a) {
+  if (a.empty())
+    return "0";
+
+  constexpr Limb Chunk = 10000000000000000000ull;  // 10^19
+  std::vector<Limb> chunks;
+  while (!a.empty())
+    chunks.push_back(divSmall(a, Chunk));
+
+  std::string s = std::to_string(chunks.back());
+  for (size_t i = chunks.size() - 1; i-- > 0;) {
+    std::string c = std::to_string(chunks[i]);
+    s.append(19 - c.size(), '0');
+    s += c;
+  }
+  return s;
+}
+// }}}
+
+// {{{ gcd
+// Stein's binary GCD: strip common factors of two, then subtract the
+// smaller from the larger odd value, which only needs shifts.
+uint64_t gcd(uint64_t a, uint64_t b) {
+  if (a == 0)
+    return b;
+  if (b == 0)
+    return a;
+
+  const int shift = __builtin_ctzll(a | b);
+  a >>= __builtin_ctzll(a);
+  do {
+    b >>= __builtin_ctzll(b);
+    if (a > b)
+      std::swap(a, b);
+    b -= a;
+  } while (b != 0);
+  return a << shift;
+}
+
+namespace {
+// a >>= n, in place
+void shiftRightInPlace(Limbs& a, size_t n) {
+  const size_t limbs = n / 64;
+  const unsigned bits = n % 64;
+  const size_t size = a.size() - limbs;
+  for (size_t i = 0; i < size; ++i) {
+    Limb v = a[i + limbs] >> bits;
+    if (bits && i + limbs + 1 < a.size())
+      v |= a[i + limbs + 1] << (64 - bits);
+    a[i] = v;
+  }
+  a.resize(size);
+  trim(a);
+}
+}  // namespace
+
+Limbs gcd(Limbs a, Limbs b) {
+  if (a.empty())
+    return b;
+  if (b.empty())
+    return a;
+
+  const size_t shift = std::min(trailingZeros(a), trailingZeros(b));
+  shiftRightInPlace(a, trailingZeros(a));
+  while (!b.empty()) {
+    shiftRightInPlace(b, trailingZeros(b));
+    if (a.size() == 1 && b.size() == 1)
+      return shiftLeft(Limbs{gcd(a[0], b[0])}, shift);
+    if (compare(a, b) > 0)
+      std::swap(a, b);
+
+    if (b.size() > a.size() + 1) {
+      // far apart: one division step saves many subtractions
+      Limbs q;
+      divmod(b, a, &q, &b);
+      continue;
+    }
+
+    subFrom(b.data(), b.size(), a.data(), a.size());
+    trim(b);
+  }
+  return shiftLeft(a, shift);
+}
+// }}}
+
+}  // namespace cmath::natural
@@ -0,0 +1,77 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Arithmetic on natural numbers of arbitrary size, the kernel beneath
+ * Real and Rational.
+ *
+ * A natural number is a little-endian vector of 64-bit limbs without
+ * leading zero limbs; zero is the empty vector.
+ */
+namespace cmath::natural {
+
+using Limb = uint64_t;
+using Limbs = std::vector<Limb>;
+
+// Multiplication switches from schoolbook to Karatsuba and Toom-3 at these
+// operand sizes (in limbs).
+constexpr size_t KaratsubaThreshold = 32;
+constexpr size_t ToomThreshold = 160;
+
+/// Removes leading zero limbs.
+void trim(Limbs& a);
+
+size_t bitLength(const Limbs& a);
+bool testBit(const Limbs& a, size_t i);
+
+/// Whether any of the lowest @p n bits is set.
+bool anyBitBelow(const Limbs& a, size_t n);
+
+/// Number of trailing zero bits of a nonzero @p a.
+size_t trailingZeros(const Limbs& a);
+
+/// -1, 0 or 1.
+int compare(const Limbs& a, const Limbs& b);
+
+Limbs shiftLeft(const Limbs& a, size_t n);
+Limbs shiftRight(const Limbs& a, size_t n);
+
+Limbs add(const Limbs& a, const Limbs& b);
+
+/// a - b, for a >= b.
+Limbs sub(const Limbs& a, const Limbs& b);
+
+/// a = a * m + c.
+void mulAddSmall(Limbs& a, Limb m, Limb c);
+
+/// a = a / d; returns the remainder.
+Limb divSmall(Limbs& a, Limb d);
+
+Limbs mul(const Limbs& a, const Limbs& b);
+
+/// Quotient and remainder of a / b, for a nonzero @p b.
+void divmod(const Limbs& a, const Limbs& b, Limbs* q, Limbs* r);
+
+/// floor(sqrt(n)).
+Limbs isqrt(const Limbs& n);
+
+/// 10^n.
+Limbs pow10(size_t n);
+
+std::string toDecimal(Limbs a);
+
+/// Greatest common divisor, by Stein's binary algorithm; gcd(0, b) = b.
+uint64_t gcd(uint64_t a, uint64_t b);
+Limbs gcd(Limbs a, Limbs b);
+
+}  // namespace cmath::natural
@@ -0,0 +1,480 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/expr_batch.h>
+#include <cmath/plot.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace cmath {
+
+namespace {
+
+constexpr double NaN = std::numeric_limits<double>::quiet_NaN();
+
+// around the area the graph is drawn in, for the title and tick labels
+constexpr double MarginLeft = 64;
+constexpr double MarginRight = 16;
+constexpr double MarginTop = 32;
+constexpr double MarginBottom = 32;
+
+// a rise of more pixels than this across an interval is a jump, unless the
+// intervals next to it rise the same way and at least 1/Steepness as much;
+// jumps are bisected down to the resolution, and break the graph there
+constexpr double JumpPixels = 4;
+constexpr double Steepness = 4;
+
+// the range is checked for poles once it is this many times wider than the
+// middle 90% of the values (by length of x)
+constexpr double OutlierFactor = 10;
+
+double realValue(Number y) {
+  const double re = y.real();
+  if (!std::isfinite(re) || !std::isfinite(y.imag()) ||
+      std::abs(y.imag()) > 1e-9 * std::max(1.0, std::abs(re)))
+    return NaN;
+  return re;
+}
+
+// whether the values run off to infinity next to point @p m, in that a
+// neighbour no further than @p narrowest away is undefined or lies less
+// than half as far beyond @p bound, or on the other side of it
+bool unbounded(const std::vector<Plot::Point>& points, size_t m, double bound,
+               double narrowest) {
+  const double excess = points[m].y - bound;
+  for (size_t j : {m - 1, m + 1}) {
+    if (j >= points.size() || std::abs(points[j].x - points[m].x) > narrowest)
+      continue;
+    if (std::isnan(points[j].y) || (points[j].y - bound) / excess < 0.5)
+      return true;
+  }
+  return false;
+}
+
+// the vertical range the graph is drawn at: all values, except for the ones
+// running off to infinity at poles
+std::pair<double, double> range(const std::vector<Plot::Point>& points,
+                                double narrowest) {
+  // each value weighs as much as the length of x it stands for, so that the
+  // samples crowding at a pole do not count for more than it spans
+  std::vector<std::pair<double, double>> ys;
+  double total = 0;
+  for (size_t i = 0; i < points.size(); ++i) {
+    if (std::isnan(points[i].y))
+      continue;
+    const size_t next = std::min(i + 1, points.size() - 1);
+    const double w = points[next].x - points[i ? i - 1 : 0].x;
+    ys.emplace_back(points[i].y, w);
+    total += w;
+  }
+
+  if (ys.empty())
+    return {-1, 1};
+
+  std::sort(ys.begin(), ys.end());
+
+  auto quantile = [&](double q) {
+    double sum = 0;
+    for (const auto& [y, w] : ys)
+      if ((sum += w) >= q * total)
+        return y;
+    return ys.back().first;
+  };
+
+  double lo = ys.front().first;
+  double hi = ys.back().first;
+  const double q05 = quantile(0.05);
+  const double q95 = quantile(0.95);
+  const double bulk = q95 - q05;
+  if (bulk > 0 && hi - lo > OutlierFactor * bulk) {
+    // the runs of values beyond the middle are left out of view where they
+    // run off to infinity, and kept in where they peak, or are not sampled
+    // finely enough yet to tell
+    const double top = q95 + bulk / 2;
+    const double bottom = q05 - bulk / 2;
+    double a = std::max(lo, bottom);
+    double b = std::min(hi, top);
+    for (size_t i = 0; i < points.size();) {
+      const double y = points[i].y;
+      if (std::isnan(y) || (bottom <= y && y <= top)) {
+        i++;
+        continue;
+      }
+
+      const bool above = y > top;
+      size_t m = i;
+      for (; i < points.size() && !std::isnan(points[i].y) &&
+             (above ? points[i].y > top : points[i].y < bottom);
+           ++i) {
+        if (above ? points[i].y > points[m].y : points[i].y < points[m].y)
+          m = i;
+      }
+
+      if (!unbounded(points, m, above ? top : bottom, narrowest)) {
+        a = std::min(a, points[m].y);
+        b = std::max(b, points[m].y);
+      }
+    }
+    lo = a;
+    hi = b;
+  }
+
+  if (hi - lo <= 1e-12 * std::max(1.0, std::abs(hi))) {
+    const double d = std::max(1.0, std::abs(hi)) / 2;
+    lo -= d;
+    hi += d;
+  }
+
+  const double pad = (hi - lo) / 20;
+  return {lo - pad, hi + pad};
+}
+
+// whether the graph jumps across the interval ending at point @p i, rising
+// in view of [@p lo, @p hi] by more than JumpPixels, at @p sy pixels per
+// unit, unlike the intervals next to it
+bool jumps(const std::vector<Plot::Point>& points, size_t i, double lo, double hi,
+           double sy) {
+  auto rise = [&](size_t k) {
+    if (k == 0 || k >= points.size() || std::isnan(points[k].y) ||
+        std::isnan(points[k - 1].y))
+      return 0.0;
+    return (std::clamp(points[k].y, lo, hi) - std::clamp(points[k - 1].y, lo, hi)) * sy;
+  };
+
+  const double d = rise(i);
+  if (std::abs(d) <= JumpPixels)
+    return false;
+
+  auto alike = [&](double e) {
+    return e * d > 0 && std::abs(e) * Steepness >= std::abs(d);
+  };
+  return !alike(rise(i - 1)) && !alike(rise(i + 1));
+}
+
+// in [-1, 1), evenly spread
+double jitter(size_t i) {
+  const double golden = 0.6180339887498949;
+  const double t = i * golden;
+  return 2 * (t - std::floor(t)) - 1;
+}
+
+// multiples of 1, 2 or 5 times a power of ten, about every @p pixels
+std::vector<double> ticks(double lo, double hi, double length, double pixels) {
+  const double raw = (hi - lo) * pixels / length;
+  const double magnitude = std::pow(10, std::floor(std::log10(raw)));
+  double step = 10 * magnitude;
+  for (double m : {1, 2, 5}) {
+    if (m * magnitude >= raw) {
+      step = m * magnitude;
+      break;
+    }
+  }
+
+  std::vector<double> result;
+  for (double k = std::ceil(lo / step); k * step <= hi; ++k)
+    result.push_back(std::abs(k) < 0.5 ? 0 : k * step);
+  return result;
+}
+
+std::string coordinate(double v) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%.2f", v);
+  return buf;
+}
+
+std::string label(double v) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%g", v);
+  return buf;
+}
+
+std::string escape(const std::string& s) {
+  std::string out;
+  for (char ch : s) {
+    switch (ch) {
+      case '&': out += "&amp;"; break;
+      case '<': out += "&lt;"; break;
+      case '>': out += "&gt;"; break;
+      default: out += ch; break;
+    }
+  }
+  return out;
+}
+
+}  // namespace
+
+// {{{ Plot
+Result<Plot> Plot::sample(const Function& f,
+                          double a,
+                          double b,
+                          const Options& options,
+                          Stats* stats) {
+  if (!std::isfinite(a) || !std::isfinite(b) || !(a < b))
+    return InvalidRange;
+
+  Stats s;
+  const double width = std::max(1.0, options.width - MarginLeft - MarginRight);
+  const double height = std::max(1.0, options.height - MarginTop - MarginBottom);
+
+  std::vector<Number> xs;
+  std::vector<Number> ys;
+  auto evaluate = [&](const std::vector<double>& x, std::vector<double>* y) {
+    xs.assign(x.begin(), x.end());
+    ys.resize(x.size());
+    f(xs.data(), xs.size(), ys.data());
+    y->resize(x.size());
+    std::transform(ys.begin(), ys.end(), y->begin(), realValue);
+    s.samples += x.size();
+    s.rounds++;
+  };
+
+  // a grid whose inner nodes are moved by up to a fifth of its spacing, so
+  // that it does not sample a periodic function at the same phase throughout
+  const size_t n = std::max<size_t>(options.initialSamples, 3);
+  std::vector<double> x(n);
+  for (size_t i = 0; i < n; ++i) {
+    const double t = i + (i && i < n - 1 ? jitter(i) / 5 : 0);
+    x[i] = a + (b - a) * t / (n - 1);
+  }
+
+  std::vector<double> y;
+  evaluate(x, &y);
+
+  std::vector<Point> points;
+  for (size_t i = 0; i < n; ++i)
+    points.push_back(Point{x[i], y[i], true});
+
+  const double sx = width / (b - a);
+  const double narrowest = options.resolution / sx;
+  std::pair<double, double> yRange;
+  for (;;) {
+    yRange = range(points, 2 * narrowest);
+    const auto [lo, hi] = yRange;
+    const double sy = height / (hi - lo);
+    auto Y = [&](double v) { return std::clamp((v - lo) * sy, -height, 2 * height); };
+
+    std::vector<bool> split(points.size() - 1);
+    for (size_t i = 1; i + 1 < points.size(); ++i) {
+      const Point& p = points[i - 1];
+      const Point& q = points[i];
+      const Point& r = points[i + 1];
+      if (std::isnan(p.y) || std::isnan(q.y) || std::isnan(r.y))
+        continue;
+
+      // out of view altogether
+      if ((p.y > hi && q.y > hi && r.y > hi) || (p.y < lo && q.y < lo && r.y < lo))
+        continue;
+
+      // distance of q from the chord p r, in pixels
+      const double dx = (r.x - p.x) * sx;
+      const double dy = Y(r.y) - Y(p.y);
+      const double cross = dx * (Y(q.y) - Y(p.y)) - dy * (q.x - p.x) * sx;
+      if (std::abs(cross) > options.tolerance * std::hypot(dx, dy))
+        split[i - 1] = split[i] = true;
+    }
+
+    // where the function becomes undefined, or jumps
+    for (size_t i = 0; i + 1 < points.size(); ++i)
+      if (std::isnan(points[i].y) != std::isnan(points[i + 1].y) ||
+          jumps(points, i + 1, lo, hi, sy))
+        split[i] = true;
+
+    std::vector<size_t> intervals;
+    std::vector<double> mid;
+    for (size_t i = 0; i + 1 < points.size(); ++i) {
+      if (split[i] && points[i + 1].x - points[i].x > narrowest) {
+        intervals.push_back(i);
+        mid.push_back((points[i].x + points[i + 1].x) / 2);
+      }
+    }
+
+    const size_t budget = options.maxSamples - std::min(s.samples, options.maxSamples);
+    if (mid.size() > budget) {
+      intervals.resize(budget);
+      mid.resize(budget);
+    }
+    if (mid.empty())
+      break;
+
+    evaluate(mid, &y);
+
+    std::vector<Point> refined;
+    refined.reserve(points.size() + mid.size());
+    for (size_t i = 0, k = 0; i < points.size(); ++i) {
+      refined.push_back(points[i]);
+      if (k < intervals.size() && intervals[k] == i) {
+        refined.push_back(Point{mid[k], y[k], true});
+        k++;
+      }
+    }
+    points.swap(refined);
+  }
+
+  // breaks the graph at jumps that bisection did not resolve
+  const auto [lo, hi] = yRange;
+  const double sy = height / (hi - lo);
+  for (size_t i = 1; i < points.size(); ++i) {
+    if (points[i].x - points[i - 1].x <= 2 * narrowest && jumps(points, i, lo, hi, sy)) {
+      points[i].connected = false;
+      s.discontinuities++;
+    }
+  }
+
+  if (stats)
+    *stats = s;
+
+  Plot plot;
+  plot.points_ = std::move(points);
+  plot.width_ = options.width;
+  plot.height_ = options.height;
+  plot.xMin_ = a;
+  plot.xMax_ = b;
+  plot.yMin_ = lo;
+  plot.yMax_ = hi;
+  return plot;
+}
+
+Result<Plot> Plot::sample(const Expr* e,
+                          const Symbol& x,
+                          double a,
+                          double b,
+                          const SymbolTable& t,
+                          const Options& options,
+                          Stats* stats) {
+  if (options.batched) {
+    Result<BatchProgram> program = BatchProgram::compile(e, t, {x});
+    if (program.isSuccess()) {
+      const BatchProgram& p = *program;
+      auto f = [&](const Number* xs, size_t n, Number* ys) { p.evaluate(xs, n, ys); };
+      return sample(f, a, b, options, stats);
+    }
+  }
+
+  auto f = [&](const Number* xs, size_t n, Number* ys) {
+    SymbolTable scope(&t);
+    for (size_t k = 0; k != n; ++k) {
+      scope.defineConstant(x, xs[k]);
+      ys[k] = e->calculate(scope);
+    }
+  };
+  return sample(f, a, b, options, stats);
+}
+
+Result<Plot> Plot::sample(const Expr* e,
+                          double a,
+                          double b,
+                          const SymbolTable& t,
+                          const Options& options,
+                          Stats* stats) {
+  const std::vector<Symbol> symbols = freeSymbols(e, t);
+
+  if (symbols.size() > 1)
+    return TooManyVariables;
+
+  if (symbols.empty()) {
+    const Number y = e->calculate(t);
+    auto f = [&](const Number*, size_t n, Number* ys) { std::fill(ys, ys + n, y); };
+    return sample(f, a, b, options, stats);
+  }
+
+  return sample(e, symbols[0], a, b, t, options, stats);
+}
+
+void Plot::writeSvg(std::ostream& out, const std::string& title) const {
+  const double left = MarginLeft;
+  const double top = MarginTop;
+  const double width = std::max(1.0, width_ - MarginLeft - MarginRight);
+  const double height = std::max(1.0, height_ - MarginTop - MarginBottom);
+  auto X = [&](double x) { return left + (x - xMin_) / (xMax_ - xMin_) * width; };
+  auto Y = [&](double y) {
+    // far enough out that lines to points out of view keep their slope in it
+    const double v = top + (yMax_ - y) / (yMax_ - yMin_) * height;
+    return std::clamp(v, top - 100 * height, top + 101 * height);
+  };
+
+  out << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << width_ << "\" height=\""
+      << height_ << "\" viewBox=\"0 0 " << width_ << ' ' << height_
+      << "\" font-family=\"sans-serif\" font-size=\"12\">\n"
+      << "<!-- " << points_.size() << " samples -->\n"
+      << "<rect width=\"100%\" height=\"100%\" fill=\"white\"/>\n"
+      << "<clipPath id=\"area\"><rect x=\"" << left << "\" y=\"" << top << "\" width=\""
+      << width << "\" height=\"" << height << "\"/></clipPath>\n"
+      << "<text x=\"" << coordinate(left + width / 2) << "\" y=\"" << top - 12
+      << "\" text-anchor=\"middle\" font-size=\"14\">" << escape(title) << "</text>\n";
+
+  out << "<g stroke=\"#e0e0e0\">\n";
+  for (double x : ticks(xMin_, xMax_, width, 80))
+    out << "<line x1=\"" << coordinate(X(x)) << "\" y1=\"" << top << "\" x2=\""
+        << coordinate(X(x)) << "\" y2=\"" << top + height << "\"/>\n";
+  for (double y : ticks(yMin_, yMax_, height, 50))
+    out << "<line x1=\"" << left << "\" y1=\"" << coordinate(Y(y)) << "\" x2=\""
+        << left + width << "\" y2=\"" << coordinate(Y(y)) << "\"/>\n";
+  out << "</g>\n";
+
+  out << "<g fill=\"#404040\">\n";
+  for (double x : ticks(xMin_, xMax_, width, 80))
+    out << "<text x=\"" << coordinate(X(x)) << "\" y=\"" << top + height + 16
+        << "\" text-anchor=\"middle\">" << label(x) << "</text>\n";
+  for (double y : ticks(yMin_, yMax_, height, 50))
+    out << "<text x=\"" << left - 6 << "\" y=\"" << coordinate(Y(y) + 4)
+        << "\" text-anchor=\"end\">" << label(y) << "</text>\n";
+  out << "</g>\n";
+
+  // the axes, where they are in view
+  out << "<g stroke=\"#808080\">\n";
+  if (xMin_ <= 0 && 0 <= xMax_)
+    out << "<line x1=\"" << coordinate(X(0)) << "\" y1=\"" << top << "\" x2=\""
+        << coordinate(X(0)) << "\" y2=\"" << top + height << "\"/>\n";
+  if (yMin_ <= 0 && 0 <= yMax_)
+    out << "<line x1=\"" << left << "\" y1=\"" << coordinate(Y(0)) << "\" x2=\""
+        << left + width << "\" y2=\"" << coordinate(Y(0)) << "\"/>\n";
+  out << "</g>\n"
+      << "<rect x=\"" << left << "\" y=\"" << top << "\" width=\"" << width
+      << "\" height=\"" << height << "\" fill=\"none\" stroke=\"#404040\"/>\n";
+
+  out << "<path clip-path=\"url(#area)\" fill=\"none\" stroke=\"#1f77b4\""
+      << " stroke-width=\"1.5\" stroke-linejoin=\"round\" d=\"";
+  bool drawing = false;
+  for (const Point& p : points_) {
+    if (std::isnan(p.y)) {
+      drawing = false;
+      continue;
+    }
+    out << (drawing && p.connected ? 'L' : 'M') << coordinate(X(p.x)) << ','
+        << coordinate(Y(p.y));
+    drawing = true;
+  }
+  out << "\"/>\n"
+      << "</svg>\n";
+}
+// }}}
+// {{{ Plot::ErrorCategory
+const Plot::ErrorCategory& Plot::ErrorCategory::get() {
+  static ErrorCategory c;
+  return c;
+}
+
+const char* Plot::ErrorCategory::name() const noexcept {
+  return "PlotError";
+}
+
+std::string Plot::ErrorCategory::message(int ec) const {
+  switch (static_cast<ErrorCode>(ec)) {
+    case TooManyVariables:
+      return "Expression has more than one variable to plot over";
+    case InvalidRange:
+      return "Plot range must be finite and non-empty";
+  }
+  return "Unknown error";
+}
+// }}}
+
+}  // namespace cmath
@@ -0,0 +1,138 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <cmath/result.h>
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace cmath {
+
+/**
+ * The graph of a real function over [a, b], sampled adaptively for drawing
+ * at a given size, and rendered to SVG.
+ *
+ * Sampling starts from a coarse grid, slightly perturbed so that it does
+ * not alias with periodic functions, and refines in rounds. Each round
+ * bisects the intervals next to every sample that strays from the chord of
+ * its neighbours by more than the tolerance, measured in pixels of the
+ * drawing, and those between a defined and an undefined value, and
+ * evaluates the function at all new points in one batch. Intervals narrower
+ * than a fraction of a pixel are not bisected any further; where such an
+ * interval still spans a large jump, unlike the ones next to it, the graph
+ * is taken to be discontinuous there and is not connected across.
+ *
+ * Where the graph is straight at the scale of the drawing, the coarse grid
+ * is all that is evaluated. Features narrower than its spacing may go
+ * unnoticed, though.
+ *
+ * The vertical range covers all samples, unless a few of them, near poles,
+ * lie far outside the rest.
+ */
+class Plot {
+ public:
+  enum ErrorCode {
+    TooManyVariables = 1,
+    InvalidRange,
+  };
+  class ErrorCategory;
+
+  struct Options {
+    unsigned width = 800;        // of the drawing, in pixels
+    unsigned height = 500;
+    size_t initialSamples = 65;
+    double tolerance = 0.25;     // in pixels
+    double resolution = 1.0 / 16;  // narrowest interval bisected, in pixels
+    size_t maxSamples = 1 << 16;
+    bool batched = true;         // compile expressions to a BatchProgram
+  };
+
+  struct Stats {
+    size_t samples = 0;          // evaluations of the function
+    unsigned rounds = 0;         // batches the function was evaluated in
+    size_t discontinuities = 0;  // jumps the graph is broken at
+  };
+
+  struct Point {
+    double x;
+    double y;        // NaN where the function is undefined or not real
+    bool connected;  // drawn with a line from the previous point
+  };
+
+  /// Evaluates the function at @p count points.
+  using Function = std::function<void(const Number* x, size_t count, Number* y)>;
+
+  static Result<Plot> sample(const Function& f,
+                             double a,
+                             double b,
+                             const Options& options,
+                             Stats* stats = nullptr);
+
+  /**
+   * Samples @p e over @p x. Other symbols are constants, with their values
+   * in @p t.
+   */
+  static Result<Plot> sample(const Expr* e,
+                             const Symbol& x,
+                             double a,
+                             double b,
+                             const SymbolTable& t,
+                             const Options& options,
+                             Stats* stats = nullptr);
+
+  /// Samples @p e over the one symbol of it that @p t does not define.
+  static Result<Plot> sample(const Expr* e,
+                             double a,
+                             double b,
+                             const SymbolTable& t,
+                             const Options& options,
+                             Stats* stats = nullptr);
+
+  const std::vector<Point>& points() const noexcept { return points_; }
+  double xMin() const noexcept { return xMin_; }
+  double xMax() const noexcept { return xMax_; }
+  double yMin() const noexcept { return yMin_; }
+  double yMax() const noexcept { return yMax_; }
+
+  /// Writes the graph with axes and @p title as SVG of the sampled size.
+  void writeSvg(std::ostream& out, const std::string& title) const;
+
+ private:
+  Plot() = default;
+
+  std::vector<Point> points_;
+  unsigned width_ = 0;
+  unsigned height_ = 0;
+  double xMin_ = 0;
+  double xMax_ = 0;
+  double yMin_ = 0;
+  double yMax_ = 0;
+};
+
+class Plot::ErrorCategory : public std::error_category {
+ public:
+  static const ErrorCategory& get();
+
+  const char* name() const noexcept override;
+  std::string message(int ec) const override;
+};
+
+inline std::error_code make_error_code(Plot::ErrorCode ec) {
+  return std::error_code(static_cast<int>(ec), Plot::ErrorCategory::get());
+}
+
+}  // namespace cmath
+
+namespace std {
+template <>
+struct is_error_code_enum<cmath::Plot::ErrorCode> : public true_type {};
+}  // namespace std
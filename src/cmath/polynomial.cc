@@ -0,0 +1,714 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/polynomial.h>
+#include <algorithm>
+#include <cmath>
+
+namespace cmath {
+
+namespace {
+
+// Plain complex multiplication. The operator of std::complex recovers
+// infinities from NaN results, at the price of a library call per product.
+inline Number mul(Number a, Number b) {
+  return Number(a.real() * b.real() - a.imag() * b.imag(),
+                a.real() * b.imag() + a.imag() * b.real());
+}
+
+inline double mul(double a, double b) {
+  return a * b;
+}
+
+template <typename T>
+T power(T x, unsigned n) {
+  T result = 1;
+  for (;;) {
+    if (n & 1)
+      result = mul(result, x);
+    n >>= 1;
+    if (!n)
+      return result;
+    x = mul(x, x);
+  }
+}
+
+double hornerDense(const double* c, size_t n, double x) {
+  double r = c[n - 1];
+  for (size_t i = n - 1; i-- != 0;)
+    r = r * x + c[i];
+  return r;
+}
+
+// Evaluates pairs of coefficients at once, then pairs of pairs at x^2, and
+// so on. The products within a round are independent of each other, so
+// that they pipeline and vectorize, whereas Horner's scheme is one chain of
+// dependent multiply-adds.
+double estrin(const double* c, size_t n, double x) {
+  double a[Polynomial::MaxDegree / 2 + 1];
+
+  size_t half = n / 2;
+  for (size_t i = 0; i != half; ++i)
+    a[i] = c[2 * i] + c[2 * i + 1] * x;
+  if (n & 1)
+    a[half] = c[n - 1];
+
+  for (n = (n + 1) / 2; n > 1; n = (n + 1) / 2) {
+    x *= x;
+    half = n / 2;
+    for (size_t i = 0; i != half; ++i)
+      a[i] = a[2 * i] + a[2 * i + 1] * x;
+    if (n & 1)
+      a[half] = a[n - 1];
+  }
+
+  return a[0];
+}
+
+}  // namespace
+
+// {{{ Polynomial
+Polynomial::Polynomial(size_t variableCount)
+    : variableCount_(variableCount),
+      terms_(),
+      real_(true),
+      coefficients_(),
+      realCoefficients_(),
+      dense_() {}
+
+Polynomial::Polynomial(size_t variableCount, Number c) : Polynomial(variableCount) {
+  terms_.push_back(Term{Exponents(variableCount), c});
+  normalize();
+}
+
+Polynomial Polynomial::variable(size_t variableCount, size_t index) {
+  Polynomial p(variableCount);
+  p.terms_.push_back(Term{Exponents(variableCount), 1});
+  p.terms_.back().exponents[index] = 1;
+  p.normalize();
+  return p;
+}
+
+bool Polynomial::isConstant() const noexcept {
+  return terms_.empty() ||
+         (terms_.size() == 1 && std::all_of(terms_[0].exponents.begin(),
+                                            terms_[0].exponents.end(),
+                                            [](unsigned k) { return k == 0; }));
+}
+
+unsigned Polynomial::degree(size_t index) const {
+  unsigned result = 0;
+  for (const Term& term : terms_)
+    result = std::max(result, term.exponents[index]);
+  return result;
+}
+
+std::vector<Number> Polynomial::coefficients() const {
+  std::vector<Number> result(terms_.empty() ? 1 : degree(0) + 1);
+  for (const Term& term : terms_)
+    result[term.exponents[0]] = term.coefficient;
+  return result;
+}
+
+void Polynomial::normalize() {
+  std::sort(terms_.begin(), terms_.end(), [](const Term& a, const Term& b) {
+    return a.exponents > b.exponents;
+  });
+
+  // merge like terms, dropping those that cancel
+  size_t n = 0;
+  for (size_t i = 0; i != terms_.size();) {
+    Term term = std::move(terms_[i]);
+    for (++i; i != terms_.size() && terms_[i].exponents == term.exponents; ++i)
+      term.coefficient += terms_[i].coefficient;
+    if (term.coefficient != Number())
+      terms_[n++] = std::move(term);
+  }
+  terms_.resize(n);
+
+  prepare();
+}
+
+void Polynomial::prepare() {
+  real_ = std::all_of(terms_.begin(), terms_.end(),
+                      [](const Term& term) { return !term.coefficient.imag(); });
+
+  coefficients_.clear();
+  realCoefficients_.clear();
+  for (const Term& term : terms_) {
+    coefficients_.push_back(term.coefficient);
+    realCoefficients_.push_back(term.coefficient.real());
+  }
+
+  dense_.clear();
+  if (variableCount_ == 1 && real_ && !terms_.empty()) {
+    dense_.resize(degree(0) + 1);
+    for (const Term& term : terms_)
+      dense_[term.exponents[0]] = term.coefficient.real();
+  }
+}
+
+// Terms [begin, end) agree in the exponents of all variables before @p var.
+// Grouping them by the exponent of @p var makes them a polynomial in that
+// variable, whose coefficients are polynomials in the variables after it.
+template <typename T>
+T Polynomial::horner(const T* coefficients, const T* x,
+                     size_t begin, size_t end, size_t var) const {
+  if (var == variableCount_)
+    return coefficients[begin];
+
+  T result = 0;
+  unsigned previous = terms_[begin].exponents[var];
+  for (size_t i = begin; i != end;) {
+    const unsigned k = terms_[i].exponents[var];
+    size_t j = i + 1;
+    while (j != end && terms_[j].exponents[var] == k)
+      ++j;
+
+    result = mul(result, power(x[var], previous - k)) +
+             horner(coefficients, x, i, j, var + 1);
+    previous = k;
+    i = j;
+  }
+
+  return mul(result, power(x[var], previous));
+}
+
+Number Polynomial::evaluate(const Number* x) const {
+  if (terms_.empty())
+    return 0;
+
+  bool realPoint = real_;
+  double rx[MaxVariables];
+  for (size_t i = 0; realPoint && i != variableCount_; ++i) {
+    realPoint = !x[i].imag();
+    rx[i] = x[i].real();
+  }
+
+  if (!realPoint)
+    return horner(coefficients_.data(), x, 0, terms_.size(), 0);
+
+  if (!dense_.empty()) {
+    const size_t n = dense_.size();
+    return n > EstrinDegree ? estrin(dense_.data(), n, rx[0])
+                            : hornerDense(dense_.data(), n, rx[0]);
+  }
+
+  return horner(realCoefficients_.data(), rx, 0, terms_.size(), 0);
+}
+
+Polynomial Polynomial::operator-() const {
+  Polynomial result(*this);
+  for (Term& term : result.terms_)
+    term.coefficient = -term.coefficient;
+  result.prepare();
+  return result;
+}
+
+Polynomial operator+(const Polynomial& a, const Polynomial& b) {
+  Polynomial result(a);
+  result.terms_.insert(result.terms_.end(), b.terms_.begin(), b.terms_.end());
+  result.normalize();
+  return result;
+}
+
+Polynomial operator-(const Polynomial& a, const Polynomial& b) {
+  return a + -b;
+}
+
+Polynomial operator*(const Polynomial& a, const Polynomial& b) {
+  Polynomial result(a.variableCount_);
+  result.terms_.reserve(a.terms_.size() * b.terms_.size());
+
+  for (const Polynomial::Term& s : a.terms_) {
+    for (const Polynomial::Term& t : b.terms_) {
+      Polynomial::Exponents exponents(s.exponents);
+      for (size_t i = 0; i != exponents.size(); ++i)
+        exponents[i] += t.exponents[i];
+      result.terms_.push_back(
+          Polynomial::Term{std::move(exponents), s.coefficient * t.coefficient});
+    }
+  }
+
+  result.normalize();
+  return result;
+}
+
+std::string Polynomial::str() const {
+  if (terms_.empty())
+    return "0";
+
+  std::string s;
+  for (const Term& term : terms_) {
+    Number c = term.coefficient;
+    if (!c.imag() && std::signbit(c.real())) {
+      s.append(s.empty() ? "-" : " - ");
+      c = -c;
+    } else if (!s.empty()) {
+      s.append(" + ");
+    }
+
+    const bool constant = std::all_of(term.exponents.begin(), term.exponents.end(),
+                                      [](unsigned k) { return k == 0; });
+    if (constant || c != Number(1)) {
+      if (c.imag() && c.real()) {
+        s.push_back('(');
+        printNumber(c, &s);
+        s.push_back(')');
+      } else {
+        printNumber(c, &s);
+      }
+    }
+
+    bool first = constant || c != Number(1);
+    for (size_t i = 0; i != term.exponents.size(); ++i) {
+      if (!term.exponents[i])
+        continue;
+      if (first)
+        s.push_back('*');
+      first = true;
+      s.append("x" + std::to_string(i));
+      if (term.exponents[i] != 1)
+        s.append("^" + std::to_string(term.exponents[i]));
+    }
+  }
+
+  return s;
+}
+
+namespace {
+
+bool fits(const Polynomial& p) {
+  if (p.terms().size() > Polynomial::MaxTerms)
+    return false;
+
+  for (size_t i = 0; i != p.variableCount(); ++i)
+    if (p.degree(i) > Polynomial::MaxDegree)
+      return false;
+
+  return true;
+}
+
+bool isMonomial(const Polynomial& p) {
+  return p.terms().size() <= 1;
+}
+
+// Whether @p e may depend on any of @p variables.
+bool mentions(const Expr* e, const std::vector<Symbol>& variables) {
+  if (dynamic_cast<const NumberExpr*>(e))
+    return false;
+
+  if (auto s = dynamic_cast<const SymbolExpr*>(e))
+    return std::find(variables.begin(), variables.end(), s->symbolName()) !=
+           variables.end();
+
+  if (auto p = dynamic_cast<const PolynomialExpr*>(e))
+    return mentions(p->source(), variables);
+
+  if (auto n = dynamic_cast<const NegExpr*>(e))
+    return mentions(n->subExpr(), variables);
+
+  if (auto u = dynamic_cast<const UnaryExpr*>(e))
+    return mentions(u->subExpr(), variables);
+
+  if (auto b = dynamic_cast<const BinaryExpr*>(e))
+    return mentions(b->left(), variables) || mentions(b->right(), variables);
+
+  if (auto sum = dynamic_cast<const SumExpr*>(e))
+    return std::any_of(sum->terms().begin(), sum->terms().end(),
+                       [&](const SumExpr::Term& term) {
+                         return mentions(term.expr.get(), variables);
+                       });
+
+  if (auto product = dynamic_cast<const ProductExpr*>(e))
+    return std::any_of(product->factors().begin(), product->factors().end(),
+                       [&](const std::unique_ptr<Expr>& factor) {
+                         return mentions(factor.get(), variables);
+                       });
+
+  if (auto c = dynamic_cast<const CallExpr*>(e))
+    return std::any_of(c->inputs().begin(), c->inputs().end(),
+                       [&](const std::unique_ptr<Expr>& input) {
+                         return mentions(input.get(), variables);
+                       });
+
+  return true;
+}
+
+// Multiplies out, unless both are sums and @p expand is false.
+bool multiply(const Polynomial& left,
+              const Polynomial& right,
+              bool expand,
+              Polynomial* out) {
+  if (!expand && !isMonomial(left) && !isMonomial(right))
+    return false;
+
+  for (size_t i = 0; i != left.variableCount(); ++i)
+    if (left.degree(i) + right.degree(i) > Polynomial::MaxDegree)
+      return false;
+
+  *out = left * right;
+  return true;
+}
+
+// Expands products and powers of sums, and evaluates the subexpressions
+// which do not mention @p variables, if @p t is given.
+bool recognizeNode(const Expr* e,
+                   const std::vector<Symbol>& variables,
+                   const SymbolTable* t,
+                   Polynomial* out) {
+  const size_t n = variables.size();
+
+  if (auto p = dynamic_cast<const PolynomialExpr*>(e))
+    return recognizeNode(p->source(), variables, t, out);
+
+  if (t && !mentions(e, variables)) {
+    *out = Polynomial(n, e->calculate(*t));
+    return true;
+  }
+
+  if (auto i = dynamic_cast<const NumberExpr*>(e)) {
+    *out = Polynomial(n, i->getNumber());
+    return true;
+  }
+
+  if (auto s = dynamic_cast<const SymbolExpr*>(e)) {
+    auto i = std::find(variables.begin(), variables.end(), s->symbolName());
+    if (i == variables.end())
+      return false;
+    *out = Polynomial::variable(n, i - variables.begin());
+    return true;
+  }
+
+  if (auto neg = dynamic_cast<const NegExpr*>(e)) {
+    if (!recognizeNode(neg->subExpr(), variables, t, out))
+      return false;
+    *out = -*out;
+    return true;
+  }
+
+  // chains fold left to right, as the binary ones nest
+  if (auto sum = dynamic_cast<const SumExpr*>(e)) {
+    if (!recognizeNode(sum->terms()[0].expr.get(), variables, t, out))
+      return false;
+
+    for (size_t i = 1; i < sum->terms().size(); ++i) {
+      const SumExpr::Term& term = sum->terms()[i];
+      Polynomial right;
+      if (!recognizeNode(term.expr.get(), variables, t, &right))
+        return false;
+      *out = term.subtract ? *out - right : *out + right;
+      if (!fits(*out))
+        return false;
+    }
+    return true;
+  }
+
+  if (auto product = dynamic_cast<const ProductExpr*>(e)) {
+    if (!recognizeNode(product->factors()[0].get(), variables, t, out))
+      return false;
+
+    for (size_t i = 1; i < product->factors().size(); ++i) {
+      Polynomial right;
+      if (!recognizeNode(product->factors()[i].get(), variables, t, &right) ||
+          !multiply(*out, right, t != nullptr, out) || !fits(*out))
+        return false;
+    }
+    return true;
+  }
+
+  auto b = dynamic_cast<const BinaryExpr*>(e);
+  if (!b)
+    return false;
+
+  const bool plus = dynamic_cast<const PlusExpr*>(e) != nullptr;
+  const bool minus = dynamic_cast<const MinusExpr*>(e) != nullptr;
+  const bool times = dynamic_cast<const MulExpr*>(e) != nullptr;
+  const bool div = dynamic_cast<const DivExpr*>(e) != nullptr;
+  const bool pow = dynamic_cast<const PowExpr*>(e) != nullptr;
+  if (!plus && !minus && !times && !div && !pow)
+    return false;
+
+  Polynomial left, right;
+  if (!recognizeNode(b->left(), variables, t, &left) ||
+      !recognizeNode(b->right(), variables, t, &right))
+    return false;
+
+  if (plus) {
+    *out = left + right;
+  } else if (minus) {
+    *out = left - right;
+  } else if (times) {
+    if (!multiply(left, right, t != nullptr, out))
+      return false;
+  } else if (div) {
+    if (!right.isConstant() || right.isZero())
+      return false;
+    *out = left * Polynomial(n, 1.0 / right.terms()[0].coefficient);
+  } else {
+    if (!right.isConstant())
+      return false;
+
+    const Number y = right.isZero() ? Number() : right.terms()[0].coefficient;
+
+    // constant powers are folded as PowExpr computes them
+    if (left.isConstant()) {
+      const Number x = left.isZero() ? Number() : left.terms()[0].coefficient;
+      *out = Polynomial(n, !x.imag() && x.real() == M_E ? std::exp(y) : std::pow(x, y));
+      return true;
+    }
+
+    if (y.imag() || y.real() < 0 || y.real() > Polynomial::MaxDegree ||
+        y.real() != std::floor(y.real()) || (!t && !isMonomial(left)))
+      return false;
+
+    unsigned k = static_cast<unsigned>(y.real());
+    for (size_t i = 0; i != n; ++i)
+      if (left.degree(i) * k > Polynomial::MaxDegree)
+        return false;
+
+    Polynomial result(n, 1);
+    for (;;) {
+      if (k & 1)
+        result = result * left;
+      k >>= 1;
+      if (!k || !fits(result))
+        break;
+      left = left * left;
+    }
+    *out = std::move(result);
+  }
+
+  return fits(*out);
+}
+
+}  // namespace
+
+bool Polynomial::recognize(const Expr* e,
+                           const std::vector<Symbol>& variables,
+                           Polynomial* out) {
+  if (variables.size() > MaxVariables)
+    return false;
+
+  return recognizeNode(e, variables, nullptr, out);
+}
+
+bool Polynomial::expand(const Expr* e,
+                        const std::vector<Symbol>& variables,
+                        const SymbolTable& t,
+                        Polynomial* out) {
+  if (variables.size() > MaxVariables)
+    return false;
+
+  return recognizeNode(e, variables, &t, out);
+}
+// }}}
+// {{{ PolynomialExpr
+PolynomialExpr::PolynomialExpr(Polynomial&& polynomial,
+                               std::vector<std::unique_ptr<Expr>>&& variables,
+                               std::unique_ptr<Expr>&& source)
+    : Expr(source->precedence()),
+      polynomial_(std::move(polynomial)),
+      variables_(std::move(variables)),
+      source_(std::move(source)) {}
+
+void PolynomialExpr::print(std::string* out) const {
+  source_->print(out);
+}
+
+Number PolynomialExpr::calculate(const SymbolTable& t) const {
+  Number x[Polynomial::MaxVariables];
+  for (size_t i = 0; i != variables_.size(); ++i)
+    x[i] = variables_[i]->calculate(t);
+
+  return polynomial_.evaluate(x);
+}
+
+Value PolynomialExpr::evaluate(const SymbolTable& t) const {
+  ValueList values;
+  for (const std::unique_ptr<Expr>& v : variables_)
+    values.emplace_back(v->evaluate(t));
+
+  // matrices do not commute, so their products are taken as written
+  if (std::any_of(values.begin(), values.end(), [](const Value& v) { return v.isMatrix(); }))
+    return source_->evaluate(t);
+
+  size_t n = 0;
+  if (!broadcastSize(values, &n))
+    return Number(std::nan(""));
+
+  // element by element from the coefficients, as for numbers
+  Number x[Polynomial::MaxVariables];
+  Tuple result(n);
+  for (size_t k = 0; k != n; ++k) {
+    for (size_t i = 0; i != values.size(); ++i)
+      x[i] = element(values[i], k);
+    result.set(k, polynomial_.evaluate(x));
+  }
+
+  if (std::none_of(values.begin(), values.end(), [](const Value& v) { return v.isTuple(); }))
+    return result[0];
+
+  return Value(std::move(result));
+}
+
+std::unique_ptr<Expr> PolynomialExpr::clone() const {
+  std::vector<std::unique_ptr<Expr>> variables;
+  for (const std::unique_ptr<Expr>& v : variables_)
+    variables.emplace_back(v->clone());
+
+  return std::make_unique<PolynomialExpr>(Polynomial(polynomial_), std::move(variables),
+                                          source_->clone());
+}
+
+bool PolynomialExpr::compare(const Expr* other) const {
+  if (auto e = dynamic_cast<const PolynomialExpr*>(other))
+    return source_->compare(e->source_.get());
+
+  return source_->compare(other);
+}
+// }}}
+// {{{ compilePolynomials
+namespace {
+
+// Collects the distinct symbols of @p e, in order of their first
+// occurrence, unless @p e contains nodes no polynomial is made of.
+bool collectSymbols(const Expr* e, std::vector<const SymbolExpr*>* out) {
+  if (dynamic_cast<const NumberExpr*>(e))
+    return true;
+
+  if (auto s = dynamic_cast<const SymbolExpr*>(e)) {
+    auto i = std::find_if(out->begin(), out->end(), [&](const SymbolExpr* t) {
+      return t->symbolName() == s->symbolName();
+    });
+    if (i == out->end())
+      out->push_back(s);
+    return out->size() <= Polynomial::MaxVariables;
+  }
+
+  if (auto n = dynamic_cast<const NegExpr*>(e))
+    return collectSymbols(n->subExpr(), out);
+
+  if (dynamic_cast<const PlusExpr*>(e) || dynamic_cast<const MinusExpr*>(e) ||
+      dynamic_cast<const MulExpr*>(e) || dynamic_cast<const DivExpr*>(e) ||
+      dynamic_cast<const PowExpr*>(e)) {
+    auto b = static_cast<const BinaryExpr*>(e);
+    return collectSymbols(b->left(), out) && collectSymbols(b->right(), out);
+  }
+
+  if (auto sum = dynamic_cast<const SumExpr*>(e))
+    return std::all_of(sum->terms().begin(), sum->terms().end(),
+                       [&](const SumExpr::Term& term) {
+                         return collectSymbols(term.expr.get(), out);
+                       });
+
+  if (auto product = dynamic_cast<const ProductExpr*>(e))
+    return std::all_of(product->factors().begin(), product->factors().end(),
+                       [&](const std::unique_ptr<Expr>& factor) {
+                         return collectSymbols(factor.get(), out);
+                       });
+
+  return false;
+}
+
+std::unique_ptr<Expr> compilePolynomial(const Expr* e) {
+  std::vector<const SymbolExpr*> symbols;
+  if (!collectSymbols(e, &symbols) || symbols.empty())
+    return nullptr;
+
+  std::vector<Symbol> names;
+  for (const SymbolExpr* s : symbols)
+    names.push_back(s->symbolName());
+
+  Polynomial p;
+  if (!Polynomial::recognize(e, names, &p))
+    return nullptr;
+
+  // linear ones gain nothing over the tree
+  unsigned degree = 0;
+  for (const Polynomial::Term& term : p.terms()) {
+    unsigned d = 0;
+    for (unsigned k : term.exponents)
+      d += k;
+    degree = std::max(degree, d);
+  }
+  if (degree < 2)
+    return nullptr;
+
+  std::vector<std::unique_ptr<Expr>> variables;
+  for (const SymbolExpr* s : symbols)
+    variables.emplace_back(s->clone());
+
+  return std::make_unique<PolynomialExpr>(std::move(p), std::move(variables), e->clone());
+}
+
+template <typename T>
+std::unique_ptr<Expr> compileBinary(const T* e) {
+  return std::make_unique<T>(compilePolynomials(e->left()), compilePolynomials(e->right()));
+}
+
+}  // namespace
+
+std::unique_ptr<Expr> compilePolynomials(const Expr* e) {
+  if (std::unique_ptr<Expr> p = compilePolynomial(e))
+    return p;
+
+  if (auto n = dynamic_cast<const NegExpr*>(e))
+    return std::make_unique<NegExpr>(compilePolynomials(n->subExpr()));
+
+  if (auto f = dynamic_cast<const FacExpr*>(e))
+    return std::make_unique<FacExpr>(compilePolynomials(f->subExpr()));
+
+  if (auto sum = dynamic_cast<const SumExpr*>(e)) {
+    std::vector<SumExpr::Term> terms;
+    for (const SumExpr::Term& term : sum->terms())
+      terms.emplace_back(
+          SumExpr::Term{compilePolynomials(term.expr.get()), term.subtract});
+    return std::make_unique<SumExpr>(std::move(terms));
+  }
+
+  if (auto product = dynamic_cast<const ProductExpr*>(e)) {
+    ProductExpr::FactorList factors;
+    for (const std::unique_ptr<Expr>& factor : product->factors())
+      factors.emplace_back(compilePolynomials(factor.get()));
+    return std::make_unique<ProductExpr>(std::move(factors));
+  }
+
+  if (auto b = dynamic_cast<const PlusExpr*>(e))
+    return compileBinary(b);
+  if (auto b = dynamic_cast<const MinusExpr*>(e))
+    return compileBinary(b);
+  if (auto b = dynamic_cast<const MulExpr*>(e))
+    return compileBinary(b);
+  if (auto b = dynamic_cast<const DivExpr*>(e))
+    return compileBinary(b);
+  if (auto b = dynamic_cast<const PowExpr*>(e))
+    return compileBinary(b);
+  if (auto b = dynamic_cast<const EquExpr*>(e))
+    return compileBinary(b);
+  if (auto b = dynamic_cast<const LessExpr*>(e))
+    return compileBinary(b);
+
+  if (auto d = dynamic_cast<const DefineExpr*>(e))  // left-hand side must stay a symbol
+    return std::make_unique<DefineExpr>(d->left()->clone(), compilePolynomials(d->right()));
+
+  if (auto d = dynamic_cast<const DefineMappingExpr*>(e))
+    return std::make_unique<DefineMappingExpr>(d->symbolName(), d->inputs(),
+                                               compilePolynomials(d->body()));
+
+  if (auto c = dynamic_cast<const CallExpr*>(e)) {
+    CallExpr::ParamList args;
+    for (const std::unique_ptr<Expr>& input : c->inputs())
+      args.emplace_back(compilePolynomials(input.get()));
+    return std::make_unique<CallExpr>(c->symbolName(), c->mapping(), std::move(args));
+  }
+
+  return e->clone();
+}
+// }}}
+
+}  // namespace cmath
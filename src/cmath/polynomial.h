@@ -0,0 +1,157 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cmath {
+
+/**
+ * Multivariate polynomial with Number coefficients, as a sparse list of
+ * terms.
+ *
+ * Evaluation uses Horner's scheme, nested per variable; univariate
+ * polynomials with real coefficients at real points are evaluated in plain
+ * double arithmetic, by Estrin's scheme from EstrinDegree on.
+ */
+class Polynomial {
+ public:
+  using Exponents = std::vector<unsigned>;
+
+  struct Term {
+    Exponents exponents;  // one per variable
+    Number coefficient;
+  };
+
+  // Recognition gives up beyond these, leaving the expression as it is.
+  static constexpr size_t MaxVariables = 8;
+  static constexpr unsigned MaxDegree = 1024;
+  static constexpr size_t MaxTerms = 1024;
+
+  // Estrin's scheme pays off from about this degree on.
+  static constexpr unsigned EstrinDegree = 24;
+
+  /// The zero polynomial in @p variableCount variables.
+  explicit Polynomial(size_t variableCount = 0);
+
+  /// The constant @p c.
+  Polynomial(size_t variableCount, Number c);
+
+  /// The variable with the given index.
+  static Polynomial variable(size_t variableCount, size_t index);
+
+  /**
+   * Recognizes @p e as a polynomial in @p variables with numeric
+   * coefficients.
+   *
+   * Sums, differences, negations, divisions by constants, powers of
+   * monomials with constant natural exponents and products with at least
+   * one monomial factor are accepted. Products and powers of sums are not
+   * expanded, as evaluating their expansion may cancel catastrophically
+   * where the factored form does not.
+   *
+   * @retval true @p out holds the polynomial.
+   * @retval false @p e is no polynomial in @p variables, or too large.
+   */
+  static bool recognize(const Expr* e, const std::vector<Symbol>& variables, Polynomial* out);
+
+  /**
+   * Like recognize(), but also multiplies out products and powers of sums,
+   * and takes any subexpression that does not mention @p variables as a
+   * constant, with its value in @p t. Meant for finding roots rather than
+   * evaluation.
+   */
+  static bool expand(const Expr* e,
+                     const std::vector<Symbol>& variables,
+                     const SymbolTable& t,
+                     Polynomial* out);
+
+  size_t variableCount() const noexcept { return variableCount_; }
+  const std::vector<Term>& terms() const noexcept { return terms_; }
+
+  bool isZero() const noexcept { return terms_.empty(); }
+  bool isConstant() const noexcept;
+
+  /// Highest exponent of variable @p index.
+  unsigned degree(size_t index = 0) const;
+
+  /// Coefficients of a univariate polynomial, lowest power first.
+  std::vector<Number> coefficients() const;
+
+  /// Value at @p x, one Number per variable.
+  Number evaluate(const Number* x) const;
+
+  Polynomial operator-() const;
+
+  friend Polynomial operator+(const Polynomial& a, const Polynomial& b);
+  friend Polynomial operator-(const Polynomial& a, const Polynomial& b);
+  friend Polynomial operator*(const Polynomial& a, const Polynomial& b);
+
+  /// Renders the terms, highest first, e.g. "2*x0^3 - 3*x0^2 + 1".
+  std::string str() const;
+
+ private:
+  void normalize();
+  void prepare();
+
+  template <typename T>
+  T horner(const T* coefficients, const T* x, size_t begin, size_t end, size_t var) const;
+
+ private:
+  size_t variableCount_;
+  std::vector<Term> terms_;  // exponents descending, no zero coefficients
+
+  // evaluation helpers, derived from terms_
+  bool real_;  // all coefficients real
+  std::vector<Number> coefficients_;
+  std::vector<double> realCoefficients_;
+  std::vector<double> dense_;  // univariate and real: by power, lowest first
+};
+
+/**
+ * Polynomial subtree, evaluated by its coefficients instead of node by
+ * node.
+ *
+ * Prints, clones and compares as the expression it was recognized from,
+ * so it can stand in for it anywhere.
+ */
+class PolynomialExpr : public Expr {
+ public:
+  PolynomialExpr(Polynomial&& polynomial,
+                 std::vector<std::unique_ptr<Expr>>&& variables,
+                 std::unique_ptr<Expr>&& source);
+
+  const Polynomial& polynomial() const noexcept { return polynomial_; }
+
+  /// The symbols, which are evaluated for the variables' values.
+  const std::vector<std::unique_ptr<Expr>>& variables() const noexcept { return variables_; }
+
+  /// The expression this was recognized from.
+  const Expr* source() const noexcept { return source_.get(); }
+
+  void print(std::string* out) const override;
+  Number calculate(const SymbolTable& t) const override;
+  Value evaluate(const SymbolTable& t) const override;
+  std::unique_ptr<Expr> clone() const override;
+  bool compare(const Expr* other) const override;
+
+ private:
+  Polynomial polynomial_;
+  std::vector<std::unique_ptr<Expr>> variables_;
+  std::unique_ptr<Expr> source_;
+};
+
+/**
+ * Replaces the polynomial subtrees of @p e of degree two or more by
+ * PolynomialExpr nodes; everything else is copied as it is.
+ */
+std::unique_ptr<Expr> compilePolynomials(const Expr* e);
+
+}  // namespace cmath
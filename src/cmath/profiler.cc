@@ -0,0 +1,377 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/polynomial.h>
+#include <cmath/profiler.h>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+namespace cmath {
+
+namespace {
+
+/**
+ * Timing probe around one node of an instrumented tree.
+ */
+class ProfiledExpr : public Expr {
+ public:
+  ProfiledExpr(Profiler* profiler,
+               Profiler::Counter* kind,
+               Profiler::Counter* target,
+               std::unique_ptr<Expr>&& inner)
+      : Expr(inner->precedence()),
+        profiler_(profiler),
+        kind_(kind),
+        target_(target),
+        inner_(std::move(inner)) {}
+
+  void print(std::string* out) const override { inner_->print(out); }
+
+  Number calculate(const SymbolTable& t) const override {
+    return time([&]() { return inner_->calculate(t); });
+  }
+
+  Value evaluate(const SymbolTable& t) const override {
+    return time([&]() { return inner_->evaluate(t); });
+  }
+
+  std::unique_ptr<Expr> clone() const override {
+    return std::make_unique<ProfiledExpr>(profiler_, kind_, target_, inner_->clone());
+  }
+
+  bool compare(const Expr* other) const override {
+    if (auto p = dynamic_cast<const ProfiledExpr*>(other))
+      return inner_->compare(p->inner_.get());
+
+    return inner_->compare(other);
+  }
+
+ private:
+  template <typename F>
+  auto time(F f) const -> decltype(f()) {
+    profiler_->enter();
+    const Profiler::Clock::time_point start = Profiler::Clock::now();
+    auto result = f();
+    profiler_->leave(kind_, target_, Profiler::Clock::now() - start);
+    return result;
+  }
+
+ private:
+  Profiler* profiler_;
+  Profiler::Counter* kind_;
+  Profiler::Counter* target_;
+  std::unique_ptr<Expr> inner_;
+};
+
+}  // namespace
+
+/**
+ * Instrumented stand-in for a CustomMappingDef.
+ */
+class Profiler::ProfiledMappingDef : public MappingDef {
+ public:
+  ProfiledMappingDef(Profiler* profiler, Counter* counter, const CustomMappingDef* def)
+      : profiler_(profiler), counter_(counter), def_(def), body_() {}
+
+  void setBody(std::unique_ptr<Expr>&& body) { body_ = std::move(body); }
+
+  Number call(const SymbolTable& t, const NumberList& inputs) const override {
+    profiler_->enter();
+    const Clock::time_point start = Clock::now();
+
+    SymbolTable st(&t);
+    const CustomMappingDef::SymbolList& params = def_->inputs();
+    for (size_t i = 0, e = params.size(); i != e; ++i)
+      st.defineConstant(params[i], i < inputs.size() ? inputs[i] : std::nan(""));
+    Number result = body_->calculate(st);
+
+    profiler_->leave(counter_, nullptr, Clock::now() - start);
+    return result;
+  }
+
+  Value evaluate(const SymbolTable& t, const ValueList& inputs) const override {
+    profiler_->enter();
+    const Clock::time_point start = Clock::now();
+
+    SymbolTable st(&t);
+    const CustomMappingDef::SymbolList& params = def_->inputs();
+    for (size_t i = 0, e = params.size(); i != e; ++i)
+      st.defineConstant(params[i], i < inputs.size() ? inputs[i] : Value(std::nan("")));
+    Value result = body_->evaluate(st);
+
+    profiler_->leave(counter_, nullptr, Clock::now() - start);
+    return result;
+  }
+
+  std::string str() const override { return def_->str(); }
+
+ private:
+  Profiler* profiler_;
+  Counter* counter_;
+  const CustomMappingDef* def_;
+  std::unique_ptr<Expr> body_;
+};
+
+// {{{ Profiler::Phase
+Profiler::Phase::Phase(Profiler* profiler, const char* name)
+    : profiler_(profiler), name_(name), start_() {
+  if (profiler_)
+    start_ = Clock::now();
+}
+
+Profiler::Phase::~Phase() {
+  if (profiler_)
+    profiler_->events_.push_back(Event{name_, start_, Clock::now() - start_});
+}
+// }}}
+// {{{ Profiler
+Profiler::Profiler()
+    : origin_(Clock::now()), counters_(), childTime_(), events_(), mappings_() {}
+
+Profiler::~Profiler() {}
+
+Profiler::Counter* Profiler::counter(const std::string& name) {
+  std::unique_ptr<Counter>& c = counters_[name];
+  if (!c) {
+    c = std::make_unique<Counter>();
+    c->name = name;
+  }
+  return c.get();
+}
+
+void Profiler::enter() {
+  childTime_.push_back(Clock::duration::zero());
+}
+
+void Profiler::leave(Counter* primary, Counter* secondary, Clock::duration elapsed) {
+  const Clock::duration self = elapsed - childTime_.back();
+  childTime_.pop_back();
+  if (!childTime_.empty())
+    childTime_.back() += elapsed;
+
+  for (Counter* c : {primary, secondary}) {
+    if (c) {
+      c->count++;
+      c->total += elapsed;
+      c->self += self;
+    }
+  }
+}
+
+void Profiler::reset() {
+  counters_.clear();
+  mappings_.clear();
+  childTime_.clear();
+  events_.clear();
+  origin_ = Clock::now();
+}
+
+std::unique_ptr<Expr> Profiler::instrument(const Expr* e) {
+  return instrumentNode(e);
+}
+
+const MappingDef* Profiler::instrumentMapping(const Symbol& name, const MappingDef* m) {
+  auto custom = dynamic_cast<const CustomMappingDef*>(m);
+  if (!custom)
+    return m;
+
+  auto i = mappings_.find(m);
+  if (i != mappings_.end())
+    return i->second.get();
+
+  // register before instrumenting the body, so recursive calls find it
+  auto p = std::make_unique<ProfiledMappingDef>(this, counter("mapping " + name), custom);
+  ProfiledMappingDef* profiled = p.get();
+  mappings_[m] = std::move(p);
+  profiled->setBody(instrumentNode(custom->expr()));
+  return profiled;
+}
+
+std::unique_ptr<Expr> Profiler::instrumentNode(const Expr* e) {
+  auto wrap = [this](const char* kind, std::unique_ptr<Expr>&& inner,
+                     Counter* target = nullptr) -> std::unique_ptr<Expr> {
+    return std::make_unique<ProfiledExpr>(this, counter(std::string("node ") + kind),
+                                          target, std::move(inner));
+  };
+
+  auto binary = [&](const char* kind, auto* b) {
+    using T = std::remove_const_t<std::remove_pointer_t<decltype(b)>>;
+    return wrap(kind, std::make_unique<T>(instrumentNode(b->left()),
+                                          instrumentNode(b->right())));
+  };
+
+  // a case tells relations from other conditions by their node, so those
+  // stay unwrapped
+  auto condition = [&](const Expr* c) -> std::unique_ptr<Expr> {
+    if (auto r = dynamic_cast<const EquExpr*>(c))
+      return std::make_unique<EquExpr>(instrumentNode(r->left()),
+                                       instrumentNode(r->right()));
+    if (auto r = dynamic_cast<const LessExpr*>(c))
+      return std::make_unique<LessExpr>(instrumentNode(r->left()),
+                                        instrumentNode(r->right()));
+    return instrumentNode(c);
+  };
+
+  if (dynamic_cast<const NumberExpr*>(e))
+    return wrap("NumberExpr", e->clone());
+
+  if (dynamic_cast<const SymbolExpr*>(e))
+    return wrap("SymbolExpr", e->clone());
+
+  if (dynamic_cast<const PolynomialExpr*>(e))
+    return wrap("PolynomialExpr", e->clone());
+
+  if (auto n = dynamic_cast<const NegExpr*>(e))
+    return wrap("NegExpr", std::make_unique<NegExpr>(instrumentNode(n->subExpr())));
+
+  if (auto f = dynamic_cast<const FacExpr*>(e))
+    return wrap("FacExpr", std::make_unique<FacExpr>(instrumentNode(f->subExpr())));
+
+  if (auto b = dynamic_cast<const PlusExpr*>(e))
+    return binary("PlusExpr", b);
+  if (auto b = dynamic_cast<const MinusExpr*>(e))
+    return binary("MinusExpr", b);
+  if (auto b = dynamic_cast<const MulExpr*>(e))
+    return binary("MulExpr", b);
+  if (auto b = dynamic_cast<const DivExpr*>(e)) {
+    // a literal divisor stays one, so that it is still multiplied by its
+    // reciprocal
+    if (dynamic_cast<const NumberExpr*>(b->right()))
+      return wrap("DivExpr", std::make_unique<DivExpr>(instrumentNode(b->left()),
+                                                       b->right()->clone()));
+    return binary("DivExpr", b);
+  }
+  if (auto sum = dynamic_cast<const SumExpr*>(e)) {
+    std::vector<SumExpr::Term> terms;
+    for (const SumExpr::Term& term : sum->terms())
+      terms.emplace_back(SumExpr::Term{instrumentNode(term.expr.get()), term.subtract});
+    return wrap("SumExpr", std::make_unique<SumExpr>(std::move(terms)));
+  }
+  if (auto product = dynamic_cast<const ProductExpr*>(e)) {
+    ProductExpr::FactorList factors;
+    for (const std::unique_ptr<Expr>& factor : product->factors())
+      factors.emplace_back(instrumentNode(factor.get()));
+    return wrap("ProductExpr", std::make_unique<ProductExpr>(std::move(factors)));
+  }
+  if (auto b = dynamic_cast<const PowExpr*>(e))
+    return binary("PowExpr", b);
+  if (auto b = dynamic_cast<const EquExpr*>(e))
+    return binary("EquExpr", b);
+  if (auto b = dynamic_cast<const LessExpr*>(e))
+    return binary("LessExpr", b);
+
+  if (auto d = dynamic_cast<const DefineExpr*>(e))  // left-hand side must stay a symbol
+    return wrap("DefineExpr", std::make_unique<DefineExpr>(d->left()->clone(),
+                                                           instrumentNode(d->right())));
+
+  if (dynamic_cast<const DefineMappingExpr*>(e))
+    return wrap("DefineMappingExpr", e->clone());
+
+  if (auto tuple = dynamic_cast<const TupleExpr*>(e)) {
+    TupleExpr::ElementList elements;
+    for (const std::unique_ptr<Expr>& element : tuple->elements())
+      elements.emplace_back(instrumentNode(element.get()));
+    return wrap("TupleExpr", std::make_unique<TupleExpr>(std::move(elements)));
+  }
+
+  if (auto c = dynamic_cast<const CaseExpr*>(e)) {
+    CaseExpr::CaseList cases;
+    for (const CaseExpr::CaseMatch& m : c->cases())
+      cases.emplace_back(condition(m.first.get()), instrumentNode(m.second.get()));
+    return wrap("CaseExpr",
+                std::make_unique<CaseExpr>(std::move(cases), instrumentNode(c->elseExpr())));
+  }
+
+  // a series hands its body to Series, which inspects and compiles it, so
+  // it is timed as a whole
+  if (dynamic_cast<const SeriesExpr*>(e))
+    return wrap("SeriesExpr", e->clone());
+
+  if (auto c = dynamic_cast<const CallExpr*>(e)) {
+    // a form, such as solve(), inspects its arguments, so those are left as
+    // they are and timed as part of the call
+    const bool form = dynamic_cast<const FormDef*>(c->mapping()) != nullptr;
+    CallExpr::ParamList args;
+    for (const std::unique_ptr<Expr>& input : c->inputs())
+      args.emplace_back(form ? input->clone() : instrumentNode(input.get()));
+
+    const MappingDef* m = instrumentMapping(c->symbolName(), c->mapping());
+    return wrap("CallExpr",
+                std::make_unique<CallExpr>(c->symbolName(), m, std::move(args)),
+                counter("call " + c->symbolName()));
+  }
+
+  // anything else is timed as a whole
+  return wrap("Expr", e->clone());
+}
+
+std::vector<const Profiler::Counter*> Profiler::hotspots() const {
+  std::vector<const Counter*> result;
+  for (const auto& c : counters_)
+    if (c.second->count)
+      result.push_back(c.second.get());
+
+  std::stable_sort(result.begin(), result.end(), [](const Counter* a, const Counter* b) {
+    return a->self > b->self;
+  });
+
+  return result;
+}
+
+void Profiler::report(std::ostream& os, uint64_t iterations) const {
+  using std::chrono::duration_cast;
+  using std::chrono::nanoseconds;
+
+  if (iterations == 0)
+    iterations = 1;
+
+  // node and mapping self times partition the profiled time, calls overlap
+  // with their CallExpr nodes
+  Clock::duration overall = Clock::duration::zero();
+  for (const auto& c : counters_)
+    if (c.first.compare(0, 5, "call ") != 0)
+      overall += c.second->self;
+
+  auto ns = [&](Clock::duration d) {
+    return static_cast<double>(duration_cast<nanoseconds>(d).count()) / iterations;
+  };
+
+  os << std::left << std::setw(24) << "hotspot" << std::right
+     << std::setw(12) << "calls" << std::setw(14) << "total ns"
+     << std::setw(14) << "self ns" << std::setw(8) << "self%" << '\n';
+
+  for (const Counter* c : hotspots()) {
+    const double share = overall.count() ? 100.0 * c->self.count() / overall.count() : 0;
+    os << std::left << std::setw(24) << c->name << std::right
+       << std::setw(12) << (c->count / iterations)
+       << std::setw(14) << std::fixed << std::setprecision(1) << ns(c->total)
+       << std::setw(14) << ns(c->self)
+       << std::setw(8) << share << '\n';
+  }
+  os.unsetf(std::ios::floatfield);
+}
+
+void Profiler::writeTrace(std::ostream& os) const {
+  using microseconds = std::chrono::duration<double, std::micro>;
+  using std::chrono::duration_cast;
+
+  os << "{\"traceEvents\":[";
+  for (size_t i = 0; i < events_.size(); ++i) {
+    const Event& e = events_[i];
+    os << (i ? ",\n" : "\n")
+       << "{\"name\":\"" << e.name << "\",\"cat\":\"cmath\",\"ph\":\"X\""
+       << ",\"ts\":" << duration_cast<microseconds>(e.start - origin_).count()
+       << ",\"dur\":" << duration_cast<microseconds>(e.duration).count()
+       << ",\"pid\":1,\"tid\":1}";
+  }
+  os << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+// }}}
+
+}  // namespace cmath
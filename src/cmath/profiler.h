@@ -0,0 +1,109 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cmath {
+
+/**
+ * Opt-in evaluation profiler.
+ *
+ * Profiling works on an instrumented copy of the expression tree, created by
+ * instrument(), in which every node is wrapped into a timing probe. The
+ * original tree (and thus regular evaluation) is left untouched, so there is
+ * no cost at all unless a profiled copy is evaluated.
+ *
+ * Samples are aggregated per node kind (e.g. "PlusExpr"), per call target
+ * ("call sin") and per custom mapping ("mapping f"), recording inclusive and
+ * self time. Coarse phases (parse, compile, evaluate) are recorded as
+ * Chrome trace events, see writeTrace().
+ *
+ * The arguments of forms, such as solve(), and the bodies of series are
+ * left uninstrumented, as those inspect them, and count towards the call
+ * or series node.
+ */
+class Profiler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Counter {
+    std::string name;
+    uint64_t count = 0;
+    Clock::duration total{};  // inclusive
+    Clock::duration self{};   // exclusive of instrumented children
+  };
+
+  struct Event {
+    std::string name;
+    Clock::time_point start;
+    Clock::duration duration;
+  };
+
+  /// Records the lifetime of this object as a trace event named @p name.
+  class Phase {
+   public:
+    Phase(Profiler* profiler, const char* name);
+    ~Phase();
+
+   private:
+    Profiler* profiler_;
+    const char* name_;
+    Clock::time_point start_;
+  };
+
+  Profiler();
+  ~Profiler();
+
+  /**
+   * Creates a timing-instrumented copy of @p e.
+   *
+   * Custom mappings called from @p e are instrumented as well. The returned
+   * tree refers to this profiler and must not outlive it.
+   */
+  std::unique_ptr<Expr> instrument(const Expr* e);
+
+  /// Counters ordered by decreasing self time.
+  std::vector<const Counter*> hotspots() const;
+
+  const std::vector<Event>& events() const noexcept { return events_; }
+
+  /// Prints a hotspot table, with times divided by @p iterations.
+  void report(std::ostream& os, uint64_t iterations = 1) const;
+
+  /// Writes all recorded phases in Chrome's trace-event JSON format.
+  void writeTrace(std::ostream& os) const;
+
+  /// Discards all samples. Previously instrumented trees become invalid.
+  void reset();
+
+  // probe interface, used by instrumented nodes
+  Counter* counter(const std::string& name);
+  void enter();
+  void leave(Counter* primary, Counter* secondary, Clock::duration elapsed);
+
+ private:
+  class ProfiledMappingDef;
+  std::unique_ptr<Expr> instrumentNode(const Expr* e);
+  const MappingDef* instrumentMapping(const Symbol& name, const MappingDef* m);
+
+ private:
+  Clock::time_point origin_;
+  std::map<std::string, std::unique_ptr<Counter>> counters_;
+  std::vector<Clock::duration> childTime_;  // per active probe
+  std::vector<Event> events_;
+  std::map<const MappingDef*, std::unique_ptr<ProfiledMappingDef>> mappings_;
+};
+
+}  // namespace cmath
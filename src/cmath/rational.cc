@@ -0,0 +1,480 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/rational.h>
+#include <cctype>
+#include <limits>
+#include <ostream>
+
+namespace cmath {
+
+using namespace natural;
+
+namespace {
+
+constexpr int64_t Int64Min = std::numeric_limits<int64_t>::min();
+constexpr int64_t Int64Max = std::numeric_limits<int64_t>::max();
+
+[[noreturn]] void fail(Rational::ErrorCode ec) {
+  throw make_error_code(ec);
+}
+
+uint64_t absolute(int64_t v) {
+  return v < 0 ? 0 - static_cast<uint64_t>(v) : static_cast<uint64_t>(v);
+}
+
+Limbs magnitude(uint64_t v) {
+  return v ? Limbs{v} : Limbs();
+}
+
+bool fitsInline(const Limbs& a) {
+  return a.empty() || (a.size() == 1 && a[0] <= uint64_t(Int64Max));
+}
+
+int64_t gcd64(int64_t a, int64_t b) {
+  return static_cast<int64_t>(natural::gcd(absolute(a), absolute(b)));
+}
+
+// signed a + b on magnitudes
+void addSigned(bool* negative, Limbs* a, bool bNegative, const Limbs& b) {
+  if (*negative == bNegative) {
+    *a = add(*a, b);
+  } else if (compare(*a, b) >= 0) {
+    *a = sub(*a, b);
+  } else {
+    *a = sub(b, *a);
+    *negative = bNegative;
+  }
+}
+}  // namespace
+
+// {{{ Rational
+Rational::Rational(long long v) : Rational() {
+  if (v == Int64Min)
+    big_ = std::make_unique<Big>(Big{true, Limbs{absolute(v)}, Limbs{1}});
+  else
+    num_ = v;
+}
+
+Rational::Rational(long long num, long long den) : Rational() {
+  if (den == 0)
+    fail(DivisionByZero);
+
+  if (num == Int64Min || den == Int64Min) {
+    *this = make((num < 0) != (den < 0), magnitude(absolute(num)), magnitude(absolute(den)));
+    return;
+  }
+
+  const int64_t g = gcd64(num, den);
+  num_ = den < 0 ? -num / g : num / g;
+  den_ = den < 0 ? -den / g : den / g;
+}
+
+Rational::Rational(const Rational& other)
+    : num_(other.num_),
+      den_(other.den_),
+      big_(other.big_ ? std::make_unique<Big>(*other.big_) : nullptr) {}
+
+Rational& Rational::operator=(const Rational& other) {
+  if (this != &other) {
+    num_ = other.num_;
+    den_ = other.den_;
+    big_ = other.big_ ? std::make_unique<Big>(*other.big_) : nullptr;
+  }
+  return *this;
+}
+
+Rational::~Rational() = default;
+
+Rational Rational::make(bool negative, Limbs&& num, Limbs&& den) {
+  if (num.empty())
+    return Rational();
+
+  if (num.size() == 1 && den.size() == 1) {
+    const uint64_t g = natural::gcd(num[0], den[0]);
+    num[0] /= g;
+    den[0] /= g;
+  } else {
+    const Limbs g = natural::gcd(num, den);
+    if (g != Limbs{1}) {
+      Limbs r;
+      divmod(num, g, &num, &r);
+      divmod(den, g, &den, &r);
+    }
+  }
+
+  Rational result;
+  if (fitsInline(num) && fitsInline(den)) {
+    result.num_ = negative ? -int64_t(num[0]) : int64_t(num[0]);
+    result.den_ = int64_t(den[0]);
+  } else {
+    result.big_ = std::make_unique<Big>(Big{negative, std::move(num), std::move(den)});
+  }
+  return result;
+}
+
+Rational::Big Rational::big() const {
+  if (big_)
+    return *big_;
+
+  return Big{num_ < 0, magnitude(absolute(num_)), magnitude(uint64_t(den_))};
+}
+
+Result<Rational> Rational::parse(std::string_view s) {
+  size_t i = 0;
+
+  // one unsigned decimal, as an exact fraction; inline unless it has more
+  // than 18 significant digits or a large exponent
+  auto decimal = [&](Rational* out) -> bool {
+    uint64_t small = 0;
+    Limbs digits;
+    bool spilled = false;
+    size_t digitCount = 0;
+    int64_t exponent = 0;
+
+    auto digit = [&](char ch) {
+      digitCount++;
+      if (!spilled && small < 100000000000000000ull) {  // 10^17
+        small = small * 10 + (ch - '0');
+        return;
+      }
+      if (!spilled) {
+        digits = magnitude(small);
+        spilled = true;
+      }
+      mulAddSmall(digits, 10, ch - '0');
+      trim(digits);
+    };
+
+    for (; i < s.size() && std::isdigit(static_cast<unsigned char>(s[i])); ++i)
+      digit(s[i]);
+
+    if (i < s.size() && s[i] == '.') {
+      for (++i; i < s.size() && std::isdigit(static_cast<unsigned char>(s[i])); ++i) {
+        digit(s[i]);
+        exponent--;
+      }
+    }
+
+    if (digitCount == 0)
+      return false;
+
+    if (i < s.size() && (s[i] == 'e' || s[i] == 'E')) {
+      ++i;
+      bool negativeExponent = false;
+      if (i < s.size() && (s[i] == '-' || s[i] == '+'))
+        negativeExponent = s[i++] == '-';
+
+      if (i == s.size() || !std::isdigit(static_cast<unsigned char>(s[i])))
+        return false;
+
+      int64_t e = 0;
+      for (; i < s.size() && std::isdigit(static_cast<unsigned char>(s[i])); ++i)
+        e = std::min<int64_t>(e * 10 + (s[i] - '0'), int64_t(1) << 40);
+
+      exponent += negativeExponent ? -e : e;
+    }
+
+    // 10^exponent must be materialized exactly
+    constexpr int64_t Limit = 1000000;
+    if (exponent > Limit || exponent < -Limit)
+      return false;
+
+    static const int64_t scale[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000,
+                                    100000000, 1000000000, 10000000000ll, 100000000000ll,
+                                    1000000000000ll, 10000000000000ll, 100000000000000ll,
+                                    1000000000000000ll, 10000000000000000ll,
+                                    100000000000000000ll, 1000000000000000000ll};
+    int64_t v = 0;
+    if (!spilled && exponent < 0 && exponent >= -18) {
+      *out = Rational(int64_t(small), scale[-exponent]);
+    } else if (!spilled && exponent >= 0 && exponent <= 18 &&
+               !__builtin_mul_overflow(int64_t(small), scale[exponent], &v)) {
+      *out = Rational(v);
+    } else {
+      if (!spilled)
+        digits = magnitude(small);
+      if (exponent >= 0)
+        *out = make(false, mul(digits, pow10(exponent)), Limbs{1});
+      else
+        *out = make(false, std::move(digits), pow10(-exponent));
+    }
+    return true;
+  };
+
+  bool negative = false;
+  if (i < s.size() && (s[i] == '-' || s[i] == '+'))
+    negative = s[i++] == '-';
+
+  Rational value;
+  if (!decimal(&value))
+    return InvalidSyntax;
+
+  if (i < s.size() && s[i] == '/') {
+    ++i;
+    Rational den;
+    if (!decimal(&den))
+      return InvalidSyntax;
+    if (den.isZero())
+      return DivisionByZero;
+    value = value / den;
+  }
+
+  if (i != s.size())
+    return InvalidSyntax;
+
+  return negative ? -value : value;
+}
+
+bool Rational::isNegative() const noexcept {
+  return big_ ? big_->negative : num_ < 0;
+}
+
+bool Rational::isInteger() const noexcept {
+  return big_ ? big_->den.size() == 1 && big_->den[0] == 1 : den_ == 1;
+}
+
+bool Rational::toInteger(int64_t* out) const noexcept {
+  if (big_ || den_ != 1)
+    return false;
+
+  *out = num_;
+  return true;
+}
+
+Rational::Limbs Rational::numerator() const {
+  return big_ ? big_->num : magnitude(absolute(num_));
+}
+
+Rational::Limbs Rational::denominator() const {
+  return big_ ? big_->den : magnitude(uint64_t(den_));
+}
+
+double Rational::toDouble() const {
+  // both exactly representable, so the division rounds correctly
+  constexpr uint64_t Exact = uint64_t(1) << 53;
+  if (!big_ && absolute(num_) <= Exact && uint64_t(den_) <= Exact)
+    return double(num_) / double(den_);
+
+  return toReal(53).toDouble();
+}
+
+Real Rational::toReal(size_t precision) const {
+  if (!big_)
+    return Real::ratio(num_ < 0, magnitude(absolute(num_)), magnitude(uint64_t(den_)),
+                       precision);
+
+  return Real::ratio(big_->negative, big_->num, big_->den, precision);
+}
+
+std::string Rational::str() const {
+  if (!big_)
+    return den_ == 1 ? std::to_string(num_)
+                     : std::to_string(num_) + '/' + std::to_string(den_);
+
+  std::string s = big_->negative ? "-" : "";
+  s += toDecimal(big_->num);
+  if (!isInteger()) {
+    s += '/';
+    s += toDecimal(big_->den);
+  }
+  return s;
+}
+
+Rational Rational::operator-() const {
+  Rational r(*this);
+  if (r.big_)
+    r.big_->negative = !r.big_->negative;
+  else
+    r.num_ = -r.num_;  // never INT64_MIN
+  return r;
+}
+
+Rational Rational::sum(const Rational& a, const Rational& b, bool subtract) {
+  if (!a.big_ && !b.big_) {
+    // Knuth, TAOCP vol. 2, 4.5.1: with g = gcd(b, d),
+    // a/b + c/d = (a (d/g) + c (b/g)) / (b/g d), and only gcd(t, g) is left
+    // to cancel
+    const int64_t c = subtract ? -b.num_ : b.num_;
+    const int64_t g = gcd64(a.den_, b.den_);
+    int64_t s, t, u, den;
+    if (!__builtin_mul_overflow(a.num_, b.den_ / g, &s) &&
+        !__builtin_mul_overflow(c, a.den_ / g, &t) && !__builtin_add_overflow(s, t, &u) &&
+        u != Int64Min) {
+      if (u == 0)
+        return Rational();
+
+      const int64_t h = g == 1 ? 1 : gcd64(u, g);
+      if (!__builtin_mul_overflow(a.den_ / g, b.den_ / h, &den)) {
+        Rational r;
+        r.num_ = u / h;
+        r.den_ = den;
+        return r;
+      }
+    }
+  }
+
+  Big x = a.big();
+  const Big y = b.big();
+  Limbs den = mul(x.den, y.den);
+  x.num = mul(x.num, y.den);
+  addSigned(&x.negative, &x.num, y.negative != subtract, mul(y.num, x.den));
+  return make(x.negative, std::move(x.num), std::move(den));
+}
+
+Rational operator+(const Rational& a, const Rational& b) {
+  return Rational::sum(a, b, false);
+}
+
+Rational operator-(const Rational& a, const Rational& b) {
+  return Rational::sum(a, b, true);
+}
+
+Rational operator*(const Rational& a, const Rational& b) {
+  if (a.isZero() || b.isZero())
+    return Rational();
+
+  if (!a.big_ && !b.big_) {
+    // cross-cancel first, the products are then in lowest terms
+    const int64_t g = gcd64(a.num_, b.den_);
+    const int64_t h = gcd64(b.num_, a.den_);
+    int64_t num, den;
+    if (!__builtin_mul_overflow(a.num_ / g, b.num_ / h, &num) && num != Int64Min &&
+        !__builtin_mul_overflow(a.den_ / h, b.den_ / g, &den)) {
+      Rational r;
+      r.num_ = num;
+      r.den_ = den;
+      return r;
+    }
+  }
+
+  Rational::Big x = a.big();
+  const Rational::Big y = b.big();
+  return Rational::make(x.negative != y.negative, mul(x.num, y.num), mul(x.den, y.den));
+}
+
+Rational operator/(const Rational& a, const Rational& b) {
+  if (b.isZero())
+    fail(Rational::DivisionByZero);
+
+  Rational reciprocal;
+  if (!b.big_) {
+    reciprocal.num_ = b.num_ < 0 ? -b.den_ : b.den_;
+    reciprocal.den_ = b.num_ < 0 ? -b.num_ : b.num_;
+  } else {
+    const Rational::Big& y = *b.big_;
+    reciprocal.big_ = std::make_unique<Rational::Big>(Rational::Big{y.negative, y.den, y.num});
+  }
+  return a * reciprocal;
+}
+
+int compare(const Rational& a, const Rational& b) {
+  if (!a.big_ && !b.big_) {
+    const __int128 x = __int128(a.num_) * b.den_;
+    const __int128 y = __int128(b.num_) * a.den_;
+    return x < y ? -1 : x > y ? 1 : 0;
+  }
+
+  const int sa = a.isZero() ? 0 : a.isNegative() ? -1 : 1;
+  const int sb = b.isZero() ? 0 : b.isNegative() ? -1 : 1;
+  if (sa != sb)
+    return sa < sb ? -1 : 1;
+
+  const Rational::Big x = a.big();
+  const Rational::Big y = b.big();
+  const int c = compare(mul(x.num, y.den), mul(y.num, x.den));
+  return sa < 0 ? -c : c;
+}
+
+Rational abs(const Rational& a) {
+  return a.isNegative() ? -a : a;
+}
+
+Rational floor(const Rational& a) {
+  if (a.isInteger())
+    return a;
+
+  if (!a.big_) {
+    const int64_t q = a.num_ / a.den_;  // rounds towards zero
+    return Rational(a.num_ < 0 ? q - 1 : q);
+  }
+
+  Limbs q, r;
+  divmod(a.big_->num, a.big_->den, &q, &r);
+  if (a.big_->negative)
+    q = add(q, Limbs{1});
+
+  return Rational::make(a.big_->negative, std::move(q), Limbs{1});
+}
+
+bool sqrt(const Rational& a, Rational* out) {
+  if (a.isNegative())
+    return false;
+
+  // in lowest terms, so both must be perfect squares
+  Limbs num = isqrt(a.numerator());
+  Limbs den = isqrt(a.denominator());
+  if (mul(num, num) != a.numerator() || mul(den, den) != a.denominator())
+    return false;
+
+  *out = Rational::make(false, std::move(num), std::move(den));
+  return true;
+}
+
+Rational pow(const Rational& a, int64_t n) {
+  if (n < 0) {
+    if (a.isZero())
+      throw make_error_code(Rational::DivisionByZero);
+    // -(n + 1) avoids overflowing on INT64_MIN
+    const Rational r = Rational(1) / a;
+    return pow(r, -(n + 1)) * r;
+  }
+
+  Rational result(1);
+  Rational base = a;
+  for (uint64_t i = static_cast<uint64_t>(n); i; i >>= 1) {
+    if (i & 1)
+      result = result * base;
+    if (i > 1)
+      base = base * base;
+  }
+  return result;
+}
+
+std::ostream& operator<<(std::ostream& os, const Rational& r) {
+  return os << r.str();
+}
+// }}}
+
+// {{{ Rational::ErrorCategory
+const Rational::ErrorCategory& Rational::ErrorCategory::get() {
+  static ErrorCategory c;
+  return c;
+}
+
+const char* Rational::ErrorCategory::name() const noexcept {
+  return "RationalError";
+}
+
+std::string Rational::ErrorCategory::message(int ec) const {
+  switch (static_cast<ErrorCode>(ec)) {
+    case InvalidSyntax:
+      return "Invalid rational number syntax";
+    case DivisionByZero:
+      return "Division by zero";
+    case NotRational:
+      return "Result is not a rational number";
+    case Undefined:
+      return "Result is undefined";
+    case UnsupportedExpr:
+      return "Expression cannot be calculated exactly";
+  }
+  return "Unknown error";
+}
+// }}}
+
+}  // namespace cmath
@@ -0,0 +1,156 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/natural.h>
+#include <cmath/real.h>
+#include <cmath/result.h>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace cmath {
+
+/**
+ * Exact rational number, always in lowest terms with a positive
+ * denominator.
+ *
+ * Numerator and denominator are kept inline as int64 while they fit, with
+ * overflow-checked arithmetic, so that everyday fractions such as
+ * 1/3 + 1/6 never touch the heap. On overflow a value is promoted to
+ * natural numbers of arbitrary size, and demoted again as soon as it fits.
+ *
+ * Division by zero throws Rational::DivisionByZero as std::error_code.
+ */
+class Rational {
+ public:
+  using Limbs = natural::Limbs;
+
+  enum ErrorCode {
+    InvalidSyntax = 1,
+    DivisionByZero,
+    NotRational,
+    Undefined,
+    UnsupportedExpr,
+  };
+  class ErrorCategory;
+
+  Rational() noexcept : num_(0), den_(1), big_() {}
+  Rational(int v) : Rational(static_cast<long long>(v)) {}
+  Rational(long v) : Rational(static_cast<long long>(v)) {}
+  Rational(long long v);
+  Rational(long long num, long long den);
+
+  Rational(const Rational& other);
+  Rational(Rational&& other) noexcept = default;
+  Rational& operator=(const Rational& other);
+  Rational& operator=(Rational&& other) noexcept = default;
+  ~Rational();
+
+  /**
+   * Parses a fraction or decimal number, such as "-1/3", "12.5" or
+   * "2.5e-3/7", exactly.
+   */
+  static Result<Rational> parse(std::string_view s);
+
+  /// Whether the value is held inline, without heap storage.
+  bool isSmall() const noexcept { return !big_; }
+
+  bool isZero() const noexcept { return !big_ && num_ == 0; }
+  bool isNegative() const noexcept;
+  bool isInteger() const noexcept;
+
+  /// Stores the value in @p out if it is an integer within 63 bits.
+  bool toInteger(int64_t* out) const noexcept;
+
+  /// Magnitudes of numerator and denominator.
+  Limbs numerator() const;
+  Limbs denominator() const;
+
+  /// Correctly rounded to the nearest double.
+  double toDouble() const;
+
+  /// Correctly rounded to @p precision bits.
+  Real toReal(size_t precision = Real::DefaultPrecision) const;
+
+  /// Renders as "n" or "n/d".
+  std::string str() const;
+
+  Rational operator-() const;
+
+  friend Rational operator+(const Rational& a, const Rational& b);
+  friend Rational operator-(const Rational& a, const Rational& b);
+  friend Rational operator*(const Rational& a, const Rational& b);
+  friend Rational operator/(const Rational& a, const Rational& b);
+
+  /// -1, 0 or 1.
+  friend int compare(const Rational& a, const Rational& b);
+
+  friend Rational floor(const Rational& a);
+
+  /// Stores sqrt(@p a) in @p out if it is rational.
+  friend bool sqrt(const Rational& a, Rational* out);
+
+ private:
+  struct Big {
+    bool negative;
+    Limbs num;
+    Limbs den;
+  };
+
+  /// Reduces @p num / @p den to lowest terms, demoting when it fits.
+  static Rational make(bool negative, Limbs&& num, Limbs&& den);
+  Big big() const;
+
+  static Rational sum(const Rational& a, const Rational& b, bool subtract);
+
+ private:
+  // value if !big_: num_ / den_, with den_ > 0 and num_ != INT64_MIN
+  int64_t num_;
+  int64_t den_;
+  std::unique_ptr<Big> big_;
+};
+
+int compare(const Rational& a, const Rational& b);
+
+Rational abs(const Rational& a);
+Rational floor(const Rational& a);
+bool sqrt(const Rational& a, Rational* out);
+
+/// @p a to the power of @p n, by binary powering.
+Rational pow(const Rational& a, int64_t n);
+
+inline bool operator==(const Rational& a, const Rational& b) { return compare(a, b) == 0; }
+inline bool operator!=(const Rational& a, const Rational& b) { return compare(a, b) != 0; }
+inline bool operator<(const Rational& a, const Rational& b) { return compare(a, b) < 0; }
+inline bool operator>(const Rational& a, const Rational& b) { return compare(a, b) > 0; }
+inline bool operator<=(const Rational& a, const Rational& b) { return compare(a, b) <= 0; }
+inline bool operator>=(const Rational& a, const Rational& b) { return compare(a, b) >= 0; }
+
+std::ostream& operator<<(std::ostream& os, const Rational& r);
+
+class Rational::ErrorCategory : public std::error_category {
+ public:
+  static const ErrorCategory& get();
+
+  const char* name() const noexcept override;
+  std::string message(int ec) const override;
+};
+
+inline std::error_code make_error_code(Rational::ErrorCode ec) {
+  return std::error_code(static_cast<int>(ec), Rational::ErrorCategory::get());
+}
+
+}  // namespace cmath
+
+namespace std {
+template <>
+struct is_error_code_enum<cmath::Rational::ErrorCode> : public true_type {};
+}  // namespace std
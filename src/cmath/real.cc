@@ -1,55 +1,916 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/natural.h>
 #include <cmath/real.h>
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <ostream>
+
+namespace cmath {
+
+using namespace natural;
+
+namespace {
 
-#if 0
+/**
+ * Whether @p x, an approximation with an error of up to @p errorBits bits
+ * below @p workBits, might round to a different value at @p precision than
+ * the exact result, i.e. is too close to a rounding boundary.
+ */
+bool nearTie(const Limbs& mantissa, size_t precision, size_t workBits, size_t errorBits) {
+  const size_t length = bitLength(mantissa);
+  if (length <= precision)
+    return false;  // exactly representable, far from any tie
 
-Real::Real(long long nominator, unsigned long long denominator) {
-  // TODO
+  const size_t tailBits = length - precision;  // <= workBits - precision <= 64
+  const Limb tail = tailBits >= 64 ? mantissa[0] : mantissa[0] & ((Limb(1) << tailBits) - 1);
+  const Limb half = Limb(1) << (tailBits - 1);
+  const Limb distance = tail > half ? tail - half : half - tail;
+
+  // error in units of the last bit of the mantissa
+  const int64_t errorShift = int64_t(length) - int64_t(workBits) + int64_t(errorBits);
+  if (errorShift < 0)
+    return distance == 0;
+  if (errorShift >= 63)
+    return true;
+  return distance <= (Limb(1) << errorShift);
 }
 
-Real::Real(long long v) {
-  // count decimal positions
-  unsigned decimalCount = 0;
-  for (long long i = v; i != 0; i /= 10)
-    decimalCount++;
+}  // namespace
+
+// {{{ Real
+Real::Real() : Real(Zero, false, DefaultPrecision) {}
+
+Real::Real(Kind kind, bool negative, size_t precision)
+    : kind_(kind),
+      negative_(negative),
+      exponent_(0),
+      precision_(std::max<size_t>(precision, 2)),
+      mantissa_() {}
 
-  digits_.reserve(decimalCount_);
+Real::Real(int v, size_t precision) : Real(static_cast<long long>(v), precision) {}
 
-  for (long long i = v; i != 0; i /= 10)
-    digits_.push_front(i % 10);
+Real::Real(long v, size_t precision) : Real(static_cast<long long>(v), precision) {}
+
+Real::Real(long long v, size_t precision) : Real(Zero, false, precision) {
+  if (v != 0) {
+    const unsigned long long m = v < 0 ? 0ull - static_cast<unsigned long long>(v) : v;
+    *this = make(v < 0, Limbs{m}, 0, precision, false);
+  }
+}
+
+Real::Real(double v, size_t precision) : Real(Zero, std::signbit(v), precision) {
+  if (std::isnan(v)) {
+    kind_ = NaN;
+  } else if (std::isinf(v)) {
+    kind_ = Infinity;
+  } else if (v != 0) {
+    int e;
+    const double m = std::frexp(std::fabs(v), &e);
+    const Limb mantissa = static_cast<Limb>(std::ldexp(m, 53));
+    *this = make(v < 0, Limbs{mantissa}, e - 53, precision, false);
+  }
 }
 
-Real::Real(const Real& v)
-    : digits_(v.digits_),
-      decimals_(v.decimals_) {
+Real Real::zero(size_t precision) {
+  return Real(Zero, false, precision);
 }
 
-Real::Real(Real&& v)
-    : digits_(std::move(v.digits_)),
-      decimals_(std::move(v.decimals_)) {
+Real Real::nan(size_t precision) {
+  return Real(NaN, false, precision);
 }
 
-Real& Real::operator=(const Real& v) {
-  digits_ = v.digits_;
-  decimals_ = v.decimals_;
-  return *this;
+Real Real::infinity(bool negative, size_t precision) {
+  return Real(Infinity, negative, precision);
 }
 
-Real& Real::operator=(Real&& v) {
-  digits_ = std::move(v.digits_);
-  decimals_ = std::move(v.decimals_);
-  return *this;
+size_t Real::bitsForDigits(size_t digits) {
+  return static_cast<size_t>(std::ceil(digits * 3.321928094887362));
 }
 
-std::ostream& Real::operator<<(std::ostream& os) {
-  for (uint8_t digit: digits_)
-    os << (char)(digit + '0');
+size_t Real::digitsForBits(size_t bits) {
+  return std::max<size_t>(1, static_cast<size_t>(bits * 0.30102999566398120));
+}
+
+Real Real::make(bool negative,
+                Limbs&& mantissa,
+                int64_t exponent,
+                size_t precision,
+                bool sticky) {
+  trim(mantissa);
+  if (mantissa.empty())
+    return Real(Zero, negative, precision);
+
+  precision = std::max<size_t>(precision, 2);
+
+  // round to nearest, ties to even; sticky tells about nonzero bits that
+  // were already cut off below the mantissa
+  const size_t length = bitLength(mantissa);
+  if (length > precision) {
+    const size_t shift = length - precision;
+    const bool round = testBit(mantissa, shift - 1);
+    sticky = sticky || anyBitBelow(mantissa, shift - 1);
+    mantissa = shiftRight(mantissa, shift);
+    exponent += shift;
+    if (round && (sticky || (mantissa[0] & 1))) {
+      mantissa = add(mantissa, Limbs{1});
+      if (bitLength(mantissa) > precision) {
+        mantissa = shiftRight(mantissa, 1);
+        exponent++;
+      }
+    }
+  }
+
+  // canonical form: odd mantissa
+  if (!(mantissa[0] & 1)) {
+    const size_t zeros = trailingZeros(mantissa);
+    mantissa = shiftRight(mantissa, zeros);
+    exponent += zeros;
+  }
+
+  Real r(Finite, negative, precision);
+  r.exponent_ = exponent;
+  r.mantissa_ = std::move(mantissa);
+  return r;
+}
+
+Real Real::quotient(bool negative,
+                    const Limbs& num,
+                    const Limbs& den,
+                    int64_t exponent,
+                    size_t precision) {
+  // scale, so that the quotient has at least two bits beyond the precision
+  const int64_t s = std::max<int64_t>(
+      0, int64_t(precision) + 2 + int64_t(bitLength(den)) - int64_t(bitLength(num)));
+
+  Limbs q, r;
+  divmod(shiftLeft(num, s), den, &q, &r);
+  return make(negative, std::move(q), exponent - s, precision, !r.empty());
+}
+
+Real Real::ratio(bool negative, const Limbs& num, const Limbs& den, size_t precision) {
+  if (num.empty())
+    return Real(Zero, negative, precision);
+
+  return quotient(negative, num, den, 0, precision);
+}
+
+Result<Real> Real::parse(std::string_view s, size_t precision) {
+  size_t i = 0;
+  bool negative = false;
+  if (i < s.size() && (s[i] == '-' || s[i] == '+'))
+    negative = s[i++] == '-';
+
+  const std::string_view rest = s.substr(i);
+  if (rest == "inf" || rest == "infinity")
+    return infinity(negative, precision);
+  if (rest == "nan")
+    return nan(precision);
+
+  Limbs digits;
+  size_t digitCount = 0;
+  int64_t exponent = 0;
+  Limb chunk = 0;
+  unsigned chunkDigits = 0;
+
+  auto flush = [&]() {
+    static const Limb scale[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000,
+                                 100000000, 1000000000, 10000000000ull, 100000000000ull,
+                                 1000000000000ull, 10000000000000ull, 100000000000000ull,
+                                 1000000000000000ull, 10000000000000000ull,
+                                 100000000000000000ull, 1000000000000000000ull};
+    mulAddSmall(digits, scale[chunkDigits], chunk);
+    trim(digits);
+    chunk = 0;
+    chunkDigits = 0;
+  };
+
+  auto digit = [&](char ch) {
+    chunk = chunk * 10 + (ch - '0');
+    digitCount++;
+    if (++chunkDigits == 18)
+      flush();
+  };
+
+  for (; i < s.size() && std::isdigit(static_cast<unsigned char>(s[i])); ++i)
+    digit(s[i]);
+
+  if (i < s.size() && s[i] == '.') {
+    for (++i; i < s.size() && std::isdigit(static_cast<unsigned char>(s[i])); ++i) {
+      digit(s[i]);
+      exponent--;
+    }
+  }
+  flush();
+
+  if (digitCount == 0)
+    return InvalidSyntax;
+
+  if (i < s.size() && (s[i] == 'e' || s[i] == 'E')) {
+    ++i;
+    bool negativeExponent = false;
+    if (i < s.size() && (s[i] == '-' || s[i] == '+'))
+      negativeExponent = s[i++] == '-';
+
+    if (i == s.size())
+      return InvalidSyntax;
+
+    int64_t e = 0;
+    for (; i < s.size() && std::isdigit(static_cast<unsigned char>(s[i])); ++i)
+      e = std::min<int64_t>(e * 10 + (s[i] - '0'), int64_t(1) << 40);
+
+    exponent += negativeExponent ? -e : e;
+  }
+
+  if (i != s.size())
+    return InvalidSyntax;
+
+  if (digits.empty())
+    return Real(Zero, negative, precision);
+
+  // beyond any sensible range, where 10^exponent cannot be materialized
+  constexpr int64_t Limit = 100000000;
+  if (exponent + int64_t(digitCount) > Limit)
+    return infinity(negative, precision);
+  if (exponent < -Limit)
+    return Real(Zero, negative, precision);
+
+  if (exponent >= 0)
+    return make(negative, mul(digits, pow10(exponent)), 0, precision, false);
+  else
+    return quotient(negative, digits, pow10(-exponent), 0, precision);
+}
+
+Real Real::rounded(size_t precision) const {
+  if (kind_ != Finite) {
+    Real r(*this);
+    r.precision_ = std::max<size_t>(precision, 2);
+    return r;
+  }
+  return make(negative_, Limbs(mantissa_), exponent_, precision, false);
+}
+
+bool Real::isInteger() const {
+  return kind_ == Zero || (kind_ == Finite && exponent_ >= 0);
+}
+
+bool Real::toInteger(int64_t* out) const {
+  if (!isInteger() || (kind_ == Finite && magnitude() >= 63))
+    return false;
+
+  const Limb m = kind_ == Zero ? 0 : mantissa_[0] << exponent_;
+  *out = negative_ ? -static_cast<int64_t>(m) : static_cast<int64_t>(m);
+  return true;
+}
+
+int64_t Real::magnitude() const {
+  return exponent_ + int64_t(bitLength(mantissa_)) - 1;
+}
+
+double Real::toDouble() const {
+  switch (kind_) {
+    case Zero:
+      return negative_ ? -0.0 : 0.0;
+    case NaN:
+      return std::nan("");
+    case Infinity:
+      return negative_ ? -HUGE_VAL : HUGE_VAL;
+    case Finite:
+      break;
+  }
+
+  // subnormal results are rounded twice
+  const Real r = rounded(53);
+  const int64_t e = std::max<int64_t>(std::min<int64_t>(r.exponent_, 4096), -4096);
+  const double d = std::ldexp(static_cast<double>(r.mantissa_[0]), static_cast<int>(e));
+  return negative_ ? -d : d;
+}
+
+std::string Real::toString(size_t digits) const {
+  switch (kind_) {
+    case Zero:
+      return negative_ ? "-0" : "0";
+    case NaN:
+      return "nan";
+    case Infinity:
+      return negative_ ? "-inf" : "inf";
+    case Finite:
+      break;
+  }
+
+  digits = std::max<size_t>(digits, 1);
+
+  // estimate the decimal exponent from the leading bits, then correct it
+  const size_t length = bitLength(mantissa_);
+  const size_t cut = length > 53 ? length - 53 : 0;
+  const double top = static_cast<double>(shiftRight(mantissa_, cut)[0]);
+  int64_t k = static_cast<int64_t>(
+      std::floor(std::log10(top) + double(exponent_ + int64_t(cut)) * 0.30102999566398120));
+
+  std::string s;
+  for (;;) {
+    // round(|x| * 10^(digits - 1 - k)), exactly
+    const int64_t scale = int64_t(digits) - 1 - k;
+    Limbs num = exponent_ >= 0 ? shiftLeft(mantissa_, exponent_) : mantissa_;
+    Limbs den = exponent_ >= 0 ? Limbs{1} : shiftLeft(Limbs{1}, -exponent_);
+    if (scale >= 0)
+      num = mul(num, pow10(scale));
+    else
+      den = mul(den, pow10(-scale));
+
+    Limbs q, r;
+    divmod(num, den, &q, &r);
+    const int c = compare(shiftLeft(r, 1), den);
+    if (c > 0 || (c == 0 && !q.empty() && (q[0] & 1)))
+      q = add(q, Limbs{1});
+
+    s = toDecimal(q);
+    if (s.size() > digits)
+      k++;
+    else if (s.size() < digits)
+      k--;
+    else
+      break;
+  }
+
+  while (s.size() > 1 && s.back() == '0')
+    s.pop_back();
+
+  std::string out = negative_ ? "-" : "";
+  if (k < -5 || k >= int64_t(digits)) {
+    out += s[0];
+    if (s.size() > 1) {
+      out += '.';
+      out.append(s, 1, std::string::npos);
+    }
+    const std::string e = std::to_string(k < 0 ? -k : k);
+    out += k < 0 ? "e-" : "e+";
+    if (e.size() < 2)
+      out += '0';
+    out += e;
+  } else if (k < 0) {
+    out += "0.";
+    out.append(-k - 1, '0');
+    out += s;
+  } else {
+    const size_t integral = k + 1;
+    if (s.size() <= integral) {
+      out += s;
+      out.append(integral - s.size(), '0');
+    } else {
+      out.append(s, 0, integral);
+      out += '.';
+      out.append(s, integral, std::string::npos);
+    }
+  }
+  return out;
+}
+
+Real Real::operator-() const {
+  Real r(*this);
+  if (kind_ != NaN)
+    r.negative_ = !negative_;
+  return r;
+}
+
+Real Real::sum(const Real& a, const Real& b, bool subtract) {
+  const size_t precision = std::max(a.precision_, b.precision_);
+  const bool bNegative = b.negative_ != subtract;
+
+  if (a.kind_ == NaN || b.kind_ == NaN)
+    return nan(precision);
+
+  if (a.kind_ == Infinity || b.kind_ == Infinity) {
+    if (a.kind_ == Infinity && b.kind_ == Infinity && a.negative_ != bNegative)
+      return nan(precision);
+    return infinity(a.kind_ == Infinity ? a.negative_ : bNegative, precision);
+  }
+
+  if (a.kind_ == Zero && b.kind_ == Zero)
+    return Real(Zero, a.negative_ && bNegative, precision);
+
+  if (b.kind_ == Zero)
+    return a.rounded(precision);
+
+  if (a.kind_ == Zero) {
+    Real r = b.rounded(precision);
+    r.negative_ = bNegative;
+    return r;
+  }
+
+  // An operand far below the other's last bit only contributes to the
+  // rounding direction; replace it by a tiny stand-in to keep the exact sum
+  // small.
+  Limbs am = a.mantissa_;
+  Limbs bm = b.mantissa_;
+  int64_t ae = a.exponent_;
+  int64_t be = b.exponent_;
+  const int64_t amag = a.magnitude();
+  const int64_t bmag = b.magnitude();
+  const int64_t gap = int64_t(precision) + 3;
+  if (amag - bmag > gap) {
+    bm = Limbs{1};
+    be = amag - gap;
+  } else if (bmag - amag > gap) {
+    am = Limbs{1};
+    ae = bmag - gap;
+  }
+
+  const int64_t e = std::min(ae, be);
+  am = shiftLeft(am, ae - e);
+  bm = shiftLeft(bm, be - e);
+
+  if (a.negative_ == bNegative)
+    return make(a.negative_, add(am, bm), e, precision, false);
+
+  const int c = compare(am, bm);
+  if (c == 0)
+    return Real(Zero, false, precision);
+  else if (c > 0)
+    return make(a.negative_, sub(am, bm), e, precision, false);
+  else
+    return make(bNegative, sub(bm, am), e, precision, false);
+}
+
+Real operator+(const Real& a, const Real& b) {
+  return Real::sum(a, b, false);
+}
+
+Real operator-(const Real& a, const Real& b) {
+  return Real::sum(a, b, true);
+}
+
+Real operator*(const Real& a, const Real& b) {
+  const size_t precision = std::max(a.precision_, b.precision_);
+  const bool negative = a.negative_ != b.negative_;
+
+  if (a.kind_ == Real::NaN || b.kind_ == Real::NaN)
+    return Real::nan(precision);
+
+  if (a.kind_ == Real::Infinity || b.kind_ == Real::Infinity) {
+    if (a.kind_ == Real::Zero || b.kind_ == Real::Zero)
+      return Real::nan(precision);
+    return Real::infinity(negative, precision);
+  }
+
+  if (a.kind_ == Real::Zero || b.kind_ == Real::Zero)
+    return Real(Real::Zero, negative, precision);
+
+  return Real::make(negative, mul(a.mantissa_, b.mantissa_), a.exponent_ + b.exponent_,
+                    precision, false);
+}
+
+Real operator/(const Real& a, const Real& b) {
+  const size_t precision = std::max(a.precision_, b.precision_);
+  const bool negative = a.negative_ != b.negative_;
+
+  if (a.kind_ == Real::NaN || b.kind_ == Real::NaN)
+    return Real::nan(precision);
+
+  if (a.kind_ == Real::Infinity)
+    return b.kind_ == Real::Infinity ? Real::nan(precision)
+                                     : Real::infinity(negative, precision);
+
+  if (b.kind_ == Real::Infinity)
+    return Real(Real::Zero, negative, precision);
+
+  if (b.kind_ == Real::Zero)
+    return a.kind_ == Real::Zero ? Real::nan(precision)
+                                 : Real::infinity(negative, precision);
+
+  if (a.kind_ == Real::Zero)
+    return Real(Real::Zero, negative, precision);
+
+  // long division is linear in the size of short divisors
+  if (precision > Real::NewtonThreshold * 64 && b.mantissa_.size() > Real::NewtonThreshold)
+    return Real::newtonDivide(a, b);
+
+  return Real::quotient(negative, a.mantissa_, b.mantissa_, a.exponent_ - b.exponent_,
+                        precision);
+}
+
+Real Real::newtonDivide(const Real& a, const Real& b) {
+  const size_t precision = std::max(a.precision_, b.precision_);
+  const size_t work = precision + 64;
+
+  // 1/b for b scaled into [1, 2), doubling the precision on every step of
+  // y' = y + y (1 - b y)
+  const int64_t scale = b.magnitude();
+  const Real d = abs(ldexp(b, -scale));
+
+  size_t p = 50;
+  Real y(1 / d.rounded(53).toDouble(), p);
+  while (p < work) {
+    p = std::min(2 * p, work);
+    const size_t q = p + 16;
+    const Real yq = y.rounded(q);
+    y = yq + yq * (Real(1, q) - d.rounded(q) * yq);
+  }
+
+  Real x = a.rounded(work) * y.rounded(work);
+  x = ldexp(x, -scale);
+  x.negative_ = a.negative_ != b.negative_;
 
-  os << '.';
+  if (nearTie(x.mantissa_, precision, work, 8))
+    return quotient(x.negative_, a.mantissa_, b.mantissa_, a.exponent_ - b.exponent_,
+                    precision);
 
-  for (uint8_t digit: decimals_)
-    os << (char)(digit + '0');
+  return x.rounded(precision);
+}
+
+Real ldexp(const Real& a, int64_t n) {
+  Real r(a);
+  if (r.kind_ == Real::Finite)
+    r.exponent_ += n;
+  return r;
+}
+
+Real sqrt(const Real& a) {
+  if (a.kind_ == Real::NaN || a.kind_ == Real::Zero)
+    return a;
+
+  if (a.negative_)
+    return Real::nan(a.precision_);
+
+  if (a.kind_ == Real::Infinity)
+    return a;
+
+  if (a.precision_ > Real::SqrtNewtonThreshold * 64)
+    return Real::newtonSqrt(a);
+
+  return Real::exactSqrt(a, a.precision_);
+}
+
+Real Real::exactSqrt(const Real& a, size_t precision) {
+  // m 2^t with an even exponent and at least 2 precision + 4 bits
+  int64_t t = std::max<int64_t>(0, 2 * int64_t(precision) + 4 -
+                                       int64_t(bitLength(a.mantissa_)));
+  if ((a.exponent_ - t) % 2)
+    t++;
+
+  const Limbs n = shiftLeft(a.mantissa_, t);
+  Limbs s = isqrt(n);
+  const bool sticky = compare(mul(s, s), n) != 0;
+  return make(false, std::move(s), (a.exponent_ - t) / 2, precision, sticky);
+}
+
+Real Real::newtonSqrt(const Real& a) {
+  const size_t precision = a.precision_;
+  const size_t work = precision + 64;
+
+  // 1/sqrt(x) for x scaled into [1, 4) by
+  // y' = y + y (1 - x y^2) / 2
+  const int64_t scale = a.magnitude() / 2 - (a.magnitude() < 0 && a.magnitude() % 2);
+  const Real x = ldexp(a, -2 * scale);
+
+  size_t p = 50;
+  Real y(1 / std::sqrt(x.rounded(53).toDouble()), p);
+  while (p < work) {
+    p = std::min(2 * p, work);
+    const size_t q = p + 16;
+    const Real yq = y.rounded(q);
+    y = yq + ldexp(yq * (Real(1, q) - x.rounded(q) * yq * yq), -1);
+  }
+
+  Real s = ldexp(x.rounded(work) * y.rounded(work), scale);
+  if (nearTie(s.mantissa_, precision, work, 8))
+    return exactSqrt(a, precision);
+
+  return s.rounded(precision);
+}
+
+int compare(const Real& a, const Real& b) {
+  if (a.kind_ == Real::NaN || b.kind_ == Real::NaN)
+    return 2;
+
+  auto sign = [](const Real& x) { return x.negative_ ? -1 : 1; };
+
+  if (a.kind_ == Real::Infinity || b.kind_ == Real::Infinity) {
+    if (a.kind_ == b.kind_ && a.negative_ == b.negative_)
+      return 0;
+    return a.kind_ == Real::Infinity ? sign(a) : -sign(b);
+  }
+
+  if (a.kind_ == Real::Zero || b.kind_ == Real::Zero) {
+    if (a.kind_ == b.kind_)
+      return 0;
+    return a.kind_ == Real::Zero ? -sign(b) : sign(a);
+  }
+
+  if (a.negative_ != b.negative_)
+    return sign(a);
+
+  int c;
+  if (a.magnitude() != b.magnitude()) {
+    c = a.magnitude() < b.magnitude() ? -1 : 1;
+  } else {
+    const int64_t e = std::min(a.exponent_, b.exponent_);
+    c = compare(shiftLeft(a.mantissa_, a.exponent_ - e), shiftLeft(b.mantissa_, b.exponent_ - e));
+  }
+  return a.negative_ ? -c : c;
+}
+
+std::ostream& operator<<(std::ostream& os, const Real& r) {
+  return os << r.str();
+}
+// }}}
+
+// {{{ elementary functions
+namespace {
+
+// 1 / n^(2k+1) / (2k+1) summed up, with alternating signs unless hyperbolic:
+// atan(1/n) or atanh(1/n)
+Real arctanInverse(long long n, size_t precision, bool hyperbolic) {
+  const Real n2(n * n, precision);
+  Real power = Real(1, precision) / Real(n, precision);
+  Real sum = power;
+  for (long long k = 1; !power.isZero() && power.magnitude() > -int64_t(precision) - 8; ++k) {
+    power = power / n2;
+    const Real term = power / Real(2 * k + 1, precision);
+    sum = (hyperbolic || k % 2 == 0) ? sum + term : sum - term;
+  }
+  return sum;
+}
+
+/// Memoizes the most precise value computed so far.
+class ConstantCache {
+ public:
+  explicit ConstantCache(Real (*compute)(size_t)) : compute_(compute) {}
+
+  Real get(size_t precision) {
+    std::lock_guard<std::mutex> _l(lock_);
+    if (value_.precision() < precision + 32 || value_.isZero())
+      value_ = compute_(precision + 64);
+    return value_.rounded(precision);
+  }
+
+ private:
+  Real (*compute_)(size_t);
+  std::mutex lock_;
+  Real value_;
+};
+
+Real computePi(size_t precision) {
+  // Machin: pi = 16 atan(1/5) - 4 atan(1/239)
+  return ldexp(arctanInverse(5, precision, false), 4) -
+         ldexp(arctanInverse(239, precision, false), 2);
+}
+
+Real computeLn2(size_t precision) {
+  // ln 2 = 2 atanh(1/3)
+  return ldexp(arctanInverse(3, precision, true), 1);
+}
+
+Real computeE(size_t precision) {
+  return exp(Real(1, precision));
+}
+
+// sin(r) or cos(r) by their Taylor series, for small |r|
+Real sinCosSeries(const Real& r, size_t precision, bool cosine) {
+  const Real r2 = r * r;
+  Real term = cosine ? Real(1, precision) : r;
+  Real sum = term;
+  for (long long n = cosine ? 0 : 1; !term.isZero() &&
+                                     term.magnitude() > -int64_t(precision) - 8;
+       n += 2) {
+    term = -(term * r2) / Real((n + 1) * (n + 2), precision);
+    sum = sum + term;
+  }
+  return sum;
+}
+
+/**
+ * Reduces @p x to r in [-pi/4, pi/4] with x = r + q pi/2, returning
+ * q mod 4, or -1 if @p x is too large to be reduced.
+ */
+int reduceQuadrant(const Real& x, size_t precision, Real* r) {
+  if (x.magnitude() < -1) {
+    *r = x.rounded(precision);
+    return 0;
+  }
+
+  if (x.magnitude() > 65536)
+    return -1;
+
+  const size_t work = precision + std::max<int64_t>(x.magnitude(), 0) + 64;
+  const Real halfPi = ldexp(Real::pi(work), -1);
+  const Real q = floor(x.rounded(work) / halfPi + Real(0.5, work));
+  *r = (x.rounded(work) - q * halfPi).rounded(precision);
+
+  // q mod 4, exactly
+  int64_t quadrant = 0;
+  (q - ldexp(floor(ldexp(q, -2)), 2)).toInteger(&quadrant);
+  return static_cast<int>(quadrant);
+}
+
+Real sinCos(const Real& x, bool cosine) {
+  if (!x.isFinite())
+    return Real::nan(x.precision());
+
+  const size_t work = x.precision() + 32;
+  Real r;
+  int quadrant = reduceQuadrant(x, work, &r);
+  if (quadrant < 0)
+    return Real::nan(x.precision());
+
+  if (cosine)
+    quadrant = (quadrant + 1) % 4;  // cos x = sin(x + pi/2)
+
+  Real y = sinCosSeries(r, work, quadrant % 2 == 1);
+  if (quadrant >= 2)
+    y = -y;
+  return y.rounded(x.precision());
+}
+
+}  // namespace
+
+Real Real::pi(size_t precision) {
+  static ConstantCache cache(&computePi);
+  return cache.get(precision);
+}
+
+Real Real::e(size_t precision) {
+  static ConstantCache cache(&computeE);
+  return cache.get(precision);
+}
+
+Real Real::ln2(size_t precision) {
+  static ConstantCache cache(&computeLn2);
+  return cache.get(precision);
+}
+
+Real abs(const Real& a) {
+  return a.isNegative() ? -a : a;
+}
+
+Real floor(const Real& a) {
+  if (!a.isFinite() || a.isInteger())
+    return a;
+
+  // the mantissa is odd, so there are fractional bits to cut off
+  Limbs q = shiftRight(a.mantissa_, -a.exponent_);
+  if (a.negative_)
+    q = add(q, Limbs{1});
+
+  return Real::make(a.negative_, std::move(q), 0, a.precision_, false);
+}
+
+Real exp(const Real& a) {
+  const size_t precision = a.precision();
+  if (a.isNaN())
+    return a;
+  if (a.isInfinity())
+    return a.isNegative() ? Real::zero(precision) : a;
+  if (a.isZero())
+    return Real(1, precision);
+
+  // beyond the exponent range
+  if (a.magnitude() > 61)
+    return a.isNegative() ? Real::zero(precision) : Real::infinity(false, precision);
+
+  // a = k ln 2 + r, |r| <= ln 2 / 2, then r / 2^s, which is squared back
+  // s times, costing s bits of accuracy
+  const size_t s = static_cast<size_t>(std::sqrt(double(precision)));
+  const size_t work = precision + 32 + s;
+
+  const int64_t k = std::llround(a.toDouble() / 0.69314718055994531);
+  const Real r = a.rounded(work + 64) - Real(static_cast<long long>(k), work + 64) *
+                                            Real::ln2(work + 64);
+  const Real x = ldexp(r.rounded(work), -int64_t(s));
+
+  Real term(1, work);
+  Real sum(1, work);
+  for (long long n = 1; !term.isZero() && term.magnitude() > -int64_t(work) - 8; ++n) {
+    term = term * x / Real(n, work);
+    sum = sum + term;
+  }
+
+  for (size_t i = 0; i < s; ++i)
+    sum = sum * sum;
+
+  return ldexp(sum, k).rounded(precision);
+}
+
+Real log(const Real& a) {
+  const size_t precision = a.precision();
+  if (a.isNaN() || (a.isNegative() && !a.isZero()))
+    return Real::nan(precision);
+  if (a.isZero())
+    return Real::infinity(true, precision);
+  if (a.isInfinity())
+    return a;
+
+  // a = m 2^k, m in [1, 2)
+  const int64_t k = a.magnitude();
+  const Real m = ldexp(a, -k);
+  const size_t work = precision + 32;
+
+  // Halley's iteration y' = y + 2 (m - e^y) / (m + e^y), tripling the
+  // number of correct bits on each step
+  Real y(std::log(m.rounded(53).toDouble()), 53);
+  for (size_t p = 53; p < work;) {
+    p = std::min(3 * p, work);
+    const Real yp = y.rounded(p);
+    const Real ey = exp(yp);
+    const Real mp = m.rounded(p);
+    y = yp + ldexp((mp - ey) / (mp + ey), 1);
+  }
+
+  if (k == 0)
+    return y.rounded(precision);
+
+  const size_t kWork = work + 64;
+  return (y.rounded(kWork) + Real(static_cast<long long>(k), kWork) * Real::ln2(kWork))
+      .rounded(precision);
+}
+
+Real sin(const Real& a) {
+  if (a.isZero())
+    return a;
+  return sinCos(a, false);
+}
+
+Real cos(const Real& a) {
+  return sinCos(a, true);
+}
+
+Real tan(const Real& a) {
+  if (a.isZero())
+    return a;
+
+  const Real x = a.rounded(a.precision() + 16);
+  return (sin(x) / cos(x)).rounded(a.precision());
+}
+
+Real pow(const Real& a, const Real& b) {
+  const size_t precision = std::max(a.precision(), b.precision());
+
+  if (b.isZero())
+    return Real(1, precision);
+
+  // zeros, infinities and NaN behave exactly like with doubles
+  if (!a.isFinite() || a.isZero() || !b.isFinite())
+    return Real(std::pow(a.toDouble(), b.toDouble()), precision);
+
+  int64_t n;
+  if (b.toInteger(&n)) {
+    // binary powering; every step rounds, so add bits for log n roundings
+    const size_t work = precision + 64 + 2 * (64 - __builtin_clzll(n < 0 ? -n : n));
+    Real result(1, work);
+    Real base = a.rounded(work);
+    for (uint64_t i = n < 0 ? -uint64_t(n) : n; i; i >>= 1) {
+      if (i & 1)
+        result = result * base;
+      if (i > 1)
+        base = base * base;
+    }
+    if (n < 0)
+      result = Real(1, work) / result;
+    return result.rounded(precision);
+  }
+
+  if (a.isNegative())
+    return Real::nan(precision);
+
+  // e^(b log a), where the absolute error of the exponent becomes the
+  // relative error of the result
+  size_t work = precision + 32;
+  Real t = b.rounded(work) * log(a.rounded(work));
+  if (t.isFinite() && !t.isZero() && t.magnitude() > 0) {
+    work += t.magnitude();
+    t = b.rounded(work) * log(a.rounded(work));
+  }
+  return exp(t).rounded(precision);
+}
+// }}}
+
+// {{{ Real::ErrorCategory
+const Real::ErrorCategory& Real::ErrorCategory::get() {
+  static ErrorCategory c;
+  return c;
+}
+
+const char* Real::ErrorCategory::name() const noexcept {
+  return "RealError";
+}
 
-  return *this;
+std::string Real::ErrorCategory::message(int ec) const {
+  switch (static_cast<ErrorCode>(ec)) {
+    case InvalidSyntax:
+      return "Invalid number syntax";
+    case NotReal:
+      return "Result is not a real number";
+    case UnsupportedExpr:
+      return "Expression cannot be calculated at arbitrary precision";
+  }
+  return "Unknown error";
 }
+// }}}
 
-#endif
+}  // namespace cmath
@@ -1,36 +1,198 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
 #pragma once
 
+#include <cmath/natural.h>
+#include <cmath/result.h>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <system_error>
 #include <vector>
 
-#if 0
-class Ratio {
- public:
- private:
-  Integer nominator_;
-  Natural denominator_;
-};
+namespace cmath {
 
+/**
+ * Arbitrary-precision binary floating point number.
+ *
+ * A finite, nonzero value is (-1)^sign * mantissa * 2^exponent, where the
+ * mantissa is an unsigned integer of at most precision() bits, stored in
+ * 64-bit limbs, least significant first. Besides that there are signed
+ * zeros, infinities and NaN, with IEEE 754 semantics.
+ *
+ * Every arithmetic operation, sqrt() and the conversions from and to
+ * decimal are correctly rounded (to nearest, ties to even) to the precision
+ * of the result, which is the larger precision of the operands. The
+ * elementary functions are computed with guard bits and are faithful.
+ */
 class Real {
  public:
-  Real(long long nominator, unsigned long long denominator);
-  explicit Real(long long v);
+  using Limb = natural::Limb;
+  using Limbs = natural::Limbs;
+
+  enum ErrorCode {
+    InvalidSyntax = 1,
+    NotReal,
+    UnsupportedExpr,
+  };
+  class ErrorCategory;
+
+  static constexpr size_t DefaultPrecision = 256;  // bits
+
+  // Bits to calculate with beyond those of the digits shown, which keep the
+  // rounding errors of a calculation below the last digit.
+  static constexpr size_t GuardBits = 32;
+
+  // Division and square root switch from exact long division and integer
+  // square root to Newton iteration at these precisions (in limbs).
+  static constexpr size_t NewtonThreshold = 128;
+  static constexpr size_t SqrtNewtonThreshold = 16;
+
+  Real();  // +0
+  explicit Real(int v, size_t precision = DefaultPrecision);
+  explicit Real(long v, size_t precision = DefaultPrecision);
+  explicit Real(long long v, size_t precision = DefaultPrecision);
+  explicit Real(double v, size_t precision = DefaultPrecision);
+
+  /**
+   * Parses a decimal number, such as "-12.5e-3", "inf" or "nan", and rounds
+   * it correctly to @p precision bits.
+   */
+  static Result<Real> parse(std::string_view s, size_t precision = DefaultPrecision);
+
+  /// @p num / @p den, correctly rounded; @p den must be nonzero.
+  static Real ratio(bool negative, const Limbs& num, const Limbs& den,
+                    size_t precision = DefaultPrecision);
+
+  static Real zero(size_t precision = DefaultPrecision);
+  static Real nan(size_t precision = DefaultPrecision);
+  static Real infinity(bool negative = false, size_t precision = DefaultPrecision);
+
+  /// Number of digits of @p precision bits, and vice versa.
+  static size_t bitsForDigits(size_t digits);
+  static size_t digitsForBits(size_t bits);
+
+  static Real pi(size_t precision = DefaultPrecision);
+  static Real e(size_t precision = DefaultPrecision);
+  static Real ln2(size_t precision = DefaultPrecision);
+
+  size_t precision() const noexcept { return precision_; }
+
+  /// This value rounded to @p precision bits.
+  Real rounded(size_t precision) const;
+
+  bool isZero() const noexcept { return kind_ == Zero; }
+  bool isNaN() const noexcept { return kind_ == NaN; }
+  bool isInfinity() const noexcept { return kind_ == Infinity; }
+  bool isFinite() const noexcept { return kind_ == Zero || kind_ == Finite; }
+  bool isNegative() const noexcept { return negative_; }
+
+  /// Whether this is a finite value without fractional part.
+  bool isInteger() const;
+
+  /// Stores the value in @p out if it is an integer within 63 bits.
+  bool toInteger(int64_t* out) const;
+
+  /// Exponent of the most significant bit, e.g. 0 for 1.5; finite only.
+  int64_t magnitude() const;
 
-  Real(const Real& v);
-  Real(Real&& v);
+  /// Correctly rounded to the nearest double.
+  double toDouble() const;
 
-  Real& operator=(const Real& v);
-  Real& operator=(Real&& v);
+  /**
+   * Renders this value with @p digits significant decimal digits, correctly
+   * rounded, omitting trailing zeros; in scientific notation if the
+   * decimal exponent is below -5 or not less than @p digits.
+   */
+  std::string toString(size_t digits) const;
 
-  std::ostream& operator<<(std::ostream& os);
+  /// Renders as many digits as the precision holds.
+  std::string str() const { return toString(digitsForBits(precision_)); }
+
+  Real operator-() const;
+
+  friend Real operator+(const Real& a, const Real& b);
+  friend Real operator-(const Real& a, const Real& b);
+  friend Real operator*(const Real& a, const Real& b);
+  friend Real operator/(const Real& a, const Real& b);
+
+  /// Multiplies by 2^n, exactly.
+  friend Real ldexp(const Real& a, int64_t n);
+
+  friend Real sqrt(const Real& a);
+  friend Real floor(const Real& a);
+
+  /// -1, 0, 1, or 2 if either is NaN.
+  friend int compare(const Real& a, const Real& b);
 
  private:
-  std::vector<uint8_t> digits_;
-  std::vector<uint8_t> decimals_; // fraction
+  enum Kind : uint8_t { Zero, Finite, Infinity, NaN };
+
+  Real(Kind kind, bool negative, size_t precision);
+
+  static Real make(bool negative, Limbs&& mantissa, int64_t exponent,
+                   size_t precision, bool sticky);
+  static Real quotient(bool negative, const Limbs& num, const Limbs& den,
+                       int64_t exponent, size_t precision);
+  static Real exactSqrt(const Real& a, size_t precision);
+  static Real sum(const Real& a, const Real& b, bool subtract);
+  static Real newtonDivide(const Real& a, const Real& b);
+  static Real newtonSqrt(const Real& a);
+
+ private:
+  Kind kind_;
+  bool negative_;
+  int64_t exponent_;
+  size_t precision_;
+  Limbs mantissa_;
 };
 
-Real operator+(Real a, Real b);
-Real operator-(Real a, Real b);
-Real operator*(Real a, Real b);
-Real operator/(Real a, Real b);
+Real ldexp(const Real& a, int64_t n);
+Real sqrt(const Real& a);
+int compare(const Real& a, const Real& b);
+
+Real abs(const Real& a);
+Real floor(const Real& a);
+Real exp(const Real& a);
+Real log(const Real& a);
+Real sin(const Real& a);
+Real cos(const Real& a);
+Real tan(const Real& a);
+Real atan(const Real& a);
+
+/// @p a to the power of @p b; an exact binary powering for integral @p b.
+Real pow(const Real& a, const Real& b);
+
+inline bool operator==(const Real& a, const Real& b) { return compare(a, b) == 0; }
+inline bool operator!=(const Real& a, const Real& b) { return compare(a, b) != 0; }
+inline bool operator<(const Real& a, const Real& b) { return compare(a, b) == -1; }
+inline bool operator>(const Real& a, const Real& b) { return compare(a, b) == 1; }
+inline bool operator<=(const Real& a, const Real& b) { return a < b || a == b; }
+inline bool operator>=(const Real& a, const Real& b) { return a > b || a == b; }
+
+std::ostream& operator<<(std::ostream& os, const Real& r);
+
+class Real::ErrorCategory : public std::error_category {
+ public:
+  static const ErrorCategory& get();
+
+  const char* name() const noexcept override;
+  std::string message(int ec) const override;
+};
+
+inline std::error_code make_error_code(Real::ErrorCode ec) {
+  return std::error_code(static_cast<int>(ec), Real::ErrorCategory::get());
+}
+
+}  // namespace cmath
 
-#endif
+namespace std {
+template <>
+struct is_error_code_enum<cmath::Real::ErrorCode> : public true_type {};
+}  // namespace std
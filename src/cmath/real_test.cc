@@ -0,0 +1,54 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/expr_parser.h>
+#include <cmath/expr_real.h>
+#include <cmath/real.h>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace cmath;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool ok, const std::string& what) {
+  if (!ok) {
+    std::cerr << "FAILED: " << what << '\n';
+    failures++;
+  }
+}
+
+// @p s with @p digits significant digits, as cm shows them
+std::string calculate(const std::string& s, size_t digits) {
+  SymbolTable st;
+  Result<std::unique_ptr<Expr>> e = parseExpression(st, s);
+  if (!e) {
+    std::cerr << "Cannot parse " << s << ": " << e.failureMessage() << '\n';
+    std::exit(EXIT_FAILURE);
+  }
+  Result<Real> y =
+      calculateReal(e->get(), st, Real::bitsForDigits(digits) + Real::GuardBits);
+  return y ? y->toString(digits) : y.failureMessage();
+}
+
+void testLastDigit() {
+  expect(calculate("2 / 3", 20) == "0.66666666666666666667", "2 / 3 to 20 digits");
+  expect(calculate("1 / 3 + 1 / 3", 20) == "0.66666666666666666667",
+         "1 / 3 + 1 / 3 to 20 digits");
+  expect(calculate("sqrt(2)", 30) == "1.41421356237309504880168872421",
+         "sqrt(2) to 30 digits");
+}
+
+}  // namespace
+
+int main() {
+  testLastDigit();
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
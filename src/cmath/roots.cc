@@ -0,0 +1,516 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/polynomial.h>
+#include <cmath/roots.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace cmath {
+
+namespace {
+
+constexpr double Epsilon = std::numeric_limits<double>::epsilon();
+
+// rotates the starting points off the real axis, see initialize()
+constexpr double StartAngle = 0.7;
+
+constexpr unsigned MaxPolishSteps = 8;
+
+// {{{ error-free transformations
+// a + b = *s + *e exactly
+inline void twoSum(double a, double b, double* s, double* e) {
+  *s = a + b;
+  const double z = *s - a;
+  *e = (a - (*s - z)) + (b - z);
+}
+
+// a * b = *p + *e exactly
+inline void twoProduct(double a, double b, double* p, double* e) {
+  *p = a * b;
+#if defined(__FMA__)
+  *e = std::fma(a, b, -*p);
+#else
+  // Dekker, splitting the factors into halves of 26 bits; std::fma would
+  // be a library call without hardware support
+  constexpr double Split = 134217729.0;  // 2^27 + 1
+  double t = Split * a;
+  const double ah = t - (t - a);
+  const double al = a - ah;
+  t = Split * b;
+  const double bh = t - (t - b);
+  const double bl = b - bh;
+  *e = ((ah * bh - *p) + ah * bl + al * bh) + al * bl;
+#endif
+}
+// }}}
+// {{{ lockstep evaluation
+// Coefficients, lowest power first, as arrays of parts.
+struct Coefficients {
+  std::vector<double> re;
+  std::vector<double> im;
+  std::vector<double> abs;
+
+  explicit Coefficients(const std::vector<Number>& c) {
+    for (Number a : c) {
+      re.push_back(a.real());
+      im.push_back(a.imag());
+      abs.push_back(std::abs(a));
+    }
+  }
+};
+
+// Points evaluated together, with value p, its compensation q, derivative
+// d and the rounding error bound s = sum |c_k| |x|^k.
+struct Batch {
+  std::vector<size_t> index;
+  std::vector<double> xr, xi, xa;
+  std::vector<double> pr, pi, qr, qi, dr, di, s;
+
+  void clear() {
+    index.clear();
+    xr.clear();
+    xi.clear();
+    xa.clear();
+  }
+
+  void add(size_t k, Number x) {
+    index.push_back(k);
+    xr.push_back(x.real());
+    xi.push_back(x.imag());
+    xa.push_back(std::abs(x));
+  }
+
+  size_t size() const noexcept { return index.size(); }
+
+  Number point(size_t j) const { return Number(xr[j], xi[j]); }
+  Number value(size_t j) const { return Number(pr[j], pi[j]); }
+  Number derivative(size_t j) const { return Number(dr[j], di[j]); }
+};
+
+/**
+ * Horner's scheme for all points of @p b at once. The inner loop runs
+ * across the points and vectorizes.
+ *
+ * If @p Compensated, the rounding errors of every step are accumulated
+ * separately by error-free transformations, which makes the value as
+ * accurate as if computed in twice the working precision (Graillat,
+ * Ménissier-Morain). The derivative stays plain.
+ */
+template <bool Compensated>
+void evaluate(const Coefficients& c, Batch* b) {
+  const size_t n = b->size();
+  const size_t m = c.re.size() - 1;
+
+  b->pr.assign(n, c.re[m]);
+  b->pi.assign(n, c.im[m]);
+  b->qr.assign(n, 0);
+  b->qi.assign(n, 0);
+  b->dr.assign(n, 0);
+  b->di.assign(n, 0);
+  b->s.assign(n, c.abs[m]);
+
+  const double* xr = b->xr.data();
+  const double* xi = b->xi.data();
+  const double* xa = b->xa.data();
+  double* pr = b->pr.data();
+  double* pi = b->pi.data();
+  double* qr = b->qr.data();
+  double* qi = b->qi.data();
+  double* dr = b->dr.data();
+  double* di = b->di.data();
+  double* s = b->s.data();
+
+  for (size_t k = m; k-- != 0;) {
+    const double cr = c.re[k];
+    const double ci = c.im[k];
+    const double ca = c.abs[k];
+    for (size_t j = 0; j != n; ++j) {
+      const double r = dr[j] * xr[j] - di[j] * xi[j] + pr[j];
+      const double i = dr[j] * xi[j] + di[j] * xr[j] + pi[j];
+      dr[j] = r;
+      di[j] = i;
+      s[j] = s[j] * xa[j] + ca;
+
+      if constexpr (Compensated) {
+        double p1, e1, p2, e2, p3, e3, p4, e4, ur, er, ui, ei, vr, fr, vi, fi;
+        twoProduct(pr[j], xr[j], &p1, &e1);
+        twoProduct(pi[j], xi[j], &p2, &e2);
+        twoProduct(pr[j], xi[j], &p3, &e3);
+        twoProduct(pi[j], xr[j], &p4, &e4);
+        twoSum(p1, -p2, &ur, &er);
+        twoSum(p3, p4, &ui, &ei);
+        twoSum(ur, cr, &vr, &fr);
+        twoSum(ui, ci, &vi, &fi);
+        const double u = qr[j] * xr[j] - qi[j] * xi[j] + ((e1 - e2 + er) + fr);
+        const double v = qr[j] * xi[j] + qi[j] * xr[j] + ((e3 + e4 + ei) + fi);
+        qr[j] = u;
+        qi[j] = v;
+        pr[j] = vr;
+        pi[j] = vi;
+      } else {
+        const double u = pr[j] * xr[j] - pi[j] * xi[j] + cr;
+        const double v = pr[j] * xi[j] + pi[j] * xr[j] + ci;
+        pr[j] = u;
+        pi[j] = v;
+      }
+    }
+  }
+
+  if constexpr (Compensated) {
+    for (size_t j = 0; j != n; ++j) {
+      pr[j] += qr[j];
+      pi[j] += qi[j];
+    }
+  }
+}
+// }}}
+// {{{ Aberth–Ehrlich
+/**
+ * Places the starting points on circles with the radii suggested by the
+ * upper convex hull of the points (k, log |a_k|), the Newton polygon (Bini).
+ */
+void initialize(const std::vector<Number>& a, double* zr, double* zi) {
+  const size_t m = a.size() - 1;
+
+  std::vector<size_t> hull;
+  std::vector<double> y(m + 1);
+  for (size_t k = 0; k <= m; ++k) {
+    if (a[k] == Number())
+      continue;
+
+    y[k] = std::log(std::abs(a[k]));
+    while (hull.size() >= 2) {
+      const size_t i = hull[hull.size() - 2];
+      const size_t j = hull.back();
+      if ((y[j] - y[i]) * (k - i) > (y[k] - y[i]) * (j - i))
+        break;
+      hull.pop_back();
+    }
+    hull.push_back(k);
+  }
+
+  size_t r = 0;
+  for (size_t h = 1; h < hull.size(); ++h) {
+    const size_t i = hull[h - 1];
+    const size_t n = hull[h] - i;
+    const double radius = std::exp((y[i] - y[hull[h]]) / n);
+    for (size_t q = 0; q != n; ++q, ++r) {
+      const double angle = 2 * M_PI * q / n + 2 * M_PI * i / m + StartAngle;
+      zr[r] = radius * std::cos(angle);
+      zi[r] = radius * std::sin(angle);
+    }
+  }
+}
+
+/**
+ * Simultaneous iteration state: the polynomial forwards and reversed, and
+ * the current approximations as arrays of parts.
+ */
+class Aberth {
+ public:
+  explicit Aberth(const std::vector<Number>& a);
+
+  /// Runs sweeps until all roots converged, or MaxIterations.
+  bool iterate(unsigned* iterations);
+
+  /// Newton steps on the compensated evaluation, while they reduce the
+  /// backward error; returns the number of steps taken.
+  unsigned polish();
+
+  Number root(size_t k) const { return Number(zr_[k], zi_[k]); }
+
+ private:
+  /**
+   * Stores the Newton correction p(z) / p'(z) in (wr, wi) and the backward
+   * error |p(z)| / sum |a_k| |z|^k in e for all points (xr, xi) listed in
+   * @p which. Points outside the unit circle are evaluated as
+   * p(z) = z^m q(1/z) on the reversed polynomial q, so as not to overflow.
+   */
+  template <bool Compensated>
+  void newton(const double* xr, const double* xi, const std::vector<size_t>& which,
+              double* wr, double* wi, double* e);
+
+ private:
+  size_t m_;
+  Coefficients forward_;
+  Coefficients reversed_;
+  bool real_;  // all coefficients real
+  std::vector<double> zr_, zi_;
+  Batch inner_, outer_;
+};
+
+Aberth::Aberth(const std::vector<Number>& a)
+    : m_(a.size() - 1),
+      forward_(a),
+      reversed_(std::vector<Number>(a.rbegin(), a.rend())),
+      real_(std::all_of(a.begin(), a.end(), [](Number c) { return !c.imag(); })),
+      zr_(m_),
+      zi_(m_),
+      inner_(),
+      outer_() {
+  initialize(a, zr_.data(), zi_.data());
+}
+
+template <bool Compensated>
+void Aberth::newton(const double* xr, const double* xi, const std::vector<size_t>& which,
+                    double* wr, double* wi, double* e) {
+  inner_.clear();
+  outer_.clear();
+  for (size_t k : which) {
+    const Number z(xr[k], xi[k]);
+    if (std::norm(z) <= 1)
+      inner_.add(k, z);
+    else
+      outer_.add(k, 1.0 / z);
+  }
+
+  evaluate<Compensated>(forward_, &inner_);
+  evaluate<Compensated>(reversed_, &outer_);
+
+  for (const Batch* b : {&inner_, &outer_}) {
+    for (size_t j = 0; j != b->size(); ++j) {
+      const size_t k = b->index[j];
+      const Number p = b->value(j);
+      const Number d = b->derivative(j);
+      e[k] = std::abs(p) / b->s[j];
+
+      Number w;
+      if (p == Number())
+        w = 0;
+      else if (b == &inner_)
+        w = p / d;
+      else  // p / p' = z / (m - y q'(y) / q(y)) with y = 1/z
+        w = 1.0 / (b->point(j) * (double(m_) - b->point(j) * d / p));
+
+      wr[k] = w.real();
+      wi[k] = w.imag();
+    }
+  }
+}
+
+bool Aberth::iterate(unsigned* iterations) {
+  const double tolerance = (2 * m_ + 1) * Epsilon;
+
+  std::vector<size_t> active(m_);
+  for (size_t k = 0; k != m_; ++k)
+    active[k] = k;
+
+  std::vector<double> wr(m_), wi(m_), e(m_);
+  std::vector<double> sr(m_), si(m_);
+
+  for (*iterations = 0; !active.empty() && *iterations < RootFinder::MaxIterations;
+       ++*iterations) {
+    newton<false>(zr_.data(), zi_.data(), active, wr.data(), wi.data(), e.data());
+
+    // sum over j != k of 1 / (z_k - z_j), running across k
+    std::fill(sr.begin(), sr.end(), 0);
+    std::fill(si.begin(), si.end(), 0);
+    for (size_t j = 0; j != m_; ++j) {
+      const double xr = zr_[j];
+      const double xi = zi_[j];
+      auto accumulate = [&](size_t begin, size_t end) {
+        for (size_t k = begin; k != end; ++k) {
+          const double dr = zr_[k] - xr;
+          const double di = zi_[k] - xi;
+          const double inv = 1 / (dr * dr + di * di);
+          sr[k] += dr * inv;
+          si[k] -= di * inv;
+        }
+      };
+      accumulate(0, j);
+      accumulate(j + 1, m_);
+    }
+
+    // roots within rounding error of their residual stay where they are
+    size_t n = 0;
+    for (size_t k : active) {
+      if (e[k] <= tolerance)
+        continue;
+      active[n++] = k;
+
+      const Number w(wr[k], wi[k]);
+      Number step = w / (1.0 - w * Number(sr[k], si[k]));
+      if (!std::isfinite(step.real()) || !std::isfinite(step.imag()))
+        step = w;
+      if (std::isfinite(step.real()) && std::isfinite(step.imag())) {
+        zr_[k] -= step.real();
+        zi_[k] -= step.imag();
+      }
+    }
+    active.resize(n);
+  }
+
+  return active.empty();
+}
+
+unsigned Aberth::polish() {
+  std::vector<size_t> active(m_);
+  for (size_t k = 0; k != m_; ++k)
+    active[k] = k;
+
+  std::vector<double> wr(m_), wi(m_), e(m_);
+  std::vector<double> nr(m_), ni(m_), vr(m_), vi(m_), f(m_);
+  newton<true>(zr_.data(), zi_.data(), active, wr.data(), wi.data(), e.data());
+
+  auto accept = [&](size_t k) {
+    zr_[k] = nr[k];
+    zi_[k] = ni[k];
+    wr[k] = vr[k];
+    wi[k] = vi[k];
+    e[k] = f[k];
+  };
+
+  unsigned steps = 0;
+  for (unsigned i = 0; i != MaxPolishSteps && !active.empty(); ++i) {
+    for (size_t k : active) {
+      nr[k] = zr_[k] - wr[k];
+      ni[k] = zi_[k] - wi[k];
+    }
+    newton<true>(nr.data(), ni.data(), active, vr.data(), vi.data(), f.data());
+
+    size_t n = 0;
+    for (size_t k : active) {
+      if (!(f[k] < e[k]))
+        continue;
+      accept(k);
+      steps++;
+      // done once the next step would not change the root anymore
+      if (e[k] > 0 && std::hypot(wr[k], wi[k]) > Epsilon * std::hypot(zr_[k], zi_[k]))
+        active[n++] = k;
+    }
+    active.resize(n);
+  }
+
+  // real roots of real polynomials come out with a spurious imaginary part
+  // of the order of rounding errors; drop it unless that is worse
+  if (real_) {
+    active.clear();
+    for (size_t k = 0; k != m_; ++k) {
+      if (zi_[k]) {
+        nr[k] = zr_[k];
+        ni[k] = 0;
+        active.push_back(k);
+      }
+    }
+    newton<true>(nr.data(), ni.data(), active, vr.data(), vi.data(), f.data());
+    for (size_t k : active)
+      if (f[k] <= e[k])
+        accept(k);
+  }
+
+  return steps;
+}
+// }}}
+
+}  // namespace
+
+// {{{ RootFinder
+Result<std::vector<Number>> RootFinder::solve(const std::vector<Number>& coefficients,
+                                              Stats* stats) {
+  for (Number c : coefficients)
+    if (!std::isfinite(c.real()) || !std::isfinite(c.imag()))
+      return NotPolynomial;
+
+  size_t end = coefficients.size();
+  while (end && coefficients[end - 1] == Number())
+    --end;
+  if (!end)
+    return ZeroPolynomial;
+
+  // deflate the roots at zero
+  size_t begin = 0;
+  while (coefficients[begin] == Number())
+    ++begin;
+  std::vector<Number> roots(begin, Number());
+
+  const std::vector<Number> a(coefficients.begin() + begin, coefficients.begin() + end);
+  const size_t m = a.size() - 1;
+
+  Stats s;
+  s.degree = end - 1;
+
+  if (m == 1) {
+    roots.push_back(-a[0] / a[1]);
+  } else if (m > 1) {
+    Aberth aberth(a);
+    if (!aberth.iterate(&s.iterations))
+      return NoConvergence;
+    s.polishSteps = aberth.polish();
+    for (size_t k = 0; k != m; ++k)
+      roots.push_back(aberth.root(k));
+  }
+
+  // real parts differing in the last bits only, as of conjugate pairs,
+  // count as equal
+  auto key = [](Number z) {
+    int e;
+    const double m = std::frexp(z.real(), &e);
+    return std::make_pair(std::ldexp(std::round(std::ldexp(m, 40)), e - 40), z.imag());
+  };
+  std::sort(roots.begin(), roots.end(),
+            [&](Number x, Number y) { return key(x) < key(y); });
+
+  if (stats)
+    *stats = s;
+
+  return roots;
+}
+
+Result<std::vector<Number>> RootFinder::solve(const Expr* e,
+                                              const Symbol& x,
+                                              const SymbolTable& t,
+                                              Stats* stats) {
+  Polynomial p;
+  if (!Polynomial::expand(e, {x}, t, &p))
+    return NotPolynomial;
+
+  return solve(p.coefficients(), stats);
+}
+
+Result<std::vector<Number>> RootFinder::solve(const Expr* e,
+                                              const SymbolTable& t,
+                                              Stats* stats) {
+  const std::vector<Symbol> symbols = freeSymbols(e, t);
+
+  if (symbols.empty())
+    return NoVariable;
+
+  if (symbols.size() > 1)
+    return NotPolynomial;
+
+  return solve(e, symbols[0], t, stats);
+}
+// }}}
+// {{{ RootFinder::ErrorCategory
+const RootFinder::ErrorCategory& RootFinder::ErrorCategory::get() {
+  static ErrorCategory c;
+  return c;
+}
+
+const char* RootFinder::ErrorCategory::name() const noexcept {
+  return "RootFinderError";
+}
+
+std::string RootFinder::ErrorCategory::message(int ec) const {
+  switch (static_cast<ErrorCode>(ec)) {
+    case NotPolynomial:
+      return "Expression is not a polynomial in one variable";
+    case NoVariable:
+      return "Expression has no variable to solve for";
+    case ZeroPolynomial:
+      return "Every number is a root of the zero polynomial";
+    case NoConvergence:
+      return "Root finder did not converge";
+  }
+  return "Unknown error";
+}
+// }}}
+
+}  // namespace cmath
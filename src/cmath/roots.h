@@ -0,0 +1,92 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <cmath/result.h>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace cmath {
+
+/**
+ * Finds all complex roots of a polynomial at once, by the Aberth–Ehrlich
+ * iteration.
+ *
+ * Starting points are spread over circles whose radii follow the Newton
+ * polygon of the coefficients. Each sweep evaluates the polynomial at all
+ * roots in lockstep on arrays of real and imaginary parts, so that the
+ * loops vectorize, and moves every root by its Newton correction, repelled
+ * by all the others. Roots are frozen once their residual is within
+ * rounding error of the evaluation. Points outside the unit circle are
+ * evaluated on the reversed polynomial, which keeps high degrees from
+ * overflowing.
+ *
+ * Zero roots are deflated exactly up front. Afterwards every root is
+ * polished by Newton steps on a compensated Horner evaluation, which is
+ * as accurate as twice the working precision.
+ */
+class RootFinder {
+ public:
+  enum ErrorCode {
+    NotPolynomial = 1,
+    NoVariable,
+    ZeroPolynomial,
+    NoConvergence,
+  };
+  class ErrorCategory;
+
+  struct Stats {
+    size_t degree = 0;
+    unsigned iterations = 0;   // Aberth sweeps
+    unsigned polishSteps = 0;  // accepted Newton steps, over all roots
+  };
+
+  static constexpr unsigned MaxIterations = 500;
+
+  /**
+   * Roots of the polynomial with the given @p coefficients, lowest power
+   * first, repeated by multiplicity and sorted by real, then imaginary
+   * part.
+   */
+  static Result<std::vector<Number>> solve(const std::vector<Number>& coefficients,
+                                           Stats* stats = nullptr);
+
+  /**
+   * Roots of @p e as a polynomial in @p x. Other symbols are constants,
+   * with their values in @p t.
+   */
+  static Result<std::vector<Number>> solve(const Expr* e,
+                                           const Symbol& x,
+                                           const SymbolTable& t,
+                                           Stats* stats = nullptr);
+
+  /// Roots of @p e in the one symbol of it that @p t does not define.
+  static Result<std::vector<Number>> solve(const Expr* e,
+                                           const SymbolTable& t,
+                                           Stats* stats = nullptr);
+};
+
+class RootFinder::ErrorCategory : public std::error_category {
+ public:
+  static const ErrorCategory& get();
+
+  const char* name() const noexcept override;
+  std::string message(int ec) const override;
+};
+
+inline std::error_code make_error_code(RootFinder::ErrorCode ec) {
+  return std::error_code(static_cast<int>(ec), RootFinder::ErrorCategory::get());
+}
+
+}  // namespace cmath
+
+namespace std {
+template <>
+struct is_error_code_enum<cmath::RootFinder::ErrorCode> : public true_type {};
+}  // namespace std
@@ -0,0 +1,681 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/series.h>
+#include <cmath/accumulate.h>
+#include <cmath/builtins.h>
+#include <cmath/polynomial.h>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <vector>
+
+namespace cmath {
+
+namespace {
+
+// ranges of up to so many terms are summed term by term, as by the compiled
+// forms of the expression, which see no closed forms
+constexpr double MaxDirectTerms = 64;
+
+// {{{ closed forms
+// Whether @p e may depend on the index @p k; nodes it does not know of are
+// taken to, as are calls of user-defined mappings, whose bodies see the
+// symbols of the caller.
+bool mentions(const Expr* e, const Symbol& k) {
+  if (dynamic_cast<const NumberExpr*>(e))
+    return false;
+
+  if (auto s = dynamic_cast<const SymbolExpr*>(e))
+    return s->symbolName() == k;
+
+  if (auto u = dynamic_cast<const UnaryExpr*>(e))
+    return mentions(u->subExpr(), k);
+
+  if (auto n = dynamic_cast<const NegExpr*>(e))
+    return mentions(n->subExpr(), k);
+
+  if (auto b = dynamic_cast<const BinaryExpr*>(e))
+    return mentions(b->left(), k) || mentions(b->right(), k);
+
+  if (auto s = dynamic_cast<const SumExpr*>(e))
+    return std::any_of(s->terms().begin(), s->terms().end(),
+                       [&](const SumExpr::Term& t) { return mentions(t.expr.get(), k); });
+
+  if (auto p = dynamic_cast<const ProductExpr*>(e))
+    return std::any_of(p->factors().begin(), p->factors().end(),
+                       [&](const auto& f) { return mentions(f.get(), k); });
+
+  if (auto p = dynamic_cast<const PolynomialExpr*>(e))
+    return mentions(p->source(), k);
+
+  if (auto c = dynamic_cast<const CallExpr*>(e))
+    return dynamic_cast<const CustomMappingDef*>(c->mapping()) != nullptr ||
+           std::any_of(c->inputs().begin(), c->inputs().end(),
+                       [&](const auto& i) { return mentions(i.get(), k); });
+
+  if (auto s = dynamic_cast<const SeriesExpr*>(e))
+    return mentions(s->first(), k) || (s->last() && mentions(s->last(), k)) ||
+           (s->index() != k && mentions(s->body(), k));
+
+  return true;
+}
+
+// Recognizes @p e as c0 + c1 k, the term of an arithmetic series.
+bool linear(const Expr* e, const Symbol& k, const SymbolTable& t, Number* c0, Number* c1) {
+  if (!mentions(e, k)) {
+    *c0 = e->calculate(t);
+    *c1 = 0;
+    return true;
+  }
+
+  if (dynamic_cast<const SymbolExpr*>(e)) {
+    *c0 = 0;
+    *c1 = 1;
+    return true;
+  }
+
+  Number a0, a1, b0, b1;
+
+  if (auto n = dynamic_cast<const NegExpr*>(e)) {
+    if (!linear(n->subExpr(), k, t, &a0, &a1))
+      return false;
+    *c0 = -a0;
+    *c1 = -a1;
+    return true;
+  }
+
+  if (dynamic_cast<const PlusExpr*>(e) || dynamic_cast<const MinusExpr*>(e)) {
+    auto b = static_cast<const BinaryExpr*>(e);
+    if (!linear(b->left(), k, t, &a0, &a1) || !linear(b->right(), k, t, &b0, &b1))
+      return false;
+    const double sign = dynamic_cast<const MinusExpr*>(e) ? -1 : 1;
+    *c0 = a0 + sign * b0;
+    *c1 = a1 + sign * b1;
+    return true;
+  }
+
+  if (auto s = dynamic_cast<const SumExpr*>(e)) {
+    *c0 = 0;
+    *c1 = 0;
+    for (const SumExpr::Term& term : s->terms()) {
+      if (!linear(term.expr.get(), k, t, &a0, &a1))
+        return false;
+      *c0 += term.subtract ? -a0 : a0;
+      *c1 += term.subtract ? -a1 : a1;
+    }
+    return true;
+  }
+
+  // products with a single factor that depends on k
+  if (dynamic_cast<const MulExpr*>(e) || dynamic_cast<const ProductExpr*>(e)) {
+    std::vector<const Expr*> factors;
+    if (auto p = dynamic_cast<const ProductExpr*>(e)) {
+      for (const auto& f : p->factors())
+        factors.push_back(f.get());
+    } else {
+      factors.push_back(static_cast<const BinaryExpr*>(e)->left());
+      factors.push_back(static_cast<const BinaryExpr*>(e)->right());
+    }
+    Number scale = 1;
+    const Expr* dependent = nullptr;
+    for (const Expr* f : factors) {
+      if (!mentions(f, k))
+        scale *= f->calculate(t);
+      else if (dependent)
+        return false;
+      else
+        dependent = f;
+    }
+    if (!linear(dependent, k, t, &a0, &a1))
+      return false;
+    *c0 = scale * a0;
+    *c1 = scale * a1;
+    return true;
+  }
+
+  if (auto d = dynamic_cast<const DivExpr*>(e)) {
+    if (mentions(d->right(), k) || !linear(d->left(), k, t, &a0, &a1))
+      return false;
+    const Number divisor = d->right()->calculate(t);
+    *c0 = a0 / divisor;
+    *c1 = a1 / divisor;
+    return true;
+  }
+
+  return false;
+}
+
+// Recognizes @p e as c r^j for k = first + j, the term of a geometric series.
+bool geometric(const Expr* e,
+               const Symbol& k,
+               double first,
+               const SymbolTable& t,
+               Number* c,
+               Number* r) {
+  if (!mentions(e, k)) {
+    *c = e->calculate(t);
+    *r = 1;
+    return true;
+  }
+
+  Number a0, a1, b0, b1;
+
+  if (auto p = dynamic_cast<const PowExpr*>(e)) {
+    if (mentions(p->left(), k) || !linear(p->right(), k, t, &a0, &a1))
+      return false;
+    const Number base = p->left()->calculate(t);
+    *c = power(base, a0 + a1 * first);
+    *r = power(base, a1);
+    return true;
+  }
+
+  if (auto call = dynamic_cast<const CallExpr*>(e)) {
+    if (call->mapping() != lookupBuiltin("exp") || call->inputs().size() != 1 ||
+        !linear(call->inputs()[0].get(), k, t, &a0, &a1))
+      return false;
+    *c = std::exp(a0 + a1 * first);
+    *r = std::exp(a1);
+    return true;
+  }
+
+  if (auto n = dynamic_cast<const NegExpr*>(e)) {
+    if (!geometric(n->subExpr(), k, first, t, c, r))
+      return false;
+    *c = -*c;
+    return true;
+  }
+
+  if (auto m = dynamic_cast<const MulExpr*>(e)) {
+    if (!geometric(m->left(), k, first, t, &a0, &a1) ||
+        !geometric(m->right(), k, first, t, &b0, &b1))
+      return false;
+    *c = a0 * b0;
+    *r = a1 * b1;
+    return true;
+  }
+
+  if (auto p = dynamic_cast<const ProductExpr*>(e)) {
+    *c = 1;
+    *r = 1;
+    for (const auto& f : p->factors()) {
+      if (!geometric(f.get(), k, first, t, &a0, &a1))
+        return false;
+      *c *= a0;
+      *r *= a1;
+    }
+    return true;
+  }
+
+  if (auto d = dynamic_cast<const DivExpr*>(e)) {
+    if (!geometric(d->left(), k, first, t, &a0, &a1) ||
+        !geometric(d->right(), k, first, t, &b0, &b1))
+      return false;
+    *c = a0 / b0;
+    *r = a1 / b1;
+    return true;
+  }
+
+  return false;
+}
+
+// One part of the arithmetic sum below. Vanishing coefficients are skipped,
+// so that a sum overflowing to infinity does not turn 0 * inf into NaN.
+double arithmeticSum(double c0, double c1, double first, double count) {
+  double s = 0;
+  if (c0 != 0)
+    s += count * c0;
+  if (c1 != 0)
+    s += c1 * (count * first) + c1 * (count * (count - 1) / 2);
+  return s;
+}
+
+// Sum of c0 + c1 k over k = first, ..., first + count - 1, computed per part
+// as complex multiplication would mix an infinite part into the other.
+Result<Number> arithmeticSum(Number c0, Number c1, double first, double count) {
+  if (std::isinf(count)) {
+    if (c0 == 0.0 && c1 == 0.0)
+      return Number(0);
+    return Series::Divergent;
+  }
+  return Number(arithmeticSum(c0.real(), c1.real(), first, count),
+                arithmeticSum(c0.imag(), c1.imag(), first, count));
+}
+
+// Sum of c r^j over j = 0, ..., count - 1.
+Result<Number> geometricSum(Number c, Number r, double count) {
+  if (std::isinf(count)) {
+    if (c == 0.0)
+      return Number(0);
+    if (std::abs(r) >= 1)
+      return Series::Divergent;
+    return c / (1.0 - r);
+  }
+  if (r == 1.0)
+    return c * count;
+  return c * (1.0 - power(r, count)) / (1.0 - r);
+}
+// }}}
+// {{{ acceleration
+// Extrapolates the limit of a sequence of partial results s_0, s_1, ...,
+// handed over one at a time.
+class Limit {
+ public:
+  // @p beta is the index of the first term, at least 1
+  Limit(double tolerance, double beta)
+      : tolerance_(tolerance), beta_(beta), scale_(0), n_(0) {}
+
+  /// Takes the next partial result; true once a method has settled.
+  bool add(Number s);
+
+  /// Settles for Levin's closest estimates, if they agree well enough.
+  bool settleForBest();
+
+  Number limit() const noexcept { return limit_; }
+  Series::Method method() const noexcept { return method_; }
+
+ private:
+  // Levin's transform takes the partial results from the first on, up to so
+  // many, past which it only loses accuracy
+  static constexpr size_t LevinTerms = 24;
+
+  // Wynn's epsilon table over the most recent partial results, an odd number
+  // of them for its even columns
+  static constexpr size_t WynnWindow = 15;
+
+  // Richardson extrapolation over so many doublings of the terms
+  static constexpr size_t RichardsonDepth = 12;
+
+  // relative agreement of a last resort estimate with the doublings
+  static constexpr double Plausible = 1e-3;
+
+  // accelerated results are only trusted from so many partial results on
+  static constexpr size_t MinPartials = 8;
+
+  // the epsilon table is built for every partial result up to so many, later
+  // for every so many
+  static constexpr size_t Sparse = 4096;
+  static constexpr size_t SparseStep = 64;
+
+  // successive estimates of one method
+  struct Estimates {
+    Number previous[2];
+    size_t count = 0;
+  };
+
+  bool settle(Estimates* e, Number estimate, Series::Method method);
+
+  Number levin() const;
+  Number wynn() const;
+  Number richardson() const;
+
+  double tolerance_;
+  double beta_;
+  double scale_;                   // largest |s_n| so far
+  size_t n_;                       // partial results so far
+  std::vector<Number> first_;      // s_0, ..., s_(LevinTerms-1)
+  std::deque<Number> recent_;      // s_(n-WynnWindow), ..., s_(n-1)
+  std::vector<Number> doublings_;  // s_(2^j - 1), the sums of 2^j terms
+  std::vector<double> nodes_;      // 1 / (beta + 2^j), for each of them
+  Estimates levin_;
+  Estimates shanks_;
+  Estimates richardson_;
+  Number best_;  // Levin's estimate with the smallest spread to the two before
+  double bestSpread_ = std::numeric_limits<double>::infinity();
+  Number limit_;
+  Series::Method method_ = Series::Method::Direct;
+};
+
+bool Limit::add(Number s) {
+  scale_ = std::max(scale_, std::abs(s));
+  if (first_.size() < LevinTerms)
+    first_.push_back(s);
+  recent_.push_back(s);
+  if (recent_.size() > WynnWindow)
+    recent_.pop_front();
+  ++n_;
+
+  const bool doubled = (n_ & (n_ - 1)) == 0;
+  if (doubled) {
+    doublings_.push_back(s);
+    nodes_.push_back(1 / (beta_ + n_));
+    if (doublings_.size() > RichardsonDepth) {
+      doublings_.erase(doublings_.begin());
+      nodes_.erase(nodes_.begin());
+    }
+  }
+
+  if (n_ < MinPartials)
+    return false;
+
+  if (n_ <= LevinTerms && settle(&levin_, levin(), Series::Method::Levin))
+    return true;
+
+  if ((n_ < Sparse || n_ % SparseStep == 0) &&
+      settle(&shanks_, wynn(), Series::Method::Shanks))
+    return true;
+
+  if (doubled && settle(&richardson_, richardson(), Series::Method::Richardson))
+    return true;
+
+  return false;
+}
+
+bool Limit::settle(Estimates* e, Number estimate, Series::Method method) {
+  if (!std::isfinite(estimate.real()) || !std::isfinite(estimate.imag())) {
+    e->count = 0;
+    return false;
+  }
+
+  const double tolerance = tolerance_ * std::max(scale_, std::abs(estimate));
+  const bool settled = e->count >= 2 &&
+                       std::abs(estimate - e->previous[0]) <= tolerance &&
+                       std::abs(e->previous[0] - e->previous[1]) <= tolerance;
+
+  // Levin's transform also accelerates logarithmic convergence, on which the
+  // others stall, often far from the limit, with estimates just as close
+  if (method == Series::Method::Levin && e->count >= 2) {
+    const double spread = std::max(std::abs(estimate - e->previous[0]),
+                                   std::abs(e->previous[0] - e->previous[1]));
+    if (spread < bestSpread_) {
+      best_ = estimate;
+      bestSpread_ = spread;
+    }
+  }
+
+  e->previous[1] = e->previous[0];
+  e->previous[0] = estimate;
+  ++e->count;
+
+  if (settled) {
+    limit_ = estimate;
+    method_ = method;
+  }
+  return settled;
+}
+
+// As a last resort, the tolerance lowered to its square root, as Levin's
+// transform loses accuracy to cancellation before it would settle within it.
+// As it also sums some divergent series, such as that of 1/sqrt(k), the
+// estimate must agree with the partial results at the last doublings, their
+// differences extrapolated geometrically, as those of a tail falling like a
+// power of n are.
+bool Limit::settleForBest() {
+  const double scale = std::max(scale_, std::abs(best_));
+  if (bestSpread_ > std::sqrt(tolerance_) * scale || doublings_.size() < 3)
+    return false;
+
+  const size_t j = doublings_.size() - 1;
+  const Number d1 = doublings_[j] - doublings_[j - 1];
+  const Number d0 = doublings_[j - 1] - doublings_[j - 2];
+  const double q = std::abs(d1) / std::abs(d0);
+  if (!(q < 1))
+    return false;
+
+  const Number tail = d1 * (q / (1 - q));
+  if (std::abs(doublings_[j] + tail - best_) > Plausible * scale)
+    return false;
+
+  limit_ = best_;
+  method_ = Series::Method::Levin;
+  return true;
+}
+
+// Levin's u-transform of all partial results so far, weighting them by the
+// remainder estimates w_j = (beta + j) a_j of their last terms.
+Number Limit::levin() const {
+  const size_t K = first_.size() - 2;
+  Number numerator = 0;
+  Number denominator = 0;
+  double binomial = 1;
+  for (size_t j = 1; j <= K + 1; ++j) {
+    const Number w = (beta_ + j) * (first_[j] - first_[j - 1]);
+    const double c = (j % 2 ? binomial : -binomial) *
+                     std::pow((beta_ + j) / (beta_ + K + 1), K - 1.0);
+    numerator += c * first_[j] / w;
+    denominator += c / w;
+    binomial = binomial * (K - j + 1) / j;
+  }
+  return numerator / denominator;
+}
+
+// Wynn's epsilon algorithm, whose even columns are Shanks' transformation
+// of the partial results, iterated.
+Number Limit::wynn() const {
+  const size_t m = (recent_.size() - 1) | 1;
+  std::vector<Number> previous(m + 1, Number(0));
+  std::vector<Number> current(recent_.end() - m, recent_.end());
+  Number best = current.back();
+  for (size_t column = 1; column < m; ++column) {
+    std::vector<Number> next(m - column);
+    for (size_t i = 0; i < next.size(); ++i)
+      next[i] = previous[i + 1] + 1.0 / (current[i + 1] - current[i]);
+    previous = std::move(current);
+    current = std::move(next);
+    if (column % 2 == 0)
+      best = current.back();
+  }
+  return best;
+}
+
+// Neville's scheme in h = 1 / (beta + n), extrapolating the partial results
+// at n = 2^j to h = 0.
+Number Limit::richardson() const {
+  std::vector<Number> table = doublings_;
+  for (size_t m = 1; m < table.size(); ++m)
+    for (size_t i = table.size() - 1; i >= m; --i)
+      table[i] += (table[i] - table[i - 1]) * (nodes_[i] / (nodes_[i - m] - nodes_[i]));
+  return table.back();
+}
+
+// Partial sums (products) of term(first + j) for j < count, stopped as soon
+// as the terms left cannot change the result any more, or extrapolated.
+Result<Number> accumulate(const Series::Term& term,
+                          double first,
+                          double count,
+                          bool product,
+                          const Series::Options& options,
+                          Series::Stats* stats) {
+  const bool infinite = std::isinf(count);
+  if (!infinite && count > options.maxFiniteTerms) {
+    // the difference (quotient) of the series from first and from first + count
+    Series::Stats tail;
+    Result<Number> head = accumulate(term, first, INFINITY, product,
+                                     options, stats);
+    if (!head)
+      return head;
+    Result<Number> rest = accumulate(term, first + count, INFINITY, product, options,
+                                     &tail);
+    if (!rest)
+      return rest;
+    stats->terms += tail.terms;
+    return product ? *head / *rest : *head - *rest;
+  }
+
+  SumAccumulator sum;
+  Number partial = product ? 1 : 0;
+  Limit limit(options.tolerance, std::max(first, 1.0));
+  double scale = 0;
+  double change = std::numeric_limits<double>::infinity();
+  size_t small = 0;  // changes in a row below the tolerance, each half the last
+
+  stats->method = Series::Method::Direct;
+  for (size_t j = 0; j < count; ++j) {
+    if (infinite && j == options.maxTerms) {
+      if (!limit.settleForBest())
+        return Series::NoConvergence;
+      stats->method = limit.method();
+      return limit.limit();
+    }
+
+    const Number x = term(first + j);
+    const Number previous = partial;
+    if (product) {
+      partial *= x;
+    } else {
+      // onto the empty sum, 0, as the closed forms add up, so that a first
+      // term of -0 parts does not keep them
+      sum.add(j ? x : Number(0) + x);
+      partial = sum.result();
+    }
+    stats->terms = j + 1;
+
+    if (!std::isfinite(partial.real()) || !std::isfinite(partial.imag()))
+      return partial;
+
+    scale = std::max(scale, std::abs(partial));
+    const double c = std::abs(partial - previous);
+    small = scale > 0 && c <= options.tolerance * scale && c <= change / 2 ? small + 1 : 0;
+    change = c;
+    if (small == 3)
+      return partial;
+
+    if (infinite && limit.add(partial)) {
+      stats->method = limit.method();
+      return limit.limit();
+    }
+  }
+  return partial;
+}
+
+// Number of indices from @p first to @p last.
+bool countOf(double first, double last, double* count) {
+  if (!std::isfinite(first) || std::isnan(last))
+    return false;
+
+  if (std::isinf(last))
+    *count = last > 0 ? last : 0;
+  else
+    *count = std::max(0.0, std::floor(last - first) + 1);
+  return true;
+}
+
+bool countOf(Number first, Number last, double* count) {
+  return first.imag() == 0 && last.imag() == 0 &&
+         countOf(first.real(), last.real(), count);
+}
+
+Result<Number> series(const Series::Term& term,
+                      double first,
+                      double last,
+                      bool product,
+                      const Series::Options& options,
+                      Series::Stats* stats) {
+  Series::Stats ignored;
+  if (!stats)
+    stats = &ignored;
+  *stats = Series::Stats{};
+
+  double count;
+  if (!countOf(first, last, &count))
+    return Series::InvalidRange;
+
+  if (count == 0)
+    return Number(product ? 1 : 0);
+
+  return accumulate(term, first, count, product, options, stats);
+}
+
+Result<Number> series(const Expr* e,
+                      const Symbol& k,
+                      Number first,
+                      Number last,
+                      const SymbolTable& t,
+                      bool product,
+                      const Series::Options& options,
+                      Series::Stats* stats) {
+  double count;
+  if (!countOf(first, last, &count))
+    return Series::InvalidRange;
+
+  if (!product && count > MaxDirectTerms) {
+    Number c0, c1;
+    if (linear(e, k, t, &c0, &c1)) {
+      if (stats)
+        *stats = Series::Stats{Series::Method::ClosedForm, 0};
+      return arithmeticSum(c0, c1, first.real(), count);
+    }
+    if (geometric(e, k, first.real(), t, &c0, &c1)) {
+      if (stats)
+        *stats = Series::Stats{Series::Method::ClosedForm, 0};
+      return geometricSum(c0, c1, count);
+    }
+  }
+
+  SymbolTable scope(&t);
+  auto term = [&](double x) {
+    scope.defineConstant(k, Number(x));
+    return e->calculate(scope);
+  };
+  return series(term, first.real(), last.real(), product, options, stats);
+}
+// }}}
+
+}  // namespace
+
+// {{{ Series
+Result<Number> Series::sum(const Term& term,
+                           double first,
+                           double last,
+                           const Options& options,
+                           Stats* stats) {
+  return series(term, first, last, false, options, stats);
+}
+
+Result<Number> Series::product(const Term& term,
+                               double first,
+                               double last,
+                               const Options& options,
+                               Stats* stats) {
+  return series(term, first, last, true, options, stats);
+}
+
+Result<Number> Series::sum(const Expr* e,
+                           const Symbol& k,
+                           Number first,
+                           Number last,
+                           const SymbolTable& t,
+                           const Options& options,
+                           Stats* stats) {
+  return series(e, k, first, last, t, false, options, stats);
+}
+
+Result<Number> Series::product(const Expr* e,
+                               const Symbol& k,
+                               Number first,
+                               Number last,
+                               const SymbolTable& t,
+                               const Options& options,
+                               Stats* stats) {
+  return series(e, k, first, last, t, true, options, stats);
+}
+// }}}
+// {{{ Series::ErrorCategory
+const Series::ErrorCategory& Series::ErrorCategory::get() {
+  static ErrorCategory c;
+  return c;
+}
+
+const char* Series::ErrorCategory::name() const noexcept {
+  return "SeriesError";
+}
+
+std::string Series::ErrorCategory::message(int ec) const {
+  switch (static_cast<ErrorCode>(ec)) {
+    case InvalidRange:
+      return "Series bounds are not real";
+    case Divergent:
+      return "Series diverges";
+    case NoConvergence:
+      return "Series did not converge";
+  }
+  return "Unknown error";
+}
+// }}}
+
+}  // namespace cmath
@@ -0,0 +1,125 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <cmath/result.h>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <system_error>
+
+namespace cmath {
+
+/**
+ * Sums and products of a term over k = first, first + 1, ... up to last,
+ * which may be infinity.
+ *
+ * Sums of terms linear in k (arithmetic series) and of terms c r^k
+ * (geometric series) are recognized from the expression and taken in
+ * closed form over more than 64 terms, at a cost independent of the
+ * length of the range.
+ *
+ * Otherwise terms are evaluated one at a time and the partial results
+ * kept only as far as needed. The stream stops as soon as the terms have
+ * fallen below the tolerance and keep falling at least geometrically, so
+ * that the rest cannot change the result. Infinite series that converge
+ * slower are extrapolated from the partial results so far, by Levin's
+ * u-transform, by Wynn's epsilon algorithm (Shanks' transformation) and
+ * by Richardson extrapolation in 1/n at n = 2^j terms; whichever settles
+ * first, with successive estimates agreeing within the tolerance, yields
+ * the limit. Should none settle within maxTerms, Levin's closest estimates
+ * are taken if they agree within the square root of the tolerance, as for
+ * the slowest series, whose terms fall like a power of k just below -1.
+ *
+ * Finite ranges are summed term by term, compensated, up to
+ * maxFiniteTerms; longer ones are taken as the difference (quotient) of
+ * two infinite series.
+ */
+class Series {
+ public:
+  enum ErrorCode {
+    InvalidRange = 1,
+    Divergent,
+    NoConvergence,
+  };
+  class ErrorCategory;
+
+  enum class Method {
+    Empty,
+    ClosedForm,
+    Direct,
+    Levin,
+    Shanks,
+    Richardson,
+  };
+
+  struct Options {
+    double tolerance = 1e-13;                 // relative to the largest partial result
+    size_t maxTerms = 1 << 20;                // before giving up on an infinite series
+    size_t maxFiniteTerms = size_t(1) << 27;  // summed term by term
+  };
+
+  struct Stats {
+    Method method = Method::Empty;
+    size_t terms = 0;  // evaluations of the term
+  };
+
+  /// Term for index k.
+  using Term = std::function<Number(double k)>;
+
+  static Result<Number> sum(const Term& term,
+                            double first,
+                            double last,
+                            const Options& options,
+                            Stats* stats = nullptr);
+
+  static Result<Number> product(const Term& term,
+                                double first,
+                                double last,
+                                const Options& options,
+                                Stats* stats = nullptr);
+
+  /**
+   * Sum of @p e over @p k from @p first to @p last, both real. Other
+   * symbols are constants, with their values in @p t.
+   */
+  static Result<Number> sum(const Expr* e,
+                            const Symbol& k,
+                            Number first,
+                            Number last,
+                            const SymbolTable& t,
+                            const Options& options,
+                            Stats* stats = nullptr);
+
+  static Result<Number> product(const Expr* e,
+                                const Symbol& k,
+                                Number first,
+                                Number last,
+                                const SymbolTable& t,
+                                const Options& options,
+                                Stats* stats = nullptr);
+};
+
+class Series::ErrorCategory : public std::error_category {
+ public:
+  static const ErrorCategory& get();
+
+  const char* name() const noexcept override;
+  std::string message(int ec) const override;
+};
+
+inline std::error_code make_error_code(Series::ErrorCode ec) {
+  return std::error_code(static_cast<int>(ec), Series::ErrorCategory::get());
+}
+
+}  // namespace cmath
+
+namespace std {
+template <>
+struct is_error_code_enum<cmath::Series::ErrorCode> : public true_type {};
+}  // namespace std
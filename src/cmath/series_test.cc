@@ -0,0 +1,66 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/series.h>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace cmath;
+
+namespace {
+
+int failures = 0;
+
+void expect(bool ok, const std::string& what) {
+  if (!ok) {
+    std::cerr << "FAILED: " << what << '\n';
+    failures++;
+  }
+}
+
+bool near(const Result<Number>& x, double expected, double tolerance) {
+  return x && std::abs(x->real() - expected) <= tolerance * std::abs(expected);
+}
+
+void testLongFiniteRange() {
+  const Series::Options options;
+  const double n = 2e6;  // past maxTerms
+
+  Result<Number> squares = Series::sum([](double k) { return Number(1 / (k * k)); }, 1,
+                                       n, options);
+  expect(near(squares, M_PI * M_PI / 6 - 1 / n + 1 / (2 * n * n), 1e-13),
+         "sum over 1/k^2 for k = 1 to 2e6");
+
+  // harmonic number, whose infinite series diverges
+  Result<Number> harmonic = Series::sum([](double k) { return Number(1 / k); }, 1, n,
+                                        options);
+  const double gamma = 0.57721566490153286;
+  expect(near(harmonic, std::log(n) + gamma + 1 / (2 * n) - 1 / (12 * n * n), 1e-13),
+         "sum over 1/k for k = 1 to 2e6");
+}
+
+void testSlowSeries() {
+  Series::Stats stats;
+  Result<Number> zeta = Series::sum([](double k) { return Number(std::pow(k, -1.1)); },
+                                    1, INFINITY, Series::Options(), &stats);
+  expect(near(zeta, 10.584448464950809, 1e-7), "sum over 1/k^1.1 for k = 1 to infinity");
+  expect(stats.method == Series::Method::Levin, "zeta(1.1) by Levin's transform");
+
+  Result<Number> divergent = Series::sum(
+      [](double k) { return Number(1 / std::sqrt(k)); }, 1, INFINITY, Series::Options());
+  expect(!divergent, "sum over 1/sqrt(k) for k = 1 to infinity diverges");
+}
+
+}  // namespace
+
+int main() {
+  testLongFiniteRange();
+  testSlowSeries();
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,408 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/simd.h>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+// The kernels below must stay free of branches, calls other than to
+// sqrt/fabs/copysign, and 64-bit integer operations beyond SSE2 (add,
+// shift, and, or, xor), or the loops calling them no longer vectorize.
+// Conditions are written as selects between values computed either way.
+
+namespace cmath {
+namespace simd {
+
+namespace {
+
+using Complex = std::complex<double>;
+
+// arguments processed at a time, copied first, as outputs may alias them
+constexpr size_t Chunk = 64;
+
+// x + Shift - Shift rounds x to the nearest integer, which also ends up in
+// the low bits of x + Shift
+constexpr double Shift = 0x1.8p52;
+
+// the trigonometric reduction is accurate up to here
+constexpr double MaxReduce = 32768;
+
+constexpr double Log2e = 1.44269504088896338700;
+constexpr double Ln2Hi = 6.93147180369123816490e-01;  // 32 bits of ln 2
+constexpr double Ln2Lo = 1.90821492927058770002e-10;
+
+constexpr double TwoOverPi = 6.36619772367581382433e-01;
+constexpr double PiO2_1 = 1.57079632673412561417e+00;  // 33 bits of pi/2 each
+constexpr double PiO2_2 = 6.07710050630396597660e-11;
+constexpr double PiO2_3 = 2.02226624871116645580e-21;
+constexpr double PiO2_3t = 8.47842766036889956997e-32;
+
+constexpr double Pi = 3.14159265358979311600e+00;
+constexpr double PiLo = 1.22464679914735317720e-16;
+constexpr double PiO2 = 1.57079632679489655800e+00;
+constexpr double PiO2Lo = 6.12323399573676588610e-17;
+constexpr double PiO4 = 7.85398163397448278999e-01;
+constexpr double PiO4Lo = 3.06161699786838294306e-17;
+constexpr double TanPiO8 = 4.14213562373095034e-01;
+constexpr double Sqrt2 = 1.41421356237309514547e+00;
+constexpr double SqrtHalf = 7.07106781186547572737e-01;
+
+// {{{ bits
+inline uint64_t bits(double x) {
+  uint64_t u;
+  std::memcpy(&u, &x, sizeof(u));
+  return u;
+}
+
+inline double fromBits(uint64_t u) {
+  double x;
+  std::memcpy(&x, &u, sizeof(x));
+  return x;
+}
+
+// @p a where the low bit of @p mask is set, else @p b
+inline double select(uint64_t mask, double a, double b) {
+  const uint64_t m = 0 - (mask & 1);
+  return fromBits((bits(a) & m) | (bits(b) & ~m));
+}
+
+inline double flipSign(double x, uint64_t sign) {
+  return fromBits(bits(x) ^ (sign << 63));
+}
+// }}}
+// {{{ exp
+// e^r - 1 for |r| <= ln(2)/2, by its Taylor polynomial of degree 13
+inline double expm1Kernel(double r) {
+  double p = 1.0 / 6227020800;  // 1/13!
+  p = p * r + 1.0 / 479001600;
+  p = p * r + 1.0 / 39916800;
+  p = p * r + 1.0 / 3628800;
+  p = p * r + 1.0 / 362880;
+  p = p * r + 1.0 / 40320;
+  p = p * r + 1.0 / 5040;
+  p = p * r + 1.0 / 720;
+  p = p * r + 1.0 / 120;
+  p = p * r + 1.0 / 24;
+  p = p * r + 1.0 / 6;
+  p = p * r + 0.5;
+  return r + r * r * p;
+}
+
+// e^x = 2^k (1 + p) with |k| <= 1077; the bits of k + Shift into @p kb
+inline double expReduce(double x, uint64_t* kb) {
+  x = std::min(std::max(x, -746.0), 711.0);
+  const double kd = x * Log2e + Shift;
+  const double k = kd - Shift;
+  *kb = bits(kd);
+  return expm1Kernel((x - k * Ln2Hi) - k * Ln2Lo);
+}
+
+// y 2^(k - down) for the k of expReduce(), in two factors, each of which
+// is a normal number over the whole range of k
+inline double scale(double y, uint64_t kb, uint64_t down) {
+  const uint64_t u = kb - bits(Shift) + 2048 - down;  // k - down + 2048 > 0
+  const uint64_t h = u >> 1;
+  return y * fromBits((h - 1) << 52) * fromBits((u - h - 1) << 52);
+}
+
+inline double expReal(double x) {
+  uint64_t kb;
+  const double p = expReduce(x, &kb);
+  return scale(1 + p, kb, 0);
+}
+
+// sinh(y) and cosh(y) from one reduction of |y|: by e^|y| - 1 up to 20,
+// beyond by e^|y| / 2, which is finite up to 710.4
+inline void sinhCosh(double y, double* sh, double* ch) {
+  const double a = std::fabs(y);
+  uint64_t kb;
+  const double p = expReduce(a, &kb);
+  const double s = scale(1, kb, 0);
+  const double em = s * p + (s - 1);
+  const double e = em + 1;
+  const double large = scale(1 + p, kb, 1);
+  const bool small = a <= 20;
+  *sh = std::copysign(small ? 0.5 * (em + em / e) : large, y);
+  *ch = small ? 0.5 * (e + 1 / e) : large;
+}
+// }}}
+// {{{ sin, cos
+// sin(r) and cos(r) for |r| <= pi/4 (fdlibm's polynomials)
+inline double sinKernel(double r) {
+  const double z = r * r;
+  const double w = z * z;
+  const double p = 8.33333333332248946124e-03 +
+                   z * (-1.98412698298579493134e-04 + z * 2.75573137070700676789e-06) +
+                   z * w * (-2.50507602534068634195e-08 + z * 1.58969099521155010221e-10);
+  return r + z * r * (-1.66666666666666324348e-01 + z * p);
+}
+
+inline double cosKernel(double r) {
+  const double z = r * r;
+  const double w = z * z;
+  const double p = z * (4.16666666666666019037e-02 +
+                        z * (-1.38888888888741095749e-03 + z * 2.48015872894767294178e-05)) +
+                   w * w *
+                       (-2.75573143513906633035e-07 +
+                        z * (2.08757232129817482790e-09 + z * -1.13596475577881948265e-11));
+  const double hz = 0.5 * z;
+  const double v = 1 - hz;
+  return v + (((1 - v) - hz) + z * p);
+}
+
+// sin(x) and cos(x) for |x| <= MaxReduce, by x = q pi/2 + r with r from
+// 152 bits of pi/2, exact up to the last rounding
+inline void sinCos(double x, double* s, double* c) {
+  const double qd = x * TwoOverPi + Shift;
+  const double q = qd - Shift;
+  const uint64_t qb = bits(qd);
+
+  const double r1 = x - q * PiO2_1;  // exact
+  const double w = q * PiO2_2;
+  const double t = r1 - w;
+  const double err = (r1 - t) - w;
+  const double r = t - ((q * PiO2_3 + q * PiO2_3t) - err);  // keeps -0
+
+  const double sr = r == 0 ? r : sinKernel(r);
+  const double cr = cosKernel(r);
+  *s = flipSign(select(qb, cr, sr), qb >> 1);
+  *c = flipSign(select(qb, sr, cr), (qb + 1) >> 1);
+}
+// }}}
+// {{{ log
+// k ln(2) + log(1 + f) for sqrt(1/2) - 1 <= f <= sqrt(2) - 1 (fdlibm)
+inline double logKernel(double f, double k) {
+  const double s = f / (2 + f);
+  const double z = s * s;
+  const double w = z * z;
+  const double t1 = w * (3.999999999940941908e-01 +
+                         w * (2.222219843214978396e-01 + w * 1.531383769920937332e-01));
+  const double t2 =
+      z * (6.666666666666735130e-01 +
+           w * (2.857142874366239149e-01 +
+                w * (1.818357216161805012e-01 + w * 1.479819860511658591e-01)));
+  const double hfsq = 0.5 * f * f;
+  return k * Ln2Hi - ((hfsq - (s * (hfsq + t2 + t1) + k * Ln2Lo)) - f);
+}
+
+// log(x) + k ln(2) for positive normal x
+inline double logReal(double x, double k) {
+  const uint64_t u = bits(x);
+  const double e = fromBits(UINT64_C(0x4330000000000000) | (u >> 52)) - (0x1p52 + 1023);
+  const double m = fromBits((u & UINT64_C(0x000fffffffffffff)) | UINT64_C(0x3ff0000000000000));
+  const bool big = m > Sqrt2;
+  return logKernel((big ? 0.5 * m : m) - 1, k + e + (big ? 1 : 0));
+}
+// }}}
+// {{{ atan2
+// atan(u) - u for |u| <= tan(pi/8) (Cephes)
+inline double atanKernel(double u) {
+  const double z = u * u;
+  const double p = (((-8.750608600031904122785e-01 * z - 1.615753718733365076637e+01) * z -
+                     7.500855792314704667340e+01) * z - 1.228866684490136173410e+02) * z -
+                   6.485021904942025371773e+01;
+  const double q = ((((z + 2.485846490142306297962e+01) * z + 1.650270098316988542046e+02) * z +
+                     4.328810604912902668951e+02) * z + 4.853903996359136964868e+02) * z +
+                   1.945506571482613964425e+02;
+  return u * z * p / q;
+}
+
+// atan2(y, x) for finite, not both zero x and y
+inline double atan2Real(double y, double x) {
+  const double ax = std::fabs(x);
+  const double ay = std::fabs(y);
+  const double a = std::min(ax, ay);
+  const double b = std::max(ax, ay);
+  const double t = a / b;
+
+  // atan(t) = pi/4 + atan((t - 1) / (t + 1)) above tan(pi/8)
+  const bool upper = t > TanPiO8;
+  const double u = upper ? (a - b) / (a + b) : t;
+  double angle = (upper ? PiO4 : 0) + (u + (atanKernel(u) + (upper ? PiO4Lo : 0)));
+
+  angle = ay > ax ? (PiO2 - angle) + PiO2Lo : angle;
+  angle = x < 0 ? (Pi - angle) + PiLo : angle;
+  return std::copysign(angle, y);
+}
+// }}}
+// {{{ array loops
+inline bool finite(double x) {
+  return std::fabs(x) <= std::numeric_limits<double>::max();
+}
+
+// Calls @p kernel on all arguments, a chunk at a time, then @p fallback
+// for the arguments @p covers rejects.
+template <typename Kernel, typename Covers, typename Fallback>
+void apply(size_t n,
+           const double* re,
+           const double* im,
+           double* outRe,
+           double* outIm,
+           Kernel kernel,
+           Covers covers,
+           Fallback fallback) {
+  alignas(64) double x[Chunk];
+  alignas(64) double y[Chunk];
+
+  for (size_t i = 0; i < n; i += Chunk) {
+    const size_t m = std::min(Chunk, n - i);
+    std::copy(re + i, re + i + m, x);
+    std::copy(im + i, im + i + m, y);
+    double* u = outRe + i;
+    double* v = outIm + i;
+
+    for (size_t k = 0; k < m; ++k)
+      kernel(x[k], y[k], u[k], v[k]);
+
+    for (size_t k = 0; k < m; ++k) {
+      if (!covers(x[k], y[k])) {
+        const Complex z = fallback(x[k], y[k]);
+        u[k] = z.real();
+        v[k] = z.imag();
+      }
+    }
+  }
+}
+// }}}
+
+}  // namespace
+
+void exp(size_t n, const double* re, const double* im, double* outRe, double* outIm) {
+  apply(n, re, im, outRe, outIm,
+        [](double x, double y, double& u, double& v) {
+          double s, c;
+          sinCos(y, &s, &c);
+          const double e = expReal(x);
+          u = e * c;
+          v = e * s;
+        },
+        [](double x, double y) { return x <= 709 && x >= -746 && std::fabs(y) <= MaxReduce; },
+        [](double x, double y) { return std::exp(Complex(x, y)); });
+}
+
+void log(size_t n, const double* re, const double* im, double* outRe, double* outIm) {
+  apply(n, re, im, outRe, outIm,
+        [](double x, double y, double& u, double& v) {
+          // scale by a power of two, so that |z|^2 neither overflows nor
+          // underflows
+          const double a = std::max(std::fabs(x), std::fabs(y));
+          const double b = std::min(std::fabs(x), std::fabs(y));
+          const double s = a > 0x1p500 ? 0x1p-600 : a < 0x1p-500 ? 0x1p600 : 1;
+          const double k = a > 0x1p500 ? 1200 : a < 0x1p-500 ? -1200 : 0;
+          const double sa = s * a;
+          const double sb = s * b;
+          const double norm = sa * sa + sb * sb;
+
+          // log1p(|z|^2 - 1) near the unit circle, where |z|^2 - 1 cancels
+          const bool unit = k == 0 && norm >= SqrtHalf && norm <= Sqrt2;
+          const double f = (a - 1) * (a + 1) + b * b;
+          u = 0.5 * (unit ? logKernel(f, 0) : logReal(norm, k));
+          v = atan2Real(y, x);
+        },
+        [](double x, double y) {
+          return finite(x) && finite(y) && (x != 0 || y != 0);
+        },
+        [](double x, double y) { return std::log(Complex(x, y)); });
+}
+
+void sqrt(size_t n, const double* re, const double* im, double* outRe, double* outIm) {
+  apply(n, re, im, outRe, outIm,
+        [](double x, double y, double& u, double& v) {
+          const double ax = std::fabs(x);
+          const double ay = std::fabs(y);
+          const double a = std::max(ax, ay);
+          const double r = std::min(ax, ay) / a;
+          const double t = std::sqrt(0.5 * ax + 0.5 * (a * std::sqrt(1 + r * r)));
+          u = x >= 0 ? t : ay / (2 * t);
+          v = x >= 0 ? y / (2 * t) : std::copysign(t, y);
+        },
+        [](double x, double y) {
+          const double a = std::max(std::fabs(x), std::fabs(y));
+          return a >= 1e-300 && a <= 1e300 && !std::isnan(x) && !std::isnan(y);
+        },
+        [](double x, double y) { return std::sqrt(Complex(x, y)); });
+}
+
+void sin(size_t n, const double* re, const double* im, double* outRe, double* outIm) {
+  apply(n, re, im, outRe, outIm,
+        [](double x, double y, double& u, double& v) {
+          double s, c, sh, ch;
+          sinCos(x, &s, &c);
+          sinhCosh(y, &sh, &ch);
+          u = s * ch;
+          v = c * sh;
+        },
+        [](double x, double y) { return std::fabs(x) <= MaxReduce && std::fabs(y) <= 709; },
+        [](double x, double y) { return std::sin(Complex(x, y)); });
+}
+
+void cos(size_t n, const double* re, const double* im, double* outRe, double* outIm) {
+  apply(n, re, im, outRe, outIm,
+        [](double x, double y, double& u, double& v) {
+          double s, c, sh, ch;
+          sinCos(x, &s, &c);
+          sinhCosh(y, &sh, &ch);
+          u = c * ch;
+          v = -(s * sh);
+        },
+        [](double x, double y) { return std::fabs(x) <= MaxReduce && std::fabs(y) <= 709; },
+        [](double x, double y) { return std::cos(Complex(x, y)); });
+}
+
+void tan(size_t n, const double* re, const double* im, double* outRe, double* outIm) {
+  apply(n, re, im, outRe, outIm,
+        [](double x, double y, double& u, double& v) {
+          // tan(x + iy) = (sin x cos x + i sinh y cosh y) / (cos^2 x + sinh^2 y),
+          // where the denominator does not cancel
+          double s, c, sh, ch;
+          sinCos(x, &s, &c);
+          sinhCosh(y, &sh, &ch);
+          const double d = c * c + sh * sh;
+          const bool small = std::fabs(y) <= 20;
+          u = small ? s * c / d : s * c / ch / ch;  // 4 sin x cos x e^(-2|y|)
+          v = small ? sh * ch / d : std::copysign(1.0, y);
+        },
+        [](double x, double y) { return std::fabs(x) <= MaxReduce && !std::isnan(y); },
+        [](double x, double y) { return std::tan(Complex(x, y)); });
+}
+
+void arg(size_t n, const double* re, const double* im, double* out) {
+  alignas(64) double x[Chunk];
+  alignas(64) double y[Chunk];
+
+  for (size_t i = 0; i < n; i += Chunk) {
+    const size_t m = std::min(Chunk, n - i);
+    std::copy(re + i, re + i + m, x);
+    std::copy(im + i, im + i + m, y);
+
+    for (size_t k = 0; k < m; ++k)
+      out[i + k] = atan2Real(y[k], x[k]);
+
+    for (size_t k = 0; k < m; ++k)
+      if (!finite(x[k]) || !finite(y[k]) || (x[k] == 0 && y[k] == 0))
+        out[i + k] = std::atan2(y[k], x[k]);
+  }
+}
+
+void polar(size_t n, const double* r, const double* theta, double* outRe, double* outIm) {
+  apply(n, r, theta, outRe, outIm,
+        [](double a, double t, double& u, double& v) {
+          double s, c;
+          sinCos(t, &s, &c);
+          u = a * c;
+          v = a * s;
+        },
+        [](double a, double t) { return finite(a) && std::fabs(t) <= MaxReduce; },
+        [](double a, double t) { return std::polar(a, t); });
+}
+
+}  // namespace simd
+}  // namespace cmath
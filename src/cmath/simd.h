@@ -0,0 +1,63 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cstddef>
+
+// Complex elementary functions over arrays, with the real and imaginary
+// parts of the arguments and results in separate arrays (structure of
+// arrays), as BatchProgram keeps its registers.
+//
+// The real kernels (exp, sin/cos with Cody-Waite reduction, log, atan2)
+// are polynomial and rational approximations without branches or table
+// lookups, written so that the compiler vectorizes each array loop. Lanes
+// the kernels do not cover (infinities, NaN, zero where the function has
+// a branch point, angles beyond 32768 for the trigonometric reduction,
+// results near overflow) are recomputed by std::complex afterwards, so special
+// values, signed zeros and branch cuts follow C99 Annex G as there.
+//
+// Errors are in units in the last place of the result's magnitude,
+// |f~(z) - f(z)| / ulp(|f(z)|), the largest over 200000 random arguments
+// in [-10, 10]^2 (log and sqrt also over magnitudes from 1e-300 to 1e300)
+// against extended precision; cmath_bench --filter simd/ reports them along
+// with the throughput. std::complex for comparison:
+//
+//   function      simd   std
+//   exp           1.8    1.7
+//   log           2.2    1.0   (near |z| = 1, the real part is within
+//                                 1e-16 absolute)
+//   sqrt          2.0    1.5
+//   sin, cos      2.7    2.3
+//   tan           4.7    5.0
+//   arg, polar    1.7    0.5
+//
+// Output arrays may be the input arrays.
+
+namespace cmath {
+namespace simd {
+
+/// e^z.
+void exp(size_t n, const double* re, const double* im, double* outRe, double* outIm);
+
+/// Principal logarithm, with the imaginary part in (-pi, pi].
+void log(size_t n, const double* re, const double* im, double* outRe, double* outIm);
+
+/// Principal square root, with a nonnegative real part.
+void sqrt(size_t n, const double* re, const double* im, double* outRe, double* outIm);
+
+void sin(size_t n, const double* re, const double* im, double* outRe, double* outIm);
+void cos(size_t n, const double* re, const double* im, double* outRe, double* outIm);
+void tan(size_t n, const double* re, const double* im, double* outRe, double* outIm);
+
+/// Argument atan2(im, re) in (-pi, pi].
+void arg(size_t n, const double* re, const double* im, double* out);
+
+/// r (cos(theta) + i sin(theta)).
+void polar(size_t n, const double* r, const double* theta, double* outRe, double* outIm);
+
+}  // namespace simd
+}  // namespace cmath
@@ -0,0 +1,886 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/lowering.h>
+#include <cmath/solve.h>
+#include <cmath/special.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace cmath {
+
+namespace {
+
+constexpr double Epsilon = std::numeric_limits<double>::epsilon();
+constexpr double TwoOverSqrtPi = 1.12837916709551257390;
+
+// larger integer exponents go through std::pow()
+constexpr double MaxIntegerExponent = 64;
+
+// doublings of the distance from the start while looking for a sign change
+constexpr unsigned MaxBracketSteps = 40;
+
+// sufficient decrease of the squared residuals in the line search (Armijo)
+constexpr double Armijo = 1e-4;
+
+constexpr double MinStep = 1e-10;
+
+[[noreturn]] void fail(Solver::ErrorCode ec) {
+  throw make_error_code(ec);
+}
+
+// a^n by repeated squaring
+Number powi(Number a, int n) {
+  if (n < 0)
+    return 1.0 / powi(a, -n);
+
+  Number y = 1;
+  for (; n; n >>= 1, a *= a)
+    if (n & 1)
+      y *= a;
+  return y;
+}
+
+bool isFinite(Number z) {
+  return std::isfinite(z.real()) && std::isfinite(z.imag());
+}
+
+// {{{ Tape
+// A value with its partial derivatives by all variables.
+struct Dual {
+  Number value;
+  std::array<Number, Solver::MaxVariables> d;
+};
+
+/**
+ * The residuals lhs - rhs of equations, compiled like a BatchProgram into a
+ * flat list of operations, and run in forward mode: each operation yields
+ * its value along with its partial derivatives by all variables, by the
+ * chain rule.
+ */
+class Tape {
+ public:
+  Tape(const std::vector<const Expr*>& equations,
+       const std::vector<Symbol>& variables,
+       const SymbolTable& t);
+
+  size_t size() const noexcept { return results_.size(); }
+
+  /// Residuals at @p x into @p f, with their gradients.
+  void run(const Number* x, Dual* f);
+
+ private:
+  enum class OpKind : uint8_t {
+    Constant,  // value
+    Variable,  // a = index of the variable
+    Neg,       // a = operand
+    PowInt,    // a = base, value = integer exponent
+    Fac,
+    Re,
+    Im,
+    Arg,
+    Sqrt,
+    Exp,
+    Log,
+    Sin,
+    Cos,
+    Tan,
+    Gamma,
+    LogGamma,
+    Erf,
+    Erfc,
+    Plus,      // a = left, b = right
+    Minus,
+    Mul,
+    Div,
+    Pow,
+    Polar,
+    BesselJ,   // a = order, b = argument
+    BesselI,
+    Equ,
+    Less,
+  };
+
+  struct Op {
+    OpKind kind;
+    uint32_t a;
+    uint32_t b;
+    Number value;
+  };
+
+  class Compiler;
+
+ private:
+  size_t n_;
+  std::vector<Op> ops_;
+  std::vector<uint32_t> results_;  // one register per equation
+  std::vector<Number> value_;      // per register
+  std::vector<Number> d_;          // n_ per register
+};
+
+class Tape::Compiler : public Lowering {
+ public:
+  Compiler(const SymbolTable& t, Tape* tape)
+      : Lowering(t, make_error_code(Solver::UnsupportedExpr)), tape_(tape) {}
+
+  uint32_t emit(OpKind kind, uint32_t a = 0, uint32_t b = 0);
+
+ private:
+  uint32_t constant(Number value) override;
+  uint32_t builtin(const Symbol& name, const std::vector<uint32_t>& args) override;
+  uint32_t operation(const Expr* e) override;
+  uint32_t pow(uint32_t x, uint32_t y);
+
+ private:
+  Tape* tape_;
+};
+
+uint32_t Tape::Compiler::emit(OpKind kind, uint32_t a, uint32_t b) {
+  tape_->ops_.push_back(Op{kind, a, b, Number()});
+  return static_cast<uint32_t>(tape_->ops_.size() - 1);
+}
+
+uint32_t Tape::Compiler::constant(Number value) {
+  const uint32_t reg = emit(OpKind::Constant);
+  tape_->ops_[reg].value = value;
+  return reg;
+}
+
+uint32_t Tape::Compiler::builtin(const Symbol& name, const std::vector<uint32_t>& args) {
+  const uint32_t x = args.empty() ? constant(std::nan("")) : args[0];
+
+  if (name == "Re")
+    return emit(OpKind::Re, x);
+  if (name == "Im")
+    return emit(OpKind::Im, x);
+  if (name == "arg")
+    return emit(OpKind::Arg, x);
+  if (name == "sin")
+    return emit(OpKind::Sin, x);
+  if (name == "cos")
+    return emit(OpKind::Cos, x);
+  if (name == "tan")
+    return emit(OpKind::Tan, x);
+  if (name == "exp")
+    return emit(OpKind::Exp, x);
+  if (name == "sqrt")
+    return emit(OpKind::Sqrt, x);
+  if (name == "log")
+    return emit(OpKind::Log, x);
+  if (name == "gamma")
+    return emit(OpKind::Gamma, x);
+  if (name == "lgamma")
+    return emit(OpKind::LogGamma, x);
+  if (name == "erf")
+    return emit(OpKind::Erf, x);
+  if (name == "erfc")
+    return emit(OpKind::Erfc, x);
+
+  const uint32_t y = args.size() < 2 ? constant(std::nan("")) : args[1];
+  if (name == "polar")
+    return emit(OpKind::Polar, x, y);
+
+  // differentiable by the argument, for constant orders only
+  if ((name == "besselj" || name == "besseli") && tape_->ops_[x].kind == OpKind::Constant)
+    return emit(name == "besselj" ? OpKind::BesselJ : OpKind::BesselI, x, y);
+
+  unsupported();
+}
+
+uint32_t Tape::Compiler::pow(uint32_t x, uint32_t y) {
+  const Op& base = tape_->ops_[x];
+  const Op& exponent = tape_->ops_[y];
+
+  // e^x goes straight to exp(), as with calculate()
+  if (base.kind == OpKind::Constant && base.value == Number(M_E))
+    return emit(OpKind::Exp, y);
+
+  // constant integer exponents by multiplication, which keeps real
+  // equations real where std::pow() leaves rounding noise in the imaginary
+  // part, such as with (-2)^3
+  if (exponent.kind == OpKind::Constant && !exponent.value.imag()) {
+    const double k = exponent.value.real();
+    if (k == std::trunc(k) && std::abs(k) <= MaxIntegerExponent) {
+      const uint32_t reg = emit(OpKind::PowInt, x);
+      tape_->ops_[reg].value = k;
+      return reg;
+    }
+  }
+
+  return emit(OpKind::Pow, x, y);
+}
+
+uint32_t Tape::Compiler::operation(const Expr* e) {
+  if (auto n = dynamic_cast<const NumberExpr*>(e))
+    return constant(n->getNumber());
+
+  if (auto n = dynamic_cast<const NegExpr*>(e))
+    return emit(OpKind::Neg, compile(n->subExpr()));
+
+  if (auto f = dynamic_cast<const FacExpr*>(e))
+    return emit(OpKind::Fac, compile(f->subExpr()));
+
+  // left to right, as the binary chain would be
+  if (auto s = dynamic_cast<const SumExpr*>(e)) {
+    uint32_t x = compile(s->terms()[0].expr.get());
+    for (size_t i = 1; i < s->terms().size(); ++i) {
+      const SumExpr::Term& term = s->terms()[i];
+      x = emit(term.subtract ? OpKind::Minus : OpKind::Plus, x, compile(term.expr.get()));
+    }
+    return x;
+  }
+
+  if (auto p = dynamic_cast<const ProductExpr*>(e)) {
+    uint32_t x = compile(p->factors()[0].get());
+    for (size_t i = 1; i < p->factors().size(); ++i)
+      x = emit(OpKind::Mul, x, compile(p->factors()[i].get()));
+    return x;
+  }
+
+  if (auto b = dynamic_cast<const BinaryExpr*>(e)) {
+    const uint32_t x = compile(b->left());
+    const uint32_t y = compile(b->right());
+
+    if (dynamic_cast<const PlusExpr*>(e))
+      return emit(OpKind::Plus, x, y);
+    if (dynamic_cast<const MinusExpr*>(e))
+      return emit(OpKind::Minus, x, y);
+    if (dynamic_cast<const MulExpr*>(e))
+      return emit(OpKind::Mul, x, y);
+    if (dynamic_cast<const DivExpr*>(e))
+      return emit(OpKind::Div, x, y);
+    if (dynamic_cast<const PowExpr*>(e))
+      return pow(x, y);
+    if (dynamic_cast<const EquExpr*>(e))
+      return emit(OpKind::Equ, x, y);
+    if (dynamic_cast<const LessExpr*>(e))
+      return emit(OpKind::Less, x, y);
+  }
+
+  unsupported();
+}
+
+Tape::Tape(const std::vector<const Expr*>& equations,
+           const std::vector<Symbol>& variables,
+           const SymbolTable& t)
+    : n_(variables.size()), ops_(), results_(), value_(), d_() {
+  Compiler compiler(t, this);
+  for (size_t i = 0; i < n_; ++i)
+    compiler.bind(variables[i], compiler.emit(OpKind::Variable, i));
+
+  for (const Expr* e : equations) {
+    if (auto equ = dynamic_cast<const EquExpr*>(e)) {
+      const uint32_t lhs = compiler.compile(equ->left());
+      const uint32_t rhs = compiler.compile(equ->right());
+      results_.push_back(compiler.emit(OpKind::Minus, lhs, rhs));
+    } else {
+      results_.push_back(compiler.compile(e));
+    }
+  }
+
+  value_.resize(ops_.size());
+  d_.resize(ops_.size() * n_);
+}
+
+void Tape::run(const Number* x, Dual* f) {
+  const size_t n = n_;
+  const Number i(0, 1);
+  const Number nan(std::nan(""), std::nan(""));
+
+  for (size_t r = 0; r < ops_.size(); ++r) {
+    const Op& op = ops_[r];
+    const Number a = value_[op.a];
+    const Number b = value_[op.b];
+    const Number* da = &d_[op.a * n];
+    const Number* db = &d_[op.b * n];
+    Number* dy = &d_[r * n];
+    Number& y = value_[r];
+
+    // f(a) with f'(a) = slope
+    auto chain = [&](Number value, Number slope) {
+      y = value;
+      for (size_t k = 0; k < n; ++k)
+        dy[k] = slope * da[k];
+    };
+
+    switch (op.kind) {
+      case OpKind::Constant:
+        y = op.value;
+        std::fill(dy, dy + n, Number());
+        break;
+      case OpKind::Variable:
+        y = x[op.a];
+        std::fill(dy, dy + n, Number());
+        dy[op.a] = 1;
+        break;
+      case OpKind::Neg:
+        chain(-a, -1.0);
+        break;
+      case OpKind::PowInt: {
+        const int k = static_cast<int>(op.value.real());
+        if (k)
+          chain(powi(a, k), op.value * powi(a, k - 1));
+        else
+          chain(1, 0);
+        break;
+      }
+      case OpKind::Fac: {
+        const Number s = factorial(a);
+        chain(s, s * digamma(a + 1.0));
+        break;
+      }
+      // Re, Im and arg are not holomorphic; they are differentiated along
+      // real directions
+      case OpKind::Re:
+        y = a.real();
+        for (size_t k = 0; k < n; ++k)
+          dy[k] = da[k].real();
+        break;
+      case OpKind::Im:
+        y = a.imag();
+        for (size_t k = 0; k < n; ++k)
+          dy[k] = da[k].imag();
+        break;
+      case OpKind::Arg:
+        y = std::arg(a);
+        for (size_t k = 0; k < n; ++k)
+          dy[k] = (da[k] / a).imag();
+        break;
+      case OpKind::Sqrt: {
+        const Number s = std::sqrt(a);
+        chain(s, 0.5 / s);
+        break;
+      }
+      case OpKind::Exp: {
+        const Number s = std::exp(a);
+        chain(s, s);
+        break;
+      }
+      case OpKind::Log:
+        chain(std::log(a), 1.0 / a);
+        break;
+      case OpKind::Sin:
+        chain(std::sin(a), std::cos(a));
+        break;
+      case OpKind::Cos:
+        chain(std::cos(a), -std::sin(a));
+        break;
+      case OpKind::Tan: {
+        const Number s = std::tan(a);
+        chain(s, 1.0 + s * s);
+        break;
+      }
+      case OpKind::Gamma: {
+        const Number s = gamma(a);
+        chain(s, s * digamma(a));
+        break;
+      }
+      case OpKind::LogGamma:
+        chain(logGamma(a), digamma(a));
+        break;
+      case OpKind::Erf:
+        chain(erf(a), TwoOverSqrtPi * std::exp(-a * a));
+        break;
+      case OpKind::Erfc:
+        chain(erfc(a), -TwoOverSqrtPi * std::exp(-a * a));
+        break;
+      case OpKind::Plus:
+        y = a + b;
+        for (size_t k = 0; k < n; ++k)
+          dy[k] = da[k] + db[k];
+        break;
+      case OpKind::Minus:
+        y = a - b;
+        for (size_t k = 0; k < n; ++k)
+          dy[k] = da[k] - db[k];
+        break;
+      case OpKind::Mul:
+        y = a * b;
+        for (size_t k = 0; k < n; ++k)
+          dy[k] = da[k] * b + a * db[k];
+        break;
+      case OpKind::Div:
+        y = a / b;
+        for (size_t k = 0; k < n; ++k)
+          dy[k] = (da[k] - y * db[k]) / b;
+        break;
+      case OpKind::Pow: {
+        y = std::pow(a, b);
+        const Number log = std::log(a);
+        for (size_t k = 0; k < n; ++k)
+          dy[k] = y * (db[k] * log + b * da[k] / a);
+        break;
+      }
+      case OpKind::Polar: {
+        // r e^(i phi), by the real parts of r and phi
+        const Number unit = std::polar(1.0, b.real());
+        y = std::polar(a.real(), b.real());
+        for (size_t k = 0; k < n; ++k)
+          dy[k] = unit * da[k].real() + i * y * db[k].real();
+        break;
+      }
+      // J_n' = (J_(n-1) - J_(n+1)) / 2 and I_n' = (I_(n-1) + I_(n+1)) / 2
+      case OpKind::BesselJ: {
+        const Number slope = (besselJ(a - 1.0, b) - besselJ(a + 1.0, b)) / 2.0;
+        y = besselJ(a, b);
+        for (size_t k = 0; k < n; ++k)
+          dy[k] = slope * db[k];
+        break;
+      }
+      case OpKind::BesselI: {
+        const Number slope = (besselI(a - 1.0, b) + besselI(a + 1.0, b)) / 2.0;
+        y = besselI(a, b);
+        for (size_t k = 0; k < n; ++k)
+          dy[k] = slope * db[k];
+        break;
+      }
+      case OpKind::Equ:
+        if (a == b) {
+          chain(a, 1.0);
+        } else {
+          y = nan;
+          std::fill(dy, dy + n, Number());
+        }
+        break;
+      case OpKind::Less:
+        if (!a.imag() && !b.imag() && a.real() < b.real()) {
+          chain(a, 1.0);
+        } else {
+          y = nan;
+          std::fill(dy, dy + n, Number());
+        }
+        break;
+    }
+  }
+
+  for (size_t k = 0; k < results_.size(); ++k) {
+    f[k].value = value_[results_[k]];
+    std::copy_n(&d_[results_[k] * n], n, f[k].d.begin());
+  }
+}
+// }}}
+// {{{ System
+// The equations' tape, counting its runs.
+class System {
+ public:
+  System(const std::vector<const Expr*>& equations,
+         const std::vector<Symbol>& variables,
+         const SymbolTable& t,
+         Solver::Stats* stats)
+      : tape_(equations, variables, t), stats_(stats) {}
+
+  size_t size() const noexcept { return tape_.size(); }
+
+  /// Residuals at @p x into @p f, with their gradients.
+  void evaluate(const Number* x, Dual* f) {
+    stats_->evaluations++;
+    tape_.run(x, f);
+  }
+
+  /// Half the sum of the squared residuals @p f.
+  double merit(const Dual* f) const;
+
+ private:
+  Tape tape_;
+  Solver::Stats* stats_;
+};
+
+double System::merit(const Dual* f) const {
+  double sum = 0;
+  for (size_t i = 0; i < size(); ++i)
+    sum += std::norm(f[i].value);
+  return sum / 2;
+}
+// }}}
+// {{{ Newton's method
+// Solves a x = b in place by Gaussian elimination with partial pivoting;
+// @p a is n by n, by rows.
+bool linearSolve(size_t n, Number* a, Number* b) {
+  for (size_t k = 0; k < n; ++k) {
+    size_t pivot = k;
+    for (size_t i = k + 1; i < n; ++i)
+      if (std::abs(a[i * n + k]) > std::abs(a[pivot * n + k]))
+        pivot = i;
+
+    if (a[pivot * n + k] == Number() || !isFinite(a[pivot * n + k]))
+      return false;
+
+    if (pivot != k) {
+      std::swap_ranges(a + k * n, a + (k + 1) * n, a + pivot * n);
+      std::swap(b[k], b[pivot]);
+    }
+
+    for (size_t i = k + 1; i < n; ++i) {
+      const Number m = a[i * n + k] / a[k * n + k];
+      for (size_t j = k; j < n; ++j)
+        a[i * n + j] -= m * a[k * n + j];
+      b[i] -= m * b[k];
+    }
+  }
+
+  for (size_t k = n; k-- > 0;) {
+    for (size_t j = k + 1; j < n; ++j)
+      b[k] -= a[k * n + j] * b[j];
+    b[k] /= a[k * n + k];
+  }
+
+  return true;
+}
+
+double maxNorm(const std::vector<Number>& v) {
+  double m = 0;
+  for (Number z : v)
+    m = std::max(m, std::abs(z));
+  return m;
+}
+
+// The Levenberg step, solving (J* J + mu I) step = -J* f, for where the
+// Jacobian J is singular.
+bool levenberg(size_t n, const std::vector<Dual>& f, Number* step) {
+  std::vector<Number> a(n * n);
+  double mu = 0;
+  for (size_t j = 0; j < n; ++j) {
+    step[j] = 0;
+    for (size_t i = 0; i < n; ++i)
+      step[j] -= std::conj(f[i].d[j]) * f[i].value;
+    for (size_t k = 0; k < n; ++k) {
+      for (size_t i = 0; i < n; ++i)
+        a[j * n + k] += std::conj(f[i].d[j]) * f[i].d[k];
+    }
+    mu = std::max(mu, a[j * n + j].real());
+  }
+
+  mu = mu > 0 ? mu * 1e-6 : 1e-6;
+  for (size_t j = 0; j < n; ++j)
+    a[j * n + j] += mu;
+
+  return linearSolve(n, a.data(), step);
+}
+
+// Newton's method from @p x, backtracking along the Newton direction until
+// the squared residuals decrease sufficiently.
+void newton(System& system,
+            const Solver::Options& options,
+            std::vector<Number>* x,
+            Solver::Stats* stats) {
+  const size_t n = system.size();
+  std::vector<Dual> f(n), g(n);
+  std::vector<Number> jacobian(n * n), step(n), y(n);
+
+  system.evaluate(x->data(), f.data());
+  double phi = system.merit(f.data());
+
+  for (;;) {
+    if (phi == 0)
+      return;
+
+    if (stats->iterations == options.maxIterations)
+      fail(Solver::NoConvergence);
+    stats->iterations++;
+
+    for (size_t i = 0; i < n; ++i) {
+      step[i] = -f[i].value;
+      for (size_t k = 0; k < n; ++k)
+        jacobian[i * n + k] = f[i].d[k];
+    }
+    const bool full = linearSolve(n, jacobian.data(), step.data());
+    if (!full && !levenberg(n, f, step.data()))
+      fail(Solver::SingularJacobian);
+
+    // a step below the tolerance is taken as is, as rounding noise in the
+    // residuals would defeat the line search there
+    if (full && maxNorm(step) <= options.tolerance * std::max(maxNorm(*x), 1.0)) {
+      for (size_t i = 0; i < n; ++i)
+        (*x)[i] += step[i];
+      stats->newtonSteps++;
+      return;
+    }
+
+    // the derivative of the merit function along the step, -2 phi for the
+    // Newton step
+    double slope = 0;
+    for (size_t i = 0; i < n; ++i) {
+      Number df = 0;
+      for (size_t k = 0; k < n; ++k)
+        df += f[i].d[k] * step[k];
+      slope += (std::conj(f[i].value) * df).real();
+    }
+
+    for (double lambda = 1;; lambda /= 2) {
+      if (lambda < MinStep || !(slope < 0))
+        fail(Solver::NoConvergence);
+
+      for (size_t i = 0; i < n; ++i)
+        y[i] = (*x)[i] + lambda * step[i];
+      system.evaluate(y.data(), g.data());
+
+      const double psi = system.merit(g.data());
+      if (std::isfinite(psi) && psi <= phi + Armijo * lambda * slope) {
+        if (full && lambda == 1)
+          stats->newtonSteps++;
+        std::swap(*x, y);
+        std::swap(f, g);
+        phi = psi;
+        break;
+      }
+    }
+  }
+}
+// }}}
+// {{{ Brent–Newton
+struct Point {
+  double x;
+  double f;
+  double df;
+};
+
+// Evaluates a real equation at @p x; false where it is not real and finite.
+bool evaluateReal(System& system, double x, Point* p) {
+  Dual f;
+  const Number z = x;
+  system.evaluate(&z, &f);
+
+  p->x = x;
+  p->f = f.value.real();
+  p->df = f.d[0].real();
+  return !f.value.imag() && std::isfinite(p->f);
+}
+
+/**
+ * Steps out from @p start on both sides, with distances doubling from the
+ * Newton step on, until the residual changes its sign. Where it is not
+ * real or finite, a side backs off halfway to its last point instead.
+ */
+bool bracket(System& system, const Point& start, Point* a, Point* b) {
+  double h = std::abs(start.f / start.df);
+  if (!std::isfinite(h) || h == 0)
+    h = std::max(std::abs(start.x), 1.0) / 100;
+
+  // the Newton direction first
+  const double first = start.f * start.df > 0 ? -1 : 1;
+  const double direction[2] = {first, -first};
+  double distance[2] = {h, h};
+  Point last[2] = {start, start};
+
+  for (unsigned k = 0; k < MaxBracketSteps; ++k) {
+    for (int side = 0; side < 2; ++side) {
+      Point p;
+      if (!evaluateReal(system, start.x + direction[side] * distance[side], &p)) {
+        distance[side] = (distance[side] + std::abs(last[side].x - start.x)) / 2;
+        continue;
+      }
+
+      if (std::signbit(p.f) != std::signbit(start.f) || p.f == 0) {
+        *a = last[side];
+        *b = p;
+        return true;
+      }
+      last[side] = p;
+      distance[side] *= 2;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Brent's method on the bracket [a, b], where Newton's step from the best
+ * point replaces the interpolation whenever it stays within the bracket
+ * and shrinks faster than bisection would.
+ */
+double brent(System& system, Point a, Point b, const Solver::Options& options,
+             Solver::Stats* stats) {
+  Point c = b;
+  double d = b.x - a.x;
+  double e = d;
+
+  for (;;) {
+    if (std::signbit(b.f) == std::signbit(c.f)) {
+      c = a;
+      d = e = b.x - a.x;
+    }
+    if (std::abs(c.f) < std::abs(b.f)) {
+      a = b;
+      b = c;
+      c = a;
+    }
+
+    const double tolerance = 2 * Epsilon * std::abs(b.x) + options.tolerance / 2;
+    const double m = (c.x - b.x) / 2;
+    if (std::abs(m) <= tolerance || b.f == 0)
+      return b.x;
+
+    if (stats->iterations == options.maxIterations)
+      fail(Solver::NoConvergence);
+    stats->iterations++;
+
+    const double newton = -b.f / b.df;
+    if (std::isfinite(newton) && newton * m > 0 && std::abs(newton) < std::abs(2 * m) &&
+        std::abs(newton) < std::abs(e) / 2) {
+      e = d;
+      d = newton;
+      stats->newtonSteps++;
+    } else if (std::abs(e) >= tolerance && std::abs(a.f) > std::abs(b.f)) {
+      // secant, or inverse quadratic interpolation through a, b and c
+      double p, q;
+      const double s = b.f / a.f;
+      if (a.x == c.x) {
+        p = 2 * m * s;
+        q = 1 - s;
+      } else {
+        const double r = b.f / c.f;
+        const double t = a.f / c.f;
+        p = s * (2 * m * t * (t - r) - (b.x - a.x) * (r - 1));
+        q = (t - 1) * (r - 1) * (s - 1);
+      }
+      if (p > 0)
+        q = -q;
+      p = std::abs(p);
+
+      if (2 * p < std::min(3 * m * q - std::abs(tolerance * q), std::abs(e * q))) {
+        e = d;
+        d = p / q;
+      } else {
+        d = e = m;
+      }
+    } else {
+      d = e = m;
+    }
+
+    a = b;
+    const double x = b.x + (std::abs(d) > tolerance ? d : std::copysign(tolerance, m));
+    if (!evaluateReal(system, x, &b))
+      fail(Solver::NoConvergence);
+  }
+}
+// }}}
+
+// The value of the @p i-th variable in @p t, else distinct values from 1 on,
+// as symmetric systems tend to be singular where all variables are equal.
+Number startValue(const Symbol& name, size_t i, const SymbolTable& t) {
+  if (auto c = dynamic_cast<const ConstantDef*>(t.lookup(name)))
+    if (isFinite(c->getNumber()))
+      return c->getNumber();
+
+  return 1 + 0.25 * i;
+}
+
+}  // namespace
+
+// {{{ Solver
+Result<std::vector<Number>> Solver::solve(const std::vector<const Expr*>& equations,
+                                          const std::vector<Symbol>& variables,
+                                          const SymbolTable& t,
+                                          const Options& options,
+                                          Stats* stats) {
+  if (equations.size() != variables.size() || variables.empty())
+    return NotSquare;
+
+  if (variables.size() > MaxVariables)
+    return TooManyVariables;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  Stats s;
+  const size_t n = variables.size();
+  std::vector<Number> x;
+  for (size_t i = 0; i < n; ++i)
+    x.push_back(startValue(variables[i], i, t));
+
+  try {
+    System system(equations, variables, t, &s);
+    Point p, a, b;
+    if (n == 1 && !x[0].imag() && evaluateReal(system, x[0].real(), &p)) {
+      if (p.f == 0)
+        x[0] = p.x;
+      else if (bracket(system, p, &a, &b))
+        x[0] = brent(system, a, b, options, &s);
+      else  // no sign change: try complex roots
+        x[0] += Number(0, std::max(std::abs(x[0]), 1.0) / 10);
+    }
+
+    if (n > 1) {
+      // real systems stay on the real axis, so they start over off of it
+      // where they have no real solution
+      const std::vector<Number> x0 = x;
+      try {
+        newton(system, options, &x, &s);
+      } catch (const std::error_code&) {
+        if (!std::all_of(x0.begin(), x0.end(), [](Number z) { return !z.imag(); }))
+          throw;
+        x = x0;
+        for (Number& z : x)
+          z += Number(0, std::max(std::abs(z), 1.0) / 10);
+        s.iterations = 0;
+        newton(system, options, &x, &s);
+      }
+    } else if (x[0].imag()) {
+      newton(system, options, &x, &s);
+    }
+
+    std::vector<Dual> f(n);
+    system.evaluate(x.data(), f.data());
+    for (size_t i = 0; i < n; ++i)
+      s.residual = std::max(s.residual, std::abs(f[i].value));
+  } catch (const std::error_code& ec) {
+    return ec;
+  }
+
+  if (!std::all_of(x.begin(), x.end(), isFinite))
+    return NoConvergence;
+
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  s.seconds = elapsed.count();
+  if (stats)
+    *stats = s;
+
+  return x;
+}
+
+Result<Number> Solver::solve(const Expr* equation,
+                             const Symbol& x,
+                             const SymbolTable& t,
+                             Stats* stats) {
+  Result<std::vector<Number>> y = solve({equation}, {x}, t, Options(), stats);
+  if (y.isFailure())
+    return y.error();
+
+  return (*y)[0];
+}
+// }}}
+// {{{ Solver::ErrorCategory
+const Solver::ErrorCategory& Solver::ErrorCategory::get() {
+  static ErrorCategory c;
+  return c;
+}
+
+const char* Solver::ErrorCategory::name() const noexcept {
+  return "SolverError";
+}
+
+std::string Solver::ErrorCategory::message(int ec) const {
+  switch (static_cast<ErrorCode>(ec)) {
+    case NotSquare:
+      return "Need as many equations as variables";
+    case TooManyVariables:
+      return "Too many variables to solve for";
+    case UnsupportedExpr:
+      return "Expression cannot be differentiated";
+    case SingularJacobian:
+      return "Equations are singular at the current point";
+    case NoConvergence:
+      return "Solver did not converge";
+  }
+  return "Unknown error";
+}
+// }}}
+
+}  // namespace cmath
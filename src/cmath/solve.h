@@ -0,0 +1,92 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+#include <cmath/result.h>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace cmath {
+
+/**
+ * Solves equations lhs = rhs, or expressions taken as = 0, for as many
+ * variables.
+ *
+ * The equations are compiled once into a flat list of operations, like a
+ * BatchProgram, which then runs in forward mode: every operation yields its
+ * value along with its gradient by all variables, so each iteration gets
+ * residuals and Jacobian from a single pass.
+ * Iterations start from the variables' values in the symbol table, or
+ * 1, 1.25, 1.5, ... for undefined ones.
+ *
+ * One real equation in one variable is first bracketed by stepping out
+ * from the start, guided by the Newton step, and then solved by Brent's
+ * method taking Newton steps wherever they stay safely inside the bracket.
+ * Otherwise, and for square systems, Newton's method runs with a
+ * backtracking line search on the sum of squared residuals, falling back
+ * to a Levenberg step where the Jacobian is singular; a single
+ * equation without a real bracket starts off the real axis, so it may
+ * converge to complex roots.
+ */
+class Solver {
+ public:
+  enum ErrorCode {
+    NotSquare = 1,
+    TooManyVariables,
+    UnsupportedExpr,
+    SingularJacobian,
+    NoConvergence,
+  };
+  class ErrorCategory;
+
+  static constexpr size_t MaxVariables = 8;
+
+  struct Options {
+    double tolerance = 1e-12;  // of the last step, relative to the solution
+    unsigned maxIterations = 100;
+  };
+
+  struct Stats {
+    unsigned iterations = 0;
+    unsigned evaluations = 0;  // traversals of all equations
+    unsigned newtonSteps = 0;  // iterations that took the full Newton step
+    double residual = 0;       // largest |lhs - rhs| at the solution
+    double seconds = 0;
+  };
+
+  static Result<std::vector<Number>> solve(const std::vector<const Expr*>& equations,
+                                           const std::vector<Symbol>& variables,
+                                           const SymbolTable& t,
+                                           const Options& options,
+                                           Stats* stats = nullptr);
+
+  static Result<Number> solve(const Expr* equation,
+                              const Symbol& x,
+                              const SymbolTable& t,
+                              Stats* stats = nullptr);
+};
+
+class Solver::ErrorCategory : public std::error_category {
+ public:
+  static const ErrorCategory& get();
+
+  const char* name() const noexcept override;
+  std::string message(int ec) const override;
+};
+
+inline std::error_code make_error_code(Solver::ErrorCode ec) {
+  return std::error_code(static_cast<int>(ec), Solver::ErrorCategory::get());
+}
+
+}  // namespace cmath
+
+namespace std {
+template <>
+struct is_error_code_enum<cmath::Solver::ErrorCode> : public true_type {};
+}  // namespace std
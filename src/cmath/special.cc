@@ -0,0 +1,332 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/special.h>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+namespace cmath {
+
+namespace {
+
+constexpr double Pi = 3.14159265358979323846;
+constexpr double Epsilon = std::numeric_limits<double>::epsilon();
+constexpr double Inf = std::numeric_limits<double>::infinity();
+constexpr double NaN = std::numeric_limits<double>::quiet_NaN();
+
+// {{{ tables
+// 171! overflows
+constexpr int MaxFactorial = 170;
+
+// n! for n = 0 to 170, multiplied in extended precision, so that rounding
+// to double is the only error
+constexpr std::array<double, MaxFactorial + 1> makeFactorials() {
+  std::array<double, MaxFactorial + 1> table{};
+  long double y = 1;
+  for (int n = 0; n <= MaxFactorial; ++n) {
+    if (n)
+      y *= n;
+    table[n] = static_cast<double>(y);
+  }
+  return table;
+}
+
+constexpr std::array<double, MaxFactorial + 1> Factorials = makeFactorials();
+
+// Lanczos approximation for g = 7, n = 9
+constexpr double LanczosG = 7;
+constexpr double Lanczos[] = {
+    0.99999999999980993,     676.5203681218851,     -1259.1392167224028,
+    771.32342877765313,      -176.61502916214059,   12.507343278686905,
+    -0.13857109526572012,    9.9843695780195716e-6, 1.5056327351493116e-7,
+};
+
+constexpr double LogSqrt2Pi = 0.91893853320467274178;
+constexpr double Sqrt2Pi = 2.50662827463100050242;
+constexpr double LogPi = 1.14472988584940017414;
+constexpr double TwoOverSqrtPi = 1.12837916709551257390;
+constexpr double OneOverSqrtPi = 0.56418958354775628695;
+// }}}
+// {{{ helpers
+// the series of the Lanczos approximation of gamma(z + 1)
+Number lanczos(Number z) {
+  Number a = Lanczos[0];
+  for (int i = 1; i < 9; ++i)
+    a += Lanczos[i] / (z + double(i));
+  return a;
+}
+
+bool isInteger(Number z) {
+  return !z.imag() && z.real() == std::floor(z.real());
+}
+
+// sin(pi x) and cos(pi x), exact at the integers and half integers
+void sinCosPi(double x, double* s, double* c) {
+  const double n = std::nearbyint(2 * x);
+  const double t = Pi * (x - n / 2);
+  const double st = std::sin(t);
+  const double ct = std::cos(t);
+  switch (static_cast<int>(std::fmod(n, 4.0) + 4) % 4) {
+    case 0:
+      *s = st;
+      *c = ct;
+      break;
+    case 1:
+      *s = ct;
+      *c = -st;
+      break;
+    case 2:
+      *s = -st;
+      *c = -ct;
+      break;
+    default:
+      *s = -ct;
+      *c = st;
+      break;
+  }
+}
+
+Number sinPi(Number z) {
+  double s, c;
+  sinCosPi(z.real(), &s, &c);
+  const double y = Pi * z.imag();
+  return Number(s * std::cosh(y), c * std::sinh(y));
+}
+
+Number cosPi(Number z) {
+  double s, c;
+  sinCosPi(z.real(), &s, &c);
+  const double y = Pi * z.imag();
+  return Number(c * std::cosh(y), -s * std::sinh(y));
+}
+
+// log(sin(pi z)), also where sin(pi z) overflows
+Number logSinPi(Number z) {
+  const Number i(0, 1);
+  if (z.imag() > 10)
+    return -i * Pi * z + std::log((std::exp(2.0 * i * Pi * z) - 1.0) / (2.0 * i));
+  if (z.imag() < -10)
+    return i * Pi * z + std::log((1.0 - std::exp(-2.0 * i * Pi * z)) / (2.0 * i));
+  return std::log(sinPi(z));
+}
+
+// erf(z) by its Taylor series, which does not cancel near the origin and
+// the imaginary axis
+Number erfSeries(Number z) {
+  const Number z2 = z * z;
+  Number sum = z;
+  Number term = z;
+  for (int n = 1; n < 4000; ++n) {
+    term *= -z2 / double(n);
+    const Number a = term / double(2 * n + 1);
+    sum += a;
+    if (std::abs(a) <= Epsilon * std::abs(sum) && double(n) > std::norm(z))
+      break;
+  }
+  return TwoOverSqrtPi * sum;
+}
+
+// erfc(z) for Re(z) > 0 by Laplace's continued fraction
+//   erfc(z) = exp(-z^2) / sqrt(pi) / (z + 1/2 / (z + 1 / (z + 3/2 / (z + ...))))
+// evaluated by the modified Lentz method
+Number erfcFraction(Number z) {
+  const double tiny = 1e-300;
+  Number f = z;
+  Number c = f;
+  Number d = 0;
+  for (int k = 1; k < 5000; ++k) {
+    const double a = k / 2.0;
+    d = z + a * d;
+    if (d == Number())
+      d = tiny;
+    c = z + a / c;
+    if (c == Number())
+      c = tiny;
+    d = 1.0 / d;
+    const Number delta = c * d;
+    f *= delta;
+    if (std::abs(delta - 1.0) <= Epsilon)
+      break;
+  }
+  return OneOverSqrtPi * std::exp(-z * z) / f;
+}
+
+// J_m(z) by its power series; the sum of the terms' magnitudes, which
+// bounds the rounding error relative to epsilon, into @p scale
+Number besselSeries(int m, Number z, double* scale) {
+  const Number h = z / 2.0;
+  Number term = 1;
+  if (m <= 20) {
+    for (int k = 1; k <= m; ++k)
+      term *= h / double(k);
+  } else if (z != Number()) {
+    term = std::exp(double(m) * std::log(h) - logGamma(m + 1.0).real());
+  } else {
+    term = 0;
+  }
+
+  const Number h2 = h * h;
+  Number sum = term;
+  *scale = std::abs(term);
+  for (int k = 1; k < 5000 && term != Number(); ++k) {
+    term *= -h2 / (double(k) * double(m + k));
+    sum += term;
+    *scale += std::abs(term);
+    if (std::abs(term) <= Epsilon * std::abs(sum) && k * (m + k) > std::norm(h))
+      break;
+  }
+  return sum;
+}
+
+// J_m(z) = 1/(2 pi) integral of exp(i (z sin t - m t)) over a period,
+// whose trapezoidal sum with N points is off by J_(N - m) and other
+// negligible orders
+Number besselTrapezoid(int m, Number z) {
+  const int n = m + 2 * static_cast<int>(std::ceil(std::abs(z))) + 32;
+  const Number i(0, 1);
+  Number sum;
+  for (int k = 0; k < n; ++k) {
+    const double t = 2 * Pi * k / n;
+    sum += std::exp(i * (z * std::sin(t) - double(m) * t));
+  }
+  return sum / double(n);
+}
+
+// J_m(z) for m >= 0, by the power series unless it cancels worse than the
+// trapezoidal sum, whose terms are of magnitude up to exp(|Im(z)|)
+Number besselOrderJ(int m, Number z) {
+  const double r = std::abs(z);
+  const double bound = std::exp(std::abs(z.imag()));
+  if (r * r <= 4.0 * (m + 1) || r - std::abs(z.imag()) < 30) {
+    double scale;
+    const Number y = besselSeries(m, z, &scale);
+    if (scale <= 4 * bound)
+      return y;
+  }
+  return besselTrapezoid(m, z);
+}
+
+// the order as a nonnegative integer, its sign into @p odd
+bool order(Number n, int* m, bool* odd) {
+  if (!isInteger(n) || !(std::abs(n.real()) <= 1e6))
+    return false;
+  *m = std::abs(static_cast<int>(n.real()));
+  *odd = *m % 2;
+  return true;
+}
+// }}}
+
+}  // namespace
+
+// {{{ gamma functions
+Number gamma(Number z) {
+  if (!z.imag()) {
+    const double x = z.real();
+    if (x == std::floor(x))
+      return x <= 0 || x > MaxFactorial + 1 ? Inf : Factorials[static_cast<int>(x) - 1];
+    return std::tgamma(x);
+  }
+
+  if (z.real() < 0.5)
+    return Pi / (sinPi(z) * gamma(1.0 - z));
+
+  z -= 1;
+  const Number t = z + LanczosG + 0.5;
+  return Sqrt2Pi * lanczos(z) * std::exp((z + 0.5) * std::log(t) - t);
+}
+
+Number logGamma(Number z) {
+  if (isInteger(z) && z.real() <= 0)
+    return Inf;
+
+  if (z.real() < 0.5)
+    return LogPi - logSinPi(z) - logGamma(1.0 - z);
+
+  z -= 1;
+  const Number t = z + LanczosG + 0.5;
+  const Number y = LogSqrt2Pi + (z + 0.5) * std::log(t) - t + std::log(lanczos(z));
+  return z.imag() ? y : y.real();
+}
+
+Number digamma(Number z) {
+  if (isInteger(z) && z.real() <= 0)
+    return Inf;
+
+  if (z.real() < 0.5)
+    return digamma(1.0 - z) - Pi * cosPi(z) / sinPi(z);
+
+  // recurrence up to where the asymptotic series is accurate
+  Number y = 0;
+  for (; std::abs(z) < 15; z += 1)
+    y -= 1.0 / z;
+
+  const Number w = 1.0 / (z * z);
+  y += std::log(z) - 0.5 / z -
+       w * (1.0 / 12 - w * (1.0 / 120 - w * (1.0 / 252 - w * (1.0 / 240 - w / 132.0))));
+  return y;
+}
+
+Number factorial(Number z) {
+  if (isInteger(z)) {
+    const double n = z.real();
+    if (n < 0 || n > MaxFactorial)
+      return Inf;
+    return Factorials[static_cast<int>(n)];
+  }
+
+  return gamma(z + 1.0);
+}
+// }}}
+// {{{ error function
+Number erf(Number z) {
+  if (!z.imag())
+    return std::erf(z.real());
+
+  if (std::abs(z) < 2 || std::abs(z.real()) < 1)
+    return erfSeries(z);
+
+  return z.real() > 0 ? 1.0 - erfcFraction(z) : erfcFraction(-z) - 1.0;
+}
+
+Number erfc(Number z) {
+  if (!z.imag())
+    return std::erfc(z.real());
+
+  if (std::abs(z) < 2 || std::abs(z.real()) < 1)
+    return 1.0 - erfSeries(z);
+
+  return z.real() > 0 ? erfcFraction(z) : 2.0 - erfcFraction(-z);
+}
+// }}}
+// {{{ Bessel functions
+Number besselJ(Number n, Number z) {
+  int m;
+  bool odd;
+  if (!order(n, &m, &odd))
+    return NaN;
+
+  // J_-m = (-1)^m J_m
+  const Number y = (n.real() < 0 && odd ? -1.0 : 1.0) * besselOrderJ(m, z);
+  return z.imag() ? y : y.real();
+}
+
+Number besselI(Number n, Number z) {
+  int m;
+  bool odd;
+  if (!order(n, &m, &odd))
+    return NaN;
+
+  // I_-m = I_m
+  static const Number powers[] = {1, Number(0, -1), -1, Number(0, 1)};  // i^-m
+  const Number y = powers[m % 4] * besselOrderJ(m, Number(-z.imag(), z.real()));
+  return z.imag() ? y : y.real();
+}
+// }}}
+
+}  // namespace cmath
@@ -0,0 +1,66 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/expr.h>
+
+// Special functions on the complex plane, in double precision.
+//
+// Results are accurate to about 1e-13 relative, unless noted otherwise, and
+// real for real arguments where the function is real.
+
+namespace cmath {
+
+/**
+ * Gamma function, by the Lanczos approximation (g = 7, 9 terms) and the
+ * reflection formula left of 1/2; libm's tgamma() on the real axis, and
+ * a table for the integers up to 171.
+ *
+ * The poles at 0, -1, -2, ... yield infinity.
+ */
+Number gamma(Number z);
+
+/**
+ * A logarithm of the gamma function, finite far beyond where gamma()
+ * overflows. It is real for positive real @p z; elsewhere its imaginary
+ * part may differ from the continuous branch by a multiple of 2 pi.
+ */
+Number logGamma(Number z);
+
+/// Logarithmic derivative of the gamma function.
+Number digamma(Number z);
+
+/**
+ * z! = gamma(z + 1), in constant time: from a table of correctly rounded
+ * values for the integers 0 to 170, by gamma() otherwise.
+ */
+Number factorial(Number z);
+
+/**
+ * Error function, by its Taylor series near the origin and the imaginary
+ * axis, and by the continued fraction of erfc() elsewhere; libm's erf() on
+ * the real axis.
+ */
+Number erf(Number z);
+
+/// Complementary error function 1 - erf(z).
+Number erfc(Number z);
+
+/**
+ * Bessel function of the first kind J_n(z) of integer order @p n, by its
+ * power series where that does not cancel, else by the trapezoidal rule on
+ * Bessel's integral, which converges exponentially. Absolute accuracy on
+ * the real axis is about 1e-15.
+ *
+ * Non-integer orders yield NaN.
+ */
+Number besselJ(Number n, Number z);
+
+/// Modified Bessel function of the first kind I_n(z) = i^-n J_n(iz).
+Number besselI(Number n, Number z);
+
+}  // namespace cmath
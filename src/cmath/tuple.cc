@@ -0,0 +1,358 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+#include <cmath/expr.h>
+#include <cmath/tuple.h>
+#include <algorithm>
+#include <cmath>
+
+namespace cmath {
+
+// {{{ Value
+Number Value::number() const noexcept {
+  return isNumber() ? number_ : Number(std::nan(""));
+}
+
+std::shared_ptr<Tuple> Value::unique() const noexcept {
+  return tuple_.use_count() == 1 ? tuple_ : nullptr;
+}
+
+std::shared_ptr<Matrix> Value::uniqueMatrix() const noexcept {
+  return matrix_.use_count() == 1 ? matrix_ : nullptr;
+}
+// }}}
+// {{{ element-wise operations
+namespace {
+
+constexpr double MaxMatrixPower = 1u << 31;
+
+Value notANumber() {
+  return Number(std::nan(""));
+}
+
+// Number of elements of a tuple or matrix.
+size_t count(const Value& v) {
+  return v.isTuple() ? v.tuple().size() : v.matrix().size();
+}
+
+const double* real(const Value& v) {
+  return v.isTuple() ? v.tuple().real() : v.matrix().real();
+}
+
+const double* imag(const Value& v) {
+  return v.isTuple() ? v.tuple().imag() : v.matrix().imag();
+}
+
+// Element @p k of a tuple or matrix, or @p v itself if it is a number.
+Number at(const Value& v, size_t k) {
+  return v.isNumber() ? v.number() : Number(real(v)[k], imag(v)[k]);
+}
+
+bool mismatch(const Value& a, const Value& b) {
+  if (a.isNumber() || b.isNumber())
+    return false;
+  if (a.isTuple() && b.isTuple())
+    return a.tuple().size() != b.tuple().size();
+  if (a.isMatrix() && b.isMatrix())
+    return a.matrix().rows() != b.matrix().rows() ||
+           a.matrix().columns() != b.matrix().columns();
+  return true;
+}
+
+// Storage for the result of an operation on @p a and @p b, shaped like the
+// one that is not a number, one of theirs if @p reuse and it is not shared.
+// Its real and imaginary parts go to @p re and @p im.
+Value resultStorage(const Value& a, const Value& b, bool reuse, double** re, double** im) {
+  const Value& shape = a.isNumber() ? b : a;
+  if (shape.isTuple()) {
+    std::shared_ptr<Tuple> t = reuse ? a.unique() : nullptr;
+    if (!t && reuse)
+      t = b.unique();
+    if (!t)
+      t = std::make_shared<Tuple>(shape.tuple().size());
+    *re = t->real();
+    *im = t->imag();
+    return Value(std::move(t));
+  }
+
+  std::shared_ptr<Matrix> m = reuse ? a.uniqueMatrix() : nullptr;
+  if (!m && reuse)
+    m = b.uniqueMatrix();
+  if (!m)
+    m = std::make_shared<Matrix>(shape.matrix().rows(), shape.matrix().columns());
+  *re = m->real();
+  *im = m->imag();
+  return Value(std::move(m));
+}
+
+// Runs f(xr, xi, yr, yi, zr, zi) over all elements of @p a and @p b, at least
+// one of them a tuple or matrix, with one loop per case of broadcasting, so
+// that each vectorizes. The result goes into fresh storage unless @p reuse.
+template <typename F>
+Value elementwise(const Value& a, const Value& b, F f, bool reuse = true) {
+  if (mismatch(a, b))
+    return notANumber();
+
+  const size_t n = count(a.isNumber() ? b : a);
+  double* zr;
+  double* zi;
+  Value z = resultStorage(a, b, reuse, &zr, &zi);
+
+  if (!a.isNumber() && !b.isNumber()) {
+    const double* xr = real(a);
+    const double* xi = imag(a);
+    const double* yr = real(b);
+    const double* yi = imag(b);
+    for (size_t k = 0; k < n; ++k)
+      f(xr[k], xi[k], yr[k], yi[k], zr[k], zi[k]);
+  } else if (!a.isNumber()) {
+    const double* xr = real(a);
+    const double* xi = imag(a);
+    const double yr = b.number().real();
+    const double yi = b.number().imag();
+    for (size_t k = 0; k < n; ++k)
+      f(xr[k], xi[k], yr, yi, zr[k], zi[k]);
+  } else {
+    const double xr = a.number().real();
+    const double xi = a.number().imag();
+    const double* yr = real(b);
+    const double* yi = imag(b);
+    for (size_t k = 0; k < n; ++k)
+      f(xr, xi, yr[k], yi[k], zr[k], zi[k]);
+  }
+
+  return z;
+}
+
+// Runs f(x, y) element by element, for what does not vectorize.
+template <typename F>
+Value elementByElement(const Value& a, const Value& b, F f) {
+  if (mismatch(a, b))
+    return notANumber();
+
+  const size_t n = count(a.isNumber() ? b : a);
+  double* zr;
+  double* zi;
+  Value z = resultStorage(a, b, true, &zr, &zi);
+  for (size_t k = 0; k < n; ++k) {
+    const Number w = f(at(a, k), at(b, k));
+    zr[k] = w.real();
+    zi[k] = w.imag();
+  }
+
+  return z;
+}
+
+// A tuple as a matrix of @p rows x @p columns, its elements in order.
+Matrix reshape(const Tuple& t, size_t rows, size_t columns) {
+  Matrix m(rows, columns);
+  std::copy(t.real(), t.real() + t.size(), m.real());
+  std::copy(t.imag(), t.imag() + t.size(), m.imag());
+  return m;
+}
+
+// The elements of a matrix, in order, as a tuple.
+Tuple flatten(const Matrix& m) {
+  Tuple t(m.size());
+  std::copy(m.real(), m.real() + m.size(), t.real());
+  std::copy(m.imag(), m.imag() + m.size(), t.imag());
+  return t;
+}
+
+// Matrix product of @p a and @p b, neither a number, with a tuple on the
+// left taken as row vector and on the right as column vector.
+Value matrixProduct(const Value& a, const Value& b) {
+  if (a.isTuple()) {
+    Result<Matrix> c = Matrix::multiply(reshape(a.tuple(), 1, a.tuple().size()), b.matrix());
+    return c ? Value(flatten(*c)) : notANumber();
+  }
+
+  if (b.isTuple()) {
+    Result<Matrix> c = Matrix::multiply(a.matrix(), reshape(b.tuple(), b.tuple().size(), 1));
+    return c ? Value(flatten(*c)) : notANumber();
+  }
+
+  Result<Matrix> c = Matrix::multiply(a.matrix(), b.matrix());
+  return c ? Value(std::move(*c)) : notANumber();
+}
+
+// @p m to an integer power @p e, by repeated squaring.
+Value matrixPower(const Matrix& m, Number e) {
+  if (m.rows() != m.columns() || e.imag() || e.real() != std::floor(e.real()) ||
+      std::abs(e.real()) >= MaxMatrixPower)
+    return notANumber();
+
+  Matrix base = m;
+  if (e.real() < 0) {
+    Result<Matrix> inverse = m.inverse();
+    if (!inverse)
+      return notANumber();
+    base = std::move(*inverse);
+  }
+
+  Matrix result = Matrix::identity(m.rows());
+  for (unsigned long k = static_cast<unsigned long>(std::abs(e.real())); k; k >>= 1) {
+    if (k & 1)
+      result = std::move(*Matrix::multiply(result, base));
+    if (k > 1)
+      base = std::move(*Matrix::multiply(base, base));
+  }
+  return Value(std::move(result));
+}
+
+}  // namespace
+
+Value operator-(Value a) {
+  if (a.isNumber())
+    return -a.number();
+
+  return elementwise(a, Number(), [](double xr, double xi, double, double, double& zr,
+                                     double& zi) {
+    zr = -xr;
+    zi = -xi;
+  });
+}
+
+Value operator+(Value a, Value b) {
+  if (a.isNumber() && b.isNumber())
+    return a.number() + b.number();
+
+  return elementwise(a, b, [](double xr, double xi, double yr, double yi, double& zr,
+                              double& zi) {
+    zr = xr + yr;
+    zi = xi + yi;
+  });
+}
+
+Value operator-(Value a, Value b) {
+  if (a.isNumber() && b.isNumber())
+    return a.number() - b.number();
+
+  return elementwise(a, b, [](double xr, double xi, double yr, double yi, double& zr,
+                              double& zi) {
+    zr = xr - yr;
+    zi = xi - yi;
+  });
+}
+
+Value operator*(Value a, Value b) {
+  if (a.isNumber() && b.isNumber())
+    return a.number() * b.number();
+
+  if ((a.isMatrix() || b.isMatrix()) && !a.isNumber() && !b.isNumber())
+    return matrixProduct(a, b);
+
+  // into fresh storage, as the operands are needed once more for the
+  // products that came out NaN, which are redone with the C rules for
+  // infinities, as std::complex does
+  Value z = elementwise(a, b, [](double xr, double xi, double yr, double yi, double& zr,
+                                 double& zi) {
+    zr = xr * yr - xi * yi;
+    zi = xr * yi + xi * yr;
+  }, false);
+  if (z.isNumber())
+    return z;
+
+  double* zr = z.isTuple() ? z.unique()->real() : z.uniqueMatrix()->real();
+  double* zi = z.isTuple() ? z.unique()->imag() : z.uniqueMatrix()->imag();
+  for (size_t k = 0; k < count(z); ++k) {
+    if (std::isnan(zr[k]) && std::isnan(zi[k])) {
+      const Number w = at(a, k) * at(b, k);
+      zr[k] = w.real();
+      zi[k] = w.imag();
+    }
+  }
+
+  return z;
+}
+
+Value operator/(Value a, Value b) {
+  if (a.isNumber() && b.isNumber())
+    return a.number() / b.number();
+
+  if (b.isMatrix())
+    return notANumber();
+
+  return elementByElement(a, b, [](Number x, Number y) { return x / y; });
+}
+
+Value power(Value a, Value b) {
+  if (a.isNumber() && b.isNumber())
+    return power(a.number(), b.number());
+
+  if (a.isMatrix())
+    return b.isNumber() ? matrixPower(a.matrix(), b.number()) : notANumber();
+
+  if (b.isMatrix())
+    return notANumber();
+
+  return elementByElement(a, b, [](Number x, Number y) { return power(x, y); });
+}
+
+Value mapElements(Number (*f)(Number), Value a) {
+  if (a.isNumber())
+    return f(a.number());
+
+  return elementByElement(a, Number(), [f](Number x, Number) { return f(x); });
+}
+
+bool broadcastSize(const ValueList& values, size_t* n) {
+  const Value* tuple = nullptr;
+  for (const Value& v : values) {
+    if (v.isMatrix())
+      return false;
+    if (!v.isTuple())
+      continue;
+    if (tuple && mismatch(*tuple, v))
+      return false;
+    tuple = &v;
+  }
+
+  *n = tuple ? tuple->tuple().size() : 1;
+  return true;
+}
+// }}}
+// {{{ printing
+void printValue(const Value& v, std::string* out) {
+  if (v.isNumber()) {
+    printNumber(v.number(), out);
+    return;
+  }
+
+  if (v.isMatrix()) {
+    const Matrix& m = v.matrix();
+    out->push_back('(');
+    for (size_t i = 0; i < m.rows(); ++i) {
+      out->append(i ? ", (" : "(");
+      for (size_t j = 0; j < m.columns(); ++j) {
+        if (j)
+          out->append(", ");
+        printNumber(m(i, j), out);
+      }
+      out->push_back(')');
+    }
+    out->push_back(')');
+    return;
+  }
+
+  out->push_back('(');
+  for (size_t i = 0; i < v.tuple().size(); ++i) {
+    if (i)
+      out->append(", ");
+    printNumber(v.tuple()[i], out);
+  }
+  out->push_back(')');
+}
+
+std::string str(const Value& v) {
+  std::string s;
+  printValue(v, &s);
+  return s;
+}
+// }}}
+
+}  // namespace cmath
@@ -0,0 +1,124 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+#pragma once
+
+#include <cmath/matrix.h>
+#include <complex>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cmath {
+
+/**
+ * Vector of complex numbers, with the real and imaginary parts in separate
+ * contiguous arrays (structure of arrays), as the element-wise operations
+ * and the kernels of cmath/simd.h loop over them. An element takes 16
+ * bytes and no node of its own, so vectors of millions of elements are
+ * fine.
+ */
+class Tuple {
+ public:
+  Tuple() = default;
+
+  /// @p n zeros.
+  explicit Tuple(size_t n) : re_(n), im_(n) {}
+
+  size_t size() const noexcept { return re_.size(); }
+
+  Number operator[](size_t i) const { return Number(re_[i], im_[i]); }
+
+  void set(size_t i, Number z) {
+    re_[i] = z.real();
+    im_[i] = z.imag();
+  }
+
+  double* real() noexcept { return re_.data(); }
+  double* imag() noexcept { return im_.data(); }
+  const double* real() const noexcept { return re_.data(); }
+  const double* imag() const noexcept { return im_.data(); }
+
+ private:
+  std::vector<double> re_;
+  std::vector<double> im_;
+};
+
+/**
+ * Result of Expr::evaluate(): a number, a tuple or a matrix.
+ *
+ * Tuples and matrices are shared between copies rather than copied. An
+ * operation whose operand is the only owner of its tuple writes the result
+ * over it, so a chain such as 2 * v + 1 allocates one array, not one per
+ * operation.
+ */
+class Value {
+ public:
+  Value(Number n = Number()) : number_(n), tuple_(), matrix_() {}
+  explicit Value(Tuple&& t)
+      : number_(), tuple_(std::make_shared<Tuple>(std::move(t))), matrix_() {}
+  explicit Value(std::shared_ptr<Tuple> t) : number_(), tuple_(std::move(t)), matrix_() {}
+  explicit Value(Matrix&& m)
+      : number_(), tuple_(), matrix_(std::make_shared<Matrix>(std::move(m))) {}
+  explicit Value(std::shared_ptr<Matrix> m) : number_(), tuple_(), matrix_(std::move(m)) {}
+
+  bool isNumber() const noexcept { return !tuple_ && !matrix_; }
+  bool isTuple() const noexcept { return tuple_ != nullptr; }
+  bool isMatrix() const noexcept { return matrix_ != nullptr; }
+
+  /// The number, or NaN for a tuple or matrix.
+  Number number() const noexcept;
+
+  const Tuple& tuple() const noexcept { return *tuple_; }
+  const Matrix& matrix() const noexcept { return *matrix_; }
+
+  /// The tuple, if this value is its only owner, to be overwritten.
+  std::shared_ptr<Tuple> unique() const noexcept;
+
+  /// The matrix, if this value is its only owner, to be overwritten.
+  std::shared_ptr<Matrix> uniqueMatrix() const noexcept;
+
+ private:
+  Number number_;
+  std::shared_ptr<Tuple> tuple_;
+  std::shared_ptr<Matrix> matrix_;
+};
+
+using ValueList = std::vector<Value>;
+
+// Element-wise operations, broadcasting numbers over tuples and matrices.
+// Operands of different sizes or shapes yield NaN. Between matrices, and
+// between a matrix and a tuple taken as column or row vector, * is the
+// matrix product, and a square matrix to an integer power is a repeated
+// product, its inverse for negative powers. Operands are taken by value,
+// so that moved ones can hold the result.
+Value operator-(Value a);
+Value operator+(Value a, Value b);
+Value operator-(Value a, Value b);
+Value operator*(Value a, Value b);
+Value operator/(Value a, Value b);
+Value power(Value a, Value b);
+
+/// @p f applied to each element of @p a, a number, tuple or matrix.
+Value mapElements(Number (*f)(Number), Value a);
+
+/**
+ * Stores the size of the tuples among @p values, or 1 if there are none,
+ * to @p n, unless their sizes differ or there is a matrix among them.
+ */
+bool broadcastSize(const ValueList& values, size_t* n);
+
+/// Element @p i of @p v, or @p v itself if it is a number.
+inline Number element(const Value& v, size_t i) {
+  return v.isTuple() ? v.tuple()[i] : v.number();
+}
+
+/// Renders @p v as a number, as (x1, x2, ...) or as ((a11, a12), (a21, a22)).
+void printValue(const Value& v, std::string* out);
+std::string str(const Value& v);
+
+}  // namespace cmath
@@ -0,0 +1,428 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+// Differential fuzzer: evaluates randomly generated programs with every
+// evaluation engine and reports (and shrinks) disagreements.
+
+#include <cmath/expr.h>
+#include <cmath/expr_archive.h>
+#include <cmath/expr_batch.h>
+#include <cmath/expr_generator.h>
+#include <cmath/expr_interval.h>
+#include <cmath/expr_parser.h>
+#include <cmath/expr_rational.h>
+#include <cmath/expr_real.h>
+#include <cmath/polynomial.h>
+#include <cmath/profiler.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+using namespace cmath;
+
+namespace {
+
+// {{{ comparison
+uint64_t ulpDistance(double a, double b) {
+  // map the doubles onto a monotonic integer line
+  auto ordered = [](double d) {
+    int64_t i;
+    std::memcpy(&i, &d, sizeof(i));
+    return i < 0 ? std::numeric_limits<int64_t>::min() - i : i;
+  };
+  int64_t x = ordered(a);
+  int64_t y = ordered(b);
+  return x > y ? uint64_t(x) - uint64_t(y) : uint64_t(y) - uint64_t(x);
+}
+
+bool close(double a, double b, double magnitude, double ulps) {
+  if (std::isnan(a) || std::isnan(b))
+    return std::isnan(a) && std::isnan(b);
+
+  if (a == b)
+    return true;
+
+  if (std::isinf(a) || std::isinf(b))
+    return false;
+
+  // the absolute part covers cancellation in the other component
+  const double eps = std::numeric_limits<double>::epsilon();
+  return ulpDistance(a, b) <= ulps || std::abs(a - b) <= ulps * eps * magnitude;
+}
+
+bool close(Number a, Number b, double ulps) {
+  // undefined, whichever part is NaN
+  const bool undefined = std::isnan(a.real()) || std::isnan(a.imag());
+  if (undefined || std::isnan(b.real()) || std::isnan(b.imag()))
+    return undefined && (std::isnan(b.real()) || std::isnan(b.imag()));
+
+  const double magnitude = std::max(std::abs(a), std::abs(b));
+  return close(a.real(), b.real(), magnitude, ulps) &&
+         close(a.imag(), b.imag(), magnitude, ulps);
+}
+
+bool close(const Value& a, const Value& b, double ulps) {
+  if (a.isNumber() || b.isNumber())
+    return a.isNumber() && b.isNumber() && close(a.number(), b.number(), ulps);
+
+  if (a.isTuple() || b.isTuple()) {
+    if (!a.isTuple() || !b.isTuple() || a.tuple().size() != b.tuple().size())
+      return false;
+    for (size_t i = 0; i < a.tuple().size(); ++i)
+      if (!close(a.tuple()[i], b.tuple()[i], ulps))
+        return false;
+    return true;
+  }
+
+  const Matrix& x = a.matrix();
+  const Matrix& y = b.matrix();
+  if (x.rows() != y.rows() || x.columns() != y.columns())
+    return false;
+  for (size_t i = 0; i < x.rows(); ++i)
+    for (size_t j = 0; j < x.columns(); ++j)
+      if (!close(x(i, j), y(i, j), ulps))
+        return false;
+  return true;
+}
+
+/// Whether @p x lies within @p ulps of @p i.
+bool contains(Interval i, double x, double ulps) {
+  double lo = i.lower();
+  double hi = i.upper();
+  for (double n = 0; n < ulps; ++n) {
+    lo = std::nextafter(lo, -HUGE_VAL);
+    hi = std::nextafter(hi, HUGE_VAL);
+  }
+  return lo <= x && x <= hi;
+}
+// }}}
+
+// {{{ engines
+// Factors to the tolerance of engines whose results round differently:
+// polynomials are evaluated in another order than written, and BatchProgram's
+// elementary functions, from cmath/simd.h, are a few ulps off std::complex;
+// ill-conditioned expressions amplify either.
+constexpr double PolynomialSlack = 1024;
+constexpr double BatchSlack = 256;
+
+/**
+ * Whether @p ec rejects an expression the engine does not cover, such as
+ * one with tuples, rather than reporting a wrong result.
+ */
+bool unsupported(const std::error_code& ec) {
+  if (ec.category() == Rational::ErrorCategory::get())
+    return true;
+
+  return ec == BatchProgram::UnsupportedExpr || ec == ExprArchive::UnsupportedExpr ||
+         ec == Interval::NotReal || ec == Interval::UnsupportedExpr ||
+         ec == Real::NotReal || ec == Real::UnsupportedExpr;
+}
+
+/**
+ * An evaluation engine, checked against the tree walker's @p expected value
+ * of the expression @p e: by Expr::calculate() with the mappings as written
+ * for engines of numbers only, which lower polynomials to what they were
+ * compiled from, and by Expr::evaluate() otherwise.
+ *
+ * @returns a description of the disagreement, or an empty string.
+ */
+struct Engine {
+  const char* name;
+  bool numeric;  // whether it calculates numbers only, skipping tuples
+  std::function<std::string(const SymbolTable& st, const std::string& source,
+                            const Expr* e, const Value& expected, double ulps)>
+      check;
+};
+
+std::string compare(const Value& actual, const Value& expected, double ulps) {
+  if (close(actual, expected, ulps))
+    return std::string();
+
+  return str(actual) + ", expected " + str(expected);
+}
+
+const std::vector<Engine>& engines() {
+  static const std::vector<Engine> all = {
+      {"clone", false,
+       [](const SymbolTable& st, const std::string&, const Expr* e, const Value& expected,
+          double ulps) { return compare(e->clone()->evaluate(st), expected, ulps); }},
+      {"reparse", false,
+       [](const SymbolTable& st, const std::string&, const Expr* e, const Value& expected,
+          double ulps) {
+         Result<std::unique_ptr<Expr>> r = parseExpression(st, e->str());
+         if (r.isFailure())
+           throw r.error();
+         return compare((*r)->evaluate(st), expected, ulps);
+       }},
+      {"profiler", false,
+       [](const SymbolTable& st, const std::string&, const Expr* e, const Value& expected,
+          double ulps) {
+         Profiler profiler;
+         return compare(profiler.instrument(e)->evaluate(st), expected, ulps);
+       }},
+      {"polynomials", true,
+       [](const SymbolTable& st, const std::string&, const Expr* e, const Value& expected,
+          double ulps) {
+         // polynomials do not keep the sign of zero imaginary parts, which
+         // picks the side of the branch cuts of sqrt(), log() and arg(), nor
+         // recover from infinities as complex arithmetic does
+         const Number x = e->calculate(st);
+         const Number y = expected.number();
+         if (!std::isfinite(std::abs(x)) || !std::isfinite(std::abs(y)) ||
+             close(x, y, ulps * PolynomialSlack) ||
+             close(std::conj(x), y, ulps * PolynomialSlack) ||
+             close(-x, y, ulps * PolynomialSlack))
+           return std::string();
+         return compare(x, y, ulps);
+       }},
+      {"archive", true,
+       [](const SymbolTable& st, const std::string& source, const Expr* e,
+          const Value& expected, double ulps) {
+         ExprArchiveWriter writer;
+         if (!writer.addSymbols(st).empty())
+           throw make_error_code(ExprArchive::UnsupportedExpr);
+         Result<size_t> formula = writer.addFormula(source, e);
+         if (formula.isFailure())
+           throw formula.error();
+         const std::string image = writer.finish();
+         Result<std::unique_ptr<ExprArchive>> a = ExprArchive::view(image.data(),
+                                                                    image.size());
+         if (a.isFailure())
+           throw a.error();
+         return compare((*a)->calculateFormula(0, st), expected, ulps);
+       }},
+      {"batch", true,
+       [](const SymbolTable& st, const std::string&, const Expr* e, const Value& expected,
+          double ulps) {
+         Result<BatchProgram> p = BatchProgram::compile(e, st, {});
+         if (p.isFailure())
+           throw p.error();
+         return compare(p->evaluate(nullptr), expected, ulps * BatchSlack);
+       }},
+      {"interval", true,
+       [](const SymbolTable& st, const std::string&, const Expr* e, const Value& expected,
+          double ulps) {
+         Result<Interval> i = calculateInterval(e, st);
+         if (i.isFailure())
+           throw i.error();
+
+         // an enclosure must hold the real result, up to its rounding; it is
+         // empty where the tree walker passes through complex numbers instead
+         const Number x = expected.number();
+         if (i->isEmpty() || x.imag() != 0 || !std::isfinite(x.real()) ||
+             contains(*i, x.real(), ulps))
+           return std::string();
+
+         return i->str() + " does not contain " + str(x);
+       }},
+      {"rational/real", true,
+       [](const SymbolTable& st, const std::string&, const Expr* e, const Value&,
+          double ulps) {
+         // both are exact or precise, hence checked against each other
+         Result<Rational> q = calculateRational(e, st);
+         if (q.isFailure())
+           throw q.error();
+         Result<Real> r = calculateReal(e, st, Real::DefaultPrecision);
+         if (r.isFailure())
+           throw r.error();
+
+         const double a = q->toDouble();
+         const double b = r->toDouble();
+         const double magnitude = std::max({std::abs(a), std::abs(b), 1.0});
+         if (close(a, b, magnitude, ulps))
+           return std::string();
+
+         return q->str() + " (rational), " + r->str() + " (real)";
+       }},
+  };
+  return all;
+}
+
+/**
+ * Evaluates @p source with all engines, over @p st, and the reference tree
+ * walker also over @p plain, which has the same mappings as written.
+ *
+ * @returns a description of the first disagreement with the reference
+ *          tree walker, or an empty string.
+ */
+std::string check(const SymbolTable& st,
+                  const SymbolTable& plain,
+                  const std::string& source,
+                  double ulps) {
+  Result<std::unique_ptr<Expr>> e = parseExpression(st, source);
+  if (e.isFailure())
+    return "parse: " + e.failureMessage();
+
+  const Value value = (*e)->evaluate(st);
+  Value number;
+  if (value.isNumber())
+    number = (*parseExpression(plain, source))->calculate(plain);
+
+  for (const Engine& engine : engines()) {
+    if (engine.numeric && !value.isNumber())
+      continue;
+
+    std::string failure;
+    try {
+      failure = engine.check(st, source, e->get(), engine.numeric ? number : value, ulps);
+    } catch (const std::error_code& ec) {
+      if (unsupported(ec))
+        continue;
+      failure = ec.message();
+    }
+
+    if (!failure.empty())
+      return std::string(engine.name) + ": " + failure;
+  }
+
+  return std::string();
+}
+// }}}
+
+/**
+ * Greedily replaces @p node by the first simplification that still fails
+ * until there is none.
+ */
+ExprGenerator::Node shrink(const SymbolTable& st,
+                           const SymbolTable& plain,
+                           ExprGenerator::Node node,
+                           double ulps) {
+  for (bool progress = true; progress;) {
+    progress = false;
+    for (ExprGenerator::Node& candidate : ExprGenerator::shrink(node)) {
+      if (!check(st, plain, ExprGenerator::render(candidate), ulps).empty()) {
+        node = std::move(candidate);
+        progress = true;
+        break;
+      }
+    }
+  }
+  return node;
+}
+
+/**
+ * Defines @p line in @p st as cm does, compiling mappings into polynomials,
+ * and in @p plain as written.
+ */
+bool define(SymbolTable& st, SymbolTable& plain, const std::string& line) {
+  Result<std::unique_ptr<Expr>> e = parseExpression(st, line);
+  if (e.isFailure()) {
+    std::cerr << "Cannot parse definition: " << line << ": " << e.failureMessage() << '\n';
+    return false;
+  }
+
+  if (const auto d = dynamic_cast<DefineExpr*>(e->get())) {
+    const Value value = d->right()->evaluate(st);
+    st.defineConstant(d->symbolName(), value);
+    plain.defineConstant(d->symbolName(), value);
+  } else if (const auto m = dynamic_cast<DefineMappingExpr*>(e->get())) {
+    st.defineMapping(m->symbolName(), m->inputs(), compilePolynomials(m->body()));
+    // parsed again, so that its calls resolve to the mappings as written
+    Result<std::unique_ptr<Expr>> p = parseExpression(plain, line);
+    plain.defineMapping(m->symbolName(), m->inputs(),
+                        static_cast<DefineMappingExpr*>(p->get())->body()->clone());
+  }
+
+  return true;
+}
+
+void printUsage() {
+  std::cout << "Usage: cmath_fuzz [--seed N] [--count N] [--expressions N]"
+            << " [--mappings N]\n"
+            << "                  [--depth N] [--symbols N] [--ulps N] [--corpus]\n"
+            << "\n"
+            << "  --corpus   print the generated programs instead of checking them\n";
+}
+
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+  uint64_t seed = 1;
+  size_t count = 100;
+  size_t expressions = 50;
+  size_t mappings = 3;
+  double ulps = 4;
+  bool corpus = false;
+  ExprGenerator::Options options;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (arg == "--seed" && hasValue) {
+      seed = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--count" && hasValue) {
+      count = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--expressions" && hasValue) {
+      expressions = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--mappings" && hasValue) {
+      mappings = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--depth" && hasValue) {
+      options.maxDepth = std::atoi(argv[++i]);
+    } else if (arg == "--symbols" && hasValue) {
+      options.symbolCount = std::atoi(argv[++i]);
+    } else if (arg == "--ulps" && hasValue) {
+      ulps = std::atof(argv[++i]);
+    } else if (arg == "--corpus") {
+      corpus = true;
+    } else {
+      printUsage();
+      return arg == "--help" ? 0 : 1;
+    }
+  }
+
+  ExprGenerator gen(seed, options);
+  size_t checked = 0;
+  size_t failures = 0;
+
+  for (size_t n = 0; n < count; ++n) {
+    const ExprGenerator::Program program = gen.program(mappings, expressions);
+
+    if (corpus) {
+      for (const std::string& line : program.lines())
+        std::cout << line << '\n';
+      continue;
+    }
+
+    SymbolTable st;
+    SymbolTable plain;
+    bool ok = true;
+    for (const std::string& line : program.definitions)
+      ok = ok && define(st, plain, line);
+    if (!ok)
+      return 1;
+
+    for (const ExprGenerator::Node& e : program.expressions) {
+      checked++;
+      const std::string source = ExprGenerator::render(e);
+      const std::string failure = check(st, plain, source, ulps);
+      if (failure.empty())
+        continue;
+
+      failures++;
+      const ExprGenerator::Node smallest = shrink(st, plain, e, ulps);
+      const std::string reduced = ExprGenerator::render(smallest);
+
+      std::cout << "program " << n << " (seed " << seed << "):\n";
+      for (const std::string& line : program.definitions)
+        std::cout << "  " << line << '\n';
+      std::cout << "  " << source << "\n    " << failure << '\n'
+                << "shrunk to (" << smallest.size() << " of " << e.size() << " nodes):\n"
+                << "  " << reduced << "\n    " << check(st, plain, reduced, ulps) << "\n\n";
+    }
+  }
+
+  if (!corpus)
+    std::cout << checked << " expressions checked, " << failures << " mismatches\n";
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,259 @@
+// This file is part of the "cmath" project, http://github.com/christianparpart/cmath>
+//   (c) 2017 Christian Parpart <christian@parpart.family>
+//
+// Licensed under the MIT License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of
+// the License at: http://opensource.org/licenses/MIT
+
+// Load generator for `cm --serve`: keeps a number of requests in flight on
+// each of several connections and reports throughput and latency.
+
+#include <cm/protocol.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Client {
+  std::vector<double> latencies;  // microseconds per request
+  size_t errors = 0;              // response lines reporting an error
+  std::string failure;
+  std::string sample;             // the first response
+};
+
+int connectTo(const std::string& path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path))
+    return -1;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool writeAll(int fd, const std::string& data) {
+  for (size_t offset = 0; offset < data.size();) {
+    const ssize_t n = ::send(fd, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+    if (n < 0)
+      return false;
+    offset += n;
+  }
+  return true;
+}
+
+size_t countErrors(const std::string& response) {
+  size_t n = 0;
+  for (size_t i = 0; i < response.size();) {
+    if (response.compare(i, 7, "error: ") == 0)
+      n++;
+    const size_t end = response.find('\n', i);
+    if (end == std::string::npos)
+      break;
+    i = end + 1;
+  }
+  return n;
+}
+
+// sends @p requests times @p payload, with up to @p pipeline in flight
+void run(const std::string& path,
+         const std::string& payload,
+         size_t requests,
+         size_t pipeline,
+         Client* client) {
+  const int fd = connectTo(path);
+  if (fd < 0) {
+    client->failure = path + ": " + std::strerror(errno);
+    return;
+  }
+
+  std::string frame;
+  protocol::appendFrame(&frame, payload);
+
+  std::deque<Clock::time_point> sent;
+  std::string out;
+  std::string in;
+  size_t inputOffset = 0;
+  std::string response;
+  size_t issued = 0;
+  size_t received = 0;
+  char buf[64 * 1024];
+
+  client->latencies.reserve(requests);
+
+  while (received < requests) {
+    while (issued < requests && sent.size() < pipeline) {
+      out += frame;
+      sent.push_back(Clock::now());
+      issued++;
+    }
+    if (!out.empty()) {
+      if (!writeAll(fd, out)) {
+        client->failure = std::string("send: ") + std::strerror(errno);
+        break;
+      }
+      out.clear();
+    }
+
+    const ssize_t n = ::read(fd, buf, sizeof(buf));
+    if (n <= 0) {
+      client->failure = n ? std::string("read: ") + std::strerror(errno)
+                          : std::string("connection closed by server");
+      break;
+    }
+    in.append(buf, n);
+
+    while (protocol::takeFrame(in, &inputOffset, &response) == protocol::Frame::Complete) {
+      const std::chrono::duration<double, std::micro> latency = Clock::now() - sent.front();
+      sent.pop_front();
+      client->latencies.push_back(latency.count());
+      client->errors += countErrors(response);
+      if (!received++)
+        client->sample = response;
+    }
+    in.erase(0, inputOffset);
+    inputOffset = 0;
+  }
+
+  ::close(fd);
+}
+
+// sends the definitions the expressions depend on, once
+bool setup(const std::string& path, const std::vector<std::string>& statements) {
+  if (statements.empty())
+    return true;
+
+  std::string payload;
+  for (const std::string& s : statements)
+    payload += s + '\n';
+
+  Client client;
+  run(path, payload, 1, 1, &client);
+  if (!client.failure.empty()) {
+    std::cerr << client.failure << '\n';
+    return false;
+  }
+  std::cout << client.sample;
+  return true;
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty())
+    return 0;
+  return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+}
+
+void printUsage() {
+  std::cout << "Usage: cmath_loadgen --socket PATH [--clients N] [--requests N]"
+            << " [--pipeline N]\n"
+            << "                     [--batch N] [--setup STMT]... [--expr EXPR]...\n"
+            << "\n"
+            << "  --clients N    concurrent connections (4)\n"
+            << "  --requests N   requests per connection (10000)\n"
+            << "  --pipeline N   requests in flight per connection (16)\n"
+            << "  --batch N      expressions per request (1)\n"
+            << "  --setup STMT   definition to send once before measuring\n"
+            << "  --expr EXPR    expression to evaluate, in turns if repeated\n";
+}
+
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+  std::string path;
+  size_t clients = 4;
+  size_t requests = 10000;
+  size_t pipeline = 16;
+  size_t batch = 1;
+  std::vector<std::string> statements;
+  std::vector<std::string> expressions;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (arg == "--socket" && hasValue) {
+      path = argv[++i];
+    } else if (arg == "--clients" && hasValue) {
+      clients = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--requests" && hasValue) {
+      requests = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--pipeline" && hasValue) {
+      pipeline = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+    } else if (arg == "--batch" && hasValue) {
+      batch = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+    } else if (arg == "--setup" && hasValue) {
+      statements.push_back(argv[++i]);
+    } else if (arg == "--expr" && hasValue) {
+      expressions.push_back(argv[++i]);
+    } else {
+      printUsage();
+      return arg == "--help" ? 0 : 1;
+    }
+  }
+
+  if (path.empty()) {
+    printUsage();
+    return 1;
+  }
+
+  if (expressions.empty())
+    expressions.push_back("2^10 + sqrt(2) * pi");
+
+  if (!setup(path, statements))
+    return 1;
+
+  std::string payload;
+  for (size_t i = 0; i < batch; ++i)
+    payload += expressions[i % expressions.size()] + '\n';
+
+  std::vector<Client> results(clients);
+  std::vector<std::thread> threads;
+  const Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < clients; ++i)
+    threads.emplace_back(run, path, payload, requests, pipeline, &results[i]);
+  for (std::thread& t : threads)
+    t.join();
+  const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+  std::vector<double> latencies;
+  size_t errors = 0;
+  for (const Client& c : results) {
+    if (!c.failure.empty())
+      std::cerr << c.failure << '\n';
+    latencies.insert(latencies.end(), c.latencies.begin(), c.latencies.end());
+    errors += c.errors;
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  if (!results.empty() && !results[0].sample.empty())
+    std::cout << "response: " << results[0].sample;
+
+  const size_t answered = latencies.size();
+  std::cout << answered << " requests (" << answered * batch << " expressions) in "
+            << elapsed.count() << " s, " << clients << " clients, pipeline " << pipeline
+            << ", batch " << batch << '\n'
+            << "throughput: " << answered / elapsed.count() << " requests/s, "
+            << answered * batch / elapsed.count() << " expressions/s\n"
+            << "latency:    p50 " << percentile(latencies, 0.50) << " us, p99 "
+            << percentile(latencies, 0.99) << " us, max "
+            << (latencies.empty() ? 0 : latencies.back()) << " us\n"
+            << "errors:     " << errors << '\n';
+
+  return answered == clients * requests && !errors ? 0 : 1;
+}